@@ -180,6 +180,34 @@ typedef struct {
  */
 #define NGHTTP2_MIN_WEIGHT 1
 
+/**
+ * @macro
+ *
+ * The highest urgency of Extensible Prioritization scheme.
+ */
+#define NGHTTP2_EXTPRI_URGENCY_HIGH 0
+
+/**
+ * @macro
+ *
+ * The lowest urgency of Extensible Prioritization scheme.
+ */
+#define NGHTTP2_EXTPRI_URGENCY_LOW 7
+
+/**
+ * @macro
+ *
+ * The default urgency of Extensible Prioritization scheme.
+ */
+#define NGHTTP2_EXTPRI_DEFAULT_URGENCY 3
+
+/**
+ * @macro
+ *
+ * The number of urgency levels of Extensible Prioritization scheme.
+ */
+#define NGHTTP2_EXTPRI_URGENCY_LEVELS (NGHTTP2_EXTPRI_URGENCY_LOW + 1)
+
 /**
  * @macro
  *
@@ -412,7 +440,8 @@ typedef enum {
   /**
    * Possible flooding by peer was detected in this HTTP/2 session.
    * Flooding is measured by how many PING and SETTINGS frames with
-   * ACK flag set are queued for transmission.  These frames are
+   * ACK flag set are queued for transmission (see
+   * `nghttp2_option_set_max_outbound_ack()`).  These frames are
    * response for the peer initiated frames, and peer can cause memory
    * exhaustion on server side to send these frames forever and does
    * not read network.
@@ -817,7 +846,8 @@ typedef enum {
   NGHTTP2_DATA_FLAG_NO_END_STREAM = 0x02,
   /**
    * Indicates that application will send complete DATA frame in
-   * :type:`nghttp2_send_data_callback`.
+   * :type:`nghttp2_send_data_callback`, or provide the data by
+   * reference in :type:`nghttp2_data_ref_callback`.
    */
   NGHTTP2_DATA_FLAG_NO_COPY = 0x04
 } nghttp2_data_flag;
@@ -839,7 +869,10 @@ typedef enum {
  * bytes to send without copying data into |buf|.  The library, seeing
  * :enum:`NGHTTP2_DATA_FLAG_NO_COPY`, will invoke
  * :type:`nghttp2_send_data_callback`.  The application must send
- * complete DATA frame in that callback.
+ * complete DATA frame in that callback.  Alternatively, the library
+ * invokes :type:`nghttp2_data_ref_callback` to get the data by
+ * reference, which lets `nghttp2_session_mem_sendv()` return it
+ * without copying.
  *
  * If this callback is set by `nghttp2_submit_request()`,
  * `nghttp2_submit_response()` or `nghttp2_submit_headers()` and
@@ -972,6 +1005,28 @@ typedef struct {
   uint8_t exclusive;
 } nghttp2_priority_spec;
 
+/**
+ * @struct
+ *
+ * The structure to specify the priority of stream in Extensible
+ * Prioritization scheme.
+ */
+typedef struct {
+  /**
+   * The urgency of stream in [:macro:`NGHTTP2_EXTPRI_URGENCY_HIGH`,
+   * :macro:`NGHTTP2_EXTPRI_URGENCY_LOW`], inclusive.  The smaller
+   * value means the higher priority.
+   */
+  uint32_t urgency;
+  /**
+   * nonzero means that stream is processed incrementally.  The
+   * streams which are processed incrementally share the bandwidth
+   * with the other incremental streams of the same urgency.
+   * Otherwise, stream is sent one after another.
+   */
+  int inc;
+} nghttp2_extpri;
+
 /**
  * @struct
  *
@@ -1330,6 +1385,86 @@ typedef int (*nghttp2_send_data_callback)(nghttp2_session *session,
                                           nghttp2_data_source *source,
                                           void *user_data);
 
+/**
+ * @functypedef
+ *
+ * Callback function invoked when :enum:`NGHTTP2_DATA_FLAG_NO_COPY` is
+ * used in :type:`nghttp2_data_source_read_callback` to get the
+ * application data of DATA frame by reference.
+ *
+ * The |frame| is a DATA frame to send.  The |source| is the same
+ * pointer passed to :type:`nghttp2_data_source_read_callback`.  The
+ * application must assign the pointer to ``frame->hd.length -
+ * frame->data.padlen`` bytes of application data to |*pdata|.  The
+ * library never writes to the data.
+ *
+ * If this callback is invoked by `nghttp2_session_mem_sendv()`, the
+ * data is returned to the caller as is, and it must stay valid until
+ * :type:`nghttp2_data_ref_release_callback` is invoked for |frame|.
+ * Otherwise, the data is copied, and the release callback is invoked
+ * before this callback returns.
+ *
+ * If all went well, return 0.  If the data is not available yet,
+ * return :enum:`NGHTTP2_ERR_WOULDBLOCK`; the library will call this
+ * callback with the same parameters later.  If application decided to
+ * reset this stream, return
+ * :enum:`NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE`, then the library
+ * will send RST_STREAM with INTERNAL_ERROR as error code.  Returning
+ * any other value is treated as :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`
+ * is returned, which will result in connection closure.
+ */
+typedef int (*nghttp2_data_ref_callback)(nghttp2_session *session,
+                                         nghttp2_frame *frame,
+                                         const uint8_t **pdata,
+                                         nghttp2_data_source *source,
+                                         void *user_data);
+
+/**
+ * @functypedef
+ *
+ * Callback function invoked when the library no longer refers to the
+ * application data |data| of DATA frame |frame|, which was obtained
+ * by :type:`nghttp2_data_ref_callback`.  For the data returned by
+ * `nghttp2_session_mem_sendv()`, this happens in the next call of the
+ * function, at which point the application must have sent the data.
+ * This callback is not invoked if session is deleted before that.
+ * The |source| is the same pointer passed to
+ * :type:`nghttp2_data_source_read_callback`.
+ *
+ * The implementation of this function must return 0 if it succeeds.
+ * If nonzero value is returned, it is treated as fatal error and
+ * `nghttp2_session_mem_sendv()` returns immediately with
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`.
+ */
+typedef int (*nghttp2_data_ref_release_callback)(nghttp2_session *session,
+                                                 nghttp2_frame *frame,
+                                                 const uint8_t *data,
+                                                 nghttp2_data_source *source,
+                                                 void *user_data);
+
+/**
+ * @functypedef
+ *
+ * Callback function invoked when DATA queued by
+ * `nghttp2_session_queue_data()` for the stream |stream_id| cannot be
+ * submitted, for example because the stream has been closed in the
+ * meantime.  The |source| is the data source given to the function,
+ * and the library never uses it after this callback, so that
+ * application can release it here.  The |lib_error_code| is the
+ * error code `nghttp2_submit_data()` returned.
+ *
+ * The implementation of this function must return 0 if it succeeds.
+ * If nonzero value is returned, it is treated as fatal error and
+ * the function which executed the command returns
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`.
+ *
+ * To set this callback to :type:`nghttp2_session_callbacks`, use
+ * `nghttp2_session_callbacks_set_on_queued_data_discard_callback()`.
+ */
+typedef int (*nghttp2_on_queued_data_discard_callback)(
+    nghttp2_session *session, int32_t stream_id, nghttp2_data_source *source,
+    int lib_error_code, void *user_data);
+
 /**
  * @functypedef
  *
@@ -1795,6 +1930,51 @@ typedef int (*nghttp2_on_invalid_header_callback2)(
     nghttp2_session *session, const nghttp2_frame *frame, nghttp2_rcbuf *name,
     nghttp2_rcbuf *value, uint8_t flags, void *user_data);
 
+/**
+ * @functypedef
+ *
+ * Callback function invoked when all header name/value pairs of the
+ * header block for the |frame| have been received.  The |nva| is the
+ * array of |nvlen| header fields in the order they appear in the
+ * header block.  The name and value of each header field are
+ * NULL-terminated.  The |frame| is HEADERS or PUSH_PROMISE, and its
+ * header block may span CONTINUATION frames.
+ *
+ * If this callback is set, :type:`nghttp2_on_header_callback` and
+ * :type:`nghttp2_on_header_callback2` are not invoked.  The header
+ * fields are validated as usual if HTTP messaging validation is
+ * turned on, and this callback is invoked only when the header block
+ * is accepted, right before :type:`nghttp2_on_frame_recv_callback`.
+ * Invalid header fields are still passed to
+ * :type:`nghttp2_on_invalid_header_callback` one by one.
+ *
+ * The |nva| and the memory it refers to are only valid during this
+ * callback.  The library buffers the whole header block until this
+ * callback is invoked.  If the sum of the length of name and value
+ * plus 32 bytes for each header field exceeds
+ * SETTINGS_MAX_HEADER_LIST_SIZE which the local endpoint sent, the
+ * stream is reset with :enum:`NGHTTP2_INTERNAL_ERROR`.  If the local
+ * endpoint does not send the setting, 64KiB is used as the limit.
+ *
+ * The implementation of this function must return 0 if it succeeds.
+ * It may return :enum:`NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE` to
+ * reset the stream (promised stream if frame is PUSH_PROMISE).  If
+ * the other nonzero value is returned, including
+ * :enum:`NGHTTP2_ERR_PAUSE`, which is not supported by this callback,
+ * it is treated as :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`.  If
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE` is returned,
+ * `nghttp2_session_recv()` and `nghttp2_session_mem_recv()` functions
+ * immediately return :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`.
+ *
+ * To set this callback to :type:`nghttp2_session_callbacks`, use
+ * `nghttp2_session_callbacks_set_on_header_block_callback()`.
+ */
+typedef int (*nghttp2_on_header_block_callback)(nghttp2_session *session,
+                                                const nghttp2_frame *frame,
+                                                const nghttp2_nv *nva,
+                                                size_t nvlen,
+                                                void *user_data);
+
 /**
  * @functypedef
  *
@@ -2258,6 +2438,52 @@ nghttp2_session_callbacks_set_on_extension_chunk_recv_callback(
 NGHTTP2_EXTERN void nghttp2_session_callbacks_set_error_callback(
     nghttp2_session_callbacks *cbs, nghttp2_error_callback error_callback);
 
+/**
+ * @function
+ *
+ * Sets callback function invoked when all header name/value pairs of
+ * a header block are received.
+ */
+NGHTTP2_EXTERN void nghttp2_session_callbacks_set_on_header_block_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_on_header_block_callback on_header_block_callback);
+
+/**
+ * @function
+ *
+ * Sets callback function invoked when
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY` is used in
+ * :type:`nghttp2_data_source_read_callback` to get the application
+ * data by reference.  If both this callback and
+ * :type:`nghttp2_send_data_callback` are set,
+ * `nghttp2_session_mem_sendv()` uses this callback, and the other
+ * functions use :type:`nghttp2_send_data_callback`.
+ */
+NGHTTP2_EXTERN void nghttp2_session_callbacks_set_data_ref_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_data_ref_callback data_ref_callback);
+
+/**
+ * @function
+ *
+ * Sets callback function invoked when the application data obtained
+ * by :type:`nghttp2_data_ref_callback` is no longer referred.
+ */
+NGHTTP2_EXTERN void nghttp2_session_callbacks_set_data_ref_release_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_data_ref_release_callback data_ref_release_callback);
+
+/**
+ * @function
+ *
+ * Sets callback function invoked when DATA queued by
+ * `nghttp2_session_queue_data()` cannot be submitted.
+ */
+NGHTTP2_EXTERN void
+nghttp2_session_callbacks_set_on_queued_data_discard_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_on_queued_data_discard_callback on_queued_data_discard_callback);
+
 /**
  * @functypedef
  *
@@ -2538,6 +2764,23 @@ NGHTTP2_EXTERN void
 nghttp2_option_set_max_send_header_block_length(nghttp2_option *option,
                                                 size_t val);
 
+/**
+ * @function
+ *
+ * This option prevents the library from copying received header
+ * field names and values when they can be referenced from the input
+ * buffer passed to `nghttp2_session_mem_recv()` directly.  See
+ * `nghttp2_hd_inflate_set_no_copy()` for the conditions.  If this
+ * option is set to nonzero, the buffers passed to
+ * :type:`nghttp2_on_header_callback` and
+ * :type:`nghttp2_on_header_callback2` are not guaranteed to be
+ * NULL-terminated, and they are only valid during the callback.
+ * `nghttp2_rcbuf_incref()` does not extend their lifetime.  By
+ * default, this option is set to zero.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_no_header_copy(nghttp2_option *option,
+                                                      int val);
+
 /**
  * @function
  *
@@ -2561,6 +2804,238 @@ nghttp2_option_set_max_deflate_dynamic_table_size(nghttp2_option *option,
 NGHTTP2_EXTERN void nghttp2_option_set_no_closed_streams(nghttp2_option *option,
                                                          int val);
 
+/**
+ * @function
+ *
+ * This option enables adaptive indexing of HPACK deflater if |val| is
+ * nonzero.  Header fields are only inserted into the dynamic table
+ * when they are sent for the second time on the connection.  See
+ * `nghttp2_hd_deflate_set_adaptive_indexing()`.  This is useful for
+ * long-lived connections which carry many unique header values.  By
+ * default, this option is set to zero.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_hd_adaptive_indexing(nghttp2_option *option, int val);
+
+/**
+ * @function
+ *
+ * This option enables memoization of encoded header blocks in HPACK
+ * deflater if |val| is nonzero.  See
+ * `nghttp2_hd_deflate_set_memoize()`.  This is useful for servers
+ * which send the same response header fields on many streams.  By
+ * default, this option is set to zero.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_hd_memoize(nghttp2_option *option,
+                                                  int val);
+
+/**
+ * @function
+ *
+ * This option disables RFC 7540 stream priorities if |val| is
+ * nonzero.  The priority information in incoming PRIORITY frames and
+ * HEADERS frames is ignored, and no idle streams are created for
+ * them.  `nghttp2_submit_priority()`,
+ * `nghttp2_session_change_stream_priority()` and
+ * `nghttp2_session_create_idle_stream()` do nothing, and the priority
+ * specification given to `nghttp2_submit_request()` and
+ * `nghttp2_submit_headers()` is ignored.  Closed streams are not
+ * retained for the dependency tree.  Instead, DATA frames are
+ * scheduled by the urgency and incremental parameters of Extensible
+ * Prioritization scheme, which can be set by
+ * `nghttp2_session_change_extpri_stream_priority()`.  This saves
+ * memory and CPU time when an application has no use for RFC 7540
+ * priorities.  By default, this option is set to zero.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_no_rfc7540_priorities(nghttp2_option *option, int val);
+
+/**
+ * @function
+ *
+ * This option makes session allocate small objects, such as streams,
+ * outbound frames and most of frame payloads, from its own memory
+ * pool if |val| is nonzero.  The pool gets memory from the allocator
+ * given to `nghttp2_session_client_new3()` or
+ * `nghttp2_session_server_new3()` in large chunks, and recycles freed
+ * objects by their size class without returning them to the
+ * allocator.  This reduces the number of calls to the allocator when
+ * many short-lived streams are processed.  The memory is returned to
+ * the allocator when session is deleted, which means that
+ * :type:`nghttp2_rcbuf` given to the application must not be used
+ * after session is deleted.  The pool keeps the memory used at the
+ * peak of session's lifetime.  By default, this option is set to
+ * zero.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_mem_pool(nghttp2_option *option,
+                                                int val);
+
+/**
+ * @function
+ *
+ * This option makes session count the memory it allocates if |val|
+ * is nonzero.  The usage can be retrieved by
+ * `nghttp2_session_get_mem_usage()`.  Each allocation gets 16 bytes
+ * of bookkeeping overhead.  This option is implicitly enabled by
+ * `nghttp2_option_set_max_session_memory()`.  By default, this option
+ * is set to zero.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_mem_accounting(nghttp2_option *option,
+                                                      int val);
+
+/**
+ * @function
+ *
+ * This option sets the maximum amount of memory, in bytes, a session
+ * should hold to |val|.  The memory is counted as described in
+ * :type:`nghttp2_mem_usage`.  The limit is soft; it does not make
+ * allocations fail.  Instead, when the usage exceeds the limit,
+ * session first releases closed and idle streams retained for
+ * priority purposes.  If it is still over the limit, new streams
+ * initiated by the remote peer are refused with RST_STREAM of error
+ * code :enum:`NGHTTP2_REFUSED_STREAM`.  If there is no open stream
+ * whose completion would release memory, session is terminated with
+ * GOAWAY of error code :enum:`NGHTTP2_ENHANCE_YOUR_CALM`.  Setting
+ * this option also enables
+ * `nghttp2_option_set_mem_accounting()`.  By default, there is no
+ * limit.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_max_session_memory(nghttp2_option *option, size_t val);
+
+/**
+ * @function
+ *
+ * This option enables automatic tuning of the local receive windows,
+ * growing them up to |max_window_size| bytes.  Zero disables it.  The
+ * value larger than :macro:`NGHTTP2_MAX_WINDOW_SIZE` is treated as
+ * :macro:`NGHTTP2_MAX_WINDOW_SIZE`.
+ *
+ * While DATA is being received, session sends PING to the remote
+ * endpoint and counts the bytes of DATA received until its ACK
+ * arrives, per connection and per stream.  This approximates
+ * bandwidth-delay product.  If the count comes close to the window
+ * and throughput keeps increasing, the window is deemed to be the
+ * bottleneck, and it is doubled: the connection window by
+ * WINDOW_UPDATE, and the stream windows by SETTINGS with
+ * :enum:`NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE`.  The windows are
+ * never shrunk.  The windows set by application are used as the
+ * starting point.  Probes are sent less frequently, up to once per
+ * second, while the windows stay the same.
+ *
+ * The PING frames and their ACKs are visible to
+ * :type:`nghttp2_on_frame_send_callback` and
+ * :type:`nghttp2_on_frame_recv_callback`.  The opaque data of the
+ * PING is ``nghttp2b``.  By default, this option is disabled.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_window_auto_tuning(nghttp2_option *option,
+                                      uint32_t max_window_size);
+
+/**
+ * @function
+ *
+ * This option sets the percentage of the local receive window which
+ * must be consumed before WINDOW_UPDATE is sent, to |val|.  The value
+ * is clamped to the range [1, 100], inclusive.  The larger value
+ * results in fewer, larger WINDOW_UPDATE frames, at the cost of the
+ * remote endpoint stalling for longer when the window is small.  This
+ * applies to both automatic WINDOW_UPDATE and the one triggered by
+ * `nghttp2_session_consume()`.  By default, the value is 50.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_window_update_threshold(nghttp2_option *option,
+                                           uint32_t val);
+
+/**
+ * @function
+ *
+ * This option, if |val| is nonzero, defers WINDOW_UPDATE frames
+ * until session is about to send frames, that is when
+ * `nghttp2_session_send()`, `nghttp2_session_mem_send()` or its
+ * variants are called.  Then one WINDOW_UPDATE is sent per stream and
+ * for the connection, covering all data received or consumed since
+ * the last call.  Without this option, WINDOW_UPDATE is queued as
+ * soon as the threshold is reached, and its increment is fixed at
+ * that time.  `nghttp2_session_want_write()` returns nonzero while
+ * WINDOW_UPDATE is deferred.  By default, this option is disabled.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_coalesce_window_update(nghttp2_option *option, int val);
+
+/**
+ * @function
+ *
+ * This option, if |val| is nonzero, attaches a command queue to
+ * session, so that other threads can ask session to resume DATA,
+ * submit DATA and reset streams by
+ * `nghttp2_session_queue_resume_data()`,
+ * `nghttp2_session_queue_data()` and
+ * `nghttp2_session_queue_rst_stream()`.  The queue is lock-free.  It
+ * is drained on the session's thread when `nghttp2_session_send()`,
+ * `nghttp2_session_mem_send()`, `nghttp2_session_recv()`,
+ * `nghttp2_session_mem_recv()` or their variants are called.  This
+ * option has no effect if the library was built by a compiler
+ * without atomic operations which the queue requires.  By default,
+ * this option is disabled.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_command_queue(nghttp2_option *option,
+                                                     int val);
+
+/**
+ * @function
+ *
+ * This option sets the rate limit of streams reset in server
+ * session.  The streams closed by RST_STREAM from the remote
+ * endpoint, and the streams which server resets because the remote
+ * endpoint sent an invalid frame to them are counted.  Up to |burst|
+ * streams can be reset at once, and the budget is refilled by |rate|
+ * streams per second.  If the budget runs out, session is terminated
+ * with GOAWAY of error code
+ * :enum:`NGHTTP2_ENHANCE_YOUR_CALM`.  This protects server from
+ * the remote endpoint which keeps opening and resetting streams
+ * without waiting for the response.  Specifying 0 to |burst|
+ * disables the limit.  This option has no effect on client session.
+ * By default, |burst| is 1000 and |rate| is 33.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_stream_reset_rate_limit(nghttp2_option *option,
+                                           uint64_t burst, uint64_t rate);
+
+/**
+ * @function
+ *
+ * This option sets the maximum number of SETTINGS ACK and PING ACK
+ * frames queued for transmission, to |val|.  Those frames are the
+ * response to the frames sent by the remote endpoint, and pile up if
+ * the remote endpoint keeps sending SETTINGS or PING without reading
+ * the responses.  If a received frame needs more ACK queued than
+ * |val|, `nghttp2_session_recv()` and `nghttp2_session_mem_recv()`
+ * fail with :enum:`NGHTTP2_ERR_FLOODED`, and
+ * `nghttp2_submit_ping()` and `nghttp2_submit_settings()` with
+ * :enum:`NGHTTP2_FLAG_ACK` return the same error.  Specifying 0 to
+ * |val| allows no ACK to be queued at all, so that the first
+ * SETTINGS or PING which needs ACK is treated as flooding; it does
+ * not disable the limit.  By default, the value is 10000.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_max_outbound_ack(nghttp2_option *option,
+                                                        size_t val);
+
+/**
+ * @function
+ *
+ * This option sets the maximum number of successive DATA frames
+ * which carry neither payload nor END_STREAM flag, to |val|.  Padding
+ * is not counted as payload.  Such DATA frames cost the remote
+ * endpoint no flow control window, but take time to process.  The
+ * count is reset when DATA frame with payload or END_STREAM flag is
+ * received.  If the count exceeds |val|, session is terminated with
+ * GOAWAY of error code :enum:`NGHTTP2_ENHANCE_YOUR_CALM`.  Specifying
+ * 0 to |val| disables the limit.  By default, the value is 1000.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_max_empty_data_frames(nghttp2_option *option, size_t val);
+
 /**
  * @function
  *
@@ -2719,7 +3194,10 @@ NGHTTP2_EXTERN int nghttp2_session_server_new3(
  * @function
  *
  * Frees any resources allocated for |session|.  If |session| is
- * ``NULL``, this function does nothing.
+ * ``NULL``, this function does nothing.  If the command queue is
+ * enabled by `nghttp2_option_set_command_queue()`, application must
+ * stop the other threads from calling ``nghttp2_session_queue_*``
+ * functions for |session| before calling this function.
  */
 NGHTTP2_EXTERN void nghttp2_session_del(nghttp2_session *session);
 
@@ -2820,6 +3298,89 @@ NGHTTP2_EXTERN int nghttp2_session_send(nghttp2_session *session);
 NGHTTP2_EXTERN ssize_t nghttp2_session_mem_send(nghttp2_session *session,
                                                 const uint8_t **data_ptr);
 
+/**
+ * @function
+ *
+ * Serializes as many frames as fit into the buffer pointed by |buf|
+ * of length |buflen|, and returns the number of bytes written.
+ *
+ * This function behaves like `nghttp2_session_mem_send()` except that
+ * it keeps processing frames until |buflen| bytes are written or
+ * there is no more data to send, and copies them into the single
+ * contiguous buffer given by the caller.  If a frame does not fit in
+ * the remaining space, the buffer is filled with its leading part,
+ * and the rest is written in the next call.  The callbacks are called
+ * in the same way as they are in `nghttp2_session_mem_send()`.
+ *
+ * The |buflen| is the budget for one write.  For example, passing the
+ * maximum TLS record payload size, 16384, produces the content of one
+ * TLS record per call.
+ *
+ * If no data is available to send, this function returns 0.
+ *
+ * The caller must send all data written to |buf| before calling this
+ * function again.
+ *
+ * This function returns the number of bytes written to |buf| if it
+ * succeeds, or one of the following negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`
+ *     The callback function failed.
+ */
+NGHTTP2_EXTERN ssize_t nghttp2_session_mem_send_into(nghttp2_session *session,
+                                                     uint8_t *buf,
+                                                     size_t buflen);
+
+/**
+ * @function
+ *
+ * Returns the serialized data to send as a list of buffers.
+ *
+ * This function behaves like `nghttp2_session_mem_send()` except that
+ * it fills the array |vec| of |veccnt| entries with the buffers to
+ * send, in order, and returns the number of entries filled.  As many
+ * complete frames as |vec| can hold are returned at once.  The
+ * |veccnt| must be at least 3.  The result can be passed to
+ * ``writev()`` after converting to ``struct iovec``.
+ *
+ * For DATA frame whose :type:`nghttp2_data_source_read_callback` sets
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY`, and if
+ * :type:`nghttp2_data_ref_callback` is set, the application data is
+ * referred directly without copying it.  Several such frames may be
+ * returned at once, even for the same stream.  Each data is handed
+ * back to the application by
+ * :type:`nghttp2_data_ref_release_callback` in the next call of this
+ * function, and it must stay valid until then, even if the stream is
+ * closed in the meantime, for example by RST_STREAM received from the
+ * remote peer.  The frame which ends the stream is the last one
+ * returned, and its :type:`nghttp2_on_frame_send_callback` and
+ * :type:`nghttp2_on_stream_close_callback` are invoked in the next
+ * call, after its data is released.  Frames which would close a
+ * stream whose data is still referred, such as RST_STREAM, are also
+ * left to the next call.
+ *
+ * If no data is available to send, this function returns 0.
+ *
+ * The buffers are valid until the next call of this function,
+ * `nghttp2_session_mem_send()` or `nghttp2_session_send()`.  The
+ * caller must send all data before calling this function again.
+ *
+ * This function returns the number of entries filled in |vec| if it
+ * succeeds, or one of the following negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     The |veccnt| is less than 3.
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`
+ *     The callback function failed.
+ */
+NGHTTP2_EXTERN ssize_t nghttp2_session_mem_sendv(nghttp2_session *session,
+                                                 nghttp2_vec *vec,
+                                                 size_t veccnt);
+
 /**
  * @function
  *
@@ -2887,6 +3448,14 @@ NGHTTP2_EXTERN ssize_t nghttp2_session_mem_send(nghttp2_session *session,
  * :enum:`NGHTTP2_ERR_FLOODED`
  *     Flooding was detected in this HTTP/2 session, and it must be
  *     closed.  This is most likely caused by misbehaviour of peer.
+ *
+ * If the remote endpoint exceeds the budgets set by
+ * `nghttp2_option_set_stream_reset_rate_limit()` or
+ * `nghttp2_option_set_max_empty_data_frames()`, session is
+ * terminated with GOAWAY of error code
+ * :enum:`NGHTTP2_ENHANCE_YOUR_CALM`, and the rest of the input is
+ * ignored.  This function does not fail in that case; send GOAWAY
+ * and close the connection as usual.
  */
 NGHTTP2_EXTERN int nghttp2_session_recv(nghttp2_session *session);
 
@@ -2926,11 +3495,47 @@ NGHTTP2_EXTERN int nghttp2_session_recv(nghttp2_session *session);
  * :enum:`NGHTTP2_ERR_FLOODED`
  *     Flooding was detected in this HTTP/2 session, and it must be
  *     closed.  This is most likely caused by misbehaviour of peer.
+ *
+ * If the remote endpoint exceeds the budgets set by
+ * `nghttp2_option_set_stream_reset_rate_limit()` or
+ * `nghttp2_option_set_max_empty_data_frames()`, session is
+ * terminated with GOAWAY of error code
+ * :enum:`NGHTTP2_ENHANCE_YOUR_CALM`, and the rest of the input is
+ * ignored.  This function does not fail in that case; send GOAWAY
+ * and close the connection as usual.
  */
 NGHTTP2_EXTERN ssize_t nghttp2_session_mem_recv(nghttp2_session *session,
                                                 const uint8_t *in,
                                                 size_t inlen);
 
+/**
+ * @function
+ *
+ * Processes data in the buffers |vec| of |veccnt| entries as an input
+ * from the remote endpoint, in order.
+ *
+ * This function behaves like `nghttp2_session_mem_recv()` applied to
+ * each buffer in turn.  Frames may span the buffers; the frame header
+ * and payload are parsed across the boundaries without joining the
+ * buffers, and DATA payload is passed to
+ * :type:`nghttp2_on_data_chunk_recv_callback` directly from each
+ * buffer.  This is useful to process the data read by ``readv()`` or
+ * stored in a ring buffer.
+ *
+ * If |nread| is not ``NULL``, it must point to the array of |veccnt|
+ * entries, and the number of bytes processed from each buffer is
+ * stored in it.  If a callback returns :enum:`NGHTTP2_ERR_PAUSE`,
+ * processing stops there and the buffers after the current one are
+ * not processed at all, even if the current one was fully consumed.
+ *
+ * This function returns the total number of bytes processed if it
+ * succeeds, or one of the negative error codes which
+ * `nghttp2_session_mem_recv()` returns.
+ */
+NGHTTP2_EXTERN ssize_t nghttp2_session_mem_recvv(nghttp2_session *session,
+                                                 const nghttp2_vec *vec,
+                                                 size_t veccnt, size_t *nread);
+
 /**
  * @function
  *
@@ -2948,6 +3553,78 @@ NGHTTP2_EXTERN ssize_t nghttp2_session_mem_recv(nghttp2_session *session,
 NGHTTP2_EXTERN int nghttp2_session_resume_data(nghttp2_session *session,
                                                int32_t stream_id);
 
+/**
+ * @function
+ *
+ * Asks |session| to call `nghttp2_session_resume_data()` for the
+ * stream |stream_id|.  Unlike other functions, this function may be
+ * called from any thread, while the thread which owns |session| is
+ * using it.  The command is executed by the owner thread next time it
+ * sends or receives data with |session|, and
+ * `nghttp2_session_want_write()` returns nonzero until then.  This
+ * function does not wake up the owner thread; application has to
+ * notify its event loop by its own means.
+ *
+ * The command queue must be enabled by
+ * `nghttp2_option_set_command_queue()`.  The memory for the command
+ * is allocated by the allocator given to session, which must be
+ * thread-safe.  It is not charged to the memory accounting, and
+ * `nghttp2_option_set_mem_pool()` is not used.  The command is
+ * discarded if it fails when executed, for example because the stream
+ * has been closed.
+ *
+ * Application must make sure that no thread calls this function, or
+ * the other ``nghttp2_session_queue_*`` functions, once
+ * `nghttp2_session_del()` may be called for |session|.  The queue is
+ * freed by `nghttp2_session_del()`, and this function does not
+ * synchronize with it.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     The command queue is not enabled.
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     The |stream_id| is 0 or negative.
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP2_EXTERN int nghttp2_session_queue_resume_data(nghttp2_session *session,
+                                                     int32_t stream_id);
+
+/**
+ * @function
+ *
+ * Asks |session| to call `nghttp2_submit_data()` with |flags|,
+ * |stream_id| and |data_prd|.  |*data_prd| is copied.  This function
+ * may be called from any thread.  If `nghttp2_submit_data()` fails
+ * when the command is executed, for example because the stream has
+ * been closed in the meantime, |data_prd| is never used, and
+ * :type:`nghttp2_on_queued_data_discard_callback` is invoked with its
+ * source instead, so that application can release it.  The command
+ * left in the queue when |session| is deleted is discarded without
+ * the callback.  See `nghttp2_session_queue_resume_data()` for the
+ * other details and the error codes.  In addition, this function
+ * returns :enum:`NGHTTP2_ERR_INVALID_ARGUMENT` if |data_prd| is
+ * ``NULL``.
+ */
+NGHTTP2_EXTERN int
+nghttp2_session_queue_data(nghttp2_session *session, uint8_t flags,
+                           int32_t stream_id,
+                           const nghttp2_data_provider *data_prd);
+
+/**
+ * @function
+ *
+ * Asks |session| to call `nghttp2_submit_rst_stream()` with
+ * |stream_id| and |error_code|.  This function may be called from any
+ * thread.  See `nghttp2_session_queue_resume_data()` for the details
+ * and the error codes.
+ */
+NGHTTP2_EXTERN int nghttp2_session_queue_rst_stream(nghttp2_session *session,
+                                                    int32_t stream_id,
+                                                    uint32_t error_code);
+
 /**
  * @function
  *
@@ -3187,6 +3864,205 @@ nghttp2_session_get_hd_inflate_dynamic_table_size(nghttp2_session *session);
 NGHTTP2_EXTERN size_t
 nghttp2_session_get_hd_deflate_dynamic_table_size(nghttp2_session *session);
 
+/**
+ * @struct
+ *
+ * The memory held by session, in bytes, which is retrieved by
+ * `nghttp2_session_get_mem_usage()`.  The numbers are the sizes
+ * requested from the allocator, and do not include the bookkeeping
+ * overhead of allocator itself.
+ */
+typedef struct {
+  /**
+   * The total amount of memory held by session, excluding session
+   * object itself.  This is the sum of the other fields.
+   */
+  size_t total;
+  /**
+   * The memory used by open streams and the stream map.
+   */
+  size_t streams;
+  /**
+   * The memory used by closed and idle streams which are retained
+   * for priority purposes.
+   */
+  size_t closed_streams;
+  /**
+   * The memory used by HPACK deflater and inflater, including their
+   * dynamic tables.
+   */
+  size_t hd;
+  /**
+   * The memory used by the frames queued for transmission and the
+   * buffer to serialize them, and other session-wide state.
+   */
+  size_t outbound;
+  /**
+   * The memory used to receive frames, such as SETTINGS entries and
+   * GOAWAY debug data.
+   */
+  size_t inbound;
+} nghttp2_mem_usage;
+
+/**
+ * @function
+ *
+ * Stores the amount of memory held by |session| in |*usage|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     Memory accounting is not enabled by
+ *     `nghttp2_option_set_mem_accounting()` or
+ *     `nghttp2_option_set_max_session_memory()`.
+ */
+NGHTTP2_EXTERN int nghttp2_session_get_mem_usage(nghttp2_session *session,
+                                                 nghttp2_mem_usage *usage);
+
+/**
+ * @function
+ *
+ * Returns the sum of the lengths of header field names and values
+ * which have been encoded by HPACK deflater.  See
+ * `nghttp2_hd_deflate_get_uncompressed_length()`.
+ */
+NGHTTP2_EXTERN uint64_t
+nghttp2_session_get_hd_deflate_uncompressed_length(nghttp2_session *session);
+
+/**
+ * @function
+ *
+ * Returns the number of bytes HPACK deflater has produced.  See
+ * `nghttp2_hd_deflate_get_compressed_length()`.
+ */
+NGHTTP2_EXTERN uint64_t
+nghttp2_session_get_hd_deflate_compressed_length(nghttp2_session *session);
+
+/**
+ * @macro
+ *
+ * The number of elements of :member:`nghttp2_stats.frames_sent` and
+ * :member:`nghttp2_stats.frames_recv`.  The frame types defined in
+ * RFC 7540 (from :enum:`NGHTTP2_DATA` to :enum:`NGHTTP2_CONTINUATION`)
+ * are counted at the index of their type, and all the other frame
+ * types, including extension frames, are counted at the last index.
+ */
+#define NGHTTP2_STATS_NUM_FRAME_TYPES 11
+
+/**
+ * @macro
+ *
+ * The number of elements of :member:`nghttp2_stats.rst_stream_sent`
+ * and :member:`nghttp2_stats.rst_stream_recv`.  The error codes
+ * defined in :type:`nghttp2_error_code` are counted at the index of
+ * their value, and all unknown error codes are counted at the last
+ * index.
+ */
+#define NGHTTP2_STATS_NUM_ERROR_CODES 15
+
+/**
+ * @struct
+ *
+ * The counters maintained by session, which are retrieved by
+ * `nghttp2_session_get_stats()`.  All counters start from 0 when
+ * session is created, and are never reset.
+ *
+ * Future versions only append new members to this struct, and never
+ * change the number of elements of the arrays, so that the members
+ * filled by `nghttp2_session_get_stats()` keep their meaning.
+ */
+typedef struct {
+  /**
+   * The number of frames sent, indexed by frame type.  See
+   * :macro:`NGHTTP2_STATS_NUM_FRAME_TYPES`.  Each CONTINUATION frame
+   * sent after HEADERS or PUSH_PROMISE is counted separately.
+   */
+  uint64_t frames_sent[NGHTTP2_STATS_NUM_FRAME_TYPES];
+  /**
+   * The number of frames received, indexed by frame type.  See
+   * :macro:`NGHTTP2_STATS_NUM_FRAME_TYPES`.
+   */
+  uint64_t frames_recv[NGHTTP2_STATS_NUM_FRAME_TYPES];
+  /**
+   * The sum of the lengths of header field names and values passed
+   * to HPACK deflater.
+   */
+  uint64_t header_bytes_sent;
+  /**
+   * The number of bytes HPACK deflater has produced.
+   */
+  uint64_t header_block_bytes_sent;
+  /**
+   * The sum of the lengths of header field names and values HPACK
+   * inflater has emitted.
+   */
+  uint64_t header_bytes_recv;
+  /**
+   * The number of header block bytes HPACK inflater has consumed.
+   */
+  uint64_t header_block_bytes_recv;
+  /**
+   * The number of DATA payload bytes sent, excluding padding.
+   */
+  uint64_t data_bytes_sent;
+  /**
+   * The number of DATA payload bytes received, excluding padding.
+   */
+  uint64_t data_bytes_recv;
+  /**
+   * The time in microseconds during which DATA was pending but the
+   * connection level flow control window of the remote endpoint was
+   * exhausted.  This is always 0 if no monotonic clock is available.
+   */
+  uint64_t conn_flow_blocked_us;
+  /**
+   * The sum of the time in microseconds during which each stream had
+   * its DATA deferred by the stream level flow control window of the
+   * remote endpoint.  The time is accumulated per stream, so it can
+   * grow faster than wall clock if multiple streams are blocked at
+   * the same time.  This is always 0 if no monotonic clock is
+   * available.
+   */
+  uint64_t stream_flow_blocked_us;
+  /**
+   * The largest number of incoming and outgoing streams which were
+   * concurrently open at any point.  Like
+   * :enum:`NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS`, streams in
+   * reserved state are not counted.
+   */
+  size_t peak_concurrent_streams;
+  /**
+   * The number of RST_STREAM frames sent, indexed by error code.
+   * See :macro:`NGHTTP2_STATS_NUM_ERROR_CODES`.
+   */
+  uint64_t rst_stream_sent[NGHTTP2_STATS_NUM_ERROR_CODES];
+  /**
+   * The number of RST_STREAM frames received, indexed by error code.
+   * See :macro:`NGHTTP2_STATS_NUM_ERROR_CODES`.
+   */
+  uint64_t rst_stream_recv[NGHTTP2_STATS_NUM_ERROR_CODES];
+} nghttp2_stats;
+
+/**
+ * @function
+ *
+ * Stores the counters maintained by |session| in |*stats|.  Unlike
+ * `nghttp2_session_get_mem_usage()`, the counters are always
+ * maintained, and no option is required.
+ *
+ * The |statslen| must be ``sizeof(nghttp2_stats)``.  At most
+ * |statslen| bytes are written, so that the application built against
+ * the header of different version can call this function safely.
+ *
+ * This function returns the number of bytes written to |*stats|.  If
+ * it is less than |statslen|, the library is older than the header,
+ * and the members beyond the returned length are left untouched.
+ */
+NGHTTP2_EXTERN size_t nghttp2_session_get_stats(nghttp2_session *session,
+                                                nghttp2_stats *stats,
+                                                size_t statslen);
+
 /**
  * @function
  *
@@ -3419,6 +4295,10 @@ NGHTTP2_EXTERN int nghttp2_session_consume_stream(nghttp2_session *session,
  * found, we use default priority instead of given |pri_spec|.  That
  * is make stream depend on root stream with weight 16.
  *
+ * If |session| is configured with
+ * `nghttp2_option_set_no_rfc7540_priorities()`, this function does
+ * nothing and returns 0.
+ *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
@@ -3462,6 +4342,10 @@ nghttp2_session_change_stream_priority(nghttp2_session *session,
  * found, we use default priority instead of given |pri_spec|.  That
  * is make stream depend on root stream with weight 16.
  *
+ * If |session| is configured with
+ * `nghttp2_option_set_no_rfc7540_priorities()`, this function does
+ * nothing and returns 0.
+ *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
@@ -3478,6 +4362,61 @@ NGHTTP2_EXTERN int
 nghttp2_session_create_idle_stream(nghttp2_session *session, int32_t stream_id,
                                    const nghttp2_priority_spec *pri_spec);
 
+/**
+ * @function
+ *
+ * Changes the priority of the existing stream denoted by |stream_id|
+ * to the Extensible Prioritization parameters |extpri|.  The
+ * priority is changed silently and instantly.  If
+ * ``extpri->urgency`` is larger than
+ * :macro:`NGHTTP2_EXTPRI_URGENCY_LOW`, it is treated as
+ * :macro:`NGHTTP2_EXTPRI_URGENCY_LOW`.
+ *
+ * The streams with the smaller urgency are sent first.  Among the
+ * streams of the same urgency, non-incremental streams are sent one
+ * by one before incremental ones, and incremental streams are sent in
+ * a round robin fashion.  Selecting the next stream takes constant
+ * time regardless of the number of streams.
+ *
+ * The stream gets :macro:`NGHTTP2_EXTPRI_DEFAULT_URGENCY` and
+ * non-incremental when it is opened.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     |session| is not configured with
+ *     `nghttp2_option_set_no_rfc7540_priorities()`.
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     No stream exists for the given |stream_id|; or |stream_id| is
+ *     0.
+ */
+NGHTTP2_EXTERN int
+nghttp2_session_change_extpri_stream_priority(nghttp2_session *session,
+                                              int32_t stream_id,
+                                              const nghttp2_extpri *extpri);
+
+/**
+ * @function
+ *
+ * Stores the Extensible Prioritization parameters of the stream
+ * denoted by |stream_id| in |*extpri|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     |session| is not configured with
+ *     `nghttp2_option_set_no_rfc7540_priorities()`.
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     No stream exists for the given |stream_id|; or |stream_id| is
+ *     0.
+ */
+NGHTTP2_EXTERN int
+nghttp2_session_get_extpri_stream_priority(nghttp2_session *session,
+                                           nghttp2_extpri *extpri,
+                                           int32_t stream_id);
+
 /**
  * @function
  *
@@ -4009,6 +4948,10 @@ NGHTTP2_EXTERN int nghttp2_submit_data(nghttp2_session *session, uint8_t flags,
  * :enum:`NGHTTP2_MIN_WEIGHT`.  If it is strictly greater than
  * :enum:`NGHTTP2_MAX_WEIGHT`, it becomes :enum:`NGHTTP2_MAX_WEIGHT`.
  *
+ * If |session| is configured with
+ * `nghttp2_option_set_no_rfc7540_priorities()`, this function does
+ * not submit PRIORITY frame, and returns 0.
+ *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
@@ -4787,6 +5730,72 @@ NGHTTP2_EXTERN
 size_t
 nghttp2_hd_deflate_get_max_dynamic_table_size(nghttp2_hd_deflater *deflater);
 
+/**
+ * @function
+ *
+ * Enables adaptive indexing if |val| is nonzero, or disables it.  By
+ * default, |deflater| indexes every header field which is not
+ * excluded by fixed rules (e.g., authorization header field, and
+ * header fields which are too large for the dynamic table).  With
+ * adaptive indexing, |deflater| remembers the name/value pairs it
+ * recently encoded, and a pair is only inserted into the dynamic
+ * table when it is encoded for the second time.  This keeps one-off
+ * values, such as request IDs and timestamps, from evicting the
+ * entries which are actually reused.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP2_EXTERN int
+nghttp2_hd_deflate_set_adaptive_indexing(nghttp2_hd_deflater *deflater,
+                                         int val);
+
+/**
+ * @function
+ *
+ * Enables memoization of encoded header blocks if |val| is nonzero,
+ * or disables it.  If enabled, |deflater| keeps the last few header
+ * lists it encoded without modifying the dynamic table, together with
+ * their encoded header blocks.  If the same header list is given
+ * again, and the dynamic table has not been modified since, the
+ * memoized header block is emitted without encoding the header fields
+ * again.  This saves CPU time when the same header list (e.g.,
+ * response header fields) is sent repeatedly on a connection.  The
+ * header lists are compared byte by byte, including
+ * :enum:`NGHTTP2_NV_FLAG_NO_INDEX` flag.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP2_EXTERN int nghttp2_hd_deflate_set_memoize(nghttp2_hd_deflater *deflater,
+                                                  int val);
+
+/**
+ * @function
+ *
+ * Returns the sum of the lengths of names and values which have been
+ * encoded by |deflater|.  Together with
+ * `nghttp2_hd_deflate_get_compressed_length()`, this tells the
+ * compression ratio of |deflater|.
+ */
+NGHTTP2_EXTERN uint64_t
+nghttp2_hd_deflate_get_uncompressed_length(nghttp2_hd_deflater *deflater);
+
+/**
+ * @function
+ *
+ * Returns the number of bytes |deflater| has produced, including
+ * dynamic table size updates.
+ */
+NGHTTP2_EXTERN uint64_t
+nghttp2_hd_deflate_get_compressed_length(nghttp2_hd_deflater *deflater);
+
 struct nghttp2_hd_inflater;
 
 /**
@@ -5070,6 +6079,71 @@ NGHTTP2_EXTERN ssize_t nghttp2_hd_inflate_hd2(nghttp2_hd_inflater *inflater,
 NGHTTP2_EXTERN int
 nghttp2_hd_inflate_end_headers(nghttp2_hd_inflater *inflater);
 
+/**
+ * @function
+ *
+ * If |val| is nonzero, |inflater| stops copying literal header field
+ * names and values into its own buffers whenever they can be
+ * referenced from the input directly.  This is the case if the string
+ * is not Huffman encoded, it is not inserted into the dynamic table,
+ * and it is entirely contained in the input passed to a single call
+ * of `nghttp2_hd_inflate_hd2()`.  Other header fields are still
+ * copied as usual.
+ *
+ * When this option is enabled, the emitted name and value may point
+ * into the input buffer, and they are NOT NULL-terminated.  They are
+ * only valid until the input buffer is modified or freed, and
+ * incrementing the reference count of such a buffer does not extend
+ * its lifetime.  The application must copy them if it needs them
+ * later.
+ *
+ * By default, this option is disabled.
+ */
+NGHTTP2_EXTERN void nghttp2_hd_inflate_set_no_copy(nghttp2_hd_inflater *inflater,
+                                                   int val);
+
+/**
+ * @function
+ *
+ * Inflates the complete header block |in| of length |inlen| in one
+ * call.  The header fields are stored in |nva|, and their names and
+ * values are copied into |buf|, each NULL-terminated.  The
+ * |*nvlen_ptr| must be the number of elements |nva| can store, and
+ * the |*buflen_ptr| must be the length of |buf|.  No memory is
+ * allocated for the header fields themselves.
+ *
+ * On return, the |*nvlen_ptr| is the number of header fields in the
+ * header block, and the |*buflen_ptr| is the total size of |buf|
+ * required for them, that is the sum of the length of name and value
+ * plus 2 for each header field.  This is true even if |nva| or |buf|
+ * is too small, so that the application can retry the next header
+ * block with the larger buffers.
+ *
+ * The whole header block is always processed, and the dynamic table
+ * is updated accordingly, so the application does not have to call
+ * `nghttp2_hd_inflate_end_headers()`.  This function must not be
+ * called while header block is being inflated by
+ * `nghttp2_hd_inflate_hd2()`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ * :enum:`NGHTTP2_ERR_HEADER_COMP`
+ *     Inflation process has failed.
+ * :enum:`NGHTTP2_ERR_BUFFER_ERROR`
+ *     |nva| or |buf| is too small.  The header fields are lost, but
+ *     |inflater| can still be used for the next header block.
+ */
+NGHTTP2_EXTERN int nghttp2_hd_inflate_hd_block(nghttp2_hd_inflater *inflater,
+                                               nghttp2_nv *nva,
+                                               size_t *nvlen_ptr,
+                                               uint8_t *buf,
+                                               size_t *buflen_ptr,
+                                               const uint8_t *in,
+                                               size_t inlen);
+
 /**
  * @function
  *
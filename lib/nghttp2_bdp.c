@@ -0,0 +1,159 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_bdp.h"
+
+#include "nghttp2_helper.h"
+
+void nghttp2_bdp_init(nghttp2_bdp *bdp, int32_t max_window) {
+  bdp->ping_sent = 0;
+  bdp->next_probe = 0;
+  bdp->backoff = 0;
+  bdp->rtt = 0;
+  bdp->max_bw = 0;
+  bdp->max_bw_tstamp = 0;
+  bdp->sample = 0;
+  bdp->stream_sample = 0;
+  bdp->epoch = 0;
+  bdp->max_window = max_window;
+  bdp->state = NGHTTP2_BDP_IDLE;
+}
+
+int nghttp2_bdp_on_data(nghttp2_bdp *bdp, uint32_t *pstream_epoch,
+                        uint32_t *pstream_recv, size_t len) {
+  if (bdp->state != NGHTTP2_BDP_INFLIGHT) {
+    return bdp->state == NGHTTP2_BDP_IDLE;
+  }
+
+  if (*pstream_epoch != bdp->epoch) {
+    *pstream_epoch = bdp->epoch;
+    *pstream_recv = 0;
+  }
+
+  /* DATA received is bounded by the receive window, which is at most
+     NGHTTP2_MAX_WINDOW_SIZE. */
+  *pstream_recv += (uint32_t)len;
+
+  bdp->sample += len;
+  bdp->stream_sample = nghttp2_max(bdp->stream_sample, *pstream_recv);
+
+  return 0;
+}
+
+int nghttp2_bdp_probe_due(nghttp2_bdp *bdp, uint64_t now) {
+  if (bdp->state != NGHTTP2_BDP_IDLE || now < bdp->next_probe) {
+    return 0;
+  }
+
+  bdp->state = NGHTTP2_BDP_QUEUED;
+
+  return 1;
+}
+
+void nghttp2_bdp_on_probe_sent(nghttp2_bdp *bdp, uint64_t now) {
+  bdp->ping_sent = now;
+  bdp->sample = 0;
+  bdp->stream_sample = 0;
+  ++bdp->epoch;
+  bdp->state = NGHTTP2_BDP_INFLIGHT;
+}
+
+void nghttp2_bdp_on_probe_dropped(nghttp2_bdp *bdp) {
+  if (bdp->state == NGHTTP2_BDP_QUEUED) {
+    bdp->state = NGHTTP2_BDP_IDLE;
+  }
+}
+
+/*
+ * Returns the new window size if |sample| bytes received in one round
+ * trip come close to |window|, or 0.
+ */
+static int32_t bdp_grow_window(nghttp2_bdp *bdp, uint64_t sample,
+                               int32_t window) {
+  uint64_t target;
+
+  if (window >= bdp->max_window || sample * 3 < (uint64_t)window * 2) {
+    return 0;
+  }
+
+  target = nghttp2_min(sample * 2, (uint64_t)bdp->max_window);
+  if (target <= (uint64_t)window) {
+    return 0;
+  }
+
+  return (int32_t)target;
+}
+
+void nghttp2_bdp_on_probe_ack(nghttp2_bdp *bdp, uint64_t now,
+                              int32_t conn_window, int32_t stream_window,
+                              int32_t *pconn_window, int32_t *pstream_window) {
+  uint64_t rtt, bw;
+
+  *pconn_window = 0;
+  *pstream_window = 0;
+
+  bdp->state = NGHTTP2_BDP_IDLE;
+
+  /* The clock may be too coarse, or unavailable.  Without the round
+     trip time, the sample tells nothing about bandwidth. */
+  if (now > bdp->ping_sent) {
+    rtt = now - bdp->ping_sent;
+
+    if (bdp->rtt == 0) {
+      bdp->rtt = rtt;
+    } else {
+      bdp->rtt = (bdp->rtt * 7 + rtt) / 8;
+    }
+
+    bw = bdp->sample * 1000000 / rtt;
+
+    /* If bandwidth went down, the sample is limited by something
+       other than the windows.  The old maximum expires, so that a
+       path which got slower for good does not block the growth
+       forever. */
+    if (bw >= bdp->max_bw ||
+        now - bdp->max_bw_tstamp >= NGHTTP2_BDP_MAX_BW_WINDOW) {
+      bdp->max_bw = bw;
+      bdp->max_bw_tstamp = now;
+
+      *pconn_window = bdp_grow_window(bdp, bdp->sample, conn_window);
+      *pstream_window =
+          bdp_grow_window(bdp, bdp->stream_sample, stream_window);
+    }
+  }
+
+  if (*pconn_window || *pstream_window) {
+    bdp->backoff = 0;
+  } else {
+    bdp->backoff = nghttp2_min(nghttp2_max(bdp->backoff * 2, bdp->rtt),
+                               (uint64_t)NGHTTP2_BDP_MAX_BACKOFF);
+    /* Without the round trip time, back off anyway, so that the probe
+       is not repeated until the clock advances. */
+    if (bdp->backoff == 0) {
+      bdp->backoff = 1;
+    }
+  }
+
+  bdp->next_probe = now + bdp->backoff;
+}
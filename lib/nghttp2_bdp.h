@@ -0,0 +1,136 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_BDP_H
+#define NGHTTP2_BDP_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+
+/* The maximum interval between probes, in microseconds, while the
+   windows are not growing. */
+#define NGHTTP2_BDP_MAX_BACKOFF 1000000
+
+/* The period, in microseconds, after which the largest bandwidth
+   observed is forgotten, so that the estimator follows the bandwidth
+   going down. */
+#define NGHTTP2_BDP_MAX_BW_WINDOW 10000000
+
+typedef enum {
+  /* No probe is outstanding */
+  NGHTTP2_BDP_IDLE,
+  /* Probe PING is queued, but not sent yet */
+  NGHTTP2_BDP_QUEUED,
+  /* Probe PING was sent, and its ACK is awaited */
+  NGHTTP2_BDP_INFLIGHT
+} nghttp2_bdp_state;
+
+/*
+ * Estimator of bandwidth-delay product of the incoming direction.
+ * While DATA is flowing, PING is sent to the remote endpoint, and the
+ * bytes received until its ACK arrives are the sample of BDP.  If the
+ * sample gets close to the receive window, and the bandwidth is not
+ * decreasing, the window is the bottleneck and it should be grown.
+ */
+typedef struct {
+  /* The time when the probe PING was sent */
+  uint64_t ping_sent;
+  /* The time before which the next probe is not sent */
+  uint64_t next_probe;
+  /* The current back-off interval of probes */
+  uint64_t backoff;
+  /* Smoothed round trip time in microseconds.  0 if not measured
+     yet. */
+  uint64_t rtt;
+  /* The largest bandwidth observed in NGHTTP2_BDP_MAX_BW_WINDOW, in
+     bytes per second */
+  uint64_t max_bw;
+  /* The time when max_bw was observed */
+  uint64_t max_bw_tstamp;
+  /* The number of DATA bytes received on the connection since the
+     probe PING was sent */
+  uint64_t sample;
+  /* The largest number of DATA bytes received on a single stream
+     since the probe PING was sent */
+  uint32_t stream_sample;
+  /* Incremented for each probe.  Streams use it to know that their
+     byte count belongs to the older probe. */
+  uint32_t epoch;
+  /* The ceiling of the receive windows */
+  int32_t max_window;
+  /* One of nghttp2_bdp_state */
+  uint8_t state;
+} nghttp2_bdp;
+
+/*
+ * Initializes |bdp| which grows the windows up to |max_window|
+ * bytes.
+ */
+void nghttp2_bdp_init(nghttp2_bdp *bdp, int32_t max_window);
+
+/*
+ * Records that |len| bytes of DATA were received on the stream whose
+ * byte count and probe epoch are |*pstream_recv| and
+ * |*pstream_epoch|.
+ *
+ * This function returns nonzero if no probe is outstanding, and the
+ * caller should check nghttp2_bdp_probe_due() to send new one.
+ */
+int nghttp2_bdp_on_data(nghttp2_bdp *bdp, uint32_t *pstream_epoch,
+                        uint32_t *pstream_recv, size_t len);
+
+/*
+ * Returns nonzero if the next probe can be sent at time |now|, and
+ * marks the probe queued.  The caller must send PING then.
+ */
+int nghttp2_bdp_probe_due(nghttp2_bdp *bdp, uint64_t now);
+
+/*
+ * Records that the probe PING was sent at time |now|.
+ */
+void nghttp2_bdp_on_probe_sent(nghttp2_bdp *bdp, uint64_t now);
+
+/*
+ * Records that the queued probe PING was discarded without being
+ * sent, so that the next probe can be queued.
+ */
+void nghttp2_bdp_on_probe_dropped(nghttp2_bdp *bdp);
+
+/*
+ * Processes ACK of the probe PING received at time |now|.
+ * |conn_window| and |stream_window| are the current receive windows
+ * of the connection and the initial one of streams.  If the window
+ * should be grown, the new size is assigned to |*pconn_window| or
+ * |*pstream_window|.  Otherwise, 0 is assigned to them.  If |now| is
+ * not later than the time the probe was sent, the round trip time is
+ * unknown, and the sample is discarded.
+ */
+void nghttp2_bdp_on_probe_ack(nghttp2_bdp *bdp, uint64_t now,
+                              int32_t conn_window, int32_t stream_window,
+                              int32_t *pconn_window, int32_t *pstream_window);
+
+#endif /* NGHTTP2_BDP_H */
@@ -168,3 +168,27 @@ void nghttp2_session_callbacks_set_error_callback(
     nghttp2_session_callbacks *cbs, nghttp2_error_callback error_callback) {
   cbs->error_callback = error_callback;
 }
+
+void nghttp2_session_callbacks_set_on_header_block_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_on_header_block_callback on_header_block_callback) {
+  cbs->on_header_block_callback = on_header_block_callback;
+}
+
+void nghttp2_session_callbacks_set_data_ref_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_data_ref_callback data_ref_callback) {
+  cbs->data_ref_callback = data_ref_callback;
+}
+
+void nghttp2_session_callbacks_set_data_ref_release_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_data_ref_release_callback data_ref_release_callback) {
+  cbs->data_ref_release_callback = data_ref_release_callback;
+}
+
+void nghttp2_session_callbacks_set_on_queued_data_discard_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_on_queued_data_discard_callback on_queued_data_discard_callback) {
+  cbs->on_queued_data_discard_callback = on_queued_data_discard_callback;
+}
@@ -119,6 +119,10 @@ struct nghttp2_session_callbacks {
   nghttp2_unpack_extension_callback unpack_extension_callback;
   nghttp2_on_extension_chunk_recv_callback on_extension_chunk_recv_callback;
   nghttp2_error_callback error_callback;
+  nghttp2_on_header_block_callback on_header_block_callback;
+  nghttp2_data_ref_callback data_ref_callback;
+  nghttp2_data_ref_release_callback data_ref_release_callback;
+  nghttp2_on_queued_data_discard_callback on_queued_data_discard_callback;
 };
 
 #endif /* NGHTTP2_CALLBACKS_H */
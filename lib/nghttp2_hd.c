@@ -470,15 +470,49 @@ static int32_t lookup_token(const uint8_t *name, size_t namelen) {
   return -1;
 }
 
-void nghttp2_hd_entry_init(nghttp2_hd_entry *ent, nghttp2_hd_nv *nv) {
+/*
+ * Initializes |rcbuf| as a non-refcounted buffer which refers to
+ * |base| of length |len|.
+ */
+static void rcbuf_wrap(nghttp2_rcbuf *rcbuf, const uint8_t *base,
+                       size_t len) {
+  memset(rcbuf, 0, sizeof(*rcbuf));
+  rcbuf->base = (uint8_t *)base;
+  rcbuf->len = len;
+  rcbuf->ref = -1;
+}
+
+/*
+ * Makes ent->cnv refer to the name and value stored right after
+ * |ent|.
+ */
+static void hd_entry_set_inline_nv(nghttp2_hd_entry *ent) {
+  ent->cnv.name = (uint8_t *)ent + sizeof(nghttp2_hd_entry);
+  ent->cnv.value = ent->cnv.name + ent->cnv.namelen + 1;
+}
+
+void nghttp2_hd_entry_init(nghttp2_hd_entry *ent, nghttp2_hd_nv *nv,
+                           int inline_nv) {
   ent->nv = *nv;
   ent->cnv.name = nv->name->base;
   ent->cnv.namelen = nv->name->len;
   ent->cnv.value = nv->value->base;
   ent->cnv.valuelen = nv->value->len;
   ent->cnv.flags = nv->flags;
-  ent->next = NULL;
   ent->hash = 0;
+  ent->nv_hash = 0;
+
+  if (inline_nv) {
+    ent->nv.name = NULL;
+    ent->nv.value = NULL;
+
+    hd_entry_set_inline_nv(ent);
+
+    *nghttp2_cpymem(ent->cnv.name, nv->name->base, nv->name->len) = '\0';
+    *nghttp2_cpymem(ent->cnv.value, nv->value->base, nv->value->len) = '\0';
+
+    return;
+  }
 
   nghttp2_rcbuf_incref(ent->nv.name);
   nghttp2_rcbuf_incref(ent->nv.value);
@@ -489,91 +523,310 @@ void nghttp2_hd_entry_free(nghttp2_hd_entry *ent) {
   nghttp2_rcbuf_decref(ent->nv.name);
 }
 
-static int name_eq(const nghttp2_hd_nv *a, const nghttp2_nv *b) {
-  return a->name->len == b->namelen &&
-         memeq(a->name->base, b->name, b->namelen);
+/*
+ * Returns the number of bytes in the arena which the entry occupies.
+ * |inlinelen| is the number of bytes stored inline after the entry.
+ * The entries are aligned to 8 bytes boundary.
+ */
+static size_t entry_arena_size(size_t inlinelen) {
+  return (sizeof(nghttp2_hd_entry) + inlinelen + 7) & ~(size_t)7;
 }
 
-static int value_eq(const nghttp2_hd_nv *a, const nghttp2_nv *b) {
-  return a->value->len == b->valuelen &&
-         memeq(a->value->base, b->value, b->valuelen);
+static size_t hd_entry_arena_size(const nghttp2_hd_entry *ent) {
+  if (ent->nv.name) {
+    return entry_arena_size(0);
+  }
+
+  return entry_arena_size(ent->cnv.namelen + ent->cnv.valuelen + 2);
 }
 
-static uint32_t name_hash(const nghttp2_nv *nv) {
-  /* 32 bit FNV-1a: http://isthe.com/chongo/tech/comp/fnv/ */
-  uint32_t h = 2166136261u;
+static int name_eq(const nghttp2_nv *a, const nghttp2_nv *b) {
+  return a->namelen == b->namelen && memeq(a->name, b->name, b->namelen);
+}
+
+static int value_eq(const nghttp2_nv *a, const nghttp2_nv *b) {
+  return a->valuelen == b->valuelen && memeq(a->value, b->value, b->valuelen);
+}
+
+/* 32 bit FNV-1a: http://isthe.com/chongo/tech/comp/fnv/ */
+static uint32_t hd_hash(uint32_t h, const uint8_t *s, size_t len) {
   size_t i;
 
-  for (i = 0; i < nv->namelen; ++i) {
-    h ^= nv->name[i];
+  for (i = 0; i < len; ++i) {
+    h ^= s[i];
     h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
   }
 
   return h;
 }
 
+static uint32_t name_hash(const nghttp2_nv *nv) {
+  return hd_hash(2166136261u, nv->name, nv->namelen);
+}
+
+/*
+ * Returns the hash value of name and value of |nv|.  |namehash| must
+ * be the hash value of its name.  Since values are often long (e.g.,
+ * cookie and user-agent), they are hashed 8 bytes at a time, using
+ * the same mixing step as FxHash.
+ */
+static uint32_t nv_hash(uint32_t namehash, const nghttp2_nv *nv) {
+  const uint8_t *p = nv->value;
+  const uint8_t *end = nv->value + nv->valuelen;
+  uint64_t h = namehash;
+  uint64_t w;
+
+  for (; end - p >= 8; p += 8) {
+    memcpy(&w, p, sizeof(w));
+    h = (((h << 5) | (h >> 59)) ^ w) * 0x517cc1b727220a95ull;
+  }
+
+  for (; p != end; ++p) {
+    h = (((h << 5) | (h >> 59)) ^ *p) * 0x517cc1b727220a95ull;
+  }
+
+  return (uint32_t)(h ^ (h >> 32));
+}
+
 static void hd_map_init(nghttp2_hd_map *map) {
   memset(map, 0, sizeof(nghttp2_hd_map));
 }
 
-static void hd_map_insert(nghttp2_hd_map *map, nghttp2_hd_entry *ent) {
-  nghttp2_hd_entry **bucket;
+static void hd_map_free(nghttp2_hd_map *map, nghttp2_mem *mem) {
+  nghttp2_mem_free(mem, map->nv.table);
+  nghttp2_mem_free(mem, map->name.table);
+}
+
+/*
+ * Returns nonzero if |ent| has the same name as |nv|, whose token is
+ * |token|.  If |name_only| is zero, value must match as well.
+ */
+static int hd_map_key_eq(const nghttp2_hd_entry *ent, const nghttp2_nv *nv,
+                         int32_t token, int name_only) {
+  if (token != ent->nv.token || (token == -1 && !name_eq(&ent->cnv, nv))) {
+    return 0;
+  }
+
+  return name_only || value_eq(&ent->cnv, nv);
+}
 
-  bucket = &map->table[ent->hash & (HD_MAP_SIZE - 1)];
+/*
+ * Places |b| in |tbl|, assuming that |tbl| has a room for it.  An
+ * entry which is closer to its initial bucket gives way to the one
+ * which is farther from it.
+ */
+static void hd_map_table_place(nghttp2_hd_map_table *tbl,
+                               nghttp2_hd_map_bucket b) {
+  size_t mask = tbl->tablelen - 1;
+  size_t idx;
+  nghttp2_hd_map_bucket *p, t;
+
+  for (idx = b.hash & mask;; idx = (idx + 1) & mask, ++b.psl) {
+    p = &tbl->table[idx];
+
+    if (p->ent == NULL) {
+      *p = b;
+      ++tbl->size;
+      return;
+    }
+
+    if (p->psl < b.psl) {
+      t = *p;
+      *p = b;
+      b = t;
+    }
+  }
+}
+
+/*
+ * Makes sure that |tbl| can store |n| entries without exceeding the
+ * load factor 3/4.
+ */
+static int hd_map_table_reserve(nghttp2_hd_map_table *tbl, size_t n,
+                                nghttp2_mem *mem) {
+  nghttp2_hd_map_table ntbl;
+  size_t i;
+
+  if (n <= tbl->tablelen / 4 * 3) {
+    return 0;
+  }
 
-  if (*bucket == NULL) {
-    *bucket = ent;
+  ntbl.tablelen = tbl->tablelen ? tbl->tablelen * 2 : 32;
+  ntbl.size = 0;
+  ntbl.table = nghttp2_mem_calloc(mem, ntbl.tablelen,
+                                  sizeof(nghttp2_hd_map_bucket));
+  if (ntbl.table == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  for (i = 0; i < tbl->tablelen; ++i) {
+    nghttp2_hd_map_bucket b = tbl->table[i];
+
+    if (b.ent == NULL) {
+      continue;
+    }
+
+    b.psl = 0;
+    hd_map_table_place(&ntbl, b);
+  }
+
+  nghttp2_mem_free(mem, tbl->table);
+  *tbl = ntbl;
+
+  return 0;
+}
+
+static nghttp2_hd_map_bucket *hd_map_table_find(nghttp2_hd_map_table *tbl,
+                                                uint32_t hash,
+                                                const nghttp2_nv *nv,
+                                                int32_t token, int name_only) {
+  size_t mask, idx;
+  uint32_t psl = 0;
+  nghttp2_hd_map_bucket *b;
+
+  if (tbl->size == 0) {
+    return NULL;
+  }
+
+  mask = tbl->tablelen - 1;
+
+  for (idx = hash & mask;; idx = (idx + 1) & mask, ++psl) {
+    b = &tbl->table[idx];
+
+    if (b->ent == NULL || b->psl < psl) {
+      return NULL;
+    }
+
+    if (b->hash == hash && hd_map_key_eq(b->ent, nv, token, name_only)) {
+      return b;
+    }
+  }
+}
+
+/*
+ * Inserts |ent| to |tbl| under the key whose hash value is |hash|.
+ * If |tbl| already has an entry with the same key, |ent| replaces it.
+ * The room must be reserved beforehand by hd_map_table_reserve().
+ */
+static void hd_map_table_insert(nghttp2_hd_map_table *tbl,
+                                nghttp2_hd_entry *ent, uint32_t hash,
+                                int name_only) {
+  nghttp2_hd_map_bucket *p;
+  nghttp2_hd_map_bucket b;
+
+  p = hd_map_table_find(tbl, hash, &ent->cnv, ent->nv.token, name_only);
+  if (p) {
+    p->ent = ent;
     return;
   }
 
-  /* lower index is linked near the root */
-  ent->next = *bucket;
-  *bucket = ent;
+  b.ent = ent;
+  b.hash = hash;
+  b.psl = 0;
+
+  hd_map_table_place(tbl, b);
 }
 
-static nghttp2_hd_entry *hd_map_find(nghttp2_hd_map *map, int *exact_match,
-                                     const nghttp2_nv *nv, int32_t token,
-                                     uint32_t hash, int name_only) {
-  nghttp2_hd_entry *p;
-  nghttp2_hd_entry *res = NULL;
+/*
+ * Removes |ent| from |tbl|.  It does nothing if the bucket for the
+ * key refers to another entry which was inserted later.
+ */
+static void hd_map_table_remove(nghttp2_hd_map_table *tbl,
+                                nghttp2_hd_entry *ent, uint32_t hash) {
+  size_t mask, idx;
+  uint32_t psl = 0;
+  nghttp2_hd_map_bucket *b, *next;
 
-  *exact_match = 0;
+  if (tbl->size == 0) {
+    return;
+  }
 
-  for (p = map->table[hash & (HD_MAP_SIZE - 1)]; p; p = p->next) {
-    if (token != p->nv.token ||
-        (token == -1 && (hash != p->hash || !name_eq(&p->nv, nv)))) {
-      continue;
+  mask = tbl->tablelen - 1;
+
+  for (idx = hash & mask;; idx = (idx + 1) & mask, ++psl) {
+    b = &tbl->table[idx];
+
+    if (b->ent == NULL || b->psl < psl) {
+      return;
     }
-    if (!res) {
-      res = p;
-      if (name_only) {
-        break;
-      }
+
+    if (b->ent == ent) {
+      break;
     }
-    if (value_eq(&p->nv, nv)) {
-      res = p;
-      *exact_match = 1;
+  }
+
+  /* Shift following buckets backward until we find an empty bucket
+     or the one which is at its initial position. */
+  for (;;) {
+    idx = (idx + 1) & mask;
+    next = &tbl->table[idx];
+
+    if (next->ent == NULL || next->psl == 0) {
+      b->ent = NULL;
       break;
     }
+
+    *b = *next;
+    --b->psl;
+    b = next;
   }
 
-  return res;
+  --tbl->size;
 }
 
-static void hd_map_remove(nghttp2_hd_map *map, nghttp2_hd_entry *ent) {
-  nghttp2_hd_entry **dst;
+/*
+ * Makes sure that one more entry can be inserted to |map|.
+ */
+static int hd_map_reserve(nghttp2_hd_map *map, nghttp2_mem *mem) {
+  int rv;
 
-  dst = &map->table[ent->hash & (HD_MAP_SIZE - 1)];
+  rv = hd_map_table_reserve(&map->name, map->name.size + 1, mem);
+  if (rv != 0) {
+    return rv;
+  }
 
-  for (; *dst; dst = &(*dst)->next) {
-    if (*dst != ent) {
-      continue;
+  return hd_map_table_reserve(&map->nv, map->nv.size + 1, mem);
+}
+
+static void hd_map_insert(nghttp2_hd_map *map, nghttp2_hd_entry *ent) {
+  hd_map_table_insert(&map->name, ent, ent->hash, 1);
+  hd_map_table_insert(&map->nv, ent, ent->nv_hash, 0);
+}
+
+/*
+ * Finds the most recently inserted entry which has the same name and
+ * value as |nv|, and if found, sets |*exact_match| to 1.  Otherwise,
+ * the most recently inserted entry which has the same name is
+ * returned.  If |name_only| is nonzero, value is not considered, and
+ * |nvhash| is not used.
+ */
+static nghttp2_hd_entry *hd_map_find(nghttp2_hd_map *map, int *exact_match,
+                                     const nghttp2_nv *nv, int32_t token,
+                                     uint32_t hash, uint32_t nvhash,
+                                     int name_only) {
+  nghttp2_hd_map_bucket *b;
+
+  *exact_match = 0;
+
+  if (!name_only) {
+    b = hd_map_table_find(&map->nv, nvhash, nv, token, 0);
+    if (b) {
+      *exact_match = 1;
+      return b->ent;
     }
+  }
 
-    *dst = ent->next;
-    ent->next = NULL;
-    return;
+  b = hd_map_table_find(&map->name, hash, nv, token, 1);
+  if (b) {
+    return b->ent;
   }
+
+  return NULL;
+}
+
+static void hd_map_remove(nghttp2_hd_map *map, nghttp2_hd_entry *ent) {
+  hd_map_table_remove(&map->name, ent, ent->hash);
+  hd_map_table_remove(&map->nv, ent, ent->nv_hash);
 }
 
 static int hd_ringbuf_init(nghttp2_hd_ringbuf *ringbuf, size_t bufsize,
@@ -631,25 +884,20 @@ static void hd_ringbuf_free(nghttp2_hd_ringbuf *ringbuf, nghttp2_mem *mem) {
     nghttp2_hd_entry *ent = hd_ringbuf_get(ringbuf, i);
 
     nghttp2_hd_entry_free(ent);
-    nghttp2_mem_free(mem, ent);
   }
   nghttp2_mem_free(mem, ringbuf->buffer);
 }
 
-static int hd_ringbuf_push_front(nghttp2_hd_ringbuf *ringbuf,
-                                 nghttp2_hd_entry *ent, nghttp2_mem *mem) {
-  int rv;
-
-  rv = hd_ringbuf_reserve(ringbuf, ringbuf->len + 1, mem);
-
-  if (rv != 0) {
-    return rv;
-  }
+/*
+ * Pushes |ent| to the front of |ringbuf|.  The room must be reserved
+ * beforehand by hd_ringbuf_reserve().
+ */
+static void hd_ringbuf_push_front(nghttp2_hd_ringbuf *ringbuf,
+                                  nghttp2_hd_entry *ent) {
+  assert(ringbuf->len <= ringbuf->mask);
 
   ringbuf->buffer[--ringbuf->first & ringbuf->mask] = ent;
   ++ringbuf->len;
-
-  return 0;
 }
 
 static void hd_ringbuf_pop_back(nghttp2_hd_ringbuf *ringbuf) {
@@ -657,10 +905,149 @@ static void hd_ringbuf_pop_back(nghttp2_hd_ringbuf *ringbuf) {
   --ringbuf->len;
 }
 
+/*
+ * Returns the pointer to the room of |size| bytes in the arena of
+ * |context| right after the newest entry, or NULL if there is no such
+ * contiguous room.
+ */
+static uint8_t *hd_arena_find_room(nghttp2_hd_context *context,
+                                   size_t size) {
+  nghttp2_hd_ringbuf *ringbuf = &context->hd_table;
+  nghttp2_hd_entry *newest;
+  uint8_t *first, *last, *end;
+
+  if (ringbuf->len == 0) {
+    return size <= context->arenalen ? context->arena : NULL;
+  }
+
+  first = (uint8_t *)hd_ringbuf_get(ringbuf, ringbuf->len - 1);
+  newest = hd_ringbuf_get(ringbuf, 0);
+  last = (uint8_t *)newest + hd_entry_arena_size(newest);
+  end = context->arena + context->arenalen;
+
+  if (last > first) {
+    if ((size_t)(end - last) >= size) {
+      return last;
+    }
+    /* Wrap around, leaving the rest of the buffer unused until the
+       oldest entry goes past it. */
+    if ((size_t)(first - context->arena) >= size) {
+      return context->arena;
+    }
+    return NULL;
+  }
+
+  if ((size_t)(first - last) >= size) {
+    return last;
+  }
+
+  return NULL;
+}
+
+/*
+ * Reallocates the arena of |context| so that it has at least |size|
+ * bytes of contiguous room after the existing entries.  The entries
+ * are moved to the new arena in order, and the references to them in
+ * hd_table and |map|, if it is not NULL, are updated.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory
+ */
+static int hd_arena_grow(nghttp2_hd_context *context, nghttp2_hd_map *map,
+                         size_t size) {
+  nghttp2_hd_ringbuf *ringbuf = &context->hd_table;
+  nghttp2_hd_map_table *tbls[2];
+  uint8_t *arena, *p;
+  size_t arenalen, used, n;
+  size_t i, j, k;
+
+  used = 0;
+  for (i = 0; i < ringbuf->len; ++i) {
+    used += hd_entry_arena_size(hd_ringbuf_get(ringbuf, i));
+  }
+
+  if (context->arenalen) {
+    arenalen = context->arenalen * 2;
+  } else {
+    arenalen = nghttp2_max(context->hd_table_bufsize_max, NGHTTP2_HD_ARENA_MIN);
+  }
+  for (; arenalen < used + size; arenalen *= 2)
+    ;
+
+  arena = nghttp2_mem_malloc(context->mem, arenalen);
+  if (arena == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  DEBUGF("hpack: grow arena %zu -> %zu bytes\n", context->arenalen, arenalen);
+
+  p = arena;
+  for (i = ringbuf->len; i > 0; --i) {
+    nghttp2_hd_entry *ent = hd_ringbuf_get(ringbuf, i - 1);
+
+    n = hd_entry_arena_size(ent);
+    memcpy(p, ent, n);
+    ent = (nghttp2_hd_entry *)(void *)p;
+    if (ent->nv.name == NULL) {
+      hd_entry_set_inline_nv(ent);
+    }
+    ringbuf->buffer[(ringbuf->first + i - 1) & ringbuf->mask] = ent;
+    p += n;
+  }
+
+  if (map) {
+    /* The buckets still refer to the entries in the old arena.  Their
+       new location is found by their sequence number. */
+    tbls[0] = &map->name;
+    tbls[1] = &map->nv;
+
+    for (k = 0; k < 2; ++k) {
+      for (j = 0; j < tbls[k]->tablelen; ++j) {
+        nghttp2_hd_map_bucket *b = &tbls[k]->table[j];
+
+        if (b->ent == NULL) {
+          continue;
+        }
+
+        b->ent =
+            hd_ringbuf_get(ringbuf, context->next_seq - 1 - b->ent->seq);
+      }
+    }
+  }
+
+  nghttp2_mem_free(context->mem, context->arena);
+
+  context->arena = arena;
+  context->arenalen = arenalen;
+
+  return 0;
+}
+
+/*
+ * Frees the arena of |context| if hd_table is empty.  It is allocated
+ * again when a new entry is added, so that the arena does not keep
+ * the size for the larger table after the table size is reduced.
+ */
+static void hd_arena_release(nghttp2_hd_context *context) {
+  if (context->hd_table.len) {
+    return;
+  }
+
+  nghttp2_mem_free(context->mem, context->arena);
+  context->arena = NULL;
+  context->arenalen = 0;
+}
+
 static int hd_context_init(nghttp2_hd_context *context, nghttp2_mem *mem) {
   int rv;
   context->mem = mem;
   context->bad = 0;
+  context->arena = NULL;
+  context->arenalen = 0;
+  context->inline_nv = 0;
   context->hd_table_bufsize_max = NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE;
   rv = hd_ringbuf_init(&context->hd_table, context->hd_table_bufsize_max /
                                                NGHTTP2_HD_ENTRY_OVERHEAD,
@@ -677,6 +1064,7 @@ static int hd_context_init(nghttp2_hd_context *context, nghttp2_mem *mem) {
 
 static void hd_context_free(nghttp2_hd_context *context) {
   hd_ringbuf_free(&context->hd_table, context->mem);
+  nghttp2_mem_free(context->mem, context->arena);
 }
 
 int nghttp2_hd_deflate_init(nghttp2_hd_deflater *deflater, nghttp2_mem *mem) {
@@ -695,6 +1083,17 @@ int nghttp2_hd_deflate_init2(nghttp2_hd_deflater *deflater,
 
   hd_map_init(&deflater->map);
 
+  deflater->seen = NULL;
+  deflater->memo = NULL;
+  deflater->memonext = 0;
+  deflater->indexing_deferred = 0;
+  deflater->uncompressed_length = 0;
+  deflater->compressed_length = 0;
+
+  /* The deflater never hands out the buffers of its entries, so they
+     can be stored inline. */
+  deflater->ctx.inline_nv = 1;
+
   if (max_deflate_dynamic_table_size < NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE) {
     deflater->notify_table_size_change = 1;
     deflater->ctx.hd_table_bufsize_max = max_deflate_dynamic_table_size;
@@ -731,12 +1130,17 @@ int nghttp2_hd_inflate_init(nghttp2_hd_inflater *inflater, nghttp2_mem *mem) {
   inflater->namercbuf = NULL;
   inflater->valuercbuf = NULL;
 
+  memset(&inflater->name_view, 0, sizeof(inflater->name_view));
+  inflater->name_view.ref = -1;
+  inflater->value_view = inflater->name_view;
+
   inflater->huffman_encoded = 0;
   inflater->index = 0;
   inflater->left = 0;
   inflater->shift = 0;
   inflater->index_required = 0;
   inflater->no_index = 0;
+  inflater->no_copy = 0;
 
   return 0;
 
@@ -752,7 +1156,15 @@ static void hd_inflate_keep_free(nghttp2_hd_inflater *inflater) {
   inflater->nv_name_keep = NULL;
 }
 
+static void hd_memo_clear(nghttp2_hd_deflater *deflater);
+
 void nghttp2_hd_deflate_free(nghttp2_hd_deflater *deflater) {
+  if (deflater->memo) {
+    hd_memo_clear(deflater);
+    nghttp2_mem_free(deflater->ctx.mem, deflater->memo);
+  }
+  nghttp2_mem_free(deflater->ctx.mem, deflater->seen);
+  hd_map_free(&deflater->map, deflater->ctx.mem);
   hd_context_free(&deflater->ctx);
 }
 
@@ -770,8 +1182,8 @@ static size_t entry_room(size_t namelen, size_t valuelen) {
 }
 
 static void emit_header(nghttp2_hd_nv *nv_out, nghttp2_hd_nv *nv) {
-  DEBUGF("inflatehd: header emission: %s: %s\n", nv->name->base,
-         nv->value->base);
+  DEBUGF("inflatehd: header emission: %.*s: %.*s\n", (int)nv->name->len,
+         nv->name->base, (int)nv->value->len, nv->value->base);
   /* ent->ref may be 0. This happens if the encoder emits literal
      block larger than header table capacity with indexing. */
   *nv_out = *nv;
@@ -954,6 +1366,55 @@ static int emit_indexed_block(nghttp2_bufs *bufs, size_t idx) {
   return 0;
 }
 
+/*
+ * Emits |str| of length |len| directly into the current buffer of
+ * |bufs|, which must have at least count_encoded_length(|len|, 7) +
+ * |len| bytes available.  The string is huffman encoded right after
+ * the space reserved for the length prefix, and the encoding is
+ * abandoned once it becomes no shorter than |len|.  This way, the
+ * string is scanned only once to decide the representation.
+ */
+static void emit_string_fast(nghttp2_bufs *bufs, const uint8_t *str,
+                             size_t len) {
+  nghttp2_buf *buf = &bufs->cur->buf;
+  size_t blocklen;
+  size_t hblocklen;
+  ssize_t enclen;
+
+  blocklen = count_encoded_length(len, 7);
+
+  enclen = len == 0 ? -1 : nghttp2_hd_huff_encode_buf(buf->last + blocklen,
+                                                       len - 1, str, len);
+
+  if (enclen < 0) {
+    DEBUGF("deflatehd: emit string str=%.*s, length=%zu, huffman=0, "
+           "encoded_length=%zu\n",
+           (int)len, (const char *)str, len, len);
+
+    *buf->last = 0;
+    encode_length(buf->last, len, 7);
+    buf->last += blocklen;
+    buf->last = nghttp2_cpymem(buf->last, str, len);
+
+    return;
+  }
+
+  DEBUGF("deflatehd: emit string str=%.*s, length=%zu, huffman=1, "
+         "encoded_length=%zd\n",
+         (int)len, (const char *)str, len, enclen);
+
+  /* The length prefix of huffman encoded string may be shorter than
+     the reserved one. */
+  hblocklen = count_encoded_length((size_t)enclen, 7);
+  if (hblocklen < blocklen) {
+    memmove(buf->last + hblocklen, buf->last + blocklen, (size_t)enclen);
+  }
+
+  *buf->last = 1 << 7;
+  encode_length(buf->last, (size_t)enclen, 7);
+  buf->last += hblocklen + (size_t)enclen;
+}
+
 static int emit_string(nghttp2_bufs *bufs, const uint8_t *str, size_t len) {
   int rv;
   uint8_t sb[16];
@@ -962,6 +1423,11 @@ static int emit_string(nghttp2_bufs *bufs, const uint8_t *str, size_t len) {
   size_t enclen;
   int huffman = 0;
 
+  if (nghttp2_bufs_cur_avail(bufs) >= count_encoded_length(len, 7) + len) {
+    emit_string_fast(bufs, str, len);
+    return 0;
+  }
+
   enclen = nghttp2_hd_huff_encode_count(str, len);
 
   if (enclen < len) {
@@ -1085,10 +1551,11 @@ static int emit_newname_block(nghttp2_bufs *bufs, const nghttp2_nv *nv,
 
 static int add_hd_table_incremental(nghttp2_hd_context *context,
                                     nghttp2_hd_nv *nv, nghttp2_hd_map *map,
-                                    uint32_t hash) {
+                                    uint32_t hash, uint32_t nvhash) {
   int rv;
   nghttp2_hd_entry *new_ent;
-  size_t room;
+  size_t room, size;
+  uint8_t *p;
   nghttp2_mem *mem;
 
   mem = context->mem;
@@ -1101,10 +1568,11 @@ static int add_hd_table_incremental(nghttp2_hd_context *context,
     nghttp2_hd_entry *ent = hd_ringbuf_get(&context->hd_table, idx);
 
     context->hd_table_bufsize -=
-        entry_room(ent->nv.name->len, ent->nv.value->len);
+        entry_room(ent->cnv.namelen, ent->cnv.valuelen);
 
-    DEBUGF("hpack: remove item from header table: %s: %s\n",
-           (char *)ent->nv.name->base, (char *)ent->nv.value->base);
+    DEBUGF("hpack: remove item from header table: %.*s: %.*s\n",
+           (int)ent->cnv.namelen, ent->cnv.name, (int)ent->cnv.valuelen,
+           ent->cnv.value);
 
     hd_ringbuf_pop_back(&context->hd_table);
     if (map) {
@@ -1112,7 +1580,6 @@ static int add_hd_table_incremental(nghttp2_hd_context *context,
     }
 
     nghttp2_hd_entry_free(ent);
-    nghttp2_mem_free(mem, ent);
   }
 
   if (room > context->hd_table_bufsize_max) {
@@ -1121,24 +1588,41 @@ static int add_hd_table_incremental(nghttp2_hd_context *context,
     return 0;
   }
 
-  new_ent = nghttp2_mem_malloc(mem, sizeof(nghttp2_hd_entry));
-  if (new_ent == NULL) {
-    return NGHTTP2_ERR_NOMEM;
+  if (map) {
+    rv = hd_map_reserve(map, mem);
+    if (rv != 0) {
+      return rv;
+    }
   }
 
-  nghttp2_hd_entry_init(new_ent, nv);
+  rv = hd_ringbuf_reserve(&context->hd_table, context->hd_table.len + 1, mem);
+  if (rv != 0) {
+    return rv;
+  }
 
-  rv = hd_ringbuf_push_front(&context->hd_table, new_ent, mem);
+  size = entry_arena_size(
+      context->inline_nv ? nv->name->len + nv->value->len + 2 : 0);
 
-  if (rv != 0) {
-    nghttp2_hd_entry_free(new_ent);
-    nghttp2_mem_free(mem, new_ent);
+  p = hd_arena_find_room(context, size);
+  if (p == NULL) {
+    rv = hd_arena_grow(context, map, size);
+    if (rv != 0) {
+      return rv;
+    }
 
-    return rv;
+    p = hd_arena_find_room(context, size);
+    assert(p);
   }
 
+  new_ent = (nghttp2_hd_entry *)(void *)p;
+
+  nghttp2_hd_entry_init(new_ent, nv, context->inline_nv);
+
+  hd_ringbuf_push_front(&context->hd_table, new_ent);
+
   new_ent->seq = context->next_seq++;
   new_ent->hash = hash;
+  new_ent->nv_hash = nvhash;
 
   if (map) {
     hd_map_insert(map, new_ent);
@@ -1182,14 +1666,14 @@ static search_result search_static_table(const nghttp2_nv *nv, int32_t token,
 static search_result search_hd_table(nghttp2_hd_context *context,
                                      const nghttp2_nv *nv, int32_t token,
                                      int indexing_mode, nghttp2_hd_map *map,
-                                     uint32_t hash) {
+                                     uint32_t hash, uint32_t nvhash) {
   search_result res = {-1, 0};
   nghttp2_hd_entry *ent;
   int exact_match;
   int name_only = indexing_mode == NGHTTP2_HD_NEVER_INDEXING;
 
   exact_match = 0;
-  ent = hd_map_find(map, &exact_match, nv, token, hash, name_only);
+  ent = hd_map_find(map, &exact_match, nv, token, hash, nvhash, name_only);
 
   if (!exact_match && token >= 0 && token <= NGHTTP2_TOKEN_WWW_AUTHENTICATE) {
     return search_static_table(nv, token, name_only);
@@ -1208,24 +1692,21 @@ static search_result search_hd_table(nghttp2_hd_context *context,
 
 static void hd_context_shrink_table_size(nghttp2_hd_context *context,
                                          nghttp2_hd_map *map) {
-  nghttp2_mem *mem;
-
-  mem = context->mem;
-
   while (context->hd_table_bufsize > context->hd_table_bufsize_max &&
          context->hd_table.len > 0) {
     size_t idx = context->hd_table.len - 1;
     nghttp2_hd_entry *ent = hd_ringbuf_get(&context->hd_table, idx);
     context->hd_table_bufsize -=
-        entry_room(ent->nv.name->len, ent->nv.value->len);
+        entry_room(ent->cnv.namelen, ent->cnv.valuelen);
     hd_ringbuf_pop_back(&context->hd_table);
     if (map) {
       hd_map_remove(map, ent);
     }
 
     nghttp2_hd_entry_free(ent);
-    nghttp2_mem_free(mem, ent);
   }
+
+  hd_arena_release(context);
 }
 
 int nghttp2_hd_deflate_change_table_size(
@@ -1241,6 +1722,12 @@ int nghttp2_hd_deflate_change_table_size(
   deflater->notify_table_size_change = 1;
 
   hd_context_shrink_table_size(&deflater->ctx, &deflater->map);
+
+  if (deflater->memo) {
+    /* Memoized header blocks may refer to evicted entries */
+    hd_memo_clear(deflater);
+  }
+
   return 0;
 }
 
@@ -1323,6 +1810,23 @@ static int hd_deflate_decide_indexing(nghttp2_hd_deflater *deflater,
   return NGHTTP2_HD_WITH_INDEXING;
 }
 
+/*
+ * Returns nonzero if the name/value pair hashed to |nvhash| has been
+ * seen recently.  Otherwise remembers it and returns 0.
+ */
+static int hd_deflate_seen(nghttp2_hd_deflater *deflater, uint32_t nvhash) {
+  uint32_t *slot =
+      &deflater->seen[nvhash & (NGHTTP2_HD_SEEN_TABLE_LENGTH - 1)];
+
+  if (*slot == nvhash) {
+    return 1;
+  }
+
+  *slot = nvhash;
+
+  return 0;
+}
+
 static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
                       const nghttp2_nv *nv) {
   int rv;
@@ -1330,19 +1834,17 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
   ssize_t idx;
   int indexing_mode;
   int32_t token;
-  nghttp2_mem *mem;
-  uint32_t hash = 0;
+  uint32_t hash;
+  uint32_t nvhash = 0;
 
   DEBUGF("deflatehd: deflating %.*s: %.*s\n", (int)nv->namelen, nv->name,
          (int)nv->valuelen, nv->value);
 
-  mem = deflater->ctx.mem;
-
   token = lookup_token(nv->name, nv->namelen);
-  if (token == -1) {
-    hash = name_hash(nv);
-  } else if (token <= NGHTTP2_TOKEN_WWW_AUTHENTICATE) {
+  if (token >= 0 && token <= NGHTTP2_TOKEN_WWW_AUTHENTICATE) {
     hash = static_table[token].hash;
+  } else {
+    hash = name_hash(nv);
   }
 
   /* Don't index authorization header field since it may contain low
@@ -1356,8 +1858,12 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
           ? NGHTTP2_HD_NEVER_INDEXING
           : hd_deflate_decide_indexing(deflater, nv, token);
 
+  if (indexing_mode != NGHTTP2_HD_NEVER_INDEXING) {
+    nvhash = nv_hash(hash, nv);
+  }
+
   res = search_hd_table(&deflater->ctx, nv, token, indexing_mode,
-                        &deflater->map, hash);
+                        &deflater->map, hash, nvhash);
 
   idx = res.index;
 
@@ -1377,33 +1883,34 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
     DEBUGF("deflatehd: name match index=%zd\n", res.index);
   }
 
-  if (indexing_mode == NGHTTP2_HD_WITH_INDEXING) {
-    nghttp2_hd_nv hd_nv;
+  /* With adaptive indexing, a header field is indexed when it is
+     seen for the second time.  Request IDs, timestamps and the like
+     are never reused, and are not worth a slot in the dynamic
+     table. */
+  if (indexing_mode == NGHTTP2_HD_WITH_INDEXING && deflater->seen &&
+      !hd_deflate_seen(deflater, nvhash)) {
+    DEBUGF("deflatehd: first seen, not indexed\n");
 
-    if (idx != -1 && idx < (ssize_t)NGHTTP2_STATIC_TABLE_LENGTH) {
-      hd_nv.name = nghttp2_hd_table_get(&deflater->ctx, (size_t)idx).name;
-      nghttp2_rcbuf_incref(hd_nv.name);
-    } else {
-      rv = nghttp2_rcbuf_new2(&hd_nv.name, nv->name, nv->namelen, mem);
-      if (rv != 0) {
-        return rv;
-      }
-    }
+    indexing_mode = NGHTTP2_HD_WITHOUT_INDEXING;
+    deflater->indexing_deferred = 1;
+  }
 
-    rv = nghttp2_rcbuf_new2(&hd_nv.value, nv->value, nv->valuelen, mem);
+  if (indexing_mode == NGHTTP2_HD_WITH_INDEXING) {
+    nghttp2_hd_nv hd_nv;
+    nghttp2_rcbuf name, value;
 
-    if (rv != 0) {
-      nghttp2_rcbuf_decref(hd_nv.name);
-      return rv;
-    }
+    /* The deflater stores name and value inline, so that they are
+       copied from |nv| directly. */
+    rcbuf_wrap(&name, nv->name, nv->namelen);
+    rcbuf_wrap(&value, nv->value, nv->valuelen);
 
+    hd_nv.name = &name;
+    hd_nv.value = &value;
     hd_nv.token = token;
     hd_nv.flags = NGHTTP2_NV_FLAG_NONE;
 
-    rv = add_hd_table_incremental(&deflater->ctx, &hd_nv, &deflater->map, hash);
-
-    nghttp2_rcbuf_decref(hd_nv.value);
-    nghttp2_rcbuf_decref(hd_nv.name);
+    rv = add_hd_table_incremental(&deflater->ctx, &hd_nv, &deflater->map, hash,
+                                  nvhash);
 
     if (rv != 0) {
       return NGHTTP2_ERR_HEADER_COMP;
@@ -1421,16 +1928,128 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
   return 0;
 }
 
+static void hd_memo_clear(nghttp2_hd_deflater *deflater) {
+  size_t i;
+
+  for (i = 0; i < NGHTTP2_HD_MEMO_LENGTH; ++i) {
+    nghttp2_mem_free(deflater->ctx.mem, deflater->memo[i].nva);
+    deflater->memo[i].nva = NULL;
+  }
+}
+
+/*
+ * Returns the memoized header block of the header list |nva| of
+ * length |nvlen|, or NULL if it is not found.
+ */
+static nghttp2_hd_memo *hd_memo_find(nghttp2_hd_deflater *deflater,
+                                     const nghttp2_nv *nva, size_t nvlen) {
+  size_t i, j;
+  nghttp2_hd_memo *memo;
+  const nghttp2_nv *a, *b;
+
+  for (i = 0; i < NGHTTP2_HD_MEMO_LENGTH; ++i) {
+    memo = &deflater->memo[i];
+
+    if (memo->nva == NULL || memo->nvlen != nvlen) {
+      continue;
+    }
+
+    for (j = 0; j < nvlen; ++j) {
+      a = &memo->nva[j];
+      b = &nva[j];
+
+      /* Application may give NULL for empty name or value */
+      if (a->namelen != b->namelen || a->valuelen != b->valuelen ||
+          ((a->flags ^ b->flags) & NGHTTP2_NV_FLAG_NO_INDEX) ||
+          (a->valuelen && memcmp(a->value, b->value, a->valuelen) != 0) ||
+          (a->namelen && memcmp(a->name, b->name, a->namelen) != 0)) {
+        break;
+      }
+    }
+
+    if (j == nvlen) {
+      return memo;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Memoizes the header list |nva| of length |nvlen|, whose encoded
+ * header block is stored in |bufs| after the first |offset| bytes.
+ * The total length of names and values is |nvbytes|.  The least
+ * recently added slot is replaced.  Since memoization is just an
+ * optimization, failing to allocate memory is not an error.
+ */
+static void hd_memo_add(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
+                        size_t offset, const nghttp2_nv *nva, size_t nvlen,
+                        size_t nvbytes) {
+  nghttp2_mem *mem = deflater->ctx.mem;
+  nghttp2_hd_memo *memo = &deflater->memo[deflater->memonext];
+  size_t outlen = nghttp2_bufs_len(bufs) - offset;
+  nghttp2_buf_chain *ci;
+  nghttp2_nv *nv;
+  uint8_t *p;
+  size_t i, n;
+
+  nghttp2_mem_free(mem, memo->nva);
+
+  memo->nva = nghttp2_mem_malloc(mem, sizeof(nghttp2_nv) * nvlen + nvbytes +
+                                          outlen);
+  if (memo->nva == NULL) {
+    return;
+  }
+
+  deflater->memonext = (deflater->memonext + 1) % NGHTTP2_HD_MEMO_LENGTH;
+
+  p = (uint8_t *)(memo->nva + nvlen);
+
+  for (i = 0; i < nvlen; ++i) {
+    nv = &memo->nva[i];
+
+    nv->name = p;
+    nv->namelen = nva[i].namelen;
+    p = nghttp2_cpymem(p, nva[i].name, nva[i].namelen);
+    nv->value = p;
+    nv->valuelen = nva[i].valuelen;
+    p = nghttp2_cpymem(p, nva[i].value, nva[i].valuelen);
+    nv->flags = nva[i].flags;
+  }
+
+  memo->nvlen = nvlen;
+  memo->out = p;
+  memo->outlen = outlen;
+
+  for (ci = bufs->head; ci; ci = ci->next) {
+    n = nghttp2_buf_len(&ci->buf);
+
+    if (offset >= n) {
+      offset -= n;
+      continue;
+    }
+
+    p = nghttp2_cpymem(p, ci->buf.pos + offset, n - offset);
+    offset = 0;
+  }
+}
+
 int nghttp2_hd_deflate_hd_bufs(nghttp2_hd_deflater *deflater,
                                nghttp2_bufs *bufs, const nghttp2_nv *nv,
                                size_t nvlen) {
   size_t i;
   int rv = 0;
+  size_t buflen, nvoffset;
+  size_t nvbytes = 0;
+  uint32_t next_seq;
+  nghttp2_hd_memo *memo;
 
   if (deflater->ctx.bad) {
     return NGHTTP2_ERR_HEADER_COMP;
   }
 
+  buflen = nghttp2_bufs_len(bufs);
+
   if (deflater->notify_table_size_change) {
     size_t min_hd_table_bufsize_max;
 
@@ -1455,6 +2074,32 @@ int nghttp2_hd_deflate_hd_bufs(nghttp2_hd_deflater *deflater,
     }
   }
 
+  for (i = 0; i < nvlen; ++i) {
+    nvbytes += nv[i].namelen + nv[i].valuelen;
+  }
+
+  deflater->uncompressed_length += nvbytes;
+
+  if (deflater->memo) {
+    memo = hd_memo_find(deflater, nv, nvlen);
+    if (memo) {
+      DEBUGF("deflatehd: emit memoized header block\n");
+
+      rv = nghttp2_bufs_add(bufs, memo->out, memo->outlen);
+      if (rv != 0) {
+        goto fail;
+      }
+
+      deflater->compressed_length += nghttp2_bufs_len(bufs) - buflen;
+
+      return 0;
+    }
+  }
+
+  nvoffset = nghttp2_bufs_len(bufs);
+  next_seq = deflater->ctx.next_seq;
+  deflater->indexing_deferred = 0;
+
   for (i = 0; i < nvlen; ++i) {
     rv = deflate_nv(deflater, bufs, &nv[i]);
     if (rv != 0) {
@@ -1462,6 +2107,18 @@ int nghttp2_hd_deflate_hd_bufs(nghttp2_hd_deflater *deflater,
     }
   }
 
+  deflater->compressed_length += nghttp2_bufs_len(bufs) - buflen;
+
+  if (deflater->memo) {
+    if (deflater->ctx.next_seq != next_seq) {
+      /* Indices of the existing entries have changed */
+      hd_memo_clear(deflater);
+    } else if (!deflater->indexing_deferred &&
+               nvbytes <= NGHTTP2_HD_MEMO_MAX_NVLEN) {
+      hd_memo_add(deflater, bufs, nvoffset, nv, nvlen, nvbytes);
+    }
+  }
+
   DEBUGF("deflatehd: all input name/value pairs were deflated\n");
 
   return 0;
@@ -1709,6 +2366,58 @@ static ssize_t hd_inflate_read(nghttp2_hd_inflater *inflater, nghttp2_buf *buf,
   return (ssize_t)len;
 }
 
+/*
+ * Returns nonzero if the current literal string, whose length is
+ * inflater->left, can be referenced from the input [in, last)
+ * without copying.  This is only possible if the string is not
+ * huffman encoded, it is entirely contained in the input, and it is
+ * not going to be inserted into the dynamic table, which would
+ * outlive the input.
+ */
+static int hd_inflate_can_view(nghttp2_hd_inflater *inflater,
+                               const uint8_t *in, const uint8_t *last) {
+  return inflater->no_copy && !inflater->huffman_encoded &&
+         !inflater->index_required && inflater->left <= (size_t)(last - in);
+}
+
+/*
+ * Makes |view| refer to the |len| bytes starting at |in|.  The empty
+ * string refers to a static buffer, so that base[0] is always
+ * readable.
+ */
+static void hd_inflate_set_view(nghttp2_rcbuf *view, const uint8_t *in,
+                                size_t len) {
+  static const uint8_t empty[] = "";
+
+  view->base = len == 0 ? (uint8_t *)empty : (uint8_t *)in;
+  view->len = len;
+}
+
+/*
+ * Copies the name which refers to the input buffer into the
+ * allocated buffer.  This is required if header emission is not
+ * completed in the current input, because the input is not
+ * available in the next call.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory
+ */
+static int hd_inflate_own_name(nghttp2_hd_inflater *inflater) {
+  nghttp2_rcbuf *view = &inflater->name_view;
+
+  if (inflater->namercbuf != view) {
+    return 0;
+  }
+
+  inflater->namercbuf = NULL;
+
+  return nghttp2_rcbuf_new2(&inflater->namercbuf, view->base, view->len,
+                            inflater->ctx.mem);
+}
+
 /*
  * Finalize indexed header representation reception.  The referenced
  * header is always emitted, and |*nv_out| is filled with that value.
@@ -1747,7 +2456,7 @@ static int hd_inflate_commit_newname(nghttp2_hd_inflater *inflater,
   nv.token = lookup_token(inflater->namercbuf->base, inflater->namercbuf->len);
 
   if (inflater->index_required) {
-    rv = add_hd_table_incremental(&inflater->ctx, &nv, NULL, 0);
+    rv = add_hd_table_incremental(&inflater->ctx, &nv, NULL, 0, 0);
 
     if (rv != 0) {
       return rv;
@@ -1794,7 +2503,7 @@ static int hd_inflate_commit_indname(nghttp2_hd_inflater *inflater,
   nv.value = inflater->valuercbuf;
 
   if (inflater->index_required) {
-    rv = add_hd_table_incremental(&inflater->ctx, &nv, NULL, 0);
+    rv = add_hd_table_incremental(&inflater->ctx, &nv, NULL, 0, 0);
     if (rv != 0) {
       nghttp2_rcbuf_decref(nv.name);
       return NGHTTP2_ERR_NOMEM;
@@ -2000,6 +2709,20 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
         goto almost_ok;
       }
 
+      if (hd_inflate_can_view(inflater, in, last)) {
+        DEBUGF("inflatehd: name refers to input\n");
+
+        hd_inflate_set_view(&inflater->name_view, in, inflater->left);
+        inflater->namercbuf = &inflater->name_view;
+
+        in += inflater->left;
+        inflater->left = 0;
+
+        inflater->state = NGHTTP2_HD_STATE_CHECK_VALUELEN;
+
+        break;
+      }
+
       if (inflater->huffman_encoded) {
         nghttp2_hd_huff_decode_context_init(&inflater->huff_decode_ctx);
 
@@ -2085,6 +2808,31 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
 
       DEBUGF("inflatehd: valuelen=%zu\n", inflater->left);
 
+      if (hd_inflate_can_view(inflater, in, last)) {
+        DEBUGF("inflatehd: value refers to input\n");
+
+        hd_inflate_set_view(&inflater->value_view, in, inflater->left);
+        inflater->valuercbuf = &inflater->value_view;
+
+        in += inflater->left;
+        inflater->left = 0;
+
+        if (inflater->opcode == NGHTTP2_HD_OPCODE_NEWNAME) {
+          rv = hd_inflate_commit_newname(inflater, nv_out);
+        } else {
+          rv = hd_inflate_commit_indname(inflater, nv_out);
+        }
+
+        if (rv != 0) {
+          goto fail;
+        }
+
+        inflater->state = NGHTTP2_HD_STATE_OPCODE;
+        *inflate_flags |= NGHTTP2_HD_INFLATE_EMIT;
+
+        return (ssize_t)(in - first);
+      }
+
       if (inflater->huffman_encoded) {
         nghttp2_hd_huff_decode_context_init(&inflater->huff_decode_ctx);
 
@@ -2182,6 +2930,11 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
 
   DEBUGF("inflatehd: all input bytes were processed\n");
 
+  rv = hd_inflate_own_name(inflater);
+  if (rv != 0) {
+    goto fail;
+  }
+
   if (in_final) {
     DEBUGF("inflatehd: in_final set\n");
 
@@ -2197,6 +2950,11 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
   return (ssize_t)(in - first);
 
 almost_ok:
+  rv = hd_inflate_own_name(inflater);
+  if (rv != 0) {
+    goto fail;
+  }
+
   if (in_final) {
     DEBUGF("inflatehd: input ended prematurely\n");
 
@@ -2213,6 +2971,81 @@ fail:
   return rv;
 }
 
+void nghttp2_hd_inflate_set_no_copy(nghttp2_hd_inflater *inflater, int val) {
+  inflater->no_copy = val != 0;
+}
+
+int nghttp2_hd_inflate_hd_block(nghttp2_hd_inflater *inflater,
+                                nghttp2_nv *nva, size_t *nvlen_ptr,
+                                uint8_t *buf, size_t *buflen_ptr,
+                                const uint8_t *in, size_t inlen) {
+  ssize_t rv;
+  nghttp2_hd_nv hd_nv;
+  int inflate_flags;
+  const uint8_t *last = in + inlen;
+  size_t nvcap = *nvlen_ptr;
+  size_t bufcap = *buflen_ptr;
+  size_t nvlen = 0;
+  size_t buflen = 0;
+  size_t n;
+  uint8_t no_copy = inflater->no_copy;
+  nghttp2_nv *nv;
+
+  /* The whole header block is available, and the header fields are
+     copied into |buf| right away, so the inflater does not have to
+     copy literals by itself. */
+  inflater->no_copy = 1;
+
+  for (;;) {
+    rv = nghttp2_hd_inflate_hd_nv(inflater, &hd_nv, &inflate_flags, in,
+                                  (size_t)(last - in), 1);
+    if (rv < 0) {
+      inflater->no_copy = no_copy;
+      return (int)rv;
+    }
+
+    in += rv;
+
+    if (inflate_flags & NGHTTP2_HD_INFLATE_EMIT) {
+      n = hd_nv.name->len + hd_nv.value->len + 2;
+
+      if (nvlen < nvcap && buflen <= bufcap && bufcap - buflen >= n) {
+        nv = &nva[nvlen];
+
+        nv->name = buf + buflen;
+        nv->namelen = hd_nv.name->len;
+        nv->value = nv->name + nv->namelen + 1;
+        nv->valuelen = hd_nv.value->len;
+        nv->flags = hd_nv.flags;
+
+        *nghttp2_cpymem(nv->name, hd_nv.name->base, nv->namelen) = '\0';
+        *nghttp2_cpymem(nv->value, hd_nv.value->base, nv->valuelen) = '\0';
+      }
+
+      ++nvlen;
+      /* Indexed representation can make the total size much larger
+         than |inlen|. */
+      buflen = SIZE_MAX - buflen < n ? SIZE_MAX : buflen + n;
+    }
+
+    if (inflate_flags & NGHTTP2_HD_INFLATE_FINAL) {
+      nghttp2_hd_inflate_end_headers(inflater);
+      break;
+    }
+  }
+
+  inflater->no_copy = no_copy;
+
+  *nvlen_ptr = nvlen;
+  *buflen_ptr = buflen;
+
+  if (nvlen > nvcap || buflen > bufcap) {
+    return NGHTTP2_ERR_BUFFER_ERROR;
+  }
+
+  return 0;
+}
+
 int nghttp2_hd_inflate_end_headers(nghttp2_hd_inflater *inflater) {
   hd_inflate_keep_free(inflater);
   inflater->state = NGHTTP2_HD_STATE_INFLATE_START;
@@ -2315,6 +3148,68 @@ nghttp2_hd_deflate_get_max_dynamic_table_size(nghttp2_hd_deflater *deflater) {
   return deflater->ctx.hd_table_bufsize_max;
 }
 
+int nghttp2_hd_deflate_set_adaptive_indexing(nghttp2_hd_deflater *deflater,
+                                             int val) {
+  nghttp2_mem *mem = deflater->ctx.mem;
+
+  if (!val) {
+    nghttp2_mem_free(mem, deflater->seen);
+    deflater->seen = NULL;
+
+    return 0;
+  }
+
+  if (deflater->seen) {
+    return 0;
+  }
+
+  deflater->seen = nghttp2_mem_calloc(mem, NGHTTP2_HD_SEEN_TABLE_LENGTH,
+                                      sizeof(uint32_t));
+  if (deflater->seen == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  return 0;
+}
+
+int nghttp2_hd_deflate_set_memoize(nghttp2_hd_deflater *deflater, int val) {
+  nghttp2_mem *mem = deflater->ctx.mem;
+
+  if (!val) {
+    if (deflater->memo) {
+      hd_memo_clear(deflater);
+      nghttp2_mem_free(mem, deflater->memo);
+      deflater->memo = NULL;
+    }
+
+    return 0;
+  }
+
+  if (deflater->memo) {
+    return 0;
+  }
+
+  deflater->memo =
+      nghttp2_mem_calloc(mem, NGHTTP2_HD_MEMO_LENGTH, sizeof(nghttp2_hd_memo));
+  if (deflater->memo == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  deflater->memonext = 0;
+
+  return 0;
+}
+
+uint64_t
+nghttp2_hd_deflate_get_uncompressed_length(nghttp2_hd_deflater *deflater) {
+  return deflater->uncompressed_length;
+}
+
+uint64_t
+nghttp2_hd_deflate_get_compressed_length(nghttp2_hd_deflater *deflater) {
+  return deflater->compressed_length;
+}
+
 size_t nghttp2_hd_inflate_get_num_table_entries(nghttp2_hd_inflater *inflater) {
   return get_max_index(&inflater->ctx);
 }
@@ -38,6 +38,18 @@
 
 #define NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE NGHTTP2_DEFAULT_HEADER_TABLE_SIZE
 #define NGHTTP2_HD_ENTRY_OVERHEAD 32
+/* The minimum size of the arena which stores dynamic table
+   entries */
+#define NGHTTP2_HD_ARENA_MIN 256
+/* The number of slots of the table which remembers recently seen
+   name/value pairs for adaptive indexing.  This must be power of
+   2. */
+#define NGHTTP2_HD_SEEN_TABLE_LENGTH 256
+/* The number of encoded header blocks the deflater memoizes */
+#define NGHTTP2_HD_MEMO_LENGTH 4
+/* The maximum sum of the lengths of names and values in a header list
+   whose encoded header block is memoized */
+#define NGHTTP2_HD_MEMO_MAX_NVLEN 4096
 
 /* The maximum length of one name/value pair.  This is the sum of the
    length of name and value.  This is not specified by the spec. We
@@ -130,19 +142,25 @@ typedef struct {
   uint8_t flags;
 } nghttp2_hd_nv;
 
+/* The dynamic table entry.  It is allocated from the arena in
+   nghttp2_hd_context.  If name and value are stored inline, they
+   follow this struct in the arena, each of them NULL-terminated. */
 struct nghttp2_hd_entry {
-  /* The header field name/value pair */
+  /* The header field name/value pair.  nv.name and nv.value are NULL
+     if name and value are stored inline. */
   nghttp2_hd_nv nv;
-  /* This is solely for nghttp2_hd_{deflate,inflate}_get_table_entry
-     APIs to keep backward compatibility. */
+  /* The header field name/value pair, which always refers to the
+     name and value wherever they are stored.  This is also used for
+     nghttp2_hd_{deflate,inflate}_get_table_entry APIs. */
   nghttp2_nv cnv;
-  /* The next entry which shares same bucket in hash table. */
-  nghttp2_hd_entry *next;
   /* The sequence number.  We will increment it by one whenever we
      store nghttp2_hd_entry to dynamic header table. */
   uint32_t seq;
   /* The hash value for header name (nv.name). */
   uint32_t hash;
+  /* The hash value for header name and value (nv.name and
+     nv.value). */
+  uint32_t nv_hash;
 };
 
 /* The entry used for static header table. */
@@ -195,6 +213,15 @@ typedef struct {
   nghttp2_hd_ringbuf hd_table;
   /* Memory allocator */
   nghttp2_mem *mem;
+  /* The ring-shaped buffer which stores the entries of hd_table.
+     Since entries are evicted in the order of insertion, the region
+     in use is always from the oldest entry to the end of the newest
+     entry, possibly wrapping around at the end of the buffer.  It is
+     allocated lazily, and grows when there is no contiguous room for
+     a new entry. */
+  uint8_t *arena;
+  /* The capacity of arena */
+  size_t arenalen;
   /* Abstract buffer size of hd_table as described in the spec. This
      is the sum of length of name/value in hd_table +
      NGHTTP2_HD_ENTRY_OVERHEAD bytes overhead per each entry. */
@@ -207,15 +234,71 @@ typedef struct {
      further invocation of inflate/deflate will fail with
      NGHTTP2_ERR_HEADER_COMP. */
   uint8_t bad;
+  /* nonzero if name and value of a new entry are copied into the
+     arena.  Otherwise, the entry refers to their nghttp2_rcbuf,
+     which may be shared with the application. */
+  uint8_t inline_nv;
 } nghttp2_hd_context;
 
-#define HD_MAP_SIZE 128
+typedef struct {
+  /* The entry stored in this bucket, or NULL if it is empty */
+  nghttp2_hd_entry *ent;
+  /* The hash value of the key of |ent|.  It is kept here so that
+     probing and rehashing do not have to touch |ent|. */
+  uint32_t hash;
+  /* The distance from the bucket which |hash| initially points
+     to. */
+  uint32_t psl;
+} nghttp2_hd_map_bucket;
+
+/* Open addressing hash table using robin hood hashing.  Each bucket
+   refers to the most recently inserted entry among the entries which
+   share the same key. */
+typedef struct {
+  nghttp2_hd_map_bucket *table;
+  /* The number of buckets, which is 0 or power of 2 */
+  size_t tablelen;
+  /* The number of entries stored */
+  size_t size;
+} nghttp2_hd_map_table;
 
-typedef struct { nghttp2_hd_entry *table[HD_MAP_SIZE]; } nghttp2_hd_map;
+typedef struct {
+  /* Indexes dynamic table entries by name */
+  nghttp2_hd_map_table name;
+  /* Indexes dynamic table entries by name and value */
+  nghttp2_hd_map_table nv;
+} nghttp2_hd_map;
+
+/* Encoded header block of a header list, which can be emitted as is
+   while the dynamic table is not modified. */
+typedef struct {
+  /* Copy of the header list.  The names and values, and the encoded
+     header block follow this array in the same allocation.  NULL if
+     this slot is unused. */
+  nghttp2_nv *nva;
+  size_t nvlen;
+  const uint8_t *out;
+  size_t outlen;
+} nghttp2_hd_memo;
 
 struct nghttp2_hd_deflater {
   nghttp2_hd_context ctx;
   nghttp2_hd_map map;
+  /* Hashes of recently seen name/value pairs, indexed by their lower
+     bits.  This is NULL unless adaptive indexing is enabled.  A pair
+     is only indexed if its hash is found here, so that one-off values
+     do not evict the entries which are actually reused. */
+  uint32_t *seen;
+  /* Array of NGHTTP2_HD_MEMO_LENGTH memoized header blocks.  This is
+     NULL unless memoization is enabled. */
+  nghttp2_hd_memo *memo;
+  /* The index of memo slot to be replaced next */
+  size_t memonext;
+  /* The sum of the lengths of names and values passed to the
+     deflater */
+  uint64_t uncompressed_length;
+  /* The number of bytes the deflater produced */
+  uint64_t compressed_length;
   /* The upper limit of the header table size the deflater accepts. */
   size_t deflate_hd_table_bufsize_max;
   /* Minimum header table size notified in the next context update */
@@ -223,6 +306,10 @@ struct nghttp2_hd_deflater {
   /* If nonzero, send header table size using encoding context update
      in the next deflate process */
   uint8_t notify_table_size_change;
+  /* Nonzero if adaptive indexing did not index a header field in the
+     current header list.  Such header block must not be memoized,
+     because the header field is indexed when it is encoded again. */
+  uint8_t indexing_deferred;
 };
 
 struct nghttp2_hd_inflater {
@@ -232,6 +319,10 @@ struct nghttp2_hd_inflater {
   /* header buffer */
   nghttp2_buf namebuf, valuebuf;
   nghttp2_rcbuf *namercbuf, *valuercbuf;
+  /* Non-refcounted buffers which refer to the input directly when
+     no_copy is enabled.  namercbuf and valuercbuf point to them if
+     the current literal is not copied. */
+  nghttp2_rcbuf name_view, value_view;
   /* Pointer to the name/value pair which are used in the current
      header emission. */
   nghttp2_rcbuf *nv_name_keep, *nv_value_keep;
@@ -255,17 +346,24 @@ struct nghttp2_hd_inflater {
   /* nonzero if deflater requires that current entry must not be
      indexed */
   uint8_t no_index;
+  /* nonzero if literal strings should refer to the input buffer
+     instead of being copied whenever possible */
+  uint8_t no_copy;
 };
 
 /*
- * Initializes the |ent| members.  The reference counts of nv->name
- * and nv->value are increased by one for each.
+ * Initializes the |ent| members.  If |inline_nv| is nonzero, nv->name
+ * and nv->value are copied into the memory right after |ent|, which
+ * must have at least nv->name->len + nv->value->len + 2 bytes.
+ * Otherwise, the reference counts of nv->name and nv->value are
+ * increased by one for each.
  */
-void nghttp2_hd_entry_init(nghttp2_hd_entry *ent, nghttp2_hd_nv *nv);
+void nghttp2_hd_entry_init(nghttp2_hd_entry *ent, nghttp2_hd_nv *nv,
+                           int inline_nv);
 
 /*
  * This function decreases the reference counts of nv->name and
- * nv->value.
+ * nv->value if they are not stored inline.
  */
 void nghttp2_hd_entry_free(nghttp2_hd_entry *ent);
 
@@ -368,7 +466,8 @@ int nghttp2_hd_emit_newname_block(nghttp2_bufs *bufs, nghttp2_nv *nv,
 /* For unittesting purpose */
 int nghttp2_hd_emit_table_size(nghttp2_bufs *bufs, size_t table_size);
 
-/* For unittesting purpose */
+/* For unittesting purpose.  The name and value of the dynamic table
+   entry are NULL if they are stored inline (e.g., in deflater). */
 nghttp2_hd_nv nghttp2_hd_table_get(nghttp2_hd_context *context, size_t index);
 
 /* For unittesting purpose */
@@ -402,6 +501,22 @@ size_t nghttp2_hd_huff_encode_count(const uint8_t *src, size_t len);
 int nghttp2_hd_huff_encode(nghttp2_bufs *bufs, const uint8_t *src,
                            size_t srclen);
 
+/*
+ * Encodes the given data |src| with length |srclen| to the contiguous
+ * buffer |dest| of |destlen| bytes.  Encoding stops as soon as the
+ * result turns out not to fit in |dest|, so giving |srclen| - 1 as
+ * |destlen| tells whether huffman encoding shortens |src| without
+ * counting the length beforehand.
+ *
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * NGHTTP2_ERR_BUFFER_ERROR
+ *     Out of buffer space.
+ */
+ssize_t nghttp2_hd_huff_encode_buf(uint8_t *dest, size_t destlen,
+                                   const uint8_t *src, size_t srclen);
+
 void nghttp2_hd_huff_decode_context_init(nghttp2_hd_huff_decode_context *ctx);
 
 /*
@@ -29,165 +29,137 @@
 #include <stdio.h>
 
 #include "nghttp2_hd.h"
+#include "nghttp2_net.h"
 
-/*
- * Encodes huffman code |sym| into |*dest_ptr|, whose least |rembits|
- * bits are not filled yet.  The |rembits| must be in range [1, 8],
- * inclusive.  At the end of the process, the |*dest_ptr| is updated
- * and points where next output should be placed. The number of
- * unfilled bits in the pointed location is returned.
- */
-static ssize_t huff_encode_sym(nghttp2_bufs *bufs, size_t *avail_ptr,
-                               size_t rembits, const nghttp2_huff_sym *sym) {
-  int rv;
-  size_t nbits = sym->nbits;
-  uint32_t code = sym->code;
+size_t nghttp2_hd_huff_encode_count(const uint8_t *src, size_t len) {
+  size_t i;
+  size_t nbits = 0;
 
-  /* We assume that sym->nbits <= 32 */
-  if (rembits > nbits) {
-    nghttp2_bufs_fast_orb_hold(bufs, (uint8_t)(code << (rembits - nbits)));
-    return (ssize_t)(rembits - nbits);
+  for (i = 0; i < len; ++i) {
+    nbits += huff_sym_table[src[i]].nbits;
   }
+  /* pad the prefix of EOS (256) */
+  return (nbits + 7) / 8;
+}
 
-  if (rembits == nbits) {
-    nghttp2_bufs_fast_orb(bufs, (uint8_t)code);
-    --*avail_ptr;
-    return 8;
-  }
+/*
+ * Appends huffman code |sym| to the accumulator |*code|, which holds
+ * |*nbits| bits aligned to MSB.  The |*nbits| must be less than 32 so
+ * that 30 bits long code always fits.
+ */
+static void huff_accumulate(uint64_t *code, size_t *nbits,
+                            const nghttp2_huff_sym *sym) {
+  *code |= (uint64_t)sym->code << (64 - *nbits - sym->nbits);
+  *nbits += sym->nbits;
+}
 
-  nghttp2_bufs_fast_orb(bufs, (uint8_t)(code >> (nbits - rembits)));
-  --*avail_ptr;
+/*
+ * Returns the last byte of the encoded string, which holds the
+ * remaining |nbits| bits of |code|.  The unused bits are padded with
+ * the prefix of EOS (256), which is all 1s.  The |nbits| must be in
+ * range [1, 7], inclusive.
+ */
+static uint8_t huff_pad_last(uint64_t code, size_t nbits) {
+  return (uint8_t)((uint8_t)(code >> 56) | ((1 << (8 - nbits)) - 1));
+}
 
-  nbits -= rembits;
-  if (nbits & 0x7) {
-    /* align code to MSB byte boundary */
-    code <<= 8 - (nbits & 0x7);
-  }
+int nghttp2_hd_huff_encode(nghttp2_bufs *bufs, const uint8_t *src,
+                           size_t srclen) {
+  int rv;
+  const uint8_t *end = src + srclen;
+  uint64_t code = 0;
+  size_t nbits = 0;
+  size_t avail;
+  uint32_t x;
+  nghttp2_buf *buf;
 
-  if (*avail_ptr < (nbits + 7) / 8) {
-    /* slow path */
-    if (nbits > 24) {
-      rv = nghttp2_bufs_addb(bufs, (uint8_t)(code >> 24));
-      if (rv != 0) {
-        return rv;
-      }
-      nbits -= 8;
-    }
-    if (nbits > 16) {
-      rv = nghttp2_bufs_addb(bufs, (uint8_t)(code >> 16));
-      if (rv != 0) {
-        return rv;
-      }
-      nbits -= 8;
+  avail = nghttp2_bufs_cur_avail(bufs);
+
+  for (; src != end; ++src) {
+    huff_accumulate(&code, &nbits, &huff_sym_table[*src]);
+    if (nbits < 32) {
+      continue;
     }
-    if (nbits > 8) {
-      rv = nghttp2_bufs_addb(bufs, (uint8_t)(code >> 8));
-      if (rv != 0) {
-        return rv;
-      }
-      nbits -= 8;
+
+    if (avail >= 4) {
+      /* fast path: flush whole 32 bits word at once */
+      buf = &bufs->cur->buf;
+      x = htonl((uint32_t)(code >> 32));
+      memcpy(buf->last, &x, sizeof(x));
+      buf->last += sizeof(x);
+      avail -= sizeof(x);
+      code <<= 32;
+      nbits -= 32;
+      continue;
     }
-    if (nbits == 8) {
-      rv = nghttp2_bufs_addb(bufs, (uint8_t)code);
+
+    /* slow path: the current buffer is (almost) full */
+    for (; nbits >= 8; nbits -= 8, code <<= 8) {
+      rv = nghttp2_bufs_addb(bufs, (uint8_t)(code >> 56));
       if (rv != 0) {
         return rv;
       }
-      *avail_ptr = nghttp2_bufs_cur_avail(bufs);
-      return 8;
     }
 
-    rv = nghttp2_bufs_addb_hold(bufs, (uint8_t)code);
+    avail = nghttp2_bufs_cur_avail(bufs);
+  }
+
+  for (; nbits >= 8; nbits -= 8, code <<= 8) {
+    rv = nghttp2_bufs_addb(bufs, (uint8_t)(code >> 56));
     if (rv != 0) {
       return rv;
     }
-    *avail_ptr = nghttp2_bufs_cur_avail(bufs);
-    return (ssize_t)(8 - nbits);
-  }
-
-  /* fast path, since most code is less than 8 */
-  if (nbits < 8) {
-    nghttp2_bufs_fast_addb_hold(bufs, (uint8_t)code);
-    *avail_ptr = nghttp2_bufs_cur_avail(bufs);
-    return (ssize_t)(8 - nbits);
-  }
-
-  /* handle longer code path */
-  if (nbits > 24) {
-    nghttp2_bufs_fast_addb(bufs, (uint8_t)(code >> 24));
-    nbits -= 8;
   }
 
-  if (nbits > 16) {
-    nghttp2_bufs_fast_addb(bufs, (uint8_t)(code >> 16));
-    nbits -= 8;
-  }
-
-  if (nbits > 8) {
-    nghttp2_bufs_fast_addb(bufs, (uint8_t)(code >> 8));
-    nbits -= 8;
-  }
-
-  if (nbits == 8) {
-    nghttp2_bufs_fast_addb(bufs, (uint8_t)code);
-    *avail_ptr = nghttp2_bufs_cur_avail(bufs);
-    return 8;
+  if (nbits) {
+    rv = nghttp2_bufs_addb(bufs, huff_pad_last(code, nbits));
+    if (rv != 0) {
+      return rv;
+    }
   }
 
-  nghttp2_bufs_fast_addb_hold(bufs, (uint8_t)code);
-  *avail_ptr = nghttp2_bufs_cur_avail(bufs);
-  return (ssize_t)(8 - nbits);
+  return 0;
 }
 
-size_t nghttp2_hd_huff_encode_count(const uint8_t *src, size_t len) {
-  size_t i;
+ssize_t nghttp2_hd_huff_encode_buf(uint8_t *dest, size_t destlen,
+                                   const uint8_t *src, size_t srclen) {
+  const uint8_t *end = src + srclen;
+  uint8_t *p = dest;
+  uint8_t *last = dest + destlen;
+  uint64_t code = 0;
   size_t nbits = 0;
+  uint32_t x;
 
-  for (i = 0; i < len; ++i) {
-    nbits += huff_sym_table[src[i]].nbits;
-  }
-  /* pad the prefix of EOS (256) */
-  return (nbits + 7) / 8;
-}
+  for (; src != end; ++src) {
+    huff_accumulate(&code, &nbits, &huff_sym_table[*src]);
+    if (nbits < 32) {
+      continue;
+    }
 
-int nghttp2_hd_huff_encode(nghttp2_bufs *bufs, const uint8_t *src,
-                           size_t srclen) {
-  int rv;
-  ssize_t rembits = 8;
-  size_t i;
-  size_t avail;
+    if (last - p < 4) {
+      return NGHTTP2_ERR_BUFFER_ERROR;
+    }
 
-  avail = nghttp2_bufs_cur_avail(bufs);
+    x = htonl((uint32_t)(code >> 32));
+    memcpy(p, &x, sizeof(x));
+    p += sizeof(x);
+    code <<= 32;
+    nbits -= 32;
+  }
 
-  for (i = 0; i < srclen; ++i) {
-    const nghttp2_huff_sym *sym = &huff_sym_table[src[i]];
-    if (rembits == 8) {
-      if (avail) {
-        nghttp2_bufs_fast_addb_hold(bufs, 0);
-      } else {
-        rv = nghttp2_bufs_addb_hold(bufs, 0);
-        if (rv != 0) {
-          return rv;
-        }
-        avail = nghttp2_bufs_cur_avail(bufs);
-      }
-    }
-    rembits = huff_encode_sym(bufs, &avail, (size_t)rembits, sym);
-    if (rembits < 0) {
-      return (int)rembits;
-    }
+  if ((size_t)(last - p) < (nbits + 7) / 8) {
+    return NGHTTP2_ERR_BUFFER_ERROR;
   }
-  /* 256 is special terminal symbol, pad with its prefix */
-  if (rembits < 8) {
-    /* if rembits < 8, we should have at least 1 buffer space
-       available */
-    const nghttp2_huff_sym *sym = &huff_sym_table[256];
-    assert(avail);
-    /* Caution we no longer adjust avail here */
-    nghttp2_bufs_fast_orb(
-        bufs, (uint8_t)(sym->code >> (sym->nbits - (size_t)rembits)));
+
+  for (; nbits >= 8; nbits -= 8, code <<= 8) {
+    *p++ = (uint8_t)(code >> 56);
   }
 
-  return 0;
+  if (nbits) {
+    *p++ = huff_pad_last(code, nbits);
+  }
+
+  return p - dest;
 }
 
 void nghttp2_hd_huff_decode_context_init(nghttp2_hd_huff_decode_context *ctx) {
@@ -198,34 +170,41 @@ void nghttp2_hd_huff_decode_context_init(nghttp2_hd_huff_decode_context *ctx) {
 ssize_t nghttp2_hd_huff_decode(nghttp2_hd_huff_decode_context *ctx,
                                nghttp2_buf *buf, const uint8_t *src,
                                size_t srclen, int final) {
-  size_t i;
+  const uint8_t *end = src + srclen;
+  const uint8_t *p;
+  const nghttp2_huff_byte_decode *t;
+  uint8_t state = ctx->state;
+  uint8_t *last = buf->last;
 
   /* We use the decoding algorithm described in
-     http://graphics.ics.uci.edu/pub/Prefix.pdf */
-  for (i = 0; i < srclen; ++i) {
-    const nghttp2_huff_decode *t;
-
-    t = &huff_decode_table[ctx->state][src[i] >> 4];
+     http://graphics.ics.uci.edu/pub/Prefix.pdf, but transitions are
+     made per byte rather than per 4 bits, so that each input byte
+     costs one table lookup. */
+  for (p = src; p != end; ++p) {
+    t = &huff_byte_decode_table[state][*p];
     if (t->flags & NGHTTP2_HUFF_FAIL) {
+      buf->last = last;
       return NGHTTP2_ERR_HEADER_COMP;
     }
     if (t->flags & NGHTTP2_HUFF_SYM) {
-      *buf->last++ = t->sym;
+      *last++ = t->sym[0];
+      if (t->flags & NGHTTP2_HUFF_SYM2) {
+        *last++ = t->sym[1];
+      }
     }
 
-    t = &huff_decode_table[t->state][src[i] & 0xf];
-    if (t->flags & NGHTTP2_HUFF_FAIL) {
-      return NGHTTP2_ERR_HEADER_COMP;
-    }
-    if (t->flags & NGHTTP2_HUFF_SYM) {
-      *buf->last++ = t->sym;
-    }
+    state = t->state;
+  }
 
-    ctx->state = t->state;
+  buf->last = last;
+
+  if (p != src) {
+    ctx->state = state;
     ctx->accept = (t->flags & NGHTTP2_HUFF_ACCEPTED) != 0;
   }
+
   if (final && !ctx->accept) {
     return NGHTTP2_ERR_HEADER_COMP;
   }
-  return (ssize_t)i;
+  return (ssize_t)srclen;
 }
@@ -38,7 +38,10 @@ typedef enum {
   /* This state emits symbol */
   NGHTTP2_HUFF_SYM = (1 << 1),
   /* If state machine reaches this state, decoding fails. */
-  NGHTTP2_HUFF_FAIL = (1 << 2)
+  NGHTTP2_HUFF_FAIL = (1 << 2),
+  /* This state emits second symbol.  Only used by
+     huff_byte_decode_table. */
+  NGHTTP2_HUFF_SYM2 = (1 << 3)
 } nghttp2_huff_decode_flag;
 
 typedef struct {
@@ -55,6 +58,18 @@ typedef struct {
 
 typedef nghttp2_huff_decode huff_decode_table_type[16];
 
+typedef struct {
+  /* huffman decoding state after consuming 8 bits.  Its meaning is
+     the same as nghttp2_huff_decode.state. */
+  uint8_t state;
+  /* bitwise OR of zero or more of the nghttp2_huff_decode_flag */
+  uint8_t flags;
+  /* Since the shortest code is 5 bits long, at most 2 symbols are
+     emitted per byte.  sym[0] is valid if NGHTTP2_HUFF_SYM flag set,
+     and sym[1] is valid if NGHTTP2_HUFF_SYM2 flag set. */
+  uint8_t sym[2];
+} nghttp2_huff_byte_decode;
+
 typedef struct {
   /* Current huffman decoding state. We stripped leaf nodes, so the
      value range is [0..255], inclusive. */
@@ -72,6 +87,11 @@ typedef struct {
 } nghttp2_huff_sym;
 
 extern const nghttp2_huff_sym huff_sym_table[];
+/* Transition table which consumes 4 bits at a time.  The decoder
+   uses huff_byte_decode_table, which is derived from the same
+   huffman tree.  This table is kept to verify the latter. */
 extern const nghttp2_huff_decode huff_decode_table[][16];
+/* Transition table which consumes 8 bits at a time */
+extern const nghttp2_huff_byte_decode huff_byte_decode_table[][256];
 
 #endif /* NGHTTP2_HD_HUFFMAN_H */
@@ -28,6 +28,7 @@
 #include <string.h>
 
 #include "nghttp2_net.h"
+#include "nghttp2_simd.h"
 
 void nghttp2_put_uint16be(uint8_t *buf, uint16_t n) {
   uint16_t x = htons(n);
@@ -246,8 +247,11 @@ int nghttp2_increase_local_window_size(int32_t *local_window_size_ptr,
 }
 
 int nghttp2_should_send_window_update(int32_t local_window_size,
-                                      int32_t recv_window_size) {
-  return recv_window_size > 0 && recv_window_size >= local_window_size / 2;
+                                      int32_t recv_window_size,
+                                      uint32_t threshold) {
+  return recv_window_size > 0 &&
+         recv_window_size >=
+             (int64_t)local_window_size * (int64_t)threshold / 100;
 }
 
 const char *nghttp2_strerror(int error_code) {
@@ -416,7 +420,9 @@ int nghttp2_check_header_name(const uint8_t *name, size_t len) {
     ++name;
     --len;
   }
-  for (last = name + len; name != last; ++name) {
+  last = name + len;
+  name += nghttp2_simd_skip_header_name(name, len);
+  for (; name != last; ++name) {
     if (!VALID_HD_NAME_CHARS[*name]) {
       return 0;
     }
@@ -494,7 +500,9 @@ static int VALID_HD_VALUE_CHARS[] = {
 
 int nghttp2_check_header_value(const uint8_t *value, size_t len) {
   const uint8_t *last;
-  for (last = value + len; value != last; ++value) {
+  last = value + len;
+  value += nghttp2_simd_skip_header_value(value, len);
+  for (; value != last; ++value) {
     if (!VALID_HD_VALUE_CHARS[*value]) {
       return 0;
     }
@@ -107,10 +107,12 @@ int nghttp2_increase_local_window_size(int32_t *local_window_size_ptr,
 
 /*
  * Returns non-zero if the function decided that WINDOW_UPDATE should
- * be sent.
+ * be sent.  WINDOW_UPDATE is sent when |recv_window_size| reaches
+ * |threshold| percent of |local_window_size|.
  */
 int nghttp2_should_send_window_update(int32_t local_window_size,
-                                      int32_t recv_window_size);
+                                      int32_t recv_window_size,
+                                      uint32_t threshold);
 
 /*
  * Copies the buffer |src| of length |len| to the destination pointed
@@ -30,6 +30,7 @@
 
 #include "nghttp2_hd.h"
 #include "nghttp2_helper.h"
+#include "nghttp2_simd.h"
 
 static uint8_t downcase(uint8_t c) {
   return 'A' <= c && c <= 'Z' ? (uint8_t)(c - 'A' + 'a') : c;
@@ -373,7 +374,9 @@ static char VALID_AUTHORITY_CHARS[] = {
 
 static int check_authority(const uint8_t *value, size_t len) {
   const uint8_t *last;
-  for (last = value + len; value != last; ++value) {
+  last = value + len;
+  value += nghttp2_simd_skip_authority(value, len);
+  for (; value != last; ++value) {
     if (!VALID_AUTHORITY_CHARS[*value]) {
       return 0;
     }
@@ -27,12 +27,14 @@
 #include <string.h>
 
 #define INITIAL_TABLE_LENGTH 256
+#define INITIAL_TABLE_LENBITS 8
 
 int nghttp2_map_init(nghttp2_map *map, nghttp2_mem *mem) {
   map->mem = mem;
   map->tablelen = INITIAL_TABLE_LENGTH;
+  map->tablelenbits = INITIAL_TABLE_LENBITS;
   map->table =
-      nghttp2_mem_calloc(mem, map->tablelen, sizeof(nghttp2_map_entry *));
+      nghttp2_mem_calloc(mem, map->tablelen, sizeof(nghttp2_map_bucket));
   if (map->table == NULL) {
     return NGHTTP2_ERR_NOMEM;
   }
@@ -50,15 +52,20 @@ void nghttp2_map_each_free(nghttp2_map *map,
                            int (*func)(nghttp2_map_entry *entry, void *ptr),
                            void *ptr) {
   uint32_t i;
+  nghttp2_map_bucket *bkt;
+
   for (i = 0; i < map->tablelen; ++i) {
-    nghttp2_map_entry *entry;
-    for (entry = map->table[i]; entry;) {
-      nghttp2_map_entry *next = entry->next;
-      func(entry, ptr);
-      entry = next;
+    bkt = &map->table[i];
+
+    if (bkt->data == NULL) {
+      continue;
     }
-    map->table[i] = NULL;
+
+    func(bkt->data, ptr);
+    bkt->data = NULL;
   }
+
+  map->size = 0;
 }
 
 int nghttp2_map_each(nghttp2_map *map,
@@ -66,74 +73,102 @@ int nghttp2_map_each(nghttp2_map *map,
                      void *ptr) {
   int rv;
   uint32_t i;
+  nghttp2_map_bucket *bkt;
+
   for (i = 0; i < map->tablelen; ++i) {
-    nghttp2_map_entry *entry;
-    for (entry = map->table[i]; entry; entry = entry->next) {
-      rv = func(entry, ptr);
-      if (rv != 0) {
-        return rv;
-      }
+    bkt = &map->table[i];
+
+    if (bkt->data == NULL) {
+      continue;
+    }
+
+    rv = func(bkt->data, ptr);
+    if (rv != 0) {
+      return rv;
     }
   }
+
   return 0;
 }
 
 void nghttp2_map_entry_init(nghttp2_map_entry *entry, key_type key) {
   entry->key = key;
-  entry->next = NULL;
 }
 
-/* Same hash function in android HashMap source code. */
-/* The |mod| must be power of 2 */
-static uint32_t hash(int32_t key, uint32_t mod) {
-  uint32_t h = (uint32_t)key;
-  h ^= (h >> 20) ^ (h >> 12);
-  h ^= (h >> 7) ^ (h >> 4);
-  return h & (mod - 1);
+/* Fibonacci hashing.  Stream IDs are chosen by the remote endpoint,
+   and idle streams can be created with any ID by PRIORITY.  Taking
+   the low bits of the key as is lets the remote endpoint put them all
+   in one home bucket, which makes every insertion and lookup O(n).
+   Multiplying by 2^32 / golden ratio spreads such keys to the upper
+   bits, which select the bucket. */
+static uint32_t hash(key_type key, uint32_t tablelenbits) {
+  return (uint32_t)((uint32_t)key * 2654435769u) >> (32 - tablelenbits);
 }
 
-static int insert(nghttp2_map_entry **table, uint32_t tablelen,
-                  nghttp2_map_entry *entry) {
-  uint32_t h = hash(entry->key, tablelen);
-  if (table[h] == NULL) {
-    table[h] = entry;
-  } else {
-    nghttp2_map_entry *p;
-    /* We won't allow duplicated key, so check it out. */
-    for (p = table[h]; p; p = p->next) {
-      if (p->key == entry->key) {
-        return NGHTTP2_ERR_INVALID_ARGUMENT;
-      }
+/*
+ * Inserts |entry| using Robin Hood hashing: an entry which is farther
+ * from its home bucket takes over the bucket of an entry which is
+ * nearer, and the latter moves on.  This keeps probe sequences short,
+ * and entries sharing a home bucket adjacent.
+ */
+static int insert(nghttp2_map_bucket *table, uint32_t tablelen,
+                  uint32_t tablelenbits, nghttp2_map_entry *entry) {
+  uint32_t idx = hash(entry->key, tablelenbits);
+  nghttp2_map_bucket b = {entry, entry->key, 0}, t;
+  nghttp2_map_bucket *bkt;
+  int displaced = 0;
+
+  for (;;) {
+    bkt = &table[idx];
+
+    if (bkt->data == NULL) {
+      *bkt = b;
+
+      return 0;
+    }
+
+    /* We won't allow duplicated key, so check it out.  If it exists,
+       it is found before |entry| takes over any bucket. */
+    if (!displaced && bkt->key == b.key) {
+      return NGHTTP2_ERR_INVALID_ARGUMENT;
+    }
+
+    if (bkt->psl < b.psl) {
+      t = *bkt;
+      *bkt = b;
+      b = t;
+      displaced = 1;
     }
-    entry->next = table[h];
-    table[h] = entry;
+
+    ++b.psl;
+    idx = (idx + 1) & (tablelen - 1);
   }
-  return 0;
 }
 
-/* new_tablelen must be power of 2 */
-static int resize(nghttp2_map *map, uint32_t new_tablelen) {
+/* new_tablelen must be power of 2, and new_tablelenbits must be
+   log2(new_tablelen) */
+static int resize(nghttp2_map *map, uint32_t new_tablelen,
+                  uint32_t new_tablelenbits) {
   uint32_t i;
-  nghttp2_map_entry **new_table;
+  nghttp2_map_bucket *new_table;
 
   new_table =
-      nghttp2_mem_calloc(map->mem, new_tablelen, sizeof(nghttp2_map_entry *));
+      nghttp2_mem_calloc(map->mem, new_tablelen, sizeof(nghttp2_map_bucket));
   if (new_table == NULL) {
     return NGHTTP2_ERR_NOMEM;
   }
 
   for (i = 0; i < map->tablelen; ++i) {
-    nghttp2_map_entry *entry;
-    for (entry = map->table[i]; entry;) {
-      nghttp2_map_entry *next = entry->next;
-      entry->next = NULL;
-      /* This function must succeed */
-      insert(new_table, new_tablelen, entry);
-      entry = next;
+    if (map->table[i].data == NULL) {
+      continue;
     }
+    /* This function must succeed */
+    insert(new_table, new_tablelen, new_tablelenbits, map->table[i].data);
   }
+
   nghttp2_mem_free(map->mem, map->table);
   map->tablelen = new_tablelen;
+  map->tablelenbits = new_tablelenbits;
   map->table = new_table;
 
   return 0;
@@ -143,12 +178,12 @@ int nghttp2_map_insert(nghttp2_map *map, nghttp2_map_entry *new_entry) {
   int rv;
   /* Load factor is 0.75 */
   if ((map->size + 1) * 4 > map->tablelen * 3) {
-    rv = resize(map, map->tablelen * 2);
+    rv = resize(map, map->tablelen * 2, map->tablelenbits + 1);
     if (rv != 0) {
       return rv;
     }
   }
-  rv = insert(map->table, map->tablelen, new_entry);
+  rv = insert(map->table, map->tablelen, map->tablelenbits, new_entry);
   if (rv != 0) {
     return rv;
   }
@@ -156,34 +191,96 @@ int nghttp2_map_insert(nghttp2_map *map, nghttp2_map_entry *new_entry) {
   return 0;
 }
 
+/*
+ * Returns the index of the bucket which stores the entry associated
+ * by |key|, or -1 if there is no such entry.
+ */
+static int64_t find(nghttp2_map *map, key_type key) {
+  uint32_t idx = hash(key, map->tablelenbits);
+  uint32_t psl;
+  nghttp2_map_bucket *bkt;
+
+  for (psl = 0;; ++psl) {
+    bkt = &map->table[idx];
+
+    /* The probe ends at an empty bucket, or an entry nearer to its
+       home bucket, which would have been displaced by |key|. */
+    if (bkt->data == NULL || bkt->psl < psl) {
+      return -1;
+    }
+
+    if (bkt->key == key) {
+      return idx;
+    }
+
+    idx = (idx + 1) & (map->tablelen - 1);
+  }
+}
+
 nghttp2_map_entry *nghttp2_map_find(nghttp2_map *map, key_type key) {
-  uint32_t h;
-  nghttp2_map_entry *entry;
-  h = hash(key, map->tablelen);
-  for (entry = map->table[h]; entry; entry = entry->next) {
-    if (entry->key == key) {
-      return entry;
+  uint32_t idx = hash(key, map->tablelenbits);
+  uint32_t psl;
+  nghttp2_map_bucket *bkt;
+
+  /* Same as find(), but tests key first because this is called for
+     every inbound frame.  An empty bucket may still have the key of
+     the removed entry, and its data, which is NULL, is returned. */
+  for (psl = 0;; ++psl) {
+    bkt = &map->table[idx];
+
+    if (bkt->key == key) {
+      return bkt->data;
     }
+
+    if (bkt->data == NULL || bkt->psl < psl) {
+      return NULL;
+    }
+
+    idx = (idx + 1) & (map->tablelen - 1);
   }
-  return NULL;
+}
+
+int nghttp2_map_replace(nghttp2_map *map, nghttp2_map_entry *entry) {
+  int64_t found = find(map, entry->key);
+
+  if (found == -1) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  map->table[found].data = entry;
+
+  return 0;
 }
 
 int nghttp2_map_remove(nghttp2_map *map, key_type key) {
-  uint32_t h;
-  nghttp2_map_entry **dst;
+  int64_t found = find(map, key);
+  uint32_t idx, next;
 
-  h = hash(key, map->tablelen);
+  if (found == -1) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
 
-  for (dst = &map->table[h]; *dst; dst = &(*dst)->next) {
-    if ((*dst)->key != key) {
-      continue;
+  idx = (uint32_t)found;
+
+  /* Shift the following entries of the same cluster back by one
+     bucket.  This avoids tombstones, which would make lookups slower
+     over time. */
+  for (;;) {
+    next = (idx + 1) & (map->tablelen - 1);
+
+    if (map->table[next].data == NULL || map->table[next].psl == 0) {
+      break;
     }
 
-    *dst = (*dst)->next;
-    --map->size;
-    return 0;
+    map->table[idx] = map->table[next];
+    --map->table[idx].psl;
+    idx = next;
   }
-  return NGHTTP2_ERR_INVALID_ARGUMENT;
+
+  map->table[idx].data = NULL;
+  --map->size;
+
+  return 0;
 }
 
 size_t nghttp2_map_size(nghttp2_map *map) { return map->size; }
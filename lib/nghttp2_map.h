@@ -38,19 +38,28 @@
 typedef int32_t key_type;
 
 typedef struct nghttp2_map_entry {
-  struct nghttp2_map_entry *next;
   key_type key;
-#if SIZEOF_INT_P == 4
-  /* we requires 8 bytes aligment */
-  int64_t pad;
-#endif
 } nghttp2_map_entry;
 
+/* The map is an open addressing hash table with linear probing and
+   Robin Hood hashing.  Key is stored in bucket, so that lookup does
+   not touch entries other than the one it returns. */
 typedef struct {
-  nghttp2_map_entry **table;
+  /* The entry stored in this bucket, or NULL if it is empty */
+  nghttp2_map_entry *data;
+  key_type key;
+  /* The distance from the home bucket of key */
+  uint32_t psl;
+} nghttp2_map_bucket;
+
+typedef struct {
+  nghttp2_map_bucket *table;
   nghttp2_mem *mem;
   size_t size;
+  /* The number of buckets, which is power of 2 */
   uint32_t tablelen;
+  /* log2(tablelen) */
+  uint32_t tablelenbits;
 } nghttp2_map;
 
 /*
@@ -118,6 +127,19 @@ nghttp2_map_entry *nghttp2_map_find(nghttp2_map *map, key_type key);
  */
 int nghttp2_map_remove(nghttp2_map *map, key_type key);
 
+/*
+ * Replaces the entry associated by the key |entry->key| with |entry|.
+ * The old entry is not freed by this function.  Unlike removing and
+ * inserting, this function never allocates memory.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_INVALID_ARGUMENT
+ *     The entry associated by |entry->key| does not exist.
+ */
+int nghttp2_map_replace(nghttp2_map *map, nghttp2_map_entry *entry);
+
 /*
  * Returns the number of items stored in the map |map|.
  */
@@ -125,7 +147,8 @@ size_t nghttp2_map_size(nghttp2_map *map);
 
 /*
  * Applies the function |func| to each entry in the |map| with the
- * optional user supplied pointer |ptr|.
+ * optional user supplied pointer |ptr|.  The |func| must not insert
+ * or remove entries.
  *
  * If the |func| returns 0, this function calls the |func| with the
  * next entry. If the |func| returns nonzero, it will not call the
@@ -0,0 +1,171 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_mem_account.h"
+
+#include <string.h>
+
+#include "nghttp2_mem.h"
+
+/* The size of the header placed in front of each allocation.  This
+   keeps the alignment of the returned memory same as malloc on the
+   most platforms. */
+#define NGHTTP2_MEM_ACCOUNT_HEADER_SIZE 16
+
+typedef struct {
+  size_t size;
+  nghttp2_mem_cat cat;
+} nghttp2_mem_account_header;
+
+void nghttp2_mem_account_init(nghttp2_mem_account *account,
+                              const nghttp2_mem *mem) {
+  size_t i;
+
+  memset(account, 0, sizeof(nghttp2_mem_account));
+
+  account->mem = *mem;
+
+  for (i = 0; i < NGHTTP2_MEM_CAT_MAX; ++i) {
+    account->tags[i].account = account;
+    account->tags[i].cat = (nghttp2_mem_cat)i;
+  }
+}
+
+static void *mem_account_data(nghttp2_mem_account_header *hd) {
+  return (uint8_t *)hd + NGHTTP2_MEM_ACCOUNT_HEADER_SIZE;
+}
+
+static nghttp2_mem_account_header *mem_account_get_header(void *ptr) {
+  return (nghttp2_mem_account_header *)(void *)((uint8_t *)ptr -
+                                                NGHTTP2_MEM_ACCOUNT_HEADER_SIZE);
+}
+
+static void mem_account_charge(nghttp2_mem_account *account,
+                               nghttp2_mem_account_header *hd) {
+  account->used[hd->cat] += hd->size;
+  account->total += hd->size;
+}
+
+static void mem_account_discharge(nghttp2_mem_account *account,
+                                  nghttp2_mem_account_header *hd) {
+  account->used[hd->cat] -= hd->size;
+  account->total -= hd->size;
+}
+
+static void *mem_account_malloc(size_t size, void *mem_user_data) {
+  nghttp2_mem_account_tag *tag = mem_user_data;
+  nghttp2_mem_account_header *hd;
+
+  if (size > SIZE_MAX - NGHTTP2_MEM_ACCOUNT_HEADER_SIZE) {
+    return NULL;
+  }
+
+  hd = nghttp2_mem_malloc(&tag->account->mem,
+                          size + NGHTTP2_MEM_ACCOUNT_HEADER_SIZE);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  hd->size = size;
+  hd->cat = tag->cat;
+
+  mem_account_charge(tag->account, hd);
+
+  return mem_account_data(hd);
+}
+
+static void mem_account_free(void *ptr, void *mem_user_data) {
+  nghttp2_mem_account_tag *tag = mem_user_data;
+  nghttp2_mem_account_header *hd;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = mem_account_get_header(ptr);
+
+  mem_account_discharge(tag->account, hd);
+
+  nghttp2_mem_free(&tag->account->mem, hd);
+}
+
+static void *mem_account_calloc(size_t nmemb, size_t size,
+                                void *mem_user_data) {
+  void *ptr;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  ptr = mem_account_malloc(nmemb * size, mem_user_data);
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  memset(ptr, 0, nmemb * size);
+
+  return ptr;
+}
+
+static void *mem_account_realloc(void *ptr, size_t size, void *mem_user_data) {
+  nghttp2_mem_account_tag *tag = mem_user_data;
+  nghttp2_mem_account_header *hd;
+  nghttp2_mem_account_header saved;
+
+  if (ptr == NULL) {
+    return mem_account_malloc(size, mem_user_data);
+  }
+
+  if (size > SIZE_MAX - NGHTTP2_MEM_ACCOUNT_HEADER_SIZE) {
+    return NULL;
+  }
+
+  hd = mem_account_get_header(ptr);
+  saved = *hd;
+
+  hd = nghttp2_mem_realloc(&tag->account->mem, hd,
+                           size + NGHTTP2_MEM_ACCOUNT_HEADER_SIZE);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  /* The category of the original allocation is kept */
+  mem_account_discharge(tag->account, &saved);
+
+  hd->size = size;
+
+  mem_account_charge(tag->account, hd);
+
+  return mem_account_data(hd);
+}
+
+void nghttp2_mem_account_mem_init(nghttp2_mem *mem,
+                                  nghttp2_mem_account *account,
+                                  nghttp2_mem_cat cat) {
+  mem->mem_user_data = &account->tags[cat];
+  mem->malloc = mem_account_malloc;
+  mem->free = mem_account_free;
+  mem->calloc = mem_account_calloc;
+  mem->realloc = mem_account_realloc;
+}
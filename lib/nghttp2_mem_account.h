@@ -0,0 +1,89 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_MEM_ACCOUNT_H
+#define NGHTTP2_MEM_ACCOUNT_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+
+/* The categories of memory which nghttp2_mem_account tracks
+   separately */
+typedef enum {
+  /* Queued outbound frames, the buffer to serialize them, and
+     anything else which does not belong to the other categories */
+  NGHTTP2_MEM_CAT_OUTBOUND,
+  /* Streams and the stream map */
+  NGHTTP2_MEM_CAT_STREAM,
+  /* HPACK deflater and inflater */
+  NGHTTP2_MEM_CAT_HD,
+  /* The buffers to receive frames */
+  NGHTTP2_MEM_CAT_INBOUND,
+  NGHTTP2_MEM_CAT_MAX
+} nghttp2_mem_cat;
+
+typedef struct nghttp2_mem_account nghttp2_mem_account;
+
+/* mem_user_data of the allocator which charges the category |cat| */
+typedef struct {
+  nghttp2_mem_account *account;
+  nghttp2_mem_cat cat;
+} nghttp2_mem_account_tag;
+
+/*
+ * Allocator wrapper which counts the number of bytes in use per
+ * category.  The size and category of each allocation is stored in
+ * front of the returned memory, so that memory can be freed through
+ * the allocator of any category of the same account.
+ */
+struct nghttp2_mem_account {
+  /* The underlying allocator */
+  nghttp2_mem mem;
+  nghttp2_mem_account_tag tags[NGHTTP2_MEM_CAT_MAX];
+  /* The number of bytes in use per category, not including the
+     header of each allocation */
+  size_t used[NGHTTP2_MEM_CAT_MAX];
+  /* The sum of used */
+  size_t total;
+};
+
+/*
+ * Initializes |account| which gets memory from |mem|.  |*mem| is
+ * copied to |account|.
+ */
+void nghttp2_mem_account_init(nghttp2_mem_account *account,
+                              const nghttp2_mem *mem);
+
+/*
+ * Initializes |mem| so that it allocates memory from |account|, and
+ * charges it to the category |cat|.
+ */
+void nghttp2_mem_account_mem_init(nghttp2_mem *mem,
+                                  nghttp2_mem_account *account,
+                                  nghttp2_mem_cat cat);
+
+#endif /* NGHTTP2_MEM_ACCOUNT_H */
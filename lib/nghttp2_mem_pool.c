@@ -0,0 +1,214 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_mem_pool.h"
+
+#include <string.h>
+
+#include "nghttp2_mem.h"
+
+/* The size of block header and chunk header.  This keeps the
+   alignment of the returned memory same as malloc on the most
+   platforms. */
+#define NGHTTP2_MEM_POOL_HEADER_SIZE 16
+
+void nghttp2_mem_pool_init(nghttp2_mem_pool *pool, const nghttp2_mem *mem) {
+  memset(pool, 0, sizeof(nghttp2_mem_pool));
+
+  pool->mem = *mem;
+}
+
+void nghttp2_mem_pool_free(nghttp2_mem_pool *pool) {
+  nghttp2_mem_pool_chunk *chunk, *next;
+
+  for (chunk = pool->chunks; chunk;) {
+    next = chunk->next;
+    nghttp2_mem_free(&pool->mem, chunk);
+    chunk = next;
+  }
+
+  pool->chunks = NULL;
+  memset(pool->free_blocks, 0, sizeof(pool->free_blocks));
+  pool->pos = pool->end = NULL;
+}
+
+static void *mem_pool_block_data(nghttp2_mem_pool_block *block) {
+  return (uint8_t *)block + NGHTTP2_MEM_POOL_HEADER_SIZE;
+}
+
+static nghttp2_mem_pool_block *mem_pool_get_block(void *ptr) {
+  return (nghttp2_mem_pool_block *)(void *)((uint8_t *)ptr -
+                                            NGHTTP2_MEM_POOL_HEADER_SIZE);
+}
+
+/*
+ * Returns the usable size of the block of size class |cls|.
+ */
+static size_t mem_pool_class_size(size_t cls) {
+  return (cls + 1) * NGHTTP2_MEM_POOL_CLASS_UNIT - NGHTTP2_MEM_POOL_HEADER_SIZE;
+}
+
+static void *mem_pool_malloc(size_t size, void *mem_user_data) {
+  nghttp2_mem_pool *pool = mem_user_data;
+  nghttp2_mem_pool_block *block;
+  nghttp2_mem_pool_chunk *chunk;
+  size_t cls, blocklen;
+
+  if (size > SIZE_MAX - NGHTTP2_MEM_POOL_HEADER_SIZE) {
+    return NULL;
+  }
+
+  blocklen = size + NGHTTP2_MEM_POOL_HEADER_SIZE;
+  cls = (blocklen + NGHTTP2_MEM_POOL_CLASS_UNIT - 1) /
+            NGHTTP2_MEM_POOL_CLASS_UNIT -
+        1;
+
+  if (cls >= NGHTTP2_MEM_POOL_NUM_CLASSES) {
+    block = nghttp2_mem_malloc(&pool->mem, blocklen);
+    if (block == NULL) {
+      return NULL;
+    }
+
+    block->cls = NGHTTP2_MEM_POOL_NUM_CLASSES;
+
+    return mem_pool_block_data(block);
+  }
+
+  block = pool->free_blocks[cls];
+  if (block) {
+    pool->free_blocks[cls] = block->next;
+
+    return mem_pool_block_data(block);
+  }
+
+  blocklen = (cls + 1) * NGHTTP2_MEM_POOL_CLASS_UNIT;
+
+  if ((size_t)(pool->end - pool->pos) < blocklen) {
+    chunk = nghttp2_mem_malloc(&pool->mem, NGHTTP2_MEM_POOL_CHUNK_SIZE);
+    if (chunk == NULL) {
+      return NULL;
+    }
+
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    pool->pos = (uint8_t *)chunk + NGHTTP2_MEM_POOL_HEADER_SIZE;
+    pool->end = (uint8_t *)chunk + NGHTTP2_MEM_POOL_CHUNK_SIZE;
+  }
+
+  block = (nghttp2_mem_pool_block *)(void *)pool->pos;
+  pool->pos += blocklen;
+
+  block->cls = cls;
+
+  return mem_pool_block_data(block);
+}
+
+static void mem_pool_free(void *ptr, void *mem_user_data) {
+  nghttp2_mem_pool *pool = mem_user_data;
+  nghttp2_mem_pool_block *block;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  block = mem_pool_get_block(ptr);
+
+  if (block->cls == NGHTTP2_MEM_POOL_NUM_CLASSES) {
+    nghttp2_mem_free(&pool->mem, block);
+    return;
+  }
+
+  block->next = pool->free_blocks[block->cls];
+  pool->free_blocks[block->cls] = block;
+}
+
+static void *mem_pool_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  void *ptr;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  ptr = mem_pool_malloc(nmemb * size, mem_user_data);
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  memset(ptr, 0, nmemb * size);
+
+  return ptr;
+}
+
+static void *mem_pool_realloc(void *ptr, size_t size, void *mem_user_data) {
+  nghttp2_mem_pool *pool = mem_user_data;
+  nghttp2_mem_pool_block *block;
+  void *nptr;
+  size_t oldsize;
+
+  if (ptr == NULL) {
+    return mem_pool_malloc(size, mem_user_data);
+  }
+
+  if (size > SIZE_MAX - NGHTTP2_MEM_POOL_HEADER_SIZE) {
+    return NULL;
+  }
+
+  block = mem_pool_get_block(ptr);
+
+  if (block->cls == NGHTTP2_MEM_POOL_NUM_CLASSES) {
+    block = nghttp2_mem_realloc(&pool->mem, block,
+                                size + NGHTTP2_MEM_POOL_HEADER_SIZE);
+    if (block == NULL) {
+      return NULL;
+    }
+
+    return mem_pool_block_data(block);
+  }
+
+  oldsize = mem_pool_class_size(block->cls);
+
+  if (size <= oldsize) {
+    return ptr;
+  }
+
+  nptr = mem_pool_malloc(size, mem_user_data);
+  if (nptr == NULL) {
+    return NULL;
+  }
+
+  memcpy(nptr, ptr, oldsize);
+
+  mem_pool_free(ptr, mem_user_data);
+
+  return nptr;
+}
+
+void nghttp2_mem_pool_mem_init(nghttp2_mem *mem, nghttp2_mem_pool *pool) {
+  mem->mem_user_data = pool;
+  mem->malloc = mem_pool_malloc;
+  mem->free = mem_pool_free;
+  mem->calloc = mem_pool_calloc;
+  mem->realloc = mem_pool_realloc;
+}
@@ -0,0 +1,96 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_MEM_POOL_H
+#define NGHTTP2_MEM_POOL_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+
+/* The granularity of size classes.  The block sizes, including
+   header, are multiples of this value. */
+#define NGHTTP2_MEM_POOL_CLASS_UNIT 32
+/* The number of size classes.  The largest block is 512 bytes, which
+   holds nghttp2_stream, nghttp2_outbound_item and the most of frame
+   payloads.  The larger requests go to the underlying allocator. */
+#define NGHTTP2_MEM_POOL_NUM_CLASSES 16
+/* The size of chunk which the blocks are carved from */
+#define NGHTTP2_MEM_POOL_CHUNK_SIZE 16384
+
+typedef struct nghttp2_mem_pool_block nghttp2_mem_pool_block;
+
+/* The header placed in front of each block. */
+struct nghttp2_mem_pool_block {
+  /* The next free block if this block is in the free list */
+  nghttp2_mem_pool_block *next;
+  /* The size class of this block, or NGHTTP2_MEM_POOL_NUM_CLASSES if
+     this block is directly allocated from the underlying
+     allocator. */
+  size_t cls;
+};
+
+typedef struct nghttp2_mem_pool_chunk nghttp2_mem_pool_chunk;
+
+struct nghttp2_mem_pool_chunk {
+  nghttp2_mem_pool_chunk *next;
+};
+
+/*
+ * Slab allocator which recycles small blocks per size class.  The
+ * blocks are carved from large chunks, and the freed blocks are kept
+ * in free lists instead of being returned to the underlying
+ * allocator.  The chunks are released when the pool is freed.
+ */
+typedef struct {
+  /* The underlying allocator */
+  nghttp2_mem mem;
+  /* The chunks allocated so far */
+  nghttp2_mem_pool_chunk *chunks;
+  /* The free lists per size class */
+  nghttp2_mem_pool_block *free_blocks[NGHTTP2_MEM_POOL_NUM_CLASSES];
+  /* The unused region of the current chunk */
+  uint8_t *pos, *end;
+} nghttp2_mem_pool;
+
+/*
+ * Initializes |pool| which gets memory from |mem|.  |*mem| is copied
+ * to |pool|.  This function does not allocate memory.
+ */
+void nghttp2_mem_pool_init(nghttp2_mem_pool *pool, const nghttp2_mem *mem);
+
+/*
+ * Releases all memory allocated by |pool|, including blocks which are
+ * still in use.
+ */
+void nghttp2_mem_pool_free(nghttp2_mem_pool *pool);
+
+/*
+ * Initializes |mem| so that it allocates memory from |pool|.
+ */
+void nghttp2_mem_pool_mem_init(nghttp2_mem *mem, nghttp2_mem_pool *pool);
+
+#endif /* NGHTTP2_MEM_POOL_H */
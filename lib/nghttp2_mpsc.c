@@ -0,0 +1,124 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_mpsc.h"
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+
+#define mpsc_exchange(PTR, VAL) __atomic_exchange_n(PTR, VAL, __ATOMIC_ACQ_REL)
+#define mpsc_load(PTR) __atomic_load_n(PTR, __ATOMIC_ACQUIRE)
+#define mpsc_store(PTR, VAL) __atomic_store_n(PTR, VAL, __ATOMIC_RELEASE)
+
+#elif defined(_MSC_VER)
+
+#include <windows.h>
+
+/* Interlocked functions imply full memory barrier */
+#define mpsc_exchange(PTR, VAL)                                                \
+  ((nghttp2_mpsc_entry *)InterlockedExchangePointer((PVOID volatile *)(PTR), \
+                                                    (VAL)))
+#define mpsc_load(PTR)                                                         \
+  ((nghttp2_mpsc_entry *)InterlockedCompareExchangePointer(                    \
+      (PVOID volatile *)(PTR), NULL, NULL))
+#define mpsc_store(PTR, VAL) ((void)mpsc_exchange(PTR, VAL))
+
+#else /* !__GNUC__ && !_MSC_VER */
+
+#define mpsc_exchange(PTR, VAL) mpsc_exchange_plain(PTR, VAL)
+#define mpsc_load(PTR) (*(PTR))
+#define mpsc_store(PTR, VAL) (*(PTR) = (VAL))
+
+static nghttp2_mpsc_entry *mpsc_exchange_plain(nghttp2_mpsc_entry **ptr,
+                                               nghttp2_mpsc_entry *val) {
+  nghttp2_mpsc_entry *old = *ptr;
+
+  *ptr = val;
+
+  return old;
+}
+
+#endif /* !__GNUC__ && !_MSC_VER */
+
+void nghttp2_mpsc_init(nghttp2_mpsc *q) {
+  q->stub.next = NULL;
+  q->head = &q->stub;
+  q->tail = &q->stub;
+}
+
+void nghttp2_mpsc_push(nghttp2_mpsc *q, nghttp2_mpsc_entry *ent) {
+  nghttp2_mpsc_entry *prev;
+
+  ent->next = NULL;
+
+  /* Between these two operations, the queue is disconnected at prev,
+     and consumer cannot see ent and the entries pushed after it. */
+  prev = mpsc_exchange(&q->head, ent);
+  mpsc_store(&prev->next, ent);
+}
+
+nghttp2_mpsc_entry *nghttp2_mpsc_pop(nghttp2_mpsc *q) {
+  nghttp2_mpsc_entry *tail, *next;
+
+  tail = q->tail;
+  next = mpsc_load(&tail->next);
+
+  if (tail == &q->stub) {
+    if (next == NULL) {
+      return NULL;
+    }
+
+    q->tail = next;
+    tail = next;
+    next = mpsc_load(&next->next);
+  }
+
+  if (next) {
+    q->tail = next;
+    return tail;
+  }
+
+  if (tail != mpsc_load(&q->head)) {
+    /* Producer is in the middle of push */
+    return NULL;
+  }
+
+  /* tail is the last entry.  Push stub after it, so that tail can be
+     detached. */
+  nghttp2_mpsc_push(q, &q->stub);
+
+  next = mpsc_load(&tail->next);
+
+  if (next) {
+    q->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+int nghttp2_mpsc_empty(nghttp2_mpsc *q) {
+  return q->tail == &q->stub && mpsc_load(&q->stub.next) == NULL;
+}
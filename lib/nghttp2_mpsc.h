@@ -0,0 +1,92 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_MPSC_H
+#define NGHTTP2_MPSC_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+
+/*
+ * Intrusive multi-producer single-consumer queue after Dmitry
+ * Vyukov's design.  nghttp2_mpsc_push() may be called from any
+ * number of threads concurrently, and never blocks nor allocates.
+ * The other functions must only be called by the single consumer.
+ *
+ * The queue needs atomic exchange, which is available with GCC
+ * compatible compilers and MSVC.  NGHTTP2_MPSC_ENABLED is defined if
+ * the queue works.  Otherwise, it is not thread-safe at all.
+ */
+
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define NGHTTP2_MPSC_ENABLED 1
+#endif /* __GNUC__ || _MSC_VER */
+
+typedef struct nghttp2_mpsc_entry {
+  struct nghttp2_mpsc_entry *next;
+} nghttp2_mpsc_entry;
+
+typedef struct {
+  /* The most recently pushed entry.  Producers swap this
+     atomically. */
+  nghttp2_mpsc_entry *head;
+  /* The oldest entry which has not been popped yet, or stub.  Only
+     touched by consumer. */
+  nghttp2_mpsc_entry *tail;
+  /* Placeholder which keeps the queue non-empty, so that producers
+     never have to touch tail. */
+  nghttp2_mpsc_entry stub;
+} nghttp2_mpsc;
+
+/*
+ * Initializes |q| as empty.
+ */
+void nghttp2_mpsc_init(nghttp2_mpsc *q);
+
+/*
+ * Appends |ent| to |q|.  This function is safe to call from multiple
+ * threads at the same time.
+ */
+void nghttp2_mpsc_push(nghttp2_mpsc *q, nghttp2_mpsc_entry *ent);
+
+/*
+ * Removes the oldest entry from |q|, and returns it.  This function
+ * returns NULL if |q| is empty.  It also returns NULL if a producer is
+ * in the middle of nghttp2_mpsc_push(), and the entry will be
+ * available soon.  Entries are returned in the order of completion
+ * of nghttp2_mpsc_push() per producer thread.
+ */
+nghttp2_mpsc_entry *nghttp2_mpsc_pop(nghttp2_mpsc *q);
+
+/*
+ * Returns nonzero if |q| has no entry to pop.  This may return zero
+ * while nghttp2_mpsc_pop() returns NULL because of the push in
+ * progress.
+ */
+int nghttp2_mpsc_empty(nghttp2_mpsc *q);
+
+#endif /* NGHTTP2_MPSC_H */
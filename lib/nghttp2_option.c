@@ -112,3 +112,82 @@ void nghttp2_option_set_no_closed_streams(nghttp2_option *option, int val) {
   option->opt_set_mask |= NGHTTP2_OPT_NO_CLOSED_STREAMS;
   option->no_closed_streams = val;
 }
+
+void nghttp2_option_set_no_header_copy(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_NO_HEADER_COPY;
+  option->no_header_copy = val;
+}
+
+void nghttp2_option_set_hd_adaptive_indexing(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_HD_ADAPTIVE_INDEXING;
+  option->hd_adaptive_indexing = val;
+}
+
+void nghttp2_option_set_hd_memoize(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_HD_MEMOIZE;
+  option->hd_memoize = val;
+}
+
+void nghttp2_option_set_no_rfc7540_priorities(nghttp2_option *option,
+                                              int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_NO_RFC7540_PRIORITIES;
+  option->no_rfc7540_priorities = val;
+}
+
+void nghttp2_option_set_mem_pool(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_MEM_POOL;
+  option->mem_pool = val;
+}
+
+void nghttp2_option_set_mem_accounting(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_MEM_ACCOUNTING;
+  option->mem_accounting = val;
+}
+
+void nghttp2_option_set_max_session_memory(nghttp2_option *option,
+                                           size_t val) {
+  option->opt_set_mask |= NGHTTP2_OPT_MAX_SESSION_MEMORY;
+  option->max_session_memory = val;
+}
+
+void nghttp2_option_set_window_auto_tuning(nghttp2_option *option,
+                                           uint32_t max_window_size) {
+  option->opt_set_mask |= NGHTTP2_OPT_WINDOW_AUTO_TUNING;
+  option->max_auto_window_size = max_window_size;
+}
+
+void nghttp2_option_set_window_update_threshold(nghttp2_option *option,
+                                                uint32_t val) {
+  option->opt_set_mask |= NGHTTP2_OPT_WINDOW_UPDATE_THRESHOLD;
+  option->window_update_threshold = val;
+}
+
+void nghttp2_option_set_coalesce_window_update(nghttp2_option *option,
+                                               int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_COALESCE_WINDOW_UPDATE;
+  option->coalesce_window_update = val;
+}
+
+void nghttp2_option_set_command_queue(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_COMMAND_QUEUE;
+  option->command_queue = val;
+}
+
+void nghttp2_option_set_stream_reset_rate_limit(nghttp2_option *option,
+                                                uint64_t burst,
+                                                uint64_t rate) {
+  option->opt_set_mask |= NGHTTP2_OPT_STREAM_RESET_RATE_LIMIT;
+  option->stream_reset_burst = burst;
+  option->stream_reset_rate = rate;
+}
+
+void nghttp2_option_set_max_outbound_ack(nghttp2_option *option, size_t val) {
+  option->opt_set_mask |= NGHTTP2_OPT_MAX_OUTBOUND_ACK;
+  option->max_outbound_ack = val;
+}
+
+void nghttp2_option_set_max_empty_data_frames(nghttp2_option *option,
+                                              size_t val) {
+  option->opt_set_mask |= NGHTTP2_OPT_MAX_EMPTY_DATA_FRAMES;
+  option->max_empty_data_frames = val;
+}
@@ -66,12 +66,31 @@ typedef enum {
   NGHTTP2_OPT_MAX_SEND_HEADER_BLOCK_LENGTH = 1 << 8,
   NGHTTP2_OPT_MAX_DEFLATE_DYNAMIC_TABLE_SIZE = 1 << 9,
   NGHTTP2_OPT_NO_CLOSED_STREAMS = 1 << 10,
+  NGHTTP2_OPT_NO_HEADER_COPY = 1 << 11,
+  NGHTTP2_OPT_HD_ADAPTIVE_INDEXING = 1 << 12,
+  NGHTTP2_OPT_HD_MEMOIZE = 1 << 13,
+  NGHTTP2_OPT_NO_RFC7540_PRIORITIES = 1 << 14,
+  NGHTTP2_OPT_MEM_POOL = 1 << 15,
+  NGHTTP2_OPT_MEM_ACCOUNTING = 1 << 16,
+  NGHTTP2_OPT_MAX_SESSION_MEMORY = 1 << 17,
+  NGHTTP2_OPT_WINDOW_AUTO_TUNING = 1 << 18,
+  NGHTTP2_OPT_WINDOW_UPDATE_THRESHOLD = 1 << 19,
+  NGHTTP2_OPT_COALESCE_WINDOW_UPDATE = 1 << 20,
+  NGHTTP2_OPT_COMMAND_QUEUE = 1 << 21,
+  NGHTTP2_OPT_STREAM_RESET_RATE_LIMIT = 1 << 22,
+  NGHTTP2_OPT_MAX_OUTBOUND_ACK = 1 << 23,
+  NGHTTP2_OPT_MAX_EMPTY_DATA_FRAMES = 1 << 24,
 } nghttp2_option_flag;
 
 /**
  * Struct to store option values for nghttp2_session.
  */
 struct nghttp2_option {
+  /**
+   * NGHTTP2_OPT_STREAM_RESET_RATE_LIMIT
+   */
+  uint64_t stream_reset_burst;
+  uint64_t stream_reset_rate;
   /**
    * NGHTTP2_OPT_MAX_SEND_HEADER_BLOCK_LENGTH
    */
@@ -80,6 +99,18 @@ struct nghttp2_option {
    * NGHTTP2_OPT_MAX_DEFLATE_DYNAMIC_TABLE_SIZE
    */
   size_t max_deflate_dynamic_table_size;
+  /**
+   * NGHTTP2_OPT_MAX_SESSION_MEMORY
+   */
+  size_t max_session_memory;
+  /**
+   * NGHTTP2_OPT_MAX_OUTBOUND_ACK
+   */
+  size_t max_outbound_ack;
+  /**
+   * NGHTTP2_OPT_MAX_EMPTY_DATA_FRAMES
+   */
+  size_t max_empty_data_frames;
   /**
    * Bitwise OR of nghttp2_option_flag to determine that which fields
    * are specified.
@@ -97,6 +128,14 @@ struct nghttp2_option {
    * NGHTTP2_OPT_BUILTIN_RECV_EXT_TYPES
    */
   uint32_t builtin_recv_ext_types;
+  /**
+   * NGHTTP2_OPT_WINDOW_AUTO_TUNING
+   */
+  uint32_t max_auto_window_size;
+  /**
+   * NGHTTP2_OPT_WINDOW_UPDATE_THRESHOLD
+   */
+  uint32_t window_update_threshold;
   /**
    * NGHTTP2_OPT_NO_AUTO_WINDOW_UPDATE
    */
@@ -117,6 +156,38 @@ struct nghttp2_option {
    * NGHTTP2_OPT_NO_CLOSED_STREAMS
    */
   int no_closed_streams;
+  /**
+   * NGHTTP2_OPT_NO_HEADER_COPY
+   */
+  int no_header_copy;
+  /**
+   * NGHTTP2_OPT_HD_ADAPTIVE_INDEXING
+   */
+  int hd_adaptive_indexing;
+  /**
+   * NGHTTP2_OPT_HD_MEMOIZE
+   */
+  int hd_memoize;
+  /**
+   * NGHTTP2_OPT_NO_RFC7540_PRIORITIES
+   */
+  int no_rfc7540_priorities;
+  /**
+   * NGHTTP2_OPT_MEM_POOL
+   */
+  int mem_pool;
+  /**
+   * NGHTTP2_OPT_MEM_ACCOUNTING
+   */
+  int mem_accounting;
+  /**
+   * NGHTTP2_OPT_COALESCE_WINDOW_UPDATE
+   */
+  int coalesce_window_update;
+  /**
+   * NGHTTP2_OPT_COMMAND_QUEUE
+   */
+  int command_queue;
   /**
    * NGHTTP2_OPT_USER_RECV_EXT_TYPES
    */
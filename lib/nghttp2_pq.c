@@ -43,26 +43,33 @@ void nghttp2_pq_free(nghttp2_pq *pq) {
   pq->q = NULL;
 }
 
-static void swap(nghttp2_pq *pq, size_t i, size_t j) {
-  nghttp2_pq_entry *a = pq->q[i];
-  nghttp2_pq_entry *b = pq->q[j];
-
-  pq->q[i] = b;
-  b->index = i;
-  pq->q[j] = a;
-  a->index = j;
-}
+/* The number of children of each node.  Compared with binary heap,
+   4-ary heap halves the height of the tree, and the children of a
+   node are likely to share a cache line. */
+#define NGHTTP2_PQ_ARITY 4
 
+/*
+ * Moves the item at |index| toward the root until heap property is
+ * restored.  Instead of swapping at each level, the parents are
+ * shifted down, and the item is stored once at its final position.
+ */
 static void bubble_up(nghttp2_pq *pq, size_t index) {
+  nghttp2_pq_entry *item = pq->q[index];
+  nghttp2_less less = pq->less;
   size_t parent;
+
   while (index != 0) {
-    parent = (index - 1) / 2;
-    if (!pq->less(pq->q[index], pq->q[parent])) {
-      return;
+    parent = (index - 1) / NGHTTP2_PQ_ARITY;
+    if (!less(item, pq->q[parent])) {
+      break;
     }
-    swap(pq, parent, index);
+    pq->q[index] = pq->q[parent];
+    pq->q[index]->index = index;
     index = parent;
   }
+
+  pq->q[index] = item;
+  item->index = index;
 }
 
 int nghttp2_pq_push(nghttp2_pq *pq, nghttp2_pq_entry *item) {
@@ -95,25 +102,41 @@ nghttp2_pq_entry *nghttp2_pq_top(nghttp2_pq *pq) {
   }
 }
 
+/*
+ * Moves the item at |index| toward the leaves until heap property is
+ * restored.
+ */
 static void bubble_down(nghttp2_pq *pq, size_t index) {
-  size_t i, j, minindex;
+  nghttp2_pq_entry *item = pq->q[index];
+  nghttp2_less less = pq->less;
+  size_t i, j, last, minindex;
+
   for (;;) {
-    j = index * 2 + 1;
-    minindex = index;
-    for (i = 0; i < 2; ++i, ++j) {
-      if (j >= pq->length) {
-        break;
-      }
-      if (pq->less(pq->q[j], pq->q[minindex])) {
-        minindex = j;
+    j = index * NGHTTP2_PQ_ARITY + 1;
+    if (j >= pq->length) {
+      break;
+    }
+
+    last = nghttp2_min(j + NGHTTP2_PQ_ARITY, pq->length);
+    minindex = j;
+
+    for (i = j + 1; i < last; ++i) {
+      if (less(pq->q[i], pq->q[minindex])) {
+        minindex = i;
       }
     }
-    if (minindex == index) {
-      return;
+
+    if (!less(pq->q[minindex], item)) {
+      break;
     }
-    swap(pq, index, minindex);
+
+    pq->q[index] = pq->q[minindex];
+    pq->q[index]->index = index;
     index = minindex;
   }
+
+  pq->q[index] = item;
+  item->index = index;
 }
 
 void nghttp2_pq_pop(nghttp2_pq *pq) {
@@ -149,6 +172,18 @@ void nghttp2_pq_remove(nghttp2_pq *pq, nghttp2_pq_entry *item) {
   }
 }
 
+void nghttp2_pq_fix(nghttp2_pq *pq, nghttp2_pq_entry *item) {
+  size_t index = item->index;
+
+  assert(pq->q[index] == item);
+
+  bubble_down(pq, index);
+
+  if (item->index == index) {
+    bubble_up(pq, index);
+  }
+}
+
 int nghttp2_pq_empty(nghttp2_pq *pq) { return pq->length == 0; }
 
 size_t nghttp2_pq_size(nghttp2_pq *pq) { return pq->length; }
@@ -163,7 +198,7 @@ void nghttp2_pq_update(nghttp2_pq *pq, nghttp2_pq_item_cb fun, void *arg) {
     rv |= (*fun)(pq->q[i], arg);
   }
   if (rv) {
-    for (i = pq->length; i > 0; --i) {
+    for (i = (pq->length - 1) / NGHTTP2_PQ_ARITY + 1; i > 0; --i) {
       bubble_down(pq, i - 1);
     }
   }
@@ -182,3 +217,11 @@ int nghttp2_pq_each(nghttp2_pq *pq, nghttp2_pq_item_cb fun, void *arg) {
   }
   return 0;
 }
+
+void nghttp2_pq_replace(nghttp2_pq *pq, nghttp2_pq_entry *item,
+                        nghttp2_pq_entry *new_item) {
+  assert(pq->q[item->index] == item);
+
+  new_item->index = item->index;
+  pq->q[item->index] = new_item;
+}
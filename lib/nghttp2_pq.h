@@ -125,4 +125,19 @@ int nghttp2_pq_each(nghttp2_pq *pq, nghttp2_pq_item_cb fun, void *arg);
  */
 void nghttp2_pq_remove(nghttp2_pq *pq, nghttp2_pq_entry *item);
 
+/*
+ * Restores the position of |item| in |pq| after its ordering key has
+ * been changed.  This is cheaper than removing |item| and pushing it
+ * again.
+ */
+void nghttp2_pq_fix(nghttp2_pq *pq, nghttp2_pq_entry *item);
+
+/*
+ * Makes |new_item| take the place of |item| in |pq|.  Both must have
+ * the same ordering key; typically |new_item| is embedded in a copy
+ * of the object which |item| is embedded in.
+ */
+void nghttp2_pq_replace(nghttp2_pq *pq, nghttp2_pq_entry *item,
+                        nghttp2_pq_entry *new_item);
+
 #endif /* NGHTTP2_PQ_H */
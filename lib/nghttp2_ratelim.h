@@ -0,0 +1,69 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_RATELIM_H
+#define NGHTTP2_RATELIM_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+
+/*
+ * Token bucket rate limiter.  The bucket holds at most |burst|
+ * tokens, and |rate| tokens are added per second.
+ */
+typedef struct {
+  /* The maximum number of tokens */
+  uint64_t burst;
+  /* The number of tokens added per second */
+  uint64_t rate;
+  /* The number of tokens currently available */
+  uint64_t val;
+  /* The time in seconds when tokens were last added */
+  uint64_t tstamp;
+} nghttp2_ratelim;
+
+/*
+ * Initializes |rl| with |burst| and |rate|.  The bucket starts full.
+ */
+void nghttp2_ratelim_init(nghttp2_ratelim *rl, uint64_t burst,
+                          uint64_t rate);
+
+/*
+ * Adds tokens for the time elapsed until |tstamp|, which is the
+ * current time in seconds.  |tstamp| earlier than the last update is
+ * ignored.
+ */
+void nghttp2_ratelim_update(nghttp2_ratelim *rl, uint64_t tstamp);
+
+/*
+ * Takes |n| tokens from |rl|.  This function returns 0 if it
+ * succeeds, or -1 if fewer than |n| tokens are available, in which
+ * case |rl| is not changed.
+ */
+int nghttp2_ratelim_drain(nghttp2_ratelim *rl, uint64_t n);
+
+#endif /* NGHTTP2_RATELIM_H */
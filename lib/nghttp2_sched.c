@@ -0,0 +1,331 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_sched.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "nghttp2_debug.h"
+
+/* RFC 7540 scheduler */
+
+static int sched_rfc7540_attach_item(nghttp2_sched *sched _U_,
+                                     nghttp2_stream *stream,
+                                     nghttp2_outbound_item *item) {
+  return nghttp2_stream_attach_item(stream, item);
+}
+
+static int sched_rfc7540_detach_item(nghttp2_sched *sched _U_,
+                                     nghttp2_stream *stream) {
+  return nghttp2_stream_detach_item(stream);
+}
+
+static int sched_rfc7540_defer_item(nghttp2_sched *sched _U_,
+                                    nghttp2_stream *stream, uint8_t flags) {
+  return nghttp2_stream_defer_item(stream, flags);
+}
+
+static int sched_rfc7540_resume_deferred_item(nghttp2_sched *sched _U_,
+                                              nghttp2_stream *stream,
+                                              uint8_t flags) {
+  return nghttp2_stream_resume_deferred_item(stream, flags);
+}
+
+static void sched_rfc7540_reschedule(nghttp2_sched *sched _U_,
+                                     nghttp2_stream *stream) {
+  stream->last_writelen = stream->item->frame.hd.length;
+
+  nghttp2_stream_reschedule(stream);
+}
+
+static void sched_rfc7540_change_extpri(nghttp2_sched *sched _U_,
+                                        nghttp2_stream *stream,
+                                        uint8_t extpri) {
+  /* extpri does not affect dependency tree. */
+  stream->extpri = extpri;
+}
+
+static nghttp2_outbound_item *
+sched_rfc7540_next_outbound_item(nghttp2_sched *sched) {
+  return nghttp2_stream_next_outbound_item(sched->root);
+}
+
+static int sched_rfc7540_empty(nghttp2_sched *sched) {
+  return nghttp2_pq_empty(&sched->root->obq);
+}
+
+static const nghttp2_sched_ops sched_rfc7540_ops = {
+    sched_rfc7540_attach_item,
+    sched_rfc7540_detach_item,
+    sched_rfc7540_defer_item,
+    sched_rfc7540_resume_deferred_item,
+    sched_rfc7540_reschedule,
+    sched_rfc7540_change_extpri,
+    sched_rfc7540_next_outbound_item,
+    sched_rfc7540_empty};
+
+void nghttp2_sched_rfc7540_init(nghttp2_sched *sched, nghttp2_stream *root) {
+  memset(sched, 0, sizeof(nghttp2_sched));
+
+  sched->ops = &sched_rfc7540_ops;
+  sched->root = root;
+}
+
+/* Urgency scheduler */
+
+static size_t sched_urgency_queue_index(nghttp2_stream *stream) {
+  return nghttp2_extpri_uint8_urgency(stream->extpri) * 2 +
+         (size_t)nghttp2_extpri_uint8_inc(stream->extpri);
+}
+
+static void sched_urgency_push(nghttp2_sched *sched, nghttp2_stream *stream) {
+  size_t idx;
+  nghttp2_sched_queue *q;
+
+  if (stream->queued) {
+    return;
+  }
+
+  idx = sched_urgency_queue_index(stream);
+  q = &sched->queues[idx];
+
+  DEBUGF("stream: push stream %d to urgency queue %zu\n", stream->stream_id,
+         idx);
+
+  stream->sched_next = NULL;
+  stream->sched_prev = q->tail;
+
+  if (q->tail) {
+    q->tail->sched_next = stream;
+  } else {
+    q->head = stream;
+    sched->active |= 1u << idx;
+  }
+
+  q->tail = stream;
+
+  stream->queued = 1;
+}
+
+static void sched_urgency_remove(nghttp2_sched *sched,
+                                 nghttp2_stream *stream) {
+  size_t idx;
+  nghttp2_sched_queue *q;
+
+  if (!stream->queued) {
+    return;
+  }
+
+  idx = sched_urgency_queue_index(stream);
+  q = &sched->queues[idx];
+
+  DEBUGF("stream: remove stream %d from urgency queue %zu\n",
+         stream->stream_id, idx);
+
+  if (stream->sched_prev) {
+    stream->sched_prev->sched_next = stream->sched_next;
+  } else {
+    q->head = stream->sched_next;
+  }
+
+  if (stream->sched_next) {
+    stream->sched_next->sched_prev = stream->sched_prev;
+  } else {
+    q->tail = stream->sched_prev;
+  }
+
+  if (q->head == NULL) {
+    sched->active &= ~(1u << idx);
+  }
+
+  stream->sched_prev = NULL;
+  stream->sched_next = NULL;
+  stream->queued = 0;
+}
+
+static int sched_urgency_attach_item(nghttp2_sched *sched,
+                                     nghttp2_stream *stream,
+                                     nghttp2_outbound_item *item) {
+  assert((stream->flags & NGHTTP2_STREAM_FLAG_DEFERRED_ALL) == 0);
+  assert(stream->item == NULL);
+
+  DEBUGF("stream: stream=%d attach item=%p\n", stream->stream_id, item);
+
+  stream->item = item;
+
+  sched_urgency_push(sched, stream);
+
+  return 0;
+}
+
+static int sched_urgency_detach_item(nghttp2_sched *sched,
+                                     nghttp2_stream *stream) {
+  DEBUGF("stream: stream=%d detach item=%p\n", stream->stream_id, stream->item);
+
+  stream->item = NULL;
+  stream->flags = (uint8_t)(stream->flags & ~NGHTTP2_STREAM_FLAG_DEFERRED_ALL);
+
+  sched_urgency_remove(sched, stream);
+
+  return 0;
+}
+
+static int sched_urgency_defer_item(nghttp2_sched *sched,
+                                    nghttp2_stream *stream, uint8_t flags) {
+  assert(stream->item);
+
+  DEBUGF("stream: stream=%d defer item=%p cause=%02x\n", stream->stream_id,
+         stream->item, flags);
+
+  stream->flags |= flags;
+
+  sched_urgency_remove(sched, stream);
+
+  return 0;
+}
+
+static int sched_urgency_resume_deferred_item(nghttp2_sched *sched,
+                                              nghttp2_stream *stream,
+                                              uint8_t flags) {
+  assert(stream->item);
+
+  DEBUGF("stream: stream=%d resume item=%p flags=%02x\n", stream->stream_id,
+         stream->item, flags);
+
+  stream->flags = (uint8_t)(stream->flags & ~flags);
+
+  if (stream->flags & NGHTTP2_STREAM_FLAG_DEFERRED_ALL) {
+    return 0;
+  }
+
+  sched_urgency_push(sched, stream);
+
+  return 0;
+}
+
+static void sched_urgency_reschedule(nghttp2_sched *sched,
+                                     nghttp2_stream *stream) {
+  nghttp2_sched_queue *q;
+
+  assert(stream->queued);
+
+  /* Non-incremental stream keeps its position until it finishes. */
+  if (!nghttp2_extpri_uint8_inc(stream->extpri)) {
+    return;
+  }
+
+  q = &sched->queues[sched_urgency_queue_index(stream)];
+
+  if (q->tail == stream) {
+    return;
+  }
+
+  sched_urgency_remove(sched, stream);
+  sched_urgency_push(sched, stream);
+}
+
+static void sched_urgency_change_extpri(nghttp2_sched *sched,
+                                       nghttp2_stream *stream,
+                                       uint8_t extpri) {
+  if (!stream->queued) {
+    stream->extpri = extpri;
+    return;
+  }
+
+  sched_urgency_remove(sched, stream);
+  stream->extpri = extpri;
+  sched_urgency_push(sched, stream);
+}
+
+static nghttp2_outbound_item *
+sched_urgency_next_outbound_item(nghttp2_sched *sched) {
+  size_t idx;
+
+  if (sched->active == 0) {
+    return NULL;
+  }
+
+  /* The number of queues is fixed, so this is constant time. */
+  for (idx = 0; (sched->active & (1u << idx)) == 0; ++idx)
+    ;
+
+  return sched->queues[idx].head->item;
+}
+
+static int sched_urgency_empty(nghttp2_sched *sched) {
+  return sched->active == 0;
+}
+
+static const nghttp2_sched_ops sched_urgency_ops = {
+    sched_urgency_attach_item,
+    sched_urgency_detach_item,
+    sched_urgency_defer_item,
+    sched_urgency_resume_deferred_item,
+    sched_urgency_reschedule,
+    sched_urgency_change_extpri,
+    sched_urgency_next_outbound_item,
+    sched_urgency_empty};
+
+void nghttp2_sched_urgency_init(nghttp2_sched *sched) {
+  memset(sched, 0, sizeof(nghttp2_sched));
+
+  sched->ops = &sched_urgency_ops;
+}
+
+int nghttp2_sched_attach_item(nghttp2_sched *sched, nghttp2_stream *stream,
+                              nghttp2_outbound_item *item) {
+  return sched->ops->attach_item(sched, stream, item);
+}
+
+int nghttp2_sched_detach_item(nghttp2_sched *sched, nghttp2_stream *stream) {
+  return sched->ops->detach_item(sched, stream);
+}
+
+int nghttp2_sched_defer_item(nghttp2_sched *sched, nghttp2_stream *stream,
+                             uint8_t flags) {
+  return sched->ops->defer_item(sched, stream, flags);
+}
+
+int nghttp2_sched_resume_deferred_item(nghttp2_sched *sched,
+                                       nghttp2_stream *stream, uint8_t flags) {
+  return sched->ops->resume_deferred_item(sched, stream, flags);
+}
+
+void nghttp2_sched_reschedule(nghttp2_sched *sched, nghttp2_stream *stream) {
+  sched->ops->reschedule(sched, stream);
+}
+
+void nghttp2_sched_change_extpri(nghttp2_sched *sched, nghttp2_stream *stream,
+                                 uint8_t extpri) {
+  sched->ops->change_extpri(sched, stream, extpri);
+}
+
+nghttp2_outbound_item *nghttp2_sched_next_outbound_item(nghttp2_sched *sched) {
+  return sched->ops->next_outbound_item(sched);
+}
+
+int nghttp2_sched_empty(nghttp2_sched *sched) {
+  return sched->ops->empty(sched);
+}
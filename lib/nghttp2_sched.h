@@ -0,0 +1,139 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_SCHED_H
+#define NGHTTP2_SCHED_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+#include "nghttp2_stream.h"
+
+/* The bit in nghttp2_stream.extpri which indicates that stream is
+   incremental.  The remaining bits store urgency. */
+#define NGHTTP2_EXTPRI_INC_MASK (1 << 7)
+
+#define nghttp2_extpri_uint8_urgency(PRI)                                      \
+  ((uint32_t)((PRI) & ~NGHTTP2_EXTPRI_INC_MASK))
+#define nghttp2_extpri_uint8_inc(PRI) (((PRI)&NGHTTP2_EXTPRI_INC_MASK) != 0)
+
+typedef struct nghttp2_sched nghttp2_sched;
+
+/*
+ * The operations of outbound DATA scheduler.  nghttp2_session decides
+ * which stream sends DATA next only through these operations, so that
+ * the scheduling algorithm can be replaced without touching the
+ * session.
+ */
+typedef struct {
+  /* Attaches |item| to |stream|, and schedules |stream| unless it is
+     deferred. */
+  int (*attach_item)(nghttp2_sched *sched, nghttp2_stream *stream,
+                     nghttp2_outbound_item *item);
+  /* Detaches stream->item, and unschedules |stream|. */
+  int (*detach_item)(nghttp2_sched *sched, nghttp2_stream *stream);
+  /* Defers stream->item for the reason |flags|, and unschedules
+     |stream|. */
+  int (*defer_item)(nghttp2_sched *sched, nghttp2_stream *stream,
+                    uint8_t flags);
+  /* Clears the deferred reason |flags|, and schedules |stream| again
+     if no other reason remains. */
+  int (*resume_deferred_item)(nghttp2_sched *sched, nghttp2_stream *stream,
+                              uint8_t flags);
+  /* Called after DATA frame in stream->item has been written. */
+  void (*reschedule)(nghttp2_sched *sched, nghttp2_stream *stream);
+  /* Changes stream->extpri to |extpri|, and moves |stream| to the
+     right position if it is scheduled. */
+  void (*change_extpri)(nghttp2_sched *sched, nghttp2_stream *stream,
+                        uint8_t extpri);
+  /* Returns the item which should be sent next, or NULL. */
+  nghttp2_outbound_item *(*next_outbound_item)(nghttp2_sched *sched);
+  /* Returns nonzero if no stream is scheduled. */
+  int (*empty)(nghttp2_sched *sched);
+} nghttp2_sched_ops;
+
+/* FIFO of streams linked by sched_prev and sched_next */
+typedef struct {
+  nghttp2_stream *head, *tail;
+} nghttp2_sched_queue;
+
+struct nghttp2_sched {
+  const nghttp2_sched_ops *ops;
+  /* The root of dependency tree.  Used by RFC 7540 scheduler. */
+  nghttp2_stream *root;
+  /* The queues of urgency scheduler.  The streams of urgency u are
+     queued in queues[u * 2] if they are non-incremental, and
+     queues[u * 2 + 1] otherwise. */
+  nghttp2_sched_queue queues[NGHTTP2_EXTPRI_URGENCY_LEVELS * 2];
+  /* The bit i is set if queues[i] is not empty. */
+  uint32_t active;
+};
+
+/*
+ * Initializes |sched| as RFC 7540 scheduler, which sends DATA
+ * according to the dependency tree rooted at |root|.
+ */
+void nghttp2_sched_rfc7540_init(nghttp2_sched *sched, nghttp2_stream *root);
+
+/*
+ * Initializes |sched| as urgency scheduler, which sends DATA
+ * according to the urgency and incremental parameters in
+ * nghttp2_stream.extpri.  Both enqueue and dequeue are done in
+ * constant time.
+ */
+void nghttp2_sched_urgency_init(nghttp2_sched *sched);
+
+/*
+ * The following functions just call the corresponding operation of
+ * |sched|.
+ *
+ * The functions returning int return 0 if they succeed, or one of
+ * the following negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory
+ */
+int nghttp2_sched_attach_item(nghttp2_sched *sched, nghttp2_stream *stream,
+                              nghttp2_outbound_item *item);
+
+int nghttp2_sched_detach_item(nghttp2_sched *sched, nghttp2_stream *stream);
+
+int nghttp2_sched_defer_item(nghttp2_sched *sched, nghttp2_stream *stream,
+                             uint8_t flags);
+
+int nghttp2_sched_resume_deferred_item(nghttp2_sched *sched,
+                                       nghttp2_stream *stream, uint8_t flags);
+
+void nghttp2_sched_reschedule(nghttp2_sched *sched, nghttp2_stream *stream);
+
+void nghttp2_sched_change_extpri(nghttp2_sched *sched, nghttp2_stream *stream,
+                                 uint8_t extpri);
+
+nghttp2_outbound_item *nghttp2_sched_next_outbound_item(nghttp2_sched *sched);
+
+int nghttp2_sched_empty(nghttp2_sched *sched);
+
+#endif /* NGHTTP2_SCHED_H */
@@ -37,6 +37,7 @@
 #include "nghttp2_http.h"
 #include "nghttp2_pq.h"
 #include "nghttp2_debug.h"
+#include "nghttp2_time.h"
 
 /*
  * Returns non-zero if the number of outgoing opened streams is larger
@@ -71,6 +72,90 @@ session_is_incoming_concurrent_streams_pending_max(nghttp2_session *session) {
          session->num_incoming_streams;
 }
 
+/*
+ * Returns non-zero if the memory held by |session| exceeds
+ * session->max_session_memory.
+ */
+static int session_is_mem_exceeded(nghttp2_session *session) {
+  return (session->opt_flags & NGHTTP2_OPTMASK_MEM_ACCOUNTING) &&
+         session->mem_account.total > session->max_session_memory;
+}
+
+/*
+ * Returns the index of session->stats.frames_sent and frames_recv for
+ * frame |type|.
+ */
+static size_t stats_frame_type_index(uint8_t type) {
+  return nghttp2_min(type, NGHTTP2_STATS_NUM_FRAME_TYPES - 1);
+}
+
+/*
+ * Returns the index of session->stats.rst_stream_sent and
+ * rst_stream_recv for |error_code|.
+ */
+static size_t stats_error_code_index(uint32_t error_code) {
+  return nghttp2_min(error_code, NGHTTP2_STATS_NUM_ERROR_CODES - 1);
+}
+
+static void session_update_peak_concurrent_streams(nghttp2_session *session) {
+  size_t n = session->num_outgoing_streams + session->num_incoming_streams;
+
+  if (session->stats.peak_concurrent_streams < n) {
+    session->stats.peak_concurrent_streams = n;
+  }
+}
+
+/*
+ * Starts measuring the time spent blocked by connection level flow
+ * control if |blocked| is nonzero, or stops and accumulates it
+ * otherwise.  Nothing happens if the state does not change.
+ */
+static void session_set_conn_flow_blocked(nghttp2_session *session,
+                                          int blocked) {
+  uint64_t now;
+
+  if (!session->conn_flow_blocked == !blocked) {
+    return;
+  }
+
+  now = nghttp2_time_now_us();
+
+  if (blocked) {
+    session->conn_flow_blocked_since = now;
+  } else if (now > session->conn_flow_blocked_since) {
+    session->stats.conn_flow_blocked_us +=
+        now - session->conn_flow_blocked_since;
+  }
+
+  session->conn_flow_blocked = blocked != 0;
+}
+
+/*
+ * Accumulates the time spent by the streams blocked by stream level
+ * flow control since the last call, and then increments the number
+ * of such streams if |blocked| is nonzero, or decrements it
+ * otherwise.
+ */
+static void session_update_stream_flow_blocked(nghttp2_session *session,
+                                               int blocked) {
+  uint64_t now = nghttp2_time_now_us();
+
+  if (session->num_flow_blocked_streams &&
+      now > session->stream_flow_blocked_last) {
+    session->stats.stream_flow_blocked_us +=
+        (now - session->stream_flow_blocked_last) *
+        session->num_flow_blocked_streams;
+  }
+
+  session->stream_flow_blocked_last = now;
+
+  if (blocked) {
+    ++session->num_flow_blocked_streams;
+  } else if (session->num_flow_blocked_streams) {
+    --session->num_flow_blocked_streams;
+  }
+}
+
 /*
  * Returns non-zero if |lib_error| is non-fatal error.
  */
@@ -357,6 +442,24 @@ static void session_inbound_frame_reset(nghttp2_session *session) {
 
   iframe->raw_lbuf = NULL;
 
+  /* Don't keep the memory used for one large header block for the
+     rest of the connection. */
+  if (nghttp2_buf_cap(&iframe->nvbuf) > NGHTTP2_HEADER_BLOCK_BUFFER_KEEP) {
+    nghttp2_buf_free(&iframe->nvbuf, &session->inbound_mem);
+    nghttp2_buf_init(&iframe->nvbuf);
+  } else {
+    nghttp2_buf_reset(&iframe->nvbuf);
+  }
+
+  if (iframe->nvcap > NGHTTP2_HEADER_BLOCK_NVA_KEEP) {
+    nghttp2_mem_free(&session->inbound_mem, iframe->nva);
+    iframe->nva = NULL;
+    iframe->nvcap = 0;
+  }
+
+  iframe->nvlen = 0;
+  iframe->nvlistlen = 0;
+
   iframe->payloadleft = 0;
   iframe->padlen = 0;
 }
@@ -378,6 +481,7 @@ static void active_outbound_item_reset(nghttp2_active_outbound_item *aob,
   nghttp2_mem_free(mem, aob->item);
   aob->item = NULL;
   nghttp2_bufs_reset(&aob->framebufs);
+  aob->data_ref = NULL;
   aob->state = NGHTTP2_OB_POP_ITEM;
 }
 
@@ -391,6 +495,11 @@ static int session_new(nghttp2_session **session_ptr,
   size_t nbuffer;
   size_t max_deflate_dynamic_table_size =
       NGHTTP2_HD_DEFAULT_MAX_DEFLATE_BUFFER_SIZE;
+  int no_header_copy = 0;
+  int hd_adaptive_indexing = 0;
+  int hd_memoize = 0;
+  int mem_pool = 0;
+  int mem_accounting = 0;
 
   if (mem == NULL) {
     mem = nghttp2_mem_default();
@@ -405,6 +514,9 @@ static int session_new(nghttp2_session **session_ptr,
   (*session_ptr)->mem = *mem;
   mem = &(*session_ptr)->mem;
 
+  nghttp2_mem_pool_init(&(*session_ptr)->mem_pool, mem);
+  nghttp2_mpsc_init(&(*session_ptr)->cmdq);
+
   /* next_stream_id is initialized in either
      nghttp2_session_client_new2 or nghttp2_session_server_new2 */
 
@@ -440,6 +552,18 @@ static int session_new(nghttp2_session **session_ptr,
   (*session_ptr)->remote_settings.max_concurrent_streams = 100;
 
   (*session_ptr)->max_send_header_block_length = NGHTTP2_MAX_HEADERSLEN;
+  (*session_ptr)->max_session_memory = SIZE_MAX;
+  (*session_ptr)->window_update_threshold =
+      NGHTTP2_DEFAULT_WINDOW_UPDATE_THRESHOLD;
+  (*session_ptr)->max_outbound_ack = NGHTTP2_MAX_OBQ_FLOOD_ITEM;
+  (*session_ptr)->max_empty_data_frames =
+      NGHTTP2_DEFAULT_MAX_EMPTY_DATA_FRAMES;
+
+  nghttp2_ratelim_init(&(*session_ptr)->stream_reset_ratelim,
+                       NGHTTP2_DEFAULT_STREAM_RESET_BURST,
+                       NGHTTP2_DEFAULT_STREAM_RESET_RATE);
+
+  nghttp2_bdp_init(&(*session_ptr)->bdp, 0);
 
   if (option) {
     if ((option->opt_set_mask & NGHTTP2_OPT_NO_AUTO_WINDOW_UPDATE) &&
@@ -499,18 +623,136 @@ static int session_new(nghttp2_session **session_ptr,
         option->no_closed_streams) {
       (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_NO_CLOSED_STREAMS;
     }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_NO_RFC7540_PRIORITIES) &&
+        option->no_rfc7540_priorities) {
+      (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_NO_HEADER_COPY) {
+      no_header_copy = option->no_header_copy;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_HD_ADAPTIVE_INDEXING) {
+      hd_adaptive_indexing = option->hd_adaptive_indexing;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_HD_MEMOIZE) {
+      hd_memoize = option->hd_memoize;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_MEM_POOL) {
+      mem_pool = option->mem_pool;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_MEM_ACCOUNTING) {
+      mem_accounting = option->mem_accounting;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_MAX_SESSION_MEMORY) {
+      (*session_ptr)->max_session_memory = option->max_session_memory;
+      mem_accounting = 1;
+    }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_WINDOW_AUTO_TUNING) &&
+        option->max_auto_window_size) {
+      (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_WINDOW_AUTO_TUNING;
+      nghttp2_bdp_init(&(*session_ptr)->bdp,
+                       (int32_t)nghttp2_min(option->max_auto_window_size,
+                                            NGHTTP2_MAX_WINDOW_SIZE));
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_WINDOW_UPDATE_THRESHOLD) {
+      (*session_ptr)->window_update_threshold =
+          nghttp2_max(1, nghttp2_min(option->window_update_threshold, 100));
+    }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_COALESCE_WINDOW_UPDATE) &&
+        option->coalesce_window_update) {
+      (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE;
+    }
+
+#ifdef NGHTTP2_MPSC_ENABLED
+    if ((option->opt_set_mask & NGHTTP2_OPT_COMMAND_QUEUE) &&
+        option->command_queue) {
+      (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_COMMAND_QUEUE;
+    }
+#endif /* NGHTTP2_MPSC_ENABLED */
+
+    if (option->opt_set_mask & NGHTTP2_OPT_STREAM_RESET_RATE_LIMIT) {
+      nghttp2_ratelim_init(&(*session_ptr)->stream_reset_ratelim,
+                           option->stream_reset_burst,
+                           option->stream_reset_rate);
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_MAX_OUTBOUND_ACK) {
+      (*session_ptr)->max_outbound_ack = option->max_outbound_ack;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_MAX_EMPTY_DATA_FRAMES) {
+      (*session_ptr)->max_empty_data_frames = option->max_empty_data_frames;
+    }
+  }
+
+  if (mem_pool) {
+    /* Nothing has been allocated by mem so far */
+    nghttp2_mem_pool_mem_init(mem, &(*session_ptr)->mem_pool);
+  }
+
+  if (mem_accounting) {
+    nghttp2_mem_account_init(&(*session_ptr)->mem_account, mem);
+    nghttp2_mem_account_mem_init(mem, &(*session_ptr)->mem_account,
+                                 NGHTTP2_MEM_CAT_OUTBOUND);
+    nghttp2_mem_account_mem_init(&(*session_ptr)->stream_mem,
+                                 &(*session_ptr)->mem_account,
+                                 NGHTTP2_MEM_CAT_STREAM);
+    nghttp2_mem_account_mem_init(&(*session_ptr)->hd_mem,
+                                 &(*session_ptr)->mem_account,
+                                 NGHTTP2_MEM_CAT_HD);
+    nghttp2_mem_account_mem_init(&(*session_ptr)->inbound_mem,
+                                 &(*session_ptr)->mem_account,
+                                 NGHTTP2_MEM_CAT_INBOUND);
+
+    (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_MEM_ACCOUNTING;
+  } else {
+    (*session_ptr)->stream_mem = *mem;
+    (*session_ptr)->hd_mem = *mem;
+    (*session_ptr)->inbound_mem = *mem;
+  }
+
+  if ((*session_ptr)->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    nghttp2_sched_urgency_init(&(*session_ptr)->sched);
+  } else {
+    nghttp2_sched_rfc7540_init(&(*session_ptr)->sched, &(*session_ptr)->root);
   }
 
   rv = nghttp2_hd_deflate_init2(&(*session_ptr)->hd_deflater,
-                                max_deflate_dynamic_table_size, mem);
+                                max_deflate_dynamic_table_size,
+                                &(*session_ptr)->hd_mem);
   if (rv != 0) {
     goto fail_hd_deflater;
   }
-  rv = nghttp2_hd_inflate_init(&(*session_ptr)->hd_inflater, mem);
+  if (hd_adaptive_indexing) {
+    rv = nghttp2_hd_deflate_set_adaptive_indexing(&(*session_ptr)->hd_deflater,
+                                                  1);
+    if (rv != 0) {
+      goto fail_hd_inflater;
+    }
+  }
+  if (hd_memoize) {
+    rv = nghttp2_hd_deflate_set_memoize(&(*session_ptr)->hd_deflater, 1);
+    if (rv != 0) {
+      goto fail_hd_inflater;
+    }
+  }
+  rv = nghttp2_hd_inflate_init(&(*session_ptr)->hd_inflater,
+                               &(*session_ptr)->hd_mem);
   if (rv != 0) {
     goto fail_hd_inflater;
   }
-  rv = nghttp2_map_init(&(*session_ptr)->streams, mem);
+  nghttp2_hd_inflate_set_no_copy(&(*session_ptr)->hd_inflater, no_header_copy);
+  rv = nghttp2_map_init(&(*session_ptr)->streams,
+                        &(*session_ptr)->stream_mem);
   if (rv != 0) {
     goto fail_map;
   }
@@ -566,7 +808,8 @@ fail_map:
 fail_hd_inflater:
   nghttp2_hd_deflate_free(&(*session_ptr)->hd_deflater);
 fail_hd_deflater:
-  nghttp2_mem_free(mem, *session_ptr);
+  nghttp2_mem_pool_free(&(*session_ptr)->mem_pool);
+  nghttp2_mem_free(&(*session_ptr)->mem_pool.mem, *session_ptr);
 fail_session:
   return rv;
 }
@@ -704,6 +947,18 @@ static void inflight_settings_del(nghttp2_inflight_settings *settings,
   nghttp2_mem_free(mem, settings);
 }
 
+/*
+ * Frees the commands in session->cmdq without executing them.
+ */
+static void session_free_command_queue(nghttp2_session *session) {
+  nghttp2_mpsc_entry *ent;
+
+  while ((ent = nghttp2_mpsc_pop(&session->cmdq)) != NULL) {
+    nghttp2_mem_free(&session->mem_pool.mem,
+                     nghttp2_struct_of(ent, nghttp2_cmd, mpsc_entry));
+  }
+}
+
 void nghttp2_session_del(nghttp2_session *session) {
   nghttp2_mem *mem;
   nghttp2_inflight_settings *settings;
@@ -733,10 +988,16 @@ void nghttp2_session_del(nghttp2_session *session) {
 
   active_outbound_item_reset(&session->aob, mem);
   session_inbound_frame_reset(session);
+  nghttp2_mem_free(&session->inbound_mem, session->iframe.nva);
+  nghttp2_buf_free(&session->iframe.nvbuf, &session->inbound_mem);
+  nghttp2_mem_free(mem, session->pending_window_update_streams);
   nghttp2_hd_deflate_free(&session->hd_deflater);
   nghttp2_hd_inflate_free(&session->hd_inflater);
   nghttp2_bufs_free(&session->aob.framebufs);
-  nghttp2_mem_free(mem, session);
+  nghttp2_buf_free(&session->vecbuf, mem);
+  session_free_command_queue(session);
+  nghttp2_mem_pool_free(&session->mem_pool);
+  nghttp2_mem_free(&session->mem_pool.mem, session);
 }
 
 int nghttp2_session_reprioritize_stream(
@@ -749,7 +1010,8 @@ int nghttp2_session_reprioritize_stream(
 
   assert(pri_spec->stream_id != stream->stream_id);
 
-  if (!nghttp2_stream_in_dep_tree(stream)) {
+  if (!nghttp2_stream_in_dep_tree(stream) ||
+      (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
     return 0;
   }
 
@@ -835,7 +1097,7 @@ int nghttp2_session_add_item(nghttp2_session *session,
       return NGHTTP2_ERR_DATA_EXIST;
     }
 
-    rv = nghttp2_stream_attach_item(stream, item);
+    rv = nghttp2_sched_attach_item(&session->sched, stream, item);
 
     if (rv != 0) {
       return rv;
@@ -984,6 +1246,42 @@ int nghttp2_session_add_rst_stream(nghttp2_session *session, int32_t stream_id,
   return 0;
 }
 
+/*
+ * Replaces the compact idle |stream|, which has been removed from the
+ * dependency tree, with the full stream object.
+ *
+ * This function returns the new stream object, or NULL if it fails
+ * to allocate memory.
+ */
+static nghttp2_stream *
+session_upgrade_compact_stream(nghttp2_session *session,
+                               nghttp2_stream *stream) {
+  nghttp2_stream *full;
+  nghttp2_mem *mem;
+
+  mem = &session->stream_mem;
+
+  full = nghttp2_mem_malloc(mem, sizeof(nghttp2_stream));
+  if (full == NULL) {
+    return NULL;
+  }
+
+  nghttp2_stream_init(full, stream->stream_id, NGHTTP2_STREAM_FLAG_NONE,
+                      NGHTTP2_STREAM_IDLE, stream->weight,
+                      (int32_t)session->remote_settings.initial_window_size,
+                      (int32_t)session->local_settings.initial_window_size,
+                      NULL, mem);
+
+  nghttp2_map_replace(&session->streams, &full->map_entry);
+
+  nghttp2_stream_free(stream);
+  nghttp2_mem_free(mem, stream);
+
+  --session->num_compact_streams;
+
+  return full;
+}
+
 nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
                                             int32_t stream_id, uint8_t flags,
                                             nghttp2_priority_spec *pri_spec_in,
@@ -997,7 +1295,7 @@ nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
   nghttp2_priority_spec *pri_spec = pri_spec_in;
   nghttp2_mem *mem;
 
-  mem = &session->mem;
+  mem = &session->stream_mem;
   stream = nghttp2_session_get_stream_raw(session, stream_id);
 
   if (stream) {
@@ -1008,6 +1306,13 @@ nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
     if (rv != 0) {
       return NULL;
     }
+
+    if (stream->flags & NGHTTP2_STREAM_FLAG_COMPACT) {
+      stream = session_upgrade_compact_stream(session, stream);
+      if (stream == NULL) {
+        return NULL;
+      }
+    }
   } else {
     stream = nghttp2_mem_malloc(mem, sizeof(nghttp2_stream));
     if (stream == NULL) {
@@ -1017,7 +1322,12 @@ nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
     stream_alloc = 1;
   }
 
-  if (pri_spec->stream_id != 0) {
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    /* Urgency scheduler does not use dependency tree.  Just give
+       stream the default weight. */
+    nghttp2_priority_spec_default_init(&pri_spec_default);
+    pri_spec = &pri_spec_default;
+  } else if (pri_spec->stream_id != 0) {
     dep_stream = nghttp2_session_get_stream_raw(session, pri_spec->stream_id);
 
     if (!dep_stream &&
@@ -1100,6 +1410,11 @@ nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
     } else {
       ++session->num_incoming_streams;
     }
+    session_update_peak_concurrent_streams(session);
+  }
+
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    return stream;
   }
 
   if (pri_spec->stream_id == 0) {
@@ -1141,7 +1456,11 @@ int nghttp2_session_close_stream(nghttp2_session *session, int32_t stream_id,
 
     item = stream->item;
 
-    rv = nghttp2_stream_detach_item(stream);
+    if (nghttp2_stream_check_deferred_by_flow_control(stream)) {
+      session_update_stream_flow_blocked(session, 0);
+    }
+
+    rv = nghttp2_sched_detach_item(&session->sched, stream);
 
     if (rv != 0) {
       return rv;
@@ -1191,7 +1510,8 @@ int nghttp2_session_close_stream(nghttp2_session *session, int32_t stream_id,
   /* Closes both directions just in case they are not closed yet */
   stream->flags |= NGHTTP2_STREAM_FLAG_CLOSED;
 
-  if ((session->opt_flags & NGHTTP2_OPTMASK_NO_CLOSED_STREAMS) == 0 &&
+  if ((session->opt_flags & (NGHTTP2_OPTMASK_NO_CLOSED_STREAMS |
+                             NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) == 0 &&
       session->server && !is_my_stream_id &&
       nghttp2_stream_in_dep_tree(stream)) {
     /* On server side, retain stream at most MAX_CONCURRENT_STREAMS
@@ -1224,6 +1544,10 @@ int nghttp2_session_destroy_stream(nghttp2_session *session,
     }
   }
 
+  if (stream->flags & NGHTTP2_STREAM_FLAG_COMPACT) {
+    --session->num_compact_streams;
+  }
+
   nghttp2_map_remove(&session->streams, stream->stream_id);
   nghttp2_stream_free(stream);
   nghttp2_mem_free(mem, stream);
@@ -1384,6 +1708,137 @@ int nghttp2_session_adjust_idle_stream(nghttp2_session *session) {
   return 0;
 }
 
+nghttp2_stream *nghttp2_session_compact_stream(nghttp2_session *session,
+                                               nghttp2_stream *stream) {
+  nghttp2_stream *compact;
+
+  assert(stream->item == NULL);
+  assert(!(stream->flags & NGHTTP2_STREAM_FLAG_COMPACT));
+
+  compact = nghttp2_mem_malloc(&session->stream_mem,
+                               NGHTTP2_STREAM_COMPACT_SIZE);
+  if (compact == NULL) {
+    return stream;
+  }
+
+  DEBUGF("stream: compact stream(%p)=%d to (%p)\n", stream,
+         stream->stream_id, compact);
+
+  /* Do not use struct assignment; compact is shorter than
+     nghttp2_stream. */
+  memcpy(compact, stream, NGHTTP2_STREAM_COMPACT_SIZE);
+  compact->flags |= NGHTTP2_STREAM_FLAG_COMPACT;
+
+  nghttp2_map_replace(&session->streams, &compact->map_entry);
+  nghttp2_stream_dep_replace(stream, compact);
+
+  if (stream->closed_prev) {
+    stream->closed_prev->closed_next = compact;
+  } else if (session->closed_stream_head == stream) {
+    session->closed_stream_head = compact;
+  } else {
+    assert(session->idle_stream_head == stream);
+    session->idle_stream_head = compact;
+  }
+
+  if (stream->closed_next) {
+    stream->closed_next->closed_prev = compact;
+  } else if (session->closed_stream_tail == stream) {
+    session->closed_stream_tail = compact;
+  } else {
+    assert(session->idle_stream_tail == stream);
+    session->idle_stream_tail = compact;
+  }
+
+  /* The obq is now owned by compact.  Do not call
+     nghttp2_stream_free(). */
+  nghttp2_mem_free(&session->mem, stream);
+
+  ++session->num_compact_streams;
+
+  return compact;
+}
+
+/*
+ * Compacts the streams in the list ending with |tail| which have been
+ * added since the last call.  The compact ones form the head of the
+ * list because new streams are appended to the tail.
+ */
+static void session_compact_stream_list(nghttp2_session *session,
+                                        nghttp2_stream *tail) {
+  nghttp2_stream *stream, *prev;
+
+  for (stream = tail;
+       stream && !(stream->flags & NGHTTP2_STREAM_FLAG_COMPACT);
+       stream = prev) {
+    prev = stream->closed_prev;
+
+    if (stream->item ||
+        nghttp2_session_compact_stream(session, stream) == stream) {
+      /* Try again next time. */
+      return;
+    }
+  }
+}
+
+/*
+ * Replaces the closed and idle streams which have been retained since
+ * the last call with the compact copies.  They are only used to
+ * maintain the dependency tree, and the pointers to them are not
+ * kept across nghttp2_session_mem_send() and
+ * nghttp2_session_mem_recv().
+ */
+static void session_compact_retained_streams(nghttp2_session *session) {
+  session_compact_stream_list(session, session->closed_stream_tail);
+  session_compact_stream_list(session, session->idle_stream_tail);
+}
+
+/*
+ * Destroys closed streams and then idle streams, oldest first, until
+ * the memory held by |session| goes under session->max_session_memory
+ * or no such stream is left.  They are only retained for priority
+ * purposes, and are the cheapest to give up.
+ *
+ * This function returns 0 if it succeeds, or one of the negative
+ * error codes returned by nghttp2_session_destroy_stream().
+ */
+static int session_reclaim_mem(nghttp2_session *session) {
+  nghttp2_stream *head;
+  int rv;
+
+  while (session->closed_stream_head && session_is_mem_exceeded(session)) {
+    head = session->closed_stream_head;
+
+    session->closed_stream_head = head->closed_next;
+
+    if (session->closed_stream_head) {
+      session->closed_stream_head->closed_prev = NULL;
+    } else {
+      session->closed_stream_tail = NULL;
+    }
+
+    --session->num_closed_streams;
+
+    rv = nghttp2_session_destroy_stream(session, head);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  while (session->idle_stream_head && session_is_mem_exceeded(session)) {
+    head = session->idle_stream_head;
+
+    nghttp2_session_detach_idle_stream(session, head);
+
+    rv = nghttp2_session_destroy_stream(session, head);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
 /*
  * Closes stream with stream ID |stream_id| if both transmission and
  * reception of the stream were disallowed. The |error_code| indicates
@@ -1935,6 +2390,21 @@ static int session_pack_extension(nghttp2_session *session, nghttp2_bufs *bufs,
   return 0;
 }
 
+/* Opaque data of PING which probes bandwidth-delay product */
+static const uint8_t bdp_ping_opaque[8] = {'n', 'g', 'h', 't',
+                                           't', 'p', '2', 'b'};
+
+/*
+ * Returns nonzero if PING |frame| is the window auto-tuning probe, or
+ * its ACK.
+ */
+static int session_is_bdp_ping(nghttp2_session *session,
+                               nghttp2_frame *frame) {
+  return (session->opt_flags & NGHTTP2_OPTMASK_WINDOW_AUTO_TUNING) &&
+         memcmp(frame->ping.opaque_data, bdp_ping_opaque,
+                sizeof(bdp_ping_opaque)) == 0;
+}
+
 /*
  * This function serializes frame for transmission.
  *
@@ -1970,7 +2440,7 @@ static int session_prep_frame(nghttp2_session *session,
       if (stream) {
         int rv2;
 
-        rv2 = nghttp2_stream_detach_item(stream);
+        rv2 = nghttp2_sched_detach_item(&session->sched, stream);
 
         if (nghttp2_is_fatal(rv2)) {
           return rv2;
@@ -1989,13 +2459,15 @@ static int session_prep_frame(nghttp2_session *session,
          queue when session->remote_window_size > 0 */
       assert(session->remote_window_size > 0);
 
-      rv = nghttp2_stream_defer_item(stream,
-                                     NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
+      rv = nghttp2_sched_defer_item(&session->sched, stream,
+                                    NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
+      session_update_stream_flow_blocked(session, 1);
+
       session->aob.item = NULL;
       active_outbound_item_reset(&session->aob, mem);
       return NGHTTP2_ERR_DEFERRED;
@@ -2008,7 +2480,8 @@ static int session_prep_frame(nghttp2_session *session,
       return rv;
     }
     if (rv == NGHTTP2_ERR_DEFERRED) {
-      rv = nghttp2_stream_defer_item(stream, NGHTTP2_STREAM_FLAG_DEFERRED_USER);
+      rv = nghttp2_sched_defer_item(&session->sched, stream,
+                                    NGHTTP2_STREAM_FLAG_DEFERRED_USER);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
@@ -2019,7 +2492,7 @@ static int session_prep_frame(nghttp2_session *session,
       return NGHTTP2_ERR_DEFERRED;
     }
     if (rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
-      rv = nghttp2_stream_detach_item(stream);
+      rv = nghttp2_sched_detach_item(&session->sched, stream);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
@@ -2035,7 +2508,7 @@ static int session_prep_frame(nghttp2_session *session,
     if (rv != 0) {
       int rv2;
 
-      rv2 = nghttp2_stream_detach_item(stream);
+      rv2 = nghttp2_sched_detach_item(&session->sched, stream);
 
       if (nghttp2_is_fatal(rv2)) {
         return rv2;
@@ -2231,6 +2704,10 @@ static int session_prep_frame(nghttp2_session *session,
     }
 
     if (session_is_closing(session)) {
+      if ((frame->hd.flags & NGHTTP2_FLAG_ACK) == 0 &&
+          session_is_bdp_ping(session, frame)) {
+        nghttp2_bdp_on_probe_dropped(&session->bdp);
+      }
       return NGHTTP2_ERR_SESSION_CLOSING;
     }
     nghttp2_frame_pack_ping(&session->aob.framebufs, &frame->ping);
@@ -2306,7 +2783,7 @@ nghttp2_session_get_next_ob_item(nghttp2_session *session) {
   }
 
   if (session->remote_window_size > 0) {
-    return nghttp2_stream_next_outbound_item(&session->root);
+    return nghttp2_sched_next_outbound_item(&session->sched);
   }
 
   return NULL;
@@ -2340,7 +2817,11 @@ nghttp2_session_pop_next_ob_item(nghttp2_session *session) {
   }
 
   if (session->remote_window_size > 0) {
-    return nghttp2_stream_next_outbound_item(&session->root);
+    return nghttp2_sched_next_outbound_item(&session->sched);
+  }
+
+  if (!nghttp2_sched_empty(&session->sched)) {
+    session_set_conn_flow_blocked(session, 1);
   }
 
   return NULL;
@@ -2453,12 +2934,6 @@ static int session_close_stream_on_goaway(nghttp2_session *session,
   return 0;
 }
 
-static void reschedule_stream(nghttp2_stream *stream) {
-  stream->last_writelen = stream->item->frame.hd.length;
-
-  nghttp2_stream_reschedule(stream);
-}
-
 static int session_update_stream_consumed_size(nghttp2_session *session,
                                                nghttp2_stream *stream,
                                                size_t delta_size);
@@ -2474,6 +2949,43 @@ static int session_update_recv_stream_window_size(nghttp2_session *session,
                                                   size_t delta_size,
                                                   int send_window_update);
 
+static int session_flush_window_update(nghttp2_session *session);
+
+static int session_bdp_on_probe_ack(nghttp2_session *session);
+
+/*
+ * Updates session->stats for |frame| which has just been sent.  The
+ * |framebufs| tells whether the frame was actually CONTINUATION
+ * following HEADERS or PUSH_PROMISE.
+ */
+static void session_stats_on_frame_sent(nghttp2_session *session,
+                                        nghttp2_frame *frame,
+                                        nghttp2_bufs *framebufs) {
+  nghttp2_stats *stats = &session->stats;
+
+  switch (frame->hd.type) {
+  case NGHTTP2_DATA:
+    ++stats->frames_sent[NGHTTP2_DATA];
+    stats->data_bytes_sent += frame->hd.length - frame->data.padlen;
+    break;
+  case NGHTTP2_HEADERS:
+  case NGHTTP2_PUSH_PROMISE:
+    if (framebufs->cur != framebufs->head) {
+      ++stats->frames_sent[NGHTTP2_CONTINUATION];
+    } else {
+      ++stats->frames_sent[frame->hd.type];
+    }
+    break;
+  case NGHTTP2_RST_STREAM:
+    ++stats->frames_sent[NGHTTP2_RST_STREAM];
+    ++stats->rst_stream_sent[stats_error_code_index(
+        frame->rst_stream.error_code)];
+    break;
+  default:
+    ++stats->frames_sent[stats_frame_type_index(frame->hd.type)];
+  }
+}
+
 /*
  * Called after a frame is sent.  This function runs
  * on_frame_send_callback and handles stream closure upon END_STREAM
@@ -2498,6 +3010,8 @@ static int session_after_frame_sent1(nghttp2_session *session) {
 
   frame = &item->frame;
 
+  session_stats_on_frame_sent(session, frame, framebufs);
+
   if (frame->hd.type == NGHTTP2_DATA) {
     nghttp2_data_aux_data *aux_data;
 
@@ -2513,13 +3027,13 @@ static int session_after_frame_sent1(nghttp2_session *session) {
     }
 
     if (stream && aux_data->eof) {
-      rv = nghttp2_stream_detach_item(stream);
+      rv = nghttp2_sched_detach_item(&session->sched, stream);
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
       /* Call on_frame_send_callback after
-         nghttp2_stream_detach_item(), so that application can issue
+         nghttp2_sched_detach_item(), so that application can issue
          nghttp2_submit_data() in the callback. */
       if (session->callbacks.on_frame_send_callback) {
         rv = session_call_on_frame_send(session, frame);
@@ -2607,6 +3121,7 @@ static int session_after_frame_sent1(nghttp2_session *session) {
     case NGHTTP2_HCAT_PUSH_RESPONSE:
       stream->flags = (uint8_t)(stream->flags & ~NGHTTP2_STREAM_FLAG_PUSH);
       ++session->num_outgoing_streams;
+      session_update_peak_concurrent_streams(session);
     /* Fall through */
     case NGHTTP2_HCAT_RESPONSE:
       stream->state = NGHTTP2_STREAM_OPENED;
@@ -2701,6 +3216,14 @@ static int session_after_frame_sent1(nghttp2_session *session) {
 
     return 0;
   }
+  case NGHTTP2_PING:
+    if ((frame->hd.flags & NGHTTP2_FLAG_ACK) == 0 &&
+        session->bdp.state == NGHTTP2_BDP_QUEUED &&
+        session_is_bdp_ping(session, frame)) {
+      nghttp2_bdp_on_probe_sent(&session->bdp, nghttp2_time_now_us());
+    }
+
+    return 0;
   case NGHTTP2_WINDOW_UPDATE:
     if (frame->hd.stream_id == 0) {
       session->window_update_queued = 0;
@@ -2814,7 +3337,7 @@ static int session_after_frame_sent2(nghttp2_session *session) {
      further data. */
   if (nghttp2_session_predicate_data_send(session, stream) != 0) {
     if (stream) {
-      rv = nghttp2_stream_detach_item(stream);
+      rv = nghttp2_sched_detach_item(&session->sched, stream);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
@@ -2861,32 +3384,267 @@ static int session_call_send_data(nghttp2_session *session,
   }
 }
 
-static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
-                                                 const uint8_t **data_ptr,
-                                                 int fast_cb) {
+/*
+ * Gets the payload of DATA frame in session->aob by reference from
+ * data_ref_callback.  The Pad Length field and padding are written
+ * into aob->framebufs around the space reserved for the payload.  If
+ * |copy| is nonzero, the payload is copied into aob->framebufs and
+ * released immediately, and aob->state becomes
+ * NGHTTP2_OB_SEND_DATA.  Otherwise, the payload is kept in
+ * aob->data_ref, and aob->state becomes NGHTTP2_OB_SEND_DATA_REF.
+ *
+ * This function returns 0 if it succeeds, or
+ * NGHTTP2_ERR_WOULDBLOCK, NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE or
+ * NGHTTP2_ERR_CALLBACK_FAILURE.
+ */
+static int session_call_data_ref(nghttp2_session *session, int copy) {
   int rv;
-  nghttp2_active_outbound_item *aob;
-  nghttp2_bufs *framebufs;
-  nghttp2_mem *mem;
+  nghttp2_active_outbound_item *aob = &session->aob;
+  nghttp2_frame *frame = &aob->item->frame;
+  nghttp2_data_aux_data *aux_data = &aob->item->aux_data.data;
+  nghttp2_buf *buf = &aob->framebufs.cur->buf;
+  const uint8_t *data = NULL;
+  size_t length, trail_padlen;
+  uint8_t *p;
 
-  mem = &session->mem;
-  aob = &session->aob;
-  framebufs = &aob->framebufs;
+  length = frame->hd.length - frame->data.padlen;
+  trail_padlen = frame->data.padlen ? frame->data.padlen - 1 : 0;
 
-  /* We may have idle streams more than we expect (e.g.,
-     nghttp2_session_change_stream_priority() or
-     nghttp2_session_create_idle_stream()).  Adjust them here. */
-  rv = nghttp2_session_adjust_idle_stream(session);
-  if (nghttp2_is_fatal(rv)) {
+  rv = session->callbacks.data_ref_callback(session, frame, &data,
+                                            &aux_data->data_prd.source,
+                                            session->user_data);
+
+  switch (rv) {
+  case 0:
+    break;
+  case NGHTTP2_ERR_WOULDBLOCK:
+  case NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE:
     return rv;
+  default:
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
   }
 
-  for (;;) {
-    switch (aob->state) {
-    case NGHTTP2_OB_POP_ITEM: {
-      nghttp2_outbound_item *item;
+  p = buf->pos + NGHTTP2_FRAME_HDLEN;
 
-      item = nghttp2_session_pop_next_ob_item(session);
+  if (frame->data.padlen) {
+    *p++ = (uint8_t)trail_padlen;
+  }
+
+  if (!copy) {
+    /* The payload goes between p and the padding */
+    memset(p, 0, trail_padlen);
+
+    aob->data_ref = data;
+    aob->state = NGHTTP2_OB_SEND_DATA_REF;
+
+    return 0;
+  }
+
+  if (length) {
+    p = nghttp2_cpymem(p, data, length);
+  }
+  memset(p, 0, trail_padlen);
+  buf->last = p + trail_padlen;
+
+  if (session->callbacks.data_ref_release_callback &&
+      session->callbacks.data_ref_release_callback(
+          session, frame, data, &aux_data->data_prd.source,
+          session->user_data) != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  aob->state = NGHTTP2_OB_SEND_DATA;
+
+  return 0;
+}
+
+/*
+ * Releases the payload of DATA frame which was handed to application
+ * by nghttp2_session_mem_sendv().
+ *
+ * This function returns 0 if it succeeds, or
+ * NGHTTP2_ERR_CALLBACK_FAILURE.
+ */
+static int session_call_data_ref_release(nghttp2_session *session) {
+  nghttp2_active_outbound_item *aob = &session->aob;
+  const uint8_t *data = aob->data_ref;
+
+  aob->data_ref = NULL;
+
+  if (session->callbacks.data_ref_release_callback &&
+      session->callbacks.data_ref_release_callback(
+          session, &aob->item->frame, data,
+          &aob->item->aux_data.data.data_prd.source,
+          session->user_data) != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+/*
+ * Releases the payload of DATA frames in session->data_refs which
+ * were handed to application by nghttp2_session_mem_sendv().
+ *
+ * This function returns 0 if it succeeds, or
+ * NGHTTP2_ERR_CALLBACK_FAILURE.
+ */
+static int session_release_data_refs(nghttp2_session *session) {
+  nghttp2_data_ref_entry *ent;
+  size_t i, n = session->num_data_refs;
+
+  session->num_data_refs = 0;
+
+  if (session->callbacks.data_ref_release_callback == NULL) {
+    return 0;
+  }
+
+  for (i = 0; i < n; ++i) {
+    ent = &session->data_refs[i];
+
+    if (session->callbacks.data_ref_release_callback(
+            session, &ent->frame, ent->data, &ent->source,
+            session->user_data) != 0) {
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Executes the commands which other threads have queued so far.  The
+ * command which fails with non-fatal error, for example because the
+ * stream has been closed, is discarded.  For discarded
+ * NGHTTP2_CMD_SUBMIT_DATA, on_queued_data_discard_callback is invoked
+ * so that application can release the data source.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ * NGHTTP2_ERR_CALLBACK_FAILURE
+ *     The callback function failed.
+ */
+static int session_drain_command_queue(nghttp2_session *session) {
+  nghttp2_mpsc_entry *ent;
+  nghttp2_cmd *cmd;
+  int rv;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_COMMAND_QUEUE)) {
+    return 0;
+  }
+
+  while ((ent = nghttp2_mpsc_pop(&session->cmdq)) != NULL) {
+    cmd = nghttp2_struct_of(ent, nghttp2_cmd, mpsc_entry);
+
+    switch (cmd->type) {
+    case NGHTTP2_CMD_RESUME_DATA:
+      rv = nghttp2_session_resume_data(session, cmd->stream_id);
+      break;
+    case NGHTTP2_CMD_SUBMIT_DATA:
+      rv = nghttp2_submit_data(session, cmd->flags, cmd->stream_id,
+                               &cmd->data_prd);
+      break;
+    default:
+      rv = nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE,
+                                     cmd->stream_id, cmd->error_code);
+      break;
+    }
+
+    DEBUGF("cmd: type=%u, stream_id=%d, rv=%d\n", cmd->type, cmd->stream_id,
+           rv);
+
+    if (rv != 0 && cmd->type == NGHTTP2_CMD_SUBMIT_DATA &&
+        session->callbacks.on_queued_data_discard_callback &&
+        session->callbacks.on_queued_data_discard_callback(
+            session, cmd->stream_id, &cmd->data_prd.source, rv,
+            session->user_data) != 0) {
+      rv = NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+
+    nghttp2_mem_free(&session->mem_pool.mem, cmd);
+
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+/* The flags for nghttp2_session_mem_send_internal() */
+typedef enum {
+  NGHTTP2_SEND_FLAG_NONE = 0,
+  /* The caller is nghttp2_session_mem_sendv().  The payload of DATA
+     frame may be taken by reference, in which case only the frame
+     header is returned and aob->state becomes
+     NGHTTP2_OB_SEND_DATA_REF. */
+  NGHTTP2_SEND_FLAG_VEC = 0x01,
+  /* The caller holds the bytes returned earlier which have not been
+     sent yet.  DATA frame which send_data_callback would write
+     directly is left for the next call to keep the order of bytes. */
+  NGHTTP2_SEND_FLAG_NO_DIRECT = 0x02
+} nghttp2_send_flag;
+
+/*
+ * Returns the next chunk of bytes to send in |*data_ptr|.  If
+ * |fast_cb| is nonzero, session_after_frame_sent1() has already been
+ * called by the caller for the frame whose transmission completes.
+ * The |flags| is bitwise OR of zero or more of nghttp2_send_flag.
+ */
+static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
+                                                 const uint8_t **data_ptr,
+                                                 int fast_cb, uint8_t flags) {
+  int rv;
+  nghttp2_active_outbound_item *aob;
+  nghttp2_bufs *framebufs;
+  nghttp2_mem *mem;
+
+  mem = &session->mem;
+  aob = &session->aob;
+  framebufs = &aob->framebufs;
+
+  if (!(flags & NGHTTP2_SEND_FLAG_NO_DIRECT)) {
+    /* The bytes returned by the previous call have been sent */
+    rv = session_release_data_refs(session);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  rv = session_drain_command_queue(session);
+  if (nghttp2_is_fatal(rv)) {
+    return rv;
+  }
+
+  /* We may have idle streams more than we expect (e.g.,
+     nghttp2_session_change_stream_priority() or
+     nghttp2_session_create_idle_stream()).  Adjust them here. */
+  rv = nghttp2_session_adjust_idle_stream(session);
+  if (nghttp2_is_fatal(rv)) {
+    return rv;
+  }
+
+  session_compact_retained_streams(session);
+
+  /* Send WINDOW_UPDATE for everything received since the last call
+     in one go. */
+  if (session->window_update_pending ||
+      session->num_pending_window_update_streams) {
+    rv = session_flush_window_update(session);
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+  }
+
+  for (;;) {
+    switch (aob->state) {
+    case NGHTTP2_OB_POP_ITEM: {
+      nghttp2_outbound_item *item;
+
+      item = nghttp2_session_pop_next_ob_item(session);
       if (item == NULL) {
         return 0;
       }
@@ -3106,13 +3864,22 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
         break;
       }
 
-      rv = session_call_send_data(session, aob->item, framebufs);
+      if (session->callbacks.data_ref_callback &&
+          ((flags & NGHTTP2_SEND_FLAG_VEC) ||
+           session->callbacks.send_data_callback == NULL)) {
+        rv = session_call_data_ref(session,
+                                   (flags & NGHTTP2_SEND_FLAG_VEC) == 0);
+      } else if (flags & NGHTTP2_SEND_FLAG_NO_DIRECT) {
+        return 0;
+      } else {
+        rv = session_call_send_data(session, aob->item, framebufs);
+      }
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
       if (rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
-        rv = nghttp2_stream_detach_item(stream);
+        rv = nghttp2_sched_detach_item(&session->sched, stream);
 
         if (nghttp2_is_fatal(rv)) {
           return rv;
@@ -3133,6 +3900,17 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
         return 0;
       }
 
+      if (aob->state == NGHTTP2_OB_SEND_DATA) {
+        /* The payload was copied into framebufs */
+        break;
+      }
+
+      if (aob->state == NGHTTP2_OB_SEND_DATA_REF) {
+        *data_ptr = framebufs->cur->buf.pos;
+
+        return (ssize_t)(NGHTTP2_FRAME_HDLEN + (frame->data.padlen > 0));
+      }
+
       pause = (rv == NGHTTP2_ERR_PAUSE);
 
       rv = session_after_frame_sent1(session);
@@ -3154,6 +3932,26 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
 
       break;
     }
+    case NGHTTP2_OB_SEND_DATA_REF:
+      /* Application has sent the frame returned by the previous
+         nghttp2_session_mem_sendv() call. */
+      rv = session_call_data_ref_release(session);
+      if (rv != 0) {
+        return rv;
+      }
+
+      rv = session_after_frame_sent1(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return rv;
+      }
+      rv = session_after_frame_sent2(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return rv;
+      }
+
+      break;
     case NGHTTP2_OB_SEND_CLIENT_MAGIC: {
       size_t datalen;
       nghttp2_buf *buf;
@@ -3184,7 +3982,8 @@ ssize_t nghttp2_session_mem_send(nghttp2_session *session,
 
   *data_ptr = NULL;
 
-  len = nghttp2_session_mem_send_internal(session, data_ptr, 1);
+  len = nghttp2_session_mem_send_internal(session, data_ptr, 1,
+                                          NGHTTP2_SEND_FLAG_NONE);
   if (len <= 0) {
     return len;
   }
@@ -3204,6 +4003,236 @@ ssize_t nghttp2_session_mem_send(nghttp2_session *session,
   return len;
 }
 
+ssize_t nghttp2_session_mem_send_into(nghttp2_session *session, uint8_t *buf,
+                                     size_t buflen) {
+  int rv;
+  ssize_t datalen;
+  size_t n;
+  const uint8_t *data;
+  uint8_t *p = buf, *end = buf + buflen;
+
+  while (p != end) {
+    data = NULL;
+
+    datalen = nghttp2_session_mem_send_internal(
+        session, &data, 1,
+        p == buf ? NGHTTP2_SEND_FLAG_NONE : NGHTTP2_SEND_FLAG_NO_DIRECT);
+    if (datalen < 0) {
+      return datalen;
+    }
+
+    if (datalen == 0) {
+      break;
+    }
+
+    n = nghttp2_min((size_t)datalen, (size_t)(end - p));
+
+    p = nghttp2_cpymem(p, data, n);
+
+    if (n < (size_t)datalen) {
+      /* The rest of the frame is sent in the next call */
+      session->aob.framebufs.cur->buf.pos -= (size_t)datalen - n;
+
+      break;
+    }
+
+    if (session->aob.item) {
+      /* See nghttp2_session_mem_send() */
+      rv = session_after_frame_sent1(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return (ssize_t)rv;
+      }
+    }
+  }
+
+  return p - buf;
+}
+
+/*
+ * Returns nonzero if session_after_frame_sent1() for the frame in
+ * session->aob may close the stream whose DATA payload is in
+ * session->data_refs.
+ */
+static int session_may_close_data_ref_stream(nghttp2_session *session) {
+  nghttp2_frame *frame;
+  size_t i;
+
+  if (session->num_data_refs == 0 || session->aob.item == NULL) {
+    return 0;
+  }
+
+  frame = &session->aob.item->frame;
+
+  switch (frame->hd.type) {
+  case NGHTTP2_GOAWAY:
+    return 1;
+  case NGHTTP2_RST_STREAM:
+    break;
+  default:
+    if (!(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+      return 0;
+    }
+  }
+
+  for (i = 0; i < session->num_data_refs; ++i) {
+    if (session->data_refs[i].frame.hd.stream_id == frame->hd.stream_id) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Appends |len| bytes pointed by |data| to |vec| whose |*pnvec|
+ * entries have been filled.  The bytes are merged into the last entry
+ * if they immediately follow it.
+ */
+static void vec_append(nghttp2_vec *vec, size_t *pnvec, const uint8_t *data,
+                       size_t len) {
+  nghttp2_vec *last;
+
+  if (*pnvec) {
+    last = &vec[*pnvec - 1];
+    if (last->base + last->len == data) {
+      last->len += len;
+      return;
+    }
+  }
+
+  vec[*pnvec].base = (uint8_t *)data;
+  vec[*pnvec].len = len;
+  ++*pnvec;
+}
+
+ssize_t nghttp2_session_mem_sendv(nghttp2_session *session, nghttp2_vec *vec,
+                                  size_t veccnt) {
+  int rv;
+  ssize_t len;
+  const uint8_t *data;
+  uint8_t *p;
+  nghttp2_active_outbound_item *aob = &session->aob;
+  nghttp2_buf *buf = &session->vecbuf;
+  nghttp2_frame *frame;
+  nghttp2_data_ref_entry *ent;
+  size_t nvec = 0, length, trail_padlen;
+  uint8_t flags = NGHTTP2_SEND_FLAG_VEC;
+
+  if (veccnt < 3) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (buf->begin == NULL) {
+    rv = nghttp2_buf_reserve(buf, NGHTTP2_VEC_BUFFER_LENGTH, &session->mem);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  nghttp2_buf_reset(buf);
+
+  /* DATA frame whose payload is referred takes up to 3 entries, and
+     its header and padding are copied into buf. */
+  while (veccnt - nvec >= 3 &&
+         nghttp2_buf_avail(buf) >= NGHTTP2_FRAME_HDLEN + NGHTTP2_MAX_PADLEN) {
+    data = NULL;
+
+    len = nghttp2_session_mem_send_internal(session, &data, 1, flags);
+    if (len < 0) {
+      return len;
+    }
+
+    if (len == 0) {
+      break;
+    }
+
+    flags |= NGHTTP2_SEND_FLAG_NO_DIRECT;
+
+    if (aob->state == NGHTTP2_OB_SEND_DATA_REF) {
+      frame = &aob->item->frame;
+      length = frame->hd.length - frame->data.padlen;
+      trail_padlen = frame->data.padlen ? frame->data.padlen - 1 : 0;
+
+      p = buf->last;
+      buf->last = nghttp2_cpymem(buf->last, data, (size_t)len);
+      vec_append(vec, &nvec, p, (size_t)len);
+
+      if (length) {
+        vec_append(vec, &nvec, aob->data_ref, length);
+      }
+
+      if (trail_padlen) {
+        p = buf->last;
+        buf->last = nghttp2_cpymem(buf->last, data + len, trail_padlen);
+        vec_append(vec, &nvec, p, trail_padlen);
+      }
+
+      if (aob->item->aux_data.data.eof ||
+          session->num_data_refs == NGHTTP2_MAX_DATA_REFS) {
+        /* session_after_frame_sent1() is deferred to the next call,
+           because it may close stream, and application may free the
+           payload on stream closure. */
+        break;
+      }
+
+      ent = &session->data_refs[session->num_data_refs++];
+      ent->frame = *frame;
+      ent->source = aob->item->aux_data.data.data_prd.source;
+      ent->data = aob->data_ref;
+
+      /* The frame does not end the stream, so the stream stays open
+         until the next call. */
+      rv = session_after_frame_sent1(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return (ssize_t)rv;
+      }
+      rv = session_after_frame_sent2(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return (ssize_t)rv;
+      }
+
+      continue;
+    }
+
+    if (session_may_close_data_ref_stream(session) ||
+        (size_t)len > nghttp2_buf_avail(buf)) {
+      if (nvec) {
+        /* The frame is returned in the next call */
+        aob->framebufs.cur->buf.pos -= len;
+
+        break;
+      }
+
+      /* Too large to copy; return it from the internal buffer alone */
+      vec[0].base = (uint8_t *)data;
+      vec[0].len = (size_t)len;
+      nvec = 1;
+    } else {
+      p = buf->last;
+      buf->last = nghttp2_cpymem(buf->last, data, (size_t)len);
+      vec_append(vec, &nvec, p, (size_t)len);
+    }
+
+    if (aob->item) {
+      /* See nghttp2_session_mem_send() */
+      rv = session_after_frame_sent1(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return (ssize_t)rv;
+      }
+    }
+
+    if (buf->pos == buf->last) {
+      break;
+    }
+  }
+
+  return (ssize_t)nvec;
+}
+
 int nghttp2_session_send(nghttp2_session *session) {
   const uint8_t *data = NULL;
   ssize_t datalen;
@@ -3213,7 +4242,8 @@ int nghttp2_session_send(nghttp2_session *session) {
   framebufs = &session->aob.framebufs;
 
   for (;;) {
-    datalen = nghttp2_session_mem_send_internal(session, &data, 0);
+    datalen = nghttp2_session_mem_send_internal(session, &data, 0,
+                                                NGHTTP2_SEND_FLAG_NONE);
     if (datalen <= 0) {
       return (int)datalen;
     }
@@ -3319,6 +4349,107 @@ static int session_call_on_header(nghttp2_session *session,
   return 0;
 }
 
+/*
+ * Appends |nv| to the header fields which are passed to
+ * on_header_block_callback when the header block ends.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ * NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE
+ *     The header list size exceeds SETTINGS_MAX_HEADER_LIST_SIZE, or
+ *     NGHTTP2_MAX_HEADERSLEN if the setting is not sent.
+ */
+static int session_header_block_add(nghttp2_session *session,
+                                    const nghttp2_hd_nv *nv) {
+  nghttp2_inbound_frame *iframe = &session->iframe;
+  nghttp2_mem *mem = &session->inbound_mem;
+  nghttp2_nv *nva;
+  nghttp2_buf *buf = &iframe->nvbuf;
+  size_t nvcap;
+  size_t max_nvlistlen;
+  int rv;
+
+  /* The header list is buffered as a whole, so it must be bounded
+     even if local endpoint does not limit it. */
+  max_nvlistlen = session->local_settings.max_header_list_size == UINT32_MAX
+                      ? NGHTTP2_MAX_HEADERSLEN
+                      : session->local_settings.max_header_list_size;
+
+  iframe->nvlistlen += nv->name->len + nv->value->len + 32;
+
+  if (iframe->nvlistlen > max_nvlistlen) {
+    DEBUGF("recv: header list size %zu exceeds %zu\n", iframe->nvlistlen,
+           max_nvlistlen);
+
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+
+  if (iframe->nvlen == iframe->nvcap) {
+    nvcap = iframe->nvcap ? iframe->nvcap * 2 : 16;
+
+    nva = nghttp2_mem_realloc(mem, iframe->nva, sizeof(nghttp2_nv) * nvcap);
+    if (nva == NULL) {
+      return NGHTTP2_ERR_NOMEM;
+    }
+
+    iframe->nva = nva;
+    iframe->nvcap = nvcap;
+  }
+
+  rv = nghttp2_buf_reserve(
+      buf, nghttp2_buf_len(buf) + nv->name->len + nv->value->len + 2, mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  nva = &iframe->nva[iframe->nvlen++];
+
+  nva->name = NULL;
+  nva->namelen = nv->name->len;
+  nva->value = NULL;
+  nva->valuelen = nv->value->len;
+  nva->flags = nv->flags;
+
+  buf->last = nghttp2_cpymem(buf->last, nv->name->base, nv->name->len);
+  *buf->last++ = '\0';
+  buf->last = nghttp2_cpymem(buf->last, nv->value->base, nv->value->len);
+  *buf->last++ = '\0';
+
+  return 0;
+}
+
+static int session_call_on_header_block(nghttp2_session *session,
+                                        const nghttp2_frame *frame) {
+  nghttp2_inbound_frame *iframe = &session->iframe;
+  uint8_t *p = iframe->nvbuf.pos;
+  size_t i;
+  int rv;
+
+  for (i = 0; i < iframe->nvlen; ++i) {
+    nghttp2_nv *nv = &iframe->nva[i];
+
+    nv->name = p;
+    p += nv->namelen + 1;
+    nv->value = p;
+    p += nv->valuelen + 1;
+  }
+
+  rv = session->callbacks.on_header_block_callback(
+      session, frame, iframe->nva, iframe->nvlen, session->user_data);
+
+  if (rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
+    return rv;
+  }
+  if (rv != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
 static int session_call_on_invalid_header(nghttp2_session *session,
                                           const nghttp2_frame *frame,
                                           const nghttp2_hd_nv *nv) {
@@ -3422,6 +4553,87 @@ static uint32_t get_error_code_from_lib_error_code(int lib_error_code) {
   }
 }
 
+/*
+ * Terminates |session| with ENHANCE_YOUR_CALM, because the remote
+ * endpoint exceeded one of the flood budgets.  |reason| is sent as
+ * debug data of GOAWAY.  The rest of the input is ignored.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory.
+ */
+static int session_handle_flood(nghttp2_session *session, const char *reason) {
+  DEBUGF("recv: flood detected: %s\n", reason);
+
+  session->flooded = 1;
+
+  return nghttp2_session_terminate_session_with_reason(
+      session, NGHTTP2_ENHANCE_YOUR_CALM, reason);
+}
+
+/*
+ * Takes one stream from the budget of streams reset by, or reset
+ * because of the remote endpoint.  Only server has the budget.  If
+ * the budget runs out, |session| is terminated.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory.
+ */
+static int session_update_stream_reset_ratelim(nghttp2_session *session) {
+  uint64_t now;
+
+  if (!session->server || session->stream_reset_ratelim.burst == 0) {
+    return 0;
+  }
+
+  now = nghttp2_time_now_us();
+  /* Without clock, the budget is never refilled, but it is still
+     consumed. */
+  if (now) {
+    nghttp2_ratelim_update(&session->stream_reset_ratelim, now / 1000000);
+  }
+
+  if (nghttp2_ratelim_drain(&session->stream_reset_ratelim, 1) == 0) {
+    return 0;
+  }
+
+  return session_handle_flood(session, "too many streams reset");
+}
+
+/*
+ * Counts the successive DATA frames which carry neither payload nor
+ * END_STREAM flag.  This function must be called when the whole DATA
+ * frame in session->iframe has been received.  If the count exceeds
+ * session->max_empty_data_frames, |session| is terminated.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory.
+ */
+static int session_update_empty_data_frames(nghttp2_session *session) {
+  nghttp2_frame *frame = &session->iframe.frame;
+
+  if (frame->hd.length > frame->data.padlen ||
+      (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+    session->num_empty_data_frames = 0;
+    return 0;
+  }
+
+  if (session->max_empty_data_frames == 0 ||
+      ++session->num_empty_data_frames <= session->max_empty_data_frames) {
+    return 0;
+  }
+
+  return session_handle_flood(session, "too many empty DATA frames");
+}
+
 static int session_handle_invalid_stream2(nghttp2_session *session,
                                           int32_t stream_id,
                                           nghttp2_frame *frame,
@@ -3432,6 +4644,10 @@ static int session_handle_invalid_stream2(nghttp2_session *session,
   if (rv != 0) {
     return rv;
   }
+  rv = session_update_stream_reset_ratelim(session);
+  if (rv != 0) {
+    return rv;
+  }
   if (session->callbacks.on_invalid_frame_recv_callback) {
     if (session->callbacks.on_invalid_frame_recv_callback(
             session, frame, lib_error_code, session->user_data) != 0) {
@@ -3574,6 +4790,11 @@ static int inflate_header_block(nghttp2_session *session, nghttp2_frame *frame,
 
     DEBUGF("recv: proclen=%zd\n", proclen);
 
+    session->stats.header_block_bytes_recv += (size_t)proclen;
+    if (inflate_flags & NGHTTP2_HD_INFLATE_EMIT) {
+      session->stats.header_bytes_recv += nv.name->len + nv.value->len;
+    }
+
     if (call_header_cb && (inflate_flags & NGHTTP2_HD_INFLATE_EMIT)) {
       rv = 0;
       if (subject_stream && session_enforce_http_messaging(session)) {
@@ -3632,7 +4853,11 @@ static int inflate_header_block(nghttp2_session *session, nghttp2_frame *frame,
         }
       }
       if (rv == 0) {
-        rv = session_call_on_header(session, frame, &nv);
+        if (session->callbacks.on_header_block_callback) {
+          rv = session_header_block_add(session, &nv);
+        } else {
+          rv = session_call_on_header(session, frame, &nv);
+        }
         /* This handles NGHTTP2_ERR_PAUSE and
            NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE as well */
         if (rv != 0) {
@@ -3745,6 +4970,23 @@ static int session_after_header_block_received(nghttp2_session *session) {
     }
   }
 
+  if (call_cb && session->callbacks.on_header_block_callback) {
+    rv = session_call_on_header_block(session, frame);
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+
+    if (rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
+      /* Same as the case where on_header_callback returns this
+         error */
+      return nghttp2_session_add_rst_stream(
+          session, frame->hd.type == NGHTTP2_PUSH_PROMISE
+                       ? frame->push_promise.promised_stream_id
+                       : frame->hd.stream_id,
+          NGHTTP2_INTERNAL_ERROR);
+    }
+  }
+
   if (call_cb) {
     rv = session_call_on_frame_received(session, frame);
     if (nghttp2_is_fatal(rv)) {
@@ -3842,6 +5084,31 @@ int nghttp2_session_on_request_headers_received(nghttp2_session *session,
                                                  NGHTTP2_ERR_REFUSED_STREAM);
   }
 
+  if (session_is_mem_exceeded(session)) {
+    rv = session_reclaim_mem(session);
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+
+    if (session_is_mem_exceeded(session)) {
+      if (session->num_incoming_streams + session->num_outgoing_streams ==
+          0) {
+        /* No stream is going to give memory back */
+        rv = nghttp2_session_terminate_session_with_reason(
+            session, NGHTTP2_ENHANCE_YOUR_CALM,
+            "session memory limit exceeded");
+        if (nghttp2_is_fatal(rv)) {
+          return rv;
+        }
+
+        return NGHTTP2_ERR_IGN_HEADER_BLOCK;
+      }
+
+      return session_inflate_handle_invalid_stream(session, frame,
+                                                   NGHTTP2_ERR_REFUSED_STREAM);
+    }
+  }
+
   stream = nghttp2_session_open_stream(
       session, frame->hd.stream_id, NGHTTP2_STREAM_FLAG_NONE,
       &frame->headers.pri_spec, NGHTTP2_STREAM_OPENING, NULL);
@@ -3933,6 +5200,7 @@ int nghttp2_session_on_push_response_headers_received(nghttp2_session *session,
     --session->num_incoming_reserved_streams;
   }
   ++session->num_incoming_streams;
+  session_update_peak_concurrent_streams(session);
   rv = session_call_on_begin_headers(session, frame);
   if (rv != 0) {
     return rv;
@@ -4035,7 +5303,8 @@ int nghttp2_session_on_priority_received(nghttp2_session *session,
         session, NGHTTP2_PROTOCOL_ERROR, "depend on itself");
   }
 
-  if (!session->server) {
+  if (!session->server ||
+      (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
     /* Re-prioritization works only in server */
     return session_call_on_frame_received(session, frame);
   }
@@ -4102,6 +5371,14 @@ int nghttp2_session_on_rst_stream_received(nghttp2_session *session,
                                              "RST_STREAM: stream in idle");
   }
 
+  ++session->stats
+        .rst_stream_recv[stats_error_code_index(frame->rst_stream.error_code)];
+
+  rv = session_update_stream_reset_ratelim(session);
+  if (rv != 0) {
+    return rv;
+  }
+
   stream = nghttp2_session_get_stream(session, frame->hd.stream_id);
   if (stream) {
     /* We may use stream->shut_flags for strict error checking. */
@@ -4139,6 +5416,10 @@ static int update_remote_initial_window_size_func(nghttp2_map_entry *entry,
   arg = (nghttp2_update_window_size_arg *)ptr;
   stream = (nghttp2_stream *)entry;
 
+  if (stream->flags & NGHTTP2_STREAM_FLAG_COMPACT) {
+    return 0;
+  }
+
   rv = nghttp2_stream_update_remote_initial_window_size(
       stream, arg->new_window_size, arg->old_window_size);
   if (rv != 0) {
@@ -4151,12 +5432,15 @@ static int update_remote_initial_window_size_func(nghttp2_map_entry *entry,
   if (stream->remote_window_size > 0 &&
       nghttp2_stream_check_deferred_by_flow_control(stream)) {
 
-    rv = nghttp2_stream_resume_deferred_item(
-        stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
+    rv = nghttp2_sched_resume_deferred_item(
+        &arg->session->sched, stream,
+        NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
 
     if (nghttp2_is_fatal(rv)) {
       return rv;
     }
+
+    session_update_stream_flow_blocked(arg->session, 0);
   }
   return 0;
 }
@@ -4184,6 +5468,19 @@ session_update_remote_initial_window_size(nghttp2_session *session,
                           update_remote_initial_window_size_func, &arg);
 }
 
+/*
+ * Returns nonzero if WINDOW_UPDATE should be sent for the window of
+ * size |local_window_size| of which |recv_window_size| bytes are
+ * received or consumed.
+ */
+static int session_should_send_window_update(nghttp2_session *session,
+                                             int32_t local_window_size,
+                                             int32_t recv_window_size) {
+  return nghttp2_should_send_window_update(local_window_size,
+                                           recv_window_size,
+                                           session->window_update_threshold);
+}
+
 static int update_local_initial_window_size_func(nghttp2_map_entry *entry,
                                                  void *ptr) {
   int rv;
@@ -4191,6 +5488,11 @@ static int update_local_initial_window_size_func(nghttp2_map_entry *entry,
   nghttp2_stream *stream;
   arg = (nghttp2_update_window_size_arg *)ptr;
   stream = (nghttp2_stream *)entry;
+
+  if (stream->flags & NGHTTP2_STREAM_FLAG_COMPACT) {
+    return 0;
+  }
+
   rv = nghttp2_stream_update_local_initial_window_size(
       stream, arg->new_window_size, arg->old_window_size);
   if (rv != 0) {
@@ -4199,7 +5501,7 @@ static int update_local_initial_window_size_func(nghttp2_map_entry *entry,
   }
   if (!(arg->session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_WINDOW_UPDATE) &&
       stream->window_update_queued == 0 &&
-      nghttp2_should_send_window_update(stream->local_window_size,
+      session_should_send_window_update(arg->session, stream->local_window_size,
                                         stream->recv_window_size)) {
 
     rv = nghttp2_session_add_window_update(arg->session, NGHTTP2_FLAG_NONE,
@@ -4570,6 +5872,16 @@ int nghttp2_session_on_push_promise_received(nghttp2_session *session,
         "PUSH_PROMISE: stream closed");
   }
 
+  if (session_is_mem_exceeded(session)) {
+    rv = nghttp2_session_add_rst_stream(session,
+                                        frame->push_promise.promised_stream_id,
+                                        NGHTTP2_REFUSED_STREAM);
+    if (rv != 0) {
+      return rv;
+    }
+    return NGHTTP2_ERR_IGN_HEADER_BLOCK;
+  }
+
   nghttp2_priority_spec_init(&pri_spec, stream->stream_id,
                              NGHTTP2_DEFAULT_WEIGHT, 0);
 
@@ -4615,6 +5927,14 @@ int nghttp2_session_on_ping_received(nghttp2_session *session,
     return session_handle_invalid_connection(session, frame, NGHTTP2_ERR_PROTO,
                                              "PING: stream_id != 0");
   }
+  if ((frame->hd.flags & NGHTTP2_FLAG_ACK) &&
+      session->bdp.state == NGHTTP2_BDP_INFLIGHT &&
+      session_is_bdp_ping(session, frame)) {
+    rv = session_bdp_on_probe_ack(session);
+    if (rv != 0) {
+      return rv;
+    }
+  }
   if ((session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_PING_ACK) == 0 &&
       (frame->hd.flags & NGHTTP2_FLAG_ACK) == 0 &&
       !session_is_closing(session)) {
@@ -4700,6 +6020,10 @@ session_on_connection_window_update_received(nghttp2_session *session,
   }
   session->remote_window_size += frame->window_update.window_size_increment;
 
+  if (session->remote_window_size > 0) {
+    session_set_conn_flow_blocked(session, 0);
+  }
+
   return session_call_on_frame_received(session, frame);
 }
 
@@ -4736,12 +6060,14 @@ static int session_on_stream_window_update_received(nghttp2_session *session,
   if (stream->remote_window_size > 0 &&
       nghttp2_stream_check_deferred_by_flow_control(stream)) {
 
-    rv = nghttp2_stream_resume_deferred_item(
-        stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
+    rv = nghttp2_sched_resume_deferred_item(
+        &session->sched, stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
 
     if (nghttp2_is_fatal(rv)) {
       return rv;
     }
+
+    session_update_stream_flow_blocked(session, 0);
   }
   return session_call_on_frame_received(session, frame);
 }
@@ -4905,6 +6231,55 @@ static int adjust_recv_window_size(int32_t *recv_window_size_ptr, size_t delta,
   return 0;
 }
 
+/*
+ * Defers WINDOW_UPDATE to |stream|, or to the connection if |stream|
+ * is NULL, until session is about to send frames.  Then
+ * session_flush_window_update() sends one WINDOW_UPDATE for all bytes
+ * received in the meantime.  WINDOW_UPDATE is only deferred when new
+ * bytes are received or consumed; the check with zero delta, which
+ * the flush itself performs, sends WINDOW_UPDATE immediately.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int session_defer_window_update(nghttp2_session *session,
+                                       nghttp2_stream *stream) {
+  int32_t *p;
+  size_t cap;
+
+  if (stream == NULL) {
+    session->window_update_pending = 1;
+    return 0;
+  }
+
+  if (stream->flags & NGHTTP2_STREAM_FLAG_WINDOW_UPDATE_PENDING) {
+    return 0;
+  }
+
+  if (session->num_pending_window_update_streams ==
+      session->pending_window_update_streams_cap) {
+    cap = nghttp2_max(16, session->pending_window_update_streams_cap * 2);
+    p = nghttp2_mem_realloc(&session->mem,
+                            session->pending_window_update_streams,
+                            sizeof(int32_t) * cap);
+    if (p == NULL) {
+      return NGHTTP2_ERR_NOMEM;
+    }
+
+    session->pending_window_update_streams = p;
+    session->pending_window_update_streams_cap = cap;
+  }
+
+  session->pending_window_update_streams
+      [session->num_pending_window_update_streams++] = stream->stream_id;
+  stream->flags |= NGHTTP2_STREAM_FLAG_WINDOW_UPDATE_PENDING;
+
+  return 0;
+}
+
 /*
  * Accumulates received bytes |delta_size| for stream-level flow
  * control and decides whether to send WINDOW_UPDATE to that stream.
@@ -4935,8 +6310,13 @@ static int session_update_recv_stream_window_size(nghttp2_session *session,
   if (send_window_update &&
       !(session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_WINDOW_UPDATE) &&
       stream->window_update_queued == 0 &&
-      nghttp2_should_send_window_update(stream->local_window_size,
+      session_should_send_window_update(session, stream->local_window_size,
                                         stream->recv_window_size)) {
+    if (delta_size &&
+        (session->opt_flags & NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE)) {
+      return session_defer_window_update(session, stream);
+    }
+
     rv = nghttp2_session_add_window_update(session, NGHTTP2_FLAG_NONE,
                                            stream->stream_id,
                                            stream->recv_window_size);
@@ -4972,8 +6352,13 @@ static int session_update_recv_connection_window_size(nghttp2_session *session,
   }
   if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_WINDOW_UPDATE) &&
       session->window_update_queued == 0 &&
-      nghttp2_should_send_window_update(session->local_window_size,
+      session_should_send_window_update(session, session->local_window_size,
                                         session->recv_window_size)) {
+    if (delta_size &&
+        (session->opt_flags & NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE)) {
+      return session_defer_window_update(session, NULL);
+    }
+
     /* Use stream ID 0 to update connection-level flow control
        window */
     rv = nghttp2_session_add_window_update(session, NGHTTP2_FLAG_NONE, 0,
@@ -4987,11 +6372,92 @@ static int session_update_recv_connection_window_size(nghttp2_session *session,
   return 0;
 }
 
+/*
+ * Accounts |len| bytes of DATA received on |stream| for window
+ * auto-tuning, and queues probe PING if it is due.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int session_bdp_on_data(nghttp2_session *session,
+                               nghttp2_stream *stream, size_t len) {
+  int rv;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_WINDOW_AUTO_TUNING) ||
+      !nghttp2_bdp_on_data(&session->bdp, &stream->bdp_epoch,
+                           &stream->bdp_recv, len) ||
+      session_is_closing(session) ||
+      !nghttp2_bdp_probe_due(&session->bdp, nghttp2_time_now_us())) {
+    return 0;
+  }
+
+  rv = nghttp2_session_add_ping(session, NGHTTP2_FLAG_NONE, bdp_ping_opaque);
+  if (rv != 0) {
+    nghttp2_bdp_on_probe_dropped(&session->bdp);
+    return rv;
+  }
+
+  return 0;
+}
+
+/*
+ * Handles ACK of window auto-tuning probe, and grows the local
+ * receive windows if they limit the throughput.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int session_bdp_on_probe_ack(nghttp2_session *session) {
+  int rv;
+  int32_t conn_window, stream_window;
+  nghttp2_settings_entry iv;
+
+  nghttp2_bdp_on_probe_ack(&session->bdp, nghttp2_time_now_us(),
+                           session->local_window_size,
+                           (int32_t)session->local_settings.initial_window_size,
+                           &conn_window, &stream_window);
+
+  if (conn_window) {
+    DEBUGF("recv: auto-tuning connection window %d -> %d\n",
+           session->local_window_size, conn_window);
+
+    rv = nghttp2_session_set_local_window_size(session, NGHTTP2_FLAG_NONE, 0,
+                                               conn_window);
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+  }
+
+  /* Do not interfere with SETTINGS from application, which may
+     change SETTINGS_INITIAL_WINDOW_SIZE. */
+  if (stream_window && session->inflight_settings_head == NULL) {
+    DEBUGF("recv: auto-tuning stream window %u -> %d\n",
+           session->local_settings.initial_window_size, stream_window);
+
+    iv.settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    iv.value = (uint32_t)stream_window;
+
+    rv = nghttp2_session_add_settings(session, NGHTTP2_FLAG_NONE, &iv, 1);
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
 static int session_update_consumed_size(nghttp2_session *session,
                                         int32_t *consumed_size_ptr,
                                         int32_t *recv_window_size_ptr,
                                         uint8_t window_update_queued,
-                                        int32_t stream_id, size_t delta_size,
+                                        nghttp2_stream *stream,
+                                        size_t delta_size,
                                         int32_t local_window_size) {
   int32_t recv_size;
   int rv;
@@ -5009,9 +6475,16 @@ static int session_update_consumed_size(nghttp2_session *session,
        nghttp2_submit_window_update(). */
     recv_size = nghttp2_min(*consumed_size_ptr, *recv_window_size_ptr);
 
-    if (nghttp2_should_send_window_update(local_window_size, recv_size)) {
-      rv = nghttp2_session_add_window_update(session, NGHTTP2_FLAG_NONE,
-                                             stream_id, recv_size);
+    if (session_should_send_window_update(session, local_window_size,
+                                          recv_size)) {
+      if (delta_size &&
+          (session->opt_flags & NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE)) {
+        return session_defer_window_update(session, stream);
+      }
+
+      rv = nghttp2_session_add_window_update(
+          session, NGHTTP2_FLAG_NONE, stream ? stream->stream_id : 0,
+          recv_size);
 
       if (rv != 0) {
         return rv;
@@ -5030,7 +6503,7 @@ static int session_update_stream_consumed_size(nghttp2_session *session,
                                                size_t delta_size) {
   return session_update_consumed_size(
       session, &stream->consumed_size, &stream->recv_window_size,
-      stream->window_update_queued, stream->stream_id, delta_size,
+      stream->window_update_queued, stream, delta_size,
       stream->local_window_size);
 }
 
@@ -5038,7 +6511,70 @@ static int session_update_connection_consumed_size(nghttp2_session *session,
                                                    size_t delta_size) {
   return session_update_consumed_size(
       session, &session->consumed_size, &session->recv_window_size,
-      session->window_update_queued, 0, delta_size, session->local_window_size);
+      session->window_update_queued, NULL, delta_size,
+      session->local_window_size);
+}
+
+/*
+ * Sends WINDOW_UPDATE deferred by session_defer_window_update().
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int session_flush_window_update(nghttp2_session *session) {
+  int rv;
+  size_t i;
+  nghttp2_stream *stream;
+  int no_auto = (session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_WINDOW_UPDATE);
+
+  if (session->window_update_pending) {
+    session->window_update_pending = 0;
+
+    if (no_auto) {
+      rv = session_update_connection_consumed_size(session, 0);
+    } else {
+      rv = session_update_recv_connection_window_size(session, 0);
+    }
+
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+  }
+
+  for (i = 0; i < session->num_pending_window_update_streams; ++i) {
+    stream = nghttp2_session_get_stream(
+        session, session->pending_window_update_streams[i]);
+    if (!stream) {
+      continue;
+    }
+
+    stream->flags = (uint8_t)(stream->flags &
+                              ~NGHTTP2_STREAM_FLAG_WINDOW_UPDATE_PENDING);
+
+    /* We don't have to send WINDOW_UPDATE if END_STREAM from peer
+       is seen. */
+    if (stream->shut_flags & NGHTTP2_SHUT_RD) {
+      continue;
+    }
+
+    if (no_auto) {
+      rv = session_update_stream_consumed_size(session, stream, 0);
+    } else {
+      rv = session_update_recv_stream_window_size(session, stream, 0, 1);
+    }
+
+    if (nghttp2_is_fatal(rv)) {
+      session->num_pending_window_update_streams = 0;
+      return rv;
+    }
+  }
+
+  session->num_pending_window_update_streams = 0;
+
+  return 0;
 }
 
 /*
@@ -5263,8 +6799,15 @@ static ssize_t inbound_frame_effective_readlen(nghttp2_inbound_frame *iframe,
   return (ssize_t)(readlen);
 }
 
-ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
-                                 size_t inlen) {
+/*
+ * Processes |inlen| bytes of data pointed by |in|.  If processing is
+ * paused by a callback returning NGHTTP2_ERR_PAUSE, |*ppaused| is set
+ * to nonzero.  The paused state cannot be told from the return value
+ * alone when the paused chunk ends exactly at the end of |in|.
+ */
+static ssize_t session_mem_recv_internal(nghttp2_session *session,
+                                         const uint8_t *in, size_t inlen,
+                                         int *ppaused) {
   const uint8_t *first = in, *last = in + inlen;
   nghttp2_inbound_frame *iframe = &session->iframe;
   size_t readlen;
@@ -5279,7 +6822,12 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
   DEBUGF("recv: connection recv_window_size=%d, local_window=%d\n",
          session->recv_window_size, session->local_window_size);
 
-  mem = &session->mem;
+  mem = &session->inbound_mem;
+
+  rv = session_drain_command_queue(session);
+  if (nghttp2_is_fatal(rv)) {
+    return rv;
+  }
 
   /* We may have idle streams more than we expect (e.g.,
      nghttp2_session_change_stream_priority() or
@@ -5289,6 +6837,8 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
     return rv;
   }
 
+  session_compact_retained_streams(session);
+
   for (;;) {
     switch (iframe->state) {
     case NGHTTP2_IB_READ_CLIENT_MAGIC:
@@ -5351,6 +6901,13 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
 
       DEBUGF("recv: [IB_READ_HEAD]\n");
 
+      if (session->flooded) {
+        /* Don't spend any more time on the remote endpoint which
+           exceeded the budget. */
+        iframe->state = NGHTTP2_IB_IGN_ALL;
+        return (ssize_t)inlen;
+      }
+
       readlen = inbound_frame_buf_read(iframe, in, last);
       in += readlen;
 
@@ -5361,6 +6918,9 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
       nghttp2_frame_unpack_frame_hd(&iframe->frame.hd, iframe->sbuf.pos);
       iframe->payloadleft = iframe->frame.hd.length;
 
+      ++session->stats
+            .frames_recv[stats_frame_type_index(iframe->frame.hd.type)];
+
       DEBUGF("recv: payloadlen=%zu, type=%u, flags=0x%02x, stream_id=%d\n",
              iframe->frame.hd.length, iframe->frame.hd.type,
              iframe->frame.hd.flags, iframe->frame.hd.stream_id);
@@ -6024,6 +7584,7 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
         if (rv == NGHTTP2_ERR_PAUSE) {
           in += hd_proclen;
           iframe->payloadleft -= hd_proclen;
+          *ppaused = 1;
 
           return in - first;
         }
@@ -6215,6 +7776,8 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
       nghttp2_frame_unpack_frame_hd(&cont_hd, iframe->sbuf.pos);
       iframe->payloadleft = cont_hd.length;
 
+      ++session->stats.frames_recv[stats_frame_type_index(cont_hd.type)];
+
       DEBUGF("recv: payloadlen=%zu, type=%u, flags=0x%02x, stream_id=%d\n",
              cont_hd.length, cont_hd.type, cont_hd.flags, cont_hd.stream_id);
 
@@ -6350,6 +7913,11 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
           return rv;
         }
 
+        rv = session_bdp_on_data(session, stream, readlen);
+        if (nghttp2_is_fatal(rv)) {
+          return rv;
+        }
+
         data_readlen = inbound_frame_effective_readlen(
             iframe, iframe->payloadleft, readlen);
 
@@ -6372,6 +7940,8 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
 
         DEBUGF("recv: data_readlen=%zd\n", data_readlen);
 
+        session->stats.data_bytes_recv += (size_t)data_readlen;
+
         if (data_readlen > 0) {
           if (session_enforce_http_messaging(session)) {
             if (nghttp2_http_on_data_chunk(stream, (size_t)data_readlen) != 0) {
@@ -6400,6 +7970,7 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
                 session, iframe->frame.hd.flags, iframe->frame.hd.stream_id,
                 in - readlen, (size_t)data_readlen, session->user_data);
             if (rv == NGHTTP2_ERR_PAUSE) {
+              *ppaused = 1;
               return in - first;
             }
 
@@ -6414,6 +7985,11 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
         break;
       }
 
+      rv = session_update_empty_data_frames(session);
+      if (nghttp2_is_fatal(rv)) {
+        return rv;
+      }
+
       rv = session_process_data_frame(session);
       if (nghttp2_is_fatal(rv)) {
         return rv;
@@ -6455,6 +8031,11 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
         break;
       }
 
+      rv = session_update_empty_data_frames(session);
+      if (nghttp2_is_fatal(rv)) {
+        return rv;
+      }
+
       session_inbound_frame_reset(session);
 
       break;
@@ -6542,6 +8123,51 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
   return in - first;
 }
 
+ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
+                                 size_t inlen) {
+  int paused = 0;
+
+  return session_mem_recv_internal(session, in, inlen, &paused);
+}
+
+ssize_t nghttp2_session_mem_recvv(nghttp2_session *session,
+                                  const nghttp2_vec *vec, size_t veccnt,
+                                  size_t *nread) {
+  size_t i;
+  ssize_t rv;
+  size_t proclen = 0;
+  int paused = 0;
+
+  if (nread) {
+    memset(nread, 0, sizeof(size_t) * veccnt);
+  }
+
+  /* The inbound state machine keeps partial frame header and payload
+     across calls, so each buffer is fed as is. */
+  for (i = 0; i < veccnt; ++i) {
+    if (vec[i].len == 0) {
+      continue;
+    }
+
+    rv = session_mem_recv_internal(session, vec[i].base, vec[i].len, &paused);
+    if (rv < 0) {
+      return rv;
+    }
+
+    if (nread) {
+      nread[i] = (size_t)rv;
+    }
+
+    proclen += (size_t)rv;
+
+    if (paused) {
+      break;
+    }
+  }
+
+  return (ssize_t)proclen;
+}
+
 int nghttp2_session_recv(nghttp2_session *session) {
   uint8_t buf[NGHTTP2_INBOUND_BUFFER_LENGTH];
   while (1) {
@@ -6603,6 +8229,12 @@ int nghttp2_session_want_write(nghttp2_session *session) {
     return 0;
   }
 
+  /* The commands may produce frames */
+  if ((session->opt_flags & NGHTTP2_OPTMASK_COMMAND_QUEUE) &&
+      !nghttp2_mpsc_empty(&session->cmdq)) {
+    return 1;
+  }
+
   /*
    * Unless termination GOAWAY is sent or received, we want to write
    * frames if there is pending ones. If pending frame is request/push
@@ -6610,10 +8242,11 @@ int nghttp2_session_want_write(nghttp2_session *session) {
    * want to write them.
    */
 
-  if (session->aob.item == NULL &&
+  if (session->aob.item == NULL && !session->window_update_pending &&
+      session->num_pending_window_update_streams == 0 &&
       nghttp2_outbound_queue_top(&session->ob_urgent) == NULL &&
       nghttp2_outbound_queue_top(&session->ob_reg) == NULL &&
-      (nghttp2_pq_empty(&session->root.obq) ||
+      (nghttp2_sched_empty(&session->sched) ||
        session->remote_window_size == 0) &&
       (nghttp2_outbound_queue_top(&session->ob_syn) == NULL ||
        session_is_outgoing_concurrent_streams_max(session))) {
@@ -6636,7 +8269,7 @@ int nghttp2_session_add_ping(nghttp2_session *session, uint8_t flags,
   mem = &session->mem;
 
   if ((flags & NGHTTP2_FLAG_ACK) &&
-      session->obq_flood_counter_ >= NGHTTP2_MAX_OBQ_FLOOD_ITEM) {
+      session->obq_flood_counter_ >= session->max_outbound_ack) {
     return NGHTTP2_ERR_FLOODED;
   }
 
@@ -6781,7 +8414,7 @@ int nghttp2_session_add_settings(nghttp2_session *session, uint8_t flags,
       return NGHTTP2_ERR_INVALID_ARGUMENT;
     }
 
-    if (session->obq_flood_counter_ >= NGHTTP2_MAX_OBQ_FLOOD_ITEM) {
+    if (session->obq_flood_counter_ >= session->max_outbound_ack) {
       return NGHTTP2_ERR_FLOODED;
     }
   }
@@ -6955,8 +8588,10 @@ int nghttp2_session_pack_data(nghttp2_session *session, nghttp2_bufs *bufs,
   }
 
   if (data_flags & NGHTTP2_DATA_FLAG_NO_COPY) {
-    if (session->callbacks.send_data_callback == NULL) {
-      DEBUGF("NGHTTP2_DATA_FLAG_NO_COPY requires send_data_callback set\n");
+    if (session->callbacks.send_data_callback == NULL &&
+        session->callbacks.data_ref_callback == NULL) {
+      DEBUGF("NGHTTP2_DATA_FLAG_NO_COPY requires send_data_callback or "
+             "data_ref_callback set\n");
 
       return NGHTTP2_ERR_CALLBACK_FAILURE;
     }
@@ -6985,7 +8620,7 @@ int nghttp2_session_pack_data(nghttp2_session *session, nghttp2_bufs *bufs,
     return rv;
   }
 
-  reschedule_stream(stream);
+  nghttp2_sched_reschedule(&session->sched, stream);
 
   if (frame->hd.length == 0 && (data_flags & NGHTTP2_DATA_FLAG_EOF) &&
       (data_flags & NGHTTP2_DATA_FLAG_NO_END_STREAM)) {
@@ -7029,8 +8664,8 @@ int nghttp2_session_resume_data(nghttp2_session *session, int32_t stream_id) {
     return NGHTTP2_ERR_INVALID_ARGUMENT;
   }
 
-  rv = nghttp2_stream_resume_deferred_item(stream,
-                                           NGHTTP2_STREAM_FLAG_DEFERRED_USER);
+  rv = nghttp2_sched_resume_deferred_item(&session->sched, stream,
+                                          NGHTTP2_STREAM_FLAG_DEFERRED_USER);
 
   if (nghttp2_is_fatal(rv)) {
     return rv;
@@ -7441,6 +9076,10 @@ int nghttp2_session_change_stream_priority(
     return NGHTTP2_ERR_INVALID_ARGUMENT;
   }
 
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    return 0;
+  }
+
   pri_spec_copy = *pri_spec;
   nghttp2_priority_spec_normalize_weight(&pri_spec_copy);
 
@@ -7474,6 +9113,10 @@ int nghttp2_session_create_idle_stream(nghttp2_session *session,
     return NGHTTP2_ERR_INVALID_ARGUMENT;
   }
 
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    return 0;
+  }
+
   pri_spec_copy = *pri_spec;
   nghttp2_priority_spec_normalize_weight(&pri_spec_copy);
 
@@ -7492,6 +9135,61 @@ int nghttp2_session_create_idle_stream(nghttp2_session *session,
   return 0;
 }
 
+int nghttp2_session_change_extpri_stream_priority(
+    nghttp2_session *session, int32_t stream_id,
+    const nghttp2_extpri *extpri_in) {
+  nghttp2_stream *stream;
+  nghttp2_extpri extpri = *extpri_in;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
+  if (stream_id == 0) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  stream = nghttp2_session_get_stream_raw(session, stream_id);
+  if (!stream) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (extpri.urgency > NGHTTP2_EXTPRI_URGENCY_LOW) {
+    extpri.urgency = NGHTTP2_EXTPRI_URGENCY_LOW;
+  }
+
+  nghttp2_sched_change_extpri(
+      &session->sched, stream,
+      (uint8_t)((uint32_t)(extpri.inc ? NGHTTP2_EXTPRI_INC_MASK : 0) |
+                extpri.urgency));
+
+  return 0;
+}
+
+int nghttp2_session_get_extpri_stream_priority(nghttp2_session *session,
+                                               nghttp2_extpri *extpri,
+                                               int32_t stream_id) {
+  nghttp2_stream *stream;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
+  if (stream_id == 0) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  stream = nghttp2_session_get_stream_raw(session, stream_id);
+  if (!stream) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  extpri->urgency = nghttp2_extpri_uint8_urgency(stream->extpri);
+  extpri->inc = nghttp2_extpri_uint8_inc(stream->extpri);
+
+  return 0;
+}
+
 size_t
 nghttp2_session_get_hd_inflate_dynamic_table_size(nghttp2_session *session) {
   return nghttp2_hd_inflate_get_dynamic_table_size(&session->hd_inflater);
@@ -7501,3 +9199,140 @@ size_t
 nghttp2_session_get_hd_deflate_dynamic_table_size(nghttp2_session *session) {
   return nghttp2_hd_deflate_get_dynamic_table_size(&session->hd_deflater);
 }
+
+int nghttp2_session_get_mem_usage(nghttp2_session *session,
+                                  nghttp2_mem_usage *usage) {
+  nghttp2_mem_account *account = &session->mem_account;
+  size_t retained;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_MEM_ACCOUNTING)) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
+  /* Retained streams are counted by the size of stream object */
+  retained = nghttp2_min(
+      (session->num_closed_streams + session->num_idle_streams -
+       session->num_compact_streams) *
+              sizeof(nghttp2_stream) +
+          session->num_compact_streams * NGHTTP2_STREAM_COMPACT_SIZE,
+      account->used[NGHTTP2_MEM_CAT_STREAM]);
+
+  usage->total = account->total;
+  usage->streams = account->used[NGHTTP2_MEM_CAT_STREAM] - retained;
+  usage->closed_streams = retained;
+  usage->hd = account->used[NGHTTP2_MEM_CAT_HD];
+  usage->outbound = account->used[NGHTTP2_MEM_CAT_OUTBOUND];
+  usage->inbound = account->used[NGHTTP2_MEM_CAT_INBOUND];
+
+  return 0;
+}
+
+size_t nghttp2_session_get_stats(nghttp2_session *session,
+                                 nghttp2_stats *stats, size_t statslen) {
+  nghttp2_stats st;
+  uint64_t now;
+
+  st = session->stats;
+
+  st.header_bytes_sent =
+      nghttp2_hd_deflate_get_uncompressed_length(&session->hd_deflater);
+  st.header_block_bytes_sent =
+      nghttp2_hd_deflate_get_compressed_length(&session->hd_deflater);
+
+  /* Include the time of blocking which is still in progress */
+  if (session->conn_flow_blocked || session->num_flow_blocked_streams) {
+    now = nghttp2_time_now_us();
+
+    if (session->conn_flow_blocked && now > session->conn_flow_blocked_since) {
+      st.conn_flow_blocked_us += now - session->conn_flow_blocked_since;
+    }
+    if (session->num_flow_blocked_streams &&
+        now > session->stream_flow_blocked_last) {
+      st.stream_flow_blocked_us += (now - session->stream_flow_blocked_last) *
+                                   session->num_flow_blocked_streams;
+    }
+  }
+
+  /* The application may be built against the header of different
+     version. */
+  statslen = nghttp2_min(statslen, sizeof(st));
+
+  memcpy(stats, &st, statslen);
+
+  return statslen;
+}
+
+uint64_t
+nghttp2_session_get_hd_deflate_uncompressed_length(nghttp2_session *session) {
+  return nghttp2_hd_deflate_get_uncompressed_length(&session->hd_deflater);
+}
+
+uint64_t
+nghttp2_session_get_hd_deflate_compressed_length(nghttp2_session *session) {
+  return nghttp2_hd_deflate_get_compressed_length(&session->hd_deflater);
+}
+
+/*
+ * Queues the command of |type| to session->cmdq.  This function may
+ * be called from any thread.
+ */
+static int session_queue_command(nghttp2_session *session, uint8_t type,
+                                 uint8_t flags, int32_t stream_id,
+                                 uint32_t error_code,
+                                 const nghttp2_data_provider *data_prd) {
+  nghttp2_cmd *cmd;
+
+  /* opt_flags never changes after session is created */
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_COMMAND_QUEUE)) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
+  if (stream_id <= 0) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  /* Neither mem_pool nor mem_account is thread-safe.  Use the
+     allocator given by application directly. */
+  cmd = nghttp2_mem_malloc(&session->mem_pool.mem, sizeof(nghttp2_cmd));
+  if (cmd == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  if (data_prd) {
+    cmd->data_prd = *data_prd;
+  } else {
+    memset(&cmd->data_prd, 0, sizeof(cmd->data_prd));
+  }
+
+  cmd->stream_id = stream_id;
+  cmd->error_code = error_code;
+  cmd->type = type;
+  cmd->flags = flags;
+
+  nghttp2_mpsc_push(&session->cmdq, &cmd->mpsc_entry);
+
+  return 0;
+}
+
+int nghttp2_session_queue_resume_data(nghttp2_session *session,
+                                      int32_t stream_id) {
+  return session_queue_command(session, NGHTTP2_CMD_RESUME_DATA,
+                               NGHTTP2_FLAG_NONE, stream_id, 0, NULL);
+}
+
+int nghttp2_session_queue_data(nghttp2_session *session, uint8_t flags,
+                               int32_t stream_id,
+                               const nghttp2_data_provider *data_prd) {
+  if (data_prd == NULL) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  return session_queue_command(session, NGHTTP2_CMD_SUBMIT_DATA, flags,
+                               stream_id, 0, data_prd);
+}
+
+int nghttp2_session_queue_rst_stream(nghttp2_session *session,
+                                     int32_t stream_id, uint32_t error_code) {
+  return session_queue_command(session, NGHTTP2_CMD_RST_STREAM,
+                               NGHTTP2_FLAG_NONE, stream_id, error_code, NULL);
+}
@@ -34,11 +34,17 @@
 #include "nghttp2_frame.h"
 #include "nghttp2_hd.h"
 #include "nghttp2_stream.h"
+#include "nghttp2_sched.h"
 #include "nghttp2_outbound_item.h"
 #include "nghttp2_int.h"
 #include "nghttp2_buf.h"
 #include "nghttp2_callbacks.h"
 #include "nghttp2_mem.h"
+#include "nghttp2_mem_pool.h"
+#include "nghttp2_mem_account.h"
+#include "nghttp2_bdp.h"
+#include "nghttp2_mpsc.h"
+#include "nghttp2_ratelim.h"
 
 /* The global variable for tests where we want to disable strict
    preface handling. */
@@ -52,7 +58,12 @@ typedef enum {
   NGHTTP2_OPTMASK_NO_RECV_CLIENT_MAGIC = 1 << 1,
   NGHTTP2_OPTMASK_NO_HTTP_MESSAGING = 1 << 2,
   NGHTTP2_OPTMASK_NO_AUTO_PING_ACK = 1 << 3,
-  NGHTTP2_OPTMASK_NO_CLOSED_STREAMS = 1 << 4
+  NGHTTP2_OPTMASK_NO_CLOSED_STREAMS = 1 << 4,
+  NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES = 1 << 5,
+  NGHTTP2_OPTMASK_MEM_ACCOUNTING = 1 << 6,
+  NGHTTP2_OPTMASK_WINDOW_AUTO_TUNING = 1 << 7,
+  NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE = 1 << 8,
+  NGHTTP2_OPTMASK_COMMAND_QUEUE = 1 << 9
 } nghttp2_optmask;
 
 /*
@@ -68,15 +79,54 @@ typedef enum {
   NGHTTP2_OB_POP_ITEM,
   NGHTTP2_OB_SEND_DATA,
   NGHTTP2_OB_SEND_NO_COPY,
+  /* The payload of DATA frame has been handed to application by
+     nghttp2_session_mem_sendv() by reference, and it is released on
+     the next call. */
+  NGHTTP2_OB_SEND_DATA_REF,
   NGHTTP2_OB_SEND_CLIENT_MAGIC
 } nghttp2_outbound_state;
 
 typedef struct {
   nghttp2_outbound_item *item;
   nghttp2_bufs framebufs;
+  /* The payload of DATA frame obtained by data_ref_callback.  Only
+     valid if state is NGHTTP2_OB_SEND_DATA_REF. */
+  const uint8_t *data_ref;
   nghttp2_outbound_state state;
 } nghttp2_active_outbound_item;
 
+/* DATA frame whose payload has been handed to application by
+   nghttp2_session_mem_sendv() by reference, and whose transmission
+   has already been completed otherwise.  The payload is released on
+   the next call. */
+typedef struct {
+  nghttp2_frame frame;
+  nghttp2_data_source source;
+  const uint8_t *data;
+} nghttp2_data_ref_entry;
+
+/* The types of nghttp2_cmd */
+typedef enum {
+  NGHTTP2_CMD_RESUME_DATA,
+  NGHTTP2_CMD_SUBMIT_DATA,
+  NGHTTP2_CMD_RST_STREAM
+} nghttp2_cmd_type;
+
+/* The command which other threads queue to session.  See
+   nghttp2_session_queue_resume_data() and friends. */
+typedef struct {
+  nghttp2_mpsc_entry mpsc_entry;
+  /* Only used by NGHTTP2_CMD_SUBMIT_DATA */
+  nghttp2_data_provider data_prd;
+  int32_t stream_id;
+  /* Only used by NGHTTP2_CMD_RST_STREAM */
+  uint32_t error_code;
+  /* nghttp2_cmd_type */
+  uint8_t type;
+  /* Only used by NGHTTP2_CMD_SUBMIT_DATA */
+  uint8_t flags;
+} nghttp2_cmd;
+
 /* Buffer length for inbound raw byte stream used in
    nghttp2_session_recv(). */
 #define NGHTTP2_INBOUND_BUFFER_LENGTH 16384
@@ -95,12 +145,39 @@ typedef struct {
    send as many of them as they want.  If peer does not read network,
    response frames are stacked up, which leads to memory exhaustion.
    The value selected here is arbitrary, but safe value and if we have
-   these frames in this number, it is considered suspicious. */
+   these frames in this number, it is considered suspicious.  This is
+   the default of nghttp2_option_set_max_outbound_ack(). */
 #define NGHTTP2_MAX_OBQ_FLOOD_ITEM 10000
 
+/* The default budget of streams reset by, or reset because of the
+   remote endpoint.  See nghttp2_option_set_stream_reset_rate_limit(). */
+#define NGHTTP2_DEFAULT_STREAM_RESET_BURST 1000
+#define NGHTTP2_DEFAULT_STREAM_RESET_RATE 33
+
+/* The default maximum number of successive DATA frames without
+   payload nor END_STREAM flag. */
+#define NGHTTP2_DEFAULT_MAX_EMPTY_DATA_FRAMES 1000
+
+/* The buffers for on_header_block_callback larger than these are
+   freed after the header block, rather than reused. */
+#define NGHTTP2_HEADER_BLOCK_BUFFER_KEEP 4096
+#define NGHTTP2_HEADER_BLOCK_NVA_KEEP 64
+
+/* The maximum number of DATA frames whose payload is referred by the
+   buffers returned by one nghttp2_session_mem_sendv() call */
+#define NGHTTP2_MAX_DATA_REFS 16
+
+/* The size of buffer for the frames which nghttp2_session_mem_sendv()
+   copies, so that they can be returned together. */
+#define NGHTTP2_VEC_BUFFER_LENGTH 16384
+
 /* The default value of maximum number of concurrent streams. */
 #define NGHTTP2_DEFAULT_MAX_CONCURRENT_STREAMS 0xffffffffu
 
+/* The default percentage of receive window consumed before
+   WINDOW_UPDATE is sent. */
+#define NGHTTP2_DEFAULT_WINDOW_UPDATE_THRESHOLD 50
+
 /* Internal state when receiving incoming frame */
 typedef enum {
   /* Receiving frame header */
@@ -140,6 +217,21 @@ typedef struct {
   nghttp2_buf lbuf;
   /* Large buffer, malloced on demand */
   uint8_t *raw_lbuf;
+  /* The header fields of the current header block, which are passed
+     to on_header_block_callback at once.  Their name and value are
+     not set until then, because nvbuf may be reallocated. */
+  nghttp2_nv *nva;
+  /* Buffer for the names and values of nva, which are stored in
+     order, each NULL-terminated.  It is kept across header blocks
+     unless it grows larger than NGHTTP2_HEADER_BLOCK_BUFFER_KEEP. */
+  nghttp2_buf nvbuf;
+  /* The number of header fields in nva */
+  size_t nvlen;
+  /* The number of header fields nva can store */
+  size_t nvcap;
+  /* The header list size of nva as defined in RFC 7540, section
+     6.5.2 */
+  size_t nvlistlen;
   /* The number of entry filled in |iv| */
   size_t niv;
   /* The number of entries |iv| can store. */
@@ -191,6 +283,8 @@ struct nghttp2_session {
   nghttp2_map /* <nghttp2_stream*> */ streams;
   /* root of dependency tree*/
   nghttp2_stream root;
+  /* Scheduler of outbound DATA frames */
+  nghttp2_sched sched;
   /* Queue for outbound urgent frames (PING and SETTINGS) */
   nghttp2_outbound_queue ob_urgent;
   /* Queue for non-DATA frames */
@@ -200,12 +294,52 @@ struct nghttp2_session {
      SETTINGS_MAX_CONCURRENT_STREAMS limit. */
   nghttp2_outbound_queue ob_syn;
   nghttp2_active_outbound_item aob;
+  /* DATA frames returned by the last nghttp2_session_mem_sendv()
+     call whose payload is released on the next call.  The last frame
+     ending a stream is not included; it stays in aob. */
+  nghttp2_data_ref_entry data_refs[NGHTTP2_MAX_DATA_REFS];
+  size_t num_data_refs;
+  /* The copy of frames returned by nghttp2_session_mem_sendv() */
+  nghttp2_buf vecbuf;
   nghttp2_inbound_frame iframe;
   nghttp2_hd_deflater hd_deflater;
   nghttp2_hd_inflater hd_inflater;
   nghttp2_session_callbacks callbacks;
   /* Memory allocator */
   nghttp2_mem mem;
+  /* Memory pool.  If it is enabled, mem allocates memory from this
+     pool.  mem_pool.mem is always the allocator given by
+     application, and session itself is allocated by it. */
+  nghttp2_mem_pool mem_pool;
+  /* Allocators which charge memory to the specific category of
+     mem_account.  mem charges NGHTTP2_MEM_CAT_OUTBOUND.  They are
+     just copies of mem if memory accounting is disabled. */
+  nghttp2_mem stream_mem;
+  nghttp2_mem hd_mem;
+  nghttp2_mem inbound_mem;
+  /* Memory accounting, which sits on top of mem_pool if both are
+     enabled.  Only used if NGHTTP2_OPTMASK_MEM_ACCOUNTING is set. */
+  nghttp2_mem_account mem_account;
+  /* Estimator of bandwidth-delay product to grow the local receive
+     windows.  Only used if NGHTTP2_OPTMASK_WINDOW_AUTO_TUNING is
+     set. */
+  nghttp2_bdp bdp;
+  /* Budget of streams reset by, or reset because of the remote
+     endpoint.  Only used by server.  Unlimited if burst is 0. */
+  nghttp2_ratelim stream_reset_ratelim;
+  /* Counters retrieved by nghttp2_session_get_stats().
+     header_bytes_sent and header_block_bytes_sent are not maintained
+     here; they are taken from hd_deflater. */
+  nghttp2_stats stats;
+  /* The time when connection level flow control started blocking
+     DATA.  Only meaningful if conn_flow_blocked is nonzero. */
+  uint64_t conn_flow_blocked_since;
+  /* The time when stats.stream_flow_blocked_us was last brought up
+     to date.  See session_update_stream_flow_blocked(). */
+  uint64_t stream_flow_blocked_last;
+  /* Commands queued by other threads.  Only used if
+     NGHTTP2_OPTMASK_COMMAND_QUEUE is set. */
+  nghttp2_mpsc cmdq;
   /* Base value when we schedule next DATA frame write.  This is
      updated when one frame was written. */
   uint64_t last_cycle;
@@ -227,6 +361,13 @@ struct nghttp2_session {
   /* Queue of In-flight SETTINGS values.  SETTINGS bearing ACK is not
      considered as in-flight. */
   nghttp2_inflight_settings *inflight_settings_head;
+  /* IDs of streams whose WINDOW_UPDATE is deferred until session is
+     about to send frames.  Only used if
+     NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE is set.  The streams may
+     be closed by then. */
+  int32_t *pending_window_update_streams;
+  size_t num_pending_window_update_streams;
+  size_t pending_window_update_streams_cap;
   /* The number of outgoing streams. This will be capped by
      remote_settings.max_concurrent_streams. */
   size_t num_outgoing_streams;
@@ -256,13 +397,30 @@ struct nghttp2_session {
      |idle_stream_head|.  The current implementation only keeps idle
      streams if session is initialized as server. */
   size_t num_idle_streams;
+  /* The number of closed and idle streams which are replaced with
+     the compact copy.  See nghttp2_session_compact_stream(). */
+  size_t num_compact_streams;
+  /* The number of streams whose DATA is deferred by stream level
+     flow control, that is
+     NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL is set. */
+  size_t num_flow_blocked_streams;
   /* The number of bytes allocated for nvbuf */
   size_t nvbuflen;
   /* Counter for detecting flooding in outbound queue */
   size_t obq_flood_counter_;
+  /* The maximum value of obq_flood_counter_ */
+  size_t max_outbound_ack;
+  /* The number of successive DATA frames received without payload
+     nor END_STREAM flag */
+  size_t num_empty_data_frames;
+  /* The maximum value of num_empty_data_frames.  0 if unlimited. */
+  size_t max_empty_data_frames;
   /* The maximum length of header block to send.  Calculated by the
      same way as nghttp2_hd_deflate_bound() does. */
   size_t max_send_header_block_length;
+  /* The soft limit of memory held by this session, which is checked
+     when the remote peer opens new stream.  SIZE_MAX if unlimited. */
+  size_t max_session_memory;
   /* Next Stream ID. Made unsigned int to detect >= (1 << 31). */
   uint32_t next_stream_id;
   /* The last stream ID this session initiated.  For client session,
@@ -308,6 +466,9 @@ struct nghttp2_session {
   nghttp2_settings_storage local_settings;
   /* Option flags. This is bitwise-OR of 0 or more of nghttp2_optmask. */
   uint32_t opt_flags;
+  /* WINDOW_UPDATE is sent when this percentage of receive window is
+     consumed. */
+  uint32_t window_update_threshold;
   /* Unacked local SETTINGS_MAX_CONCURRENT_STREAMS value. We use this
      to refuse the incoming stream if it exceeds this value. */
   uint32_t pending_local_max_concurrent_stream;
@@ -326,6 +487,17 @@ struct nghttp2_session {
      this session.  The nonzero does not necessarily mean
      WINDOW_UPDATE is not queued. */
   uint8_t window_update_queued;
+  /* Nonzero if WINDOW_UPDATE to this session is deferred until
+     session is about to send frames.  Only used if
+     NGHTTP2_OPTMASK_COALESCE_WINDOW_UPDATE is set. */
+  uint8_t window_update_pending;
+  /* Nonzero if DATA is pending but the connection level flow
+     control window of the remote endpoint is exhausted. */
+  uint8_t conn_flow_blocked;
+  /* Nonzero if the remote endpoint exceeded one of the flood
+     budgets.  Session has been terminated, and the rest of the input
+     is ignored. */
+  uint8_t flooded;
   /* Bitfield of extension frame types that application is willing to
      receive.  To designate the bit of given frame type i, use
      user_recv_ext_types[i / 8] & (1 << (i & 0x7)).  First 10 frame
@@ -576,6 +748,18 @@ int nghttp2_session_adjust_closed_stream(nghttp2_session *session);
  */
 int nghttp2_session_adjust_idle_stream(nghttp2_session *session);
 
+/*
+ * Replaces the retained closed or idle |stream| with a copy which
+ * only has the first NGHTTP2_STREAM_COMPACT_SIZE bytes of
+ * nghttp2_stream, and frees |stream|.  |stream| must not have item
+ * attached.  If memory allocation fails, |stream| is left as is.
+ *
+ * This function returns the compact copy, or |stream| if it cannot
+ * be replaced.
+ */
+nghttp2_stream *nghttp2_session_compact_stream(nghttp2_session *session,
+                                               nghttp2_stream *stream);
+
 /*
  * If further receptions and transmissions over the stream |stream_id|
  * are disallowed, close the stream with error code NGHTTP2_NO_ERROR.
@@ -0,0 +1,289 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_simd.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NGHTTP2_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif /* __SSE2__ || _M_X64 || _M_IX86_FP >= 2 */
+
+/* AVX2 code is compiled with target attribute, and is only used if
+   CPU supports it. */
+#if defined(NGHTTP2_SIMD_SSE2) &&                                              \
+    (defined(__x86_64__) || defined(__i386__)) && defined(__has_attribute)
+#if __has_attribute(target)
+#define NGHTTP2_SIMD_AVX2 1
+#include <immintrin.h>
+#endif /* __has_attribute(target) */
+#endif /* NGHTTP2_SIMD_SSE2 && (__x86_64__ || __i386__) && __has_attribute */
+
+#ifdef NGHTTP2_SIMD_SSE2
+
+/* All valid characters of header field name and authority are in
+   [0x21, 0x7e], so that ranges can be checked with signed comparison,
+   and the bytes larger than 0x7f never fall in any of them. */
+#define SSE2_RANGE(V, LO, HI)                                                  \
+  _mm_and_si128(_mm_cmpgt_epi8((V), _mm_set1_epi8((char)((LO)-1))),            \
+                _mm_cmpgt_epi8(_mm_set1_epi8((char)((HI) + 1)), (V)))
+#define SSE2_EQ(V, C) _mm_cmpeq_epi8((V), _mm_set1_epi8((char)(C)))
+
+/* The same characters as VALID_HD_NAME_CHARS in nghttp2_helper.c */
+static __m128i sse2_valid_header_name(__m128i v) {
+  __m128i ok;
+
+  ok = _mm_or_si128(SSE2_EQ(v, '!'), SSE2_RANGE(v, '#', '\''));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, '*', '+'));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, '-', '.'));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, '0', '9'));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, '^', 'z'));
+  ok = _mm_or_si128(ok, SSE2_EQ(v, '|'));
+  return _mm_or_si128(ok, SSE2_EQ(v, '~'));
+}
+
+/* The same characters as VALID_AUTHORITY_CHARS in nghttp2_http.c */
+static __m128i sse2_valid_authority(__m128i v) {
+  __m128i ok;
+
+  ok = _mm_or_si128(SSE2_EQ(v, '!'), SSE2_RANGE(v, '$', '.'));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, '0', ';'));
+  ok = _mm_or_si128(ok, SSE2_EQ(v, '='));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, '@', '['));
+  ok = _mm_or_si128(ok, SSE2_EQ(v, ']'));
+  ok = _mm_or_si128(ok, SSE2_EQ(v, '_'));
+  ok = _mm_or_si128(ok, SSE2_RANGE(v, 'a', 'z'));
+  return _mm_or_si128(ok, SSE2_EQ(v, '~'));
+}
+
+/* Control characters except for HT, and DEL.  The complement of
+   VALID_HD_VALUE_CHARS in nghttp2_helper.c */
+static __m128i sse2_invalid_header_value(__m128i v) {
+  __m128i ctl;
+
+  ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+  ctl = _mm_andnot_si128(SSE2_EQ(v, '\t'), ctl);
+  return _mm_or_si128(ctl, SSE2_EQ(v, 0x7f));
+}
+
+#define SSE2_LOAD(P) _mm_loadu_si128((const __m128i *)(const void *)(P))
+
+static size_t sse2_skip_header_name(const uint8_t *s, size_t len) {
+  size_t n;
+
+  for (n = 0; len - n >= 16; n += 16) {
+    if (_mm_movemask_epi8(sse2_valid_header_name(SSE2_LOAD(s + n))) !=
+        0xffff) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+static size_t sse2_skip_authority(const uint8_t *s, size_t len) {
+  size_t n;
+
+  for (n = 0; len - n >= 16; n += 16) {
+    if (_mm_movemask_epi8(sse2_valid_authority(SSE2_LOAD(s + n))) != 0xffff) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+static size_t sse2_skip_header_value(const uint8_t *s, size_t len) {
+  size_t n;
+
+  for (n = 0; len - n >= 16; n += 16) {
+    if (_mm_movemask_epi8(sse2_invalid_header_value(SSE2_LOAD(s + n)))) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+#ifdef NGHTTP2_SIMD_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+#define AVX2_RANGE(V, LO, HI)                                                  \
+  _mm256_and_si256(                                                            \
+      _mm256_cmpgt_epi8((V), _mm256_set1_epi8((char)((LO)-1))),                \
+      _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((HI) + 1)), (V)))
+#define AVX2_EQ(V, C) _mm256_cmpeq_epi8((V), _mm256_set1_epi8((char)(C)))
+
+AVX2_TARGET static __m256i avx2_valid_header_name(__m256i v) {
+  __m256i ok;
+
+  ok = _mm256_or_si256(AVX2_EQ(v, '!'), AVX2_RANGE(v, '#', '\''));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, '*', '+'));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, '-', '.'));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, '0', '9'));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, '^', 'z'));
+  ok = _mm256_or_si256(ok, AVX2_EQ(v, '|'));
+  return _mm256_or_si256(ok, AVX2_EQ(v, '~'));
+}
+
+AVX2_TARGET static __m256i avx2_valid_authority(__m256i v) {
+  __m256i ok;
+
+  ok = _mm256_or_si256(AVX2_EQ(v, '!'), AVX2_RANGE(v, '$', '.'));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, '0', ';'));
+  ok = _mm256_or_si256(ok, AVX2_EQ(v, '='));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, '@', '['));
+  ok = _mm256_or_si256(ok, AVX2_EQ(v, ']'));
+  ok = _mm256_or_si256(ok, AVX2_EQ(v, '_'));
+  ok = _mm256_or_si256(ok, AVX2_RANGE(v, 'a', 'z'));
+  return _mm256_or_si256(ok, AVX2_EQ(v, '~'));
+}
+
+AVX2_TARGET static __m256i avx2_invalid_header_value(__m256i v) {
+  __m256i ctl;
+
+  ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+  ctl = _mm256_andnot_si256(AVX2_EQ(v, '\t'), ctl);
+  return _mm256_or_si256(ctl, AVX2_EQ(v, 0x7f));
+}
+
+#define AVX2_LOAD(P) _mm256_loadu_si256((const __m256i *)(const void *)(P))
+
+AVX2_TARGET static size_t avx2_skip_header_name(const uint8_t *s,
+                                                size_t len) {
+  size_t n;
+
+  for (n = 0; len - n >= 32; n += 32) {
+    if (_mm256_movemask_epi8(avx2_valid_header_name(AVX2_LOAD(s + n))) != -1) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+AVX2_TARGET static size_t avx2_skip_authority(const uint8_t *s, size_t len) {
+  size_t n;
+
+  for (n = 0; len - n >= 32; n += 32) {
+    if (_mm256_movemask_epi8(avx2_valid_authority(AVX2_LOAD(s + n))) != -1) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+AVX2_TARGET static size_t avx2_skip_header_value(const uint8_t *s,
+                                                 size_t len) {
+  size_t n;
+
+  for (n = 0; len - n >= 32; n += 32) {
+    if (_mm256_movemask_epi8(avx2_invalid_header_value(AVX2_LOAD(s + n)))) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+static int have_avx2(void) { return __builtin_cpu_supports("avx2"); }
+
+#endif /* NGHTTP2_SIMD_AVX2 */
+
+size_t nghttp2_simd_skip_header_name(const uint8_t *s, size_t len) {
+  size_t n = 0;
+
+#ifdef NGHTTP2_SIMD_AVX2
+  if (len >= 32 && have_avx2()) {
+    n = avx2_skip_header_name(s, len);
+  }
+#endif /* NGHTTP2_SIMD_AVX2 */
+
+  return n + sse2_skip_header_name(s + n, len - n);
+}
+
+size_t nghttp2_simd_skip_header_value(const uint8_t *s, size_t len) {
+  size_t n = 0;
+
+#ifdef NGHTTP2_SIMD_AVX2
+  if (len >= 32 && have_avx2()) {
+    n = avx2_skip_header_value(s, len);
+  }
+#endif /* NGHTTP2_SIMD_AVX2 */
+
+  return n + sse2_skip_header_value(s + n, len - n);
+}
+
+size_t nghttp2_simd_skip_authority(const uint8_t *s, size_t len) {
+  size_t n = 0;
+
+#ifdef NGHTTP2_SIMD_AVX2
+  if (len >= 32 && have_avx2()) {
+    n = avx2_skip_authority(s, len);
+  }
+#endif /* NGHTTP2_SIMD_AVX2 */
+
+  return n + sse2_skip_authority(s + n, len - n);
+}
+
+#else /* !NGHTTP2_SIMD_SSE2 */
+
+/* Portable fallback, which checks 8 bytes at a time using 64 bit
+   integer.  Only header field value is worth doing so. */
+
+#define NGHTTP2_SIMD_ONES ((uint64_t)0x0101010101010101ULL)
+#define NGHTTP2_SIMD_HIGHS ((uint64_t)0x8080808080808080ULL)
+
+size_t nghttp2_simd_skip_header_name(const uint8_t *s _U_, size_t len _U_) {
+  return 0;
+}
+
+size_t nghttp2_simd_skip_header_value(const uint8_t *s, size_t len) {
+  uint64_t x, y;
+  size_t n;
+
+  for (n = 0; len - n >= 8; n += 8) {
+    memcpy(&x, s + n, 8);
+    y = x ^ (NGHTTP2_SIMD_ONES * 0x7f);
+
+    /* Any byte less than 0x20, which includes HT, or equal to 0x7f.
+       HT is left to the caller. */
+    if (((x - NGHTTP2_SIMD_ONES * 0x20) & ~x & NGHTTP2_SIMD_HIGHS) ||
+        ((y - NGHTTP2_SIMD_ONES) & ~y & NGHTTP2_SIMD_HIGHS)) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+size_t nghttp2_simd_skip_authority(const uint8_t *s _U_, size_t len _U_) {
+  return 0;
+}
+
+#endif /* !NGHTTP2_SIMD_SSE2 */
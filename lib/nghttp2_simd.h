@@ -0,0 +1,59 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_SIMD_H
+#define NGHTTP2_SIMD_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+
+/*
+ * The functions below scan |s| of length |len| in blocks of 8 to 32
+ * bytes, depending on the instruction set available at run time, and
+ * return the number of leading bytes which are known to be valid.
+ * The returned value is less than |len| if |s| contains an invalid
+ * byte or the remaining bytes do not fill a block.  The caller must
+ * check the rest of |s| byte by byte.
+ */
+
+/*
+ * Scans header field name, excluding leading ':' of pseudo header
+ * field.  See nghttp2_check_header_name().
+ */
+size_t nghttp2_simd_skip_header_name(const uint8_t *s, size_t len);
+
+/*
+ * Scans header field value.  See nghttp2_check_header_value().
+ */
+size_t nghttp2_simd_skip_header_value(const uint8_t *s, size_t len);
+
+/*
+ * Scans the value of :authority or host header field.
+ */
+size_t nghttp2_simd_skip_authority(const uint8_t *s, size_t len);
+
+#endif /* NGHTTP2_SIMD_H */
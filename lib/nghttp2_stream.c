@@ -78,6 +78,8 @@ void nghttp2_stream_init(nghttp2_stream *stream, int32_t stream_id,
   stream->recv_window_size = 0;
   stream->consumed_size = 0;
   stream->recv_reduction = 0;
+  stream->bdp_recv = 0;
+  stream->bdp_epoch = 0;
   stream->window_update_queued = 0;
 
   stream->dep_prev = NULL;
@@ -88,6 +90,9 @@ void nghttp2_stream_init(nghttp2_stream *stream, int32_t stream_id,
   stream->closed_prev = NULL;
   stream->closed_next = NULL;
 
+  stream->sched_prev = NULL;
+  stream->sched_next = NULL;
+
   stream->weight = weight;
   stream->sum_dep_weight = 0;
 
@@ -103,6 +108,7 @@ void nghttp2_stream_init(nghttp2_stream *stream, int32_t stream_id,
   stream->descendant_next_seq = 0;
   stream->seq = 0;
   stream->last_writelen = 0;
+  stream->extpri = NGHTTP2_EXTPRI_DEFAULT_URGENCY;
 }
 
 void nghttp2_stream_free(nghttp2_stream *stream) {
@@ -232,12 +238,10 @@ void nghttp2_stream_reschedule(nghttp2_stream *stream) {
   dep_stream = stream->dep_prev;
 
   for (; dep_stream; stream = dep_stream, dep_stream = dep_stream->dep_prev) {
-    nghttp2_pq_remove(&dep_stream->obq, &stream->pq_entry);
-
     stream_next_cycle(stream, dep_stream->descendant_last_cycle);
     stream->seq = dep_stream->descendant_next_seq++;
 
-    nghttp2_pq_push(&dep_stream->obq, &stream->pq_entry);
+    nghttp2_pq_fix(&dep_stream->obq, &stream->pq_entry);
 
     DEBUGF("stream: stream=%d obq resched cycle=%d\n", stream->stream_id,
            stream->cycle);
@@ -271,8 +275,6 @@ void nghttp2_stream_change_weight(nghttp2_stream *stream, int32_t weight) {
     return;
   }
 
-  nghttp2_pq_remove(&dep_stream->obq, &stream->pq_entry);
-
   wlen_penalty = (uint32_t)stream->last_writelen * NGHTTP2_MAX_WEIGHT;
 
   /* Compute old stream->pending_penalty we used to calculate
@@ -297,7 +299,7 @@ void nghttp2_stream_change_weight(nghttp2_stream *stream, int32_t weight) {
 
   /* Continue to use same stream->seq */
 
-  nghttp2_pq_push(&dep_stream->obq, &stream->pq_entry);
+  nghttp2_pq_fix(&dep_stream->obq, &stream->pq_entry);
 
   DEBUGF("stream: stream=%d obq resched cycle=%d\n", stream->stream_id,
          stream->cycle);
@@ -916,6 +918,35 @@ void nghttp2_stream_dep_remove_subtree(nghttp2_stream *stream) {
   stream->dep_prev = NULL;
 }
 
+void nghttp2_stream_dep_replace(nghttp2_stream *stream,
+                                nghttp2_stream *new_stream) {
+  nghttp2_stream *si;
+
+  DEBUGF("stream: dep_replace stream(%p)=%d, new_stream(%p)\n", stream,
+         stream->stream_id, new_stream);
+
+  if (stream->sib_prev) {
+    stream->sib_prev->sib_next = new_stream;
+  } else if (stream->dep_prev) {
+    stream->dep_prev->dep_next = new_stream;
+  }
+
+  if (stream->sib_next) {
+    stream->sib_next->sib_prev = new_stream;
+  }
+
+  for (si = stream->dep_next; si; si = si->sib_next) {
+    si->dep_prev = new_stream;
+  }
+
+  if (stream->queued) {
+    nghttp2_pq_replace(&stream->dep_prev->obq, &stream->pq_entry,
+                       &new_stream->pq_entry);
+  }
+
+  validate_tree(new_stream->dep_prev);
+}
+
 int nghttp2_stream_in_dep_tree(nghttp2_stream *stream) {
   return stream->dep_prev || stream->dep_next || stream->sib_prev ||
          stream->sib_next;
@@ -29,6 +29,8 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <stddef.h>
+
 #include <nghttp2/nghttp2.h>
 #include "nghttp2_outbound_item.h"
 #include "nghttp2_map.h"
@@ -90,7 +92,15 @@ typedef enum {
   NGHTTP2_STREAM_FLAG_DEFERRED_USER = 0x08,
   /* bitwise OR of NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL and
      NGHTTP2_STREAM_FLAG_DEFERRED_USER. */
-  NGHTTP2_STREAM_FLAG_DEFERRED_ALL = 0x0c
+  NGHTTP2_STREAM_FLAG_DEFERRED_ALL = 0x0c,
+  /* Indicates that stream ID is in
+     session->pending_window_update_streams, and WINDOW_UPDATE is
+     considered when session is about to send frames. */
+  NGHTTP2_STREAM_FLAG_WINDOW_UPDATE_PENDING = 0x10,
+  /* Indicates that this is a compact copy of retained closed or idle
+     stream, which only has the first NGHTTP2_STREAM_COMPACT_SIZE
+     bytes of nghttp2_stream. */
+  NGHTTP2_STREAM_FLAG_COMPACT = 0x20
 
 } nghttp2_stream_flag;
 
@@ -133,6 +143,14 @@ typedef enum {
   NGHTTP2_HTTP_FLAG_EXPECT_FINAL_RESPONSE = 1 << 14
 } nghttp2_http_flag;
 
+/*
+ * The fields of nghttp2_stream are ordered so that the ones which the
+ * retained closed and idle streams use come first.  Those streams
+ * are only kept to maintain the dependency tree, and they are
+ * eventually replaced with a compact copy which has just the first
+ * NGHTTP2_STREAM_COMPACT_SIZE bytes.  See
+ * nghttp2_session_compact_stream().
+ */
 struct nghttp2_stream {
   /* Intrusive Map */
   nghttp2_map_entry map_entry;
@@ -142,10 +160,6 @@ struct nghttp2_stream {
      streams which itself has some data to send, or has a descendant
      which has some data to sent. */
   nghttp2_pq obq;
-  /* Content-Length of request/response body.  -1 if unknown. */
-  int64_t content_length;
-  /* Received body so far */
-  int64_t recv_content_length;
   /* Base last_cycle for direct descendent streams. */
   uint32_t descendant_last_cycle;
   /* Next scheduled time to sent item */
@@ -169,14 +183,44 @@ struct nghttp2_stream {
      closed_next points to the next stream object if it is the element
      of the list. */
   nghttp2_stream *closed_prev, *closed_next;
-  /* The arbitrary data provided by user for this stream. */
-  void *stream_user_data;
   /* Item to send */
   nghttp2_outbound_item *item;
   /* Last written length of frame payload */
   size_t last_writelen;
   /* stream ID */
   int32_t stream_id;
+  /* weight of this stream */
+  int32_t weight;
+  /* This is unpaid penalty (offset) when calculating cycle. */
+  uint32_t pending_penalty;
+  /* sum of weight of direct descendants */
+  int32_t sum_dep_weight;
+  nghttp2_stream_state state;
+  /* This is bitwise-OR of 0 or more of nghttp2_stream_flag. */
+  uint8_t flags;
+  /* Bitwise OR of zero or more nghttp2_shut_flag values */
+  uint8_t shut_flags;
+  /* Nonzero if this stream has been queued to stream pointed by
+     dep_prev.  We maintain the invariant that if a stream is queued,
+     then its ancestors, except for root, are also queued.  This
+     invariant may break in fatal error condition.  When urgency
+     scheduler is used, nonzero if this stream is in its queue. */
+  uint8_t queued;
+  /* Urgency and incremental flag of Extensible Prioritization
+     scheme.  See nghttp2_extpri_uint8_urgency() and
+     nghttp2_extpri_uint8_inc(). */
+  uint8_t extpri;
+  /* The fields below are not available if
+     NGHTTP2_STREAM_FLAG_COMPACT is set. */
+  /* Content-Length of request/response body.  -1 if unknown. */
+  int64_t content_length;
+  /* Received body so far */
+  int64_t recv_content_length;
+  /* When urgency scheduler is used, the stream which has DATA to send
+     is kept in the doubly linked list of its urgency. */
+  nghttp2_stream *sched_prev, *sched_next;
+  /* The arbitrary data provided by user for this stream. */
+  void *stream_user_data;
   /* Current remote window size. This value is computed against the
      current initial window size of remote endpoint. */
   int32_t remote_window_size;
@@ -191,36 +235,27 @@ struct nghttp2_stream {
   /* The amount of recv_window_size cut using submitting negative
      value to WINDOW_UPDATE */
   int32_t recv_reduction;
+  /* The number of DATA bytes received since the window auto-tuning
+     probe |bdp_epoch| was sent.  See nghttp2_bdp_on_data(). */
+  uint32_t bdp_recv;
+  uint32_t bdp_epoch;
   /* window size for local flow control. It is initially set to
      NGHTTP2_INITIAL_WINDOW_SIZE and could be increased/decreased by
      submitting WINDOW_UPDATE. See nghttp2_submit_window_update(). */
   int32_t local_window_size;
-  /* weight of this stream */
-  int32_t weight;
-  /* This is unpaid penalty (offset) when calculating cycle. */
-  uint32_t pending_penalty;
-  /* sum of weight of direct descendants */
-  int32_t sum_dep_weight;
-  nghttp2_stream_state state;
   /* status code from remote server */
   int16_t status_code;
   /* Bitwise OR of zero or more nghttp2_http_flag values */
   uint16_t http_flags;
-  /* This is bitwise-OR of 0 or more of nghttp2_stream_flag. */
-  uint8_t flags;
-  /* Bitwise OR of zero or more nghttp2_shut_flag values */
-  uint8_t shut_flags;
-  /* Nonzero if this stream has been queued to stream pointed by
-     dep_prev.  We maintain the invariant that if a stream is queued,
-     then its ancestors, except for root, are also queued.  This
-     invariant may break in fatal error condition. */
-  uint8_t queued;
   /* This flag is used to reduce excessive queuing of WINDOW_UPDATE to
      this stream.  The nonzero does not necessarily mean WINDOW_UPDATE
      is not queued. */
   uint8_t window_update_queued;
 };
 
+/* The size of the compact copy of nghttp2_stream */
+#define NGHTTP2_STREAM_COMPACT_SIZE offsetof(nghttp2_stream, content_length)
+
 void nghttp2_stream_init(nghttp2_stream *stream, int32_t stream_id,
                          uint8_t flags, nghttp2_stream_state initial_state,
                          int32_t weight, int32_t remote_initial_window_size,
@@ -409,6 +444,14 @@ int nghttp2_stream_dep_add_subtree(nghttp2_stream *dep_stream,
  */
 void nghttp2_stream_dep_remove_subtree(nghttp2_stream *stream);
 
+/*
+ * Makes |new_stream| take the place of |stream| in the dependency
+ * tree, including the parent's obq.  |new_stream| must be a copy of
+ * |stream|.  The pointers in |stream| are left untouched.
+ */
+void nghttp2_stream_dep_replace(nghttp2_stream *stream,
+                                nghttp2_stream *new_stream);
+
 /*
  * Returns nonzero if |stream| is in any dependency tree.
  */
@@ -196,7 +196,8 @@ int32_t nghttp2_submit_headers(nghttp2_session *session, uint8_t flags,
 
   flags &= NGHTTP2_FLAG_END_STREAM;
 
-  if (pri_spec && !nghttp2_priority_spec_check_default(pri_spec)) {
+  if (pri_spec && !nghttp2_priority_spec_check_default(pri_spec) &&
+      !(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
     rv = detect_self_dependency(session, stream_id, pri_spec);
     if (rv != 0) {
       return rv;
@@ -236,6 +237,10 @@ int nghttp2_submit_priority(nghttp2_session *session, uint8_t flags _U_,
     return NGHTTP2_ERR_INVALID_ARGUMENT;
   }
 
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    return 0;
+  }
+
   copy_pri_spec = *pri_spec;
 
   nghttp2_priority_spec_normalize_weight(&copy_pri_spec);
@@ -586,7 +591,8 @@ int32_t nghttp2_submit_request(nghttp2_session *session,
     return NGHTTP2_ERR_PROTO;
   }
 
-  if (pri_spec && !nghttp2_priority_spec_check_default(pri_spec)) {
+  if (pri_spec && !nghttp2_priority_spec_check_default(pri_spec) &&
+      !(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
     rv = detect_self_dependency(session, -1, pri_spec);
     if (rv != 0) {
       return rv;
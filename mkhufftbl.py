@@ -5,6 +5,11 @@
 # and decoding tables in C language.  The resulting code is used in
 # lib/nghttp2_hd_huffman.h and lib/nghttp2_hd_huffman_data.c
 #
+# Two decoding tables are generated.  huff_decode_table advances the
+# decoder 4 bits at a time, and huff_byte_decode_table advances it 8
+# bits at a time.  The latter is derived from the same tree and is the
+# one used by the decoder.
+#
 # [1] http://http2.github.io/http2-spec/compression.html
 
 from __future__ import unicode_literals
@@ -280,6 +285,7 @@ class Node:
         self.left = None
         self.right = None
         self.trans = []
+        self.trans8 = []
         self.id = None
         self.accept = False
 
@@ -357,9 +363,40 @@ def _build_transition_table(ctx, node):
 def huffman_tree_build_transition_table(ctx):
     _build_transition_table(ctx, ctx.root)
 
+def _walk8(node, byte, root):
+    syms = []
+    for i in range(7, -1, -1):
+        if (byte >> i) & 1:
+            node = node.right
+        else:
+            node = node.left
+        if node.term is not None:
+            if node.term == 256:
+                # EOS must not appear in the encoded string
+                return (None, syms)
+            syms.append(node.term)
+            node = root
+    return (node, syms)
+
+def _build_byte_transition_table(ctx, node):
+    if node.term is not None:
+        return
+    for byte in range(256):
+        nd, syms = _walk8(node, byte, ctx.root)
+        # The shortest code is 5 bits long, so at most 2 symbols are
+        # completed within 8 bits.
+        assert len(syms) <= 2
+        node.trans8.append((nd, syms))
+    _build_byte_transition_table(ctx, node.left)
+    _build_byte_transition_table(ctx, node.right)
+
+def huffman_tree_build_byte_transition_table(ctx):
+    _build_byte_transition_table(ctx, ctx.root)
+
 NGHTTP2_HUFF_ACCEPTED = 1
 NGHTTP2_HUFF_SYM = 1 << 1
 NGHTTP2_HUFF_FAIL = 1 << 2
+NGHTTP2_HUFF_SYM2 = 1 << 3
 
 def _print_transition_table(node):
     if node.term is not None:
@@ -392,6 +429,33 @@ def _print_transition_table(node):
 def huffman_tree_print_transition_table(ctx):
     _print_transition_table(ctx.root)
 
+def _print_byte_transition_table(node):
+    if node.term is not None:
+        return
+    print '/* {} */'.format(node.id)
+    print '{'
+    for nd, syms in node.trans8:
+        flags = 0
+        out = syms + [0] * (2 - len(syms))
+        if len(syms) >= 1:
+            flags |= NGHTTP2_HUFF_SYM
+        if len(syms) == 2:
+            flags |= NGHTTP2_HUFF_SYM2
+        if nd is None:
+            id = 0
+            flags |= NGHTTP2_HUFF_FAIL
+        else:
+            id = nd.id
+            if nd.accept:
+                flags |= NGHTTP2_HUFF_ACCEPTED
+        print '  {{{}, 0x{:02x}, {{{}, {}}}}},'.format(id, flags, out[0], out[1])
+    print '},'
+    _print_byte_transition_table(node.left)
+    _print_byte_transition_table(node.right)
+
+def huffman_tree_print_byte_transition_table(ctx):
+    _print_byte_transition_table(ctx.root)
+
 if __name__ == '__main__':
     ctx = Context()
     symbol_tbl = [(None, 0) for i in range(257)]
@@ -412,6 +476,7 @@ if __name__ == '__main__':
 
     huffman_tree_set_node_id(ctx)
     huffman_tree_build_transition_table(ctx)
+    huffman_tree_build_byte_transition_table(ctx)
 
     print '''\
 typedef struct {
@@ -434,8 +499,10 @@ enum {{
   NGHTTP2_HUFF_ACCEPTED = {},
   NGHTTP2_HUFF_SYM = {},
   NGHTTP2_HUFF_FAIL = {},
+  NGHTTP2_HUFF_SYM2 = {},
 }} nghttp2_huff_decode_flag;
-'''.format(NGHTTP2_HUFF_ACCEPTED, NGHTTP2_HUFF_SYM, NGHTTP2_HUFF_FAIL)
+'''.format(NGHTTP2_HUFF_ACCEPTED, NGHTTP2_HUFF_SYM, NGHTTP2_HUFF_FAIL,
+           NGHTTP2_HUFF_SYM2)
 
     print '''\
 typedef struct {
@@ -449,3 +516,17 @@ typedef struct {
 const nghttp2_huff_decode huff_decode_table[][16] = {'''
     huffman_tree_print_transition_table(ctx)
     print '};'
+    print ''
+
+    print '''\
+typedef struct {
+  uint8_t state;
+  uint8_t flags;
+  uint8_t sym[2];
+} nghttp2_huff_byte_decode;
+'''
+
+    print '''\
+const nghttp2_huff_byte_decode huff_byte_decode_table[][256] = {'''
+    huffman_tree_print_byte_transition_table(ctx)
+    print '};'
@@ -0,0 +1,105 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nghttp2_bench_helper.h"
+/* include benchmarks' include files here */
+#include "nghttp2_hd_bench.h"
+#include "nghttp2_map_bench.h"
+#include "nghttp2_pq_bench.h"
+#include "nghttp2_sched_bench.h"
+#include "nghttp2_session_bench.h"
+
+typedef struct {
+  const char *name;
+  nghttp2_bench_func func;
+} bench_entry;
+
+static const bench_entry benches[] = {
+    {"hd_huff_encode", bench_nghttp2_hd_huff_encode},
+    {"hd_huff_decode", bench_nghttp2_hd_huff_decode},
+    {"hd_huff_decode_nibble", bench_nghttp2_hd_huff_decode_nibble},
+    {"hd_deflate_4k", bench_nghttp2_hd_deflate_4k},
+    {"hd_deflate_64k", bench_nghttp2_hd_deflate_64k},
+    {"hd_deflate_response", bench_nghttp2_hd_deflate_response},
+    {"hd_deflate_response_memoize", bench_nghttp2_hd_deflate_response_memoize},
+    {"hd_inflate_4k", bench_nghttp2_hd_inflate_4k},
+    {"hd_inflate_64k", bench_nghttp2_hd_inflate_64k},
+    {"map_find_100", bench_nghttp2_map_find_100},
+    {"map_find_10k", bench_nghttp2_map_find_10k},
+    {"map_churn_100", bench_nghttp2_map_churn_100},
+    {"map_churn_10k", bench_nghttp2_map_churn_10k},
+    {"pq_push_pop_1k", bench_nghttp2_pq_push_pop_1k},
+    {"pq_push_pop_10k", bench_nghttp2_pq_push_pop_10k},
+    {"pq_remove_1k", bench_nghttp2_pq_remove_1k},
+    {"pq_remove_10k", bench_nghttp2_pq_remove_10k},
+    {"sched_rfc7540_1k", bench_nghttp2_sched_rfc7540_1k},
+    {"sched_rfc7540_10k", bench_nghttp2_sched_rfc7540_10k},
+    {"sched_urgency_1k", bench_nghttp2_sched_urgency_1k},
+    {"sched_urgency_10k", bench_nghttp2_sched_urgency_10k},
+    {"session_mem_recv_100", bench_nghttp2_session_mem_recv_100},
+    {"session_mem_send_100", bench_nghttp2_session_mem_send_100},
+    {"session_mem_send_1k", bench_nghttp2_session_mem_send_1k},
+    {"session_reprioritize_1k", bench_nghttp2_session_reprioritize_1k},
+};
+
+/*
+ * Runs all benchmarks if no argument is given.  Otherwise, runs
+ * benchmarks whose name contains one of the arguments.  If the first
+ * argument is "--json", the results are printed in JSON, one object
+ * per line.
+ */
+int main(int argc, char *argv[]) {
+  size_t i;
+  int j;
+  int first = 1;
+
+  if (argc > 1 && strcmp(argv[1], "--json") == 0) {
+    nghttp2_bench_set_output(NGHTTP2_BENCH_OUTPUT_JSON);
+    ++first;
+  }
+
+  for (i = 0; i < ARRLEN(benches); ++i) {
+    if (argc > first) {
+      for (j = first; j < argc; ++j) {
+        if (strstr(benches[i].name, argv[j])) {
+          break;
+        }
+      }
+      if (j == argc) {
+        continue;
+      }
+    }
+
+    nghttp2_bench_run(benches[i].name, benches[i].func);
+  }
+
+  return 0;
+}
@@ -68,7 +68,9 @@ int main(int argc _U_, char *argv[] _U_) {
   if (!CU_add_test(pSuite, "pq", test_nghttp2_pq) ||
       !CU_add_test(pSuite, "pq_update", test_nghttp2_pq_update) ||
       !CU_add_test(pSuite, "pq_remove", test_nghttp2_pq_remove) ||
+      !CU_add_test(pSuite, "pq_fix", test_nghttp2_pq_fix) ||
       !CU_add_test(pSuite, "map", test_nghttp2_map) ||
+      !CU_add_test(pSuite, "map_collision", test_nghttp2_map_collision) ||
       !CU_add_test(pSuite, "map_functional", test_nghttp2_map_functional) ||
       !CU_add_test(pSuite, "map_each_free", test_nghttp2_map_each_free) ||
       !CU_add_test(pSuite, "queue", test_nghttp2_queue) ||
@@ -79,6 +81,8 @@ int main(int argc _U_, char *argv[] _U_) {
       !CU_add_test(pSuite, "session_recv_invalid_frame",
                    test_nghttp2_session_recv_invalid_frame) ||
       !CU_add_test(pSuite, "session_recv_eof", test_nghttp2_session_recv_eof) ||
+      !CU_add_test(pSuite, "session_mem_recvv",
+                   test_nghttp2_session_mem_recvv) ||
       !CU_add_test(pSuite, "session_recv_data",
                    test_nghttp2_session_recv_data) ||
       !CU_add_test(pSuite, "session_recv_data_no_auto_flow_control",
@@ -271,6 +275,8 @@ int main(int argc _U_, char *argv[] _U_) {
                    test_nghttp2_session_keep_closed_stream) ||
       !CU_add_test(pSuite, "session_keep_idle_stream",
                    test_nghttp2_session_keep_idle_stream) ||
+      !CU_add_test(pSuite, "session_compact_stream",
+                   test_nghttp2_session_compact_stream) ||
       !CU_add_test(pSuite, "session_detach_idle_stream",
                    test_nghttp2_session_detach_idle_stream) ||
       !CU_add_test(pSuite, "session_large_dep_tree",
@@ -291,6 +297,10 @@ int main(int argc _U_, char *argv[] _U_) {
                    test_nghttp2_session_reset_pending_headers) ||
       !CU_add_test(pSuite, "session_send_data_callback",
                    test_nghttp2_session_send_data_callback) ||
+      !CU_add_test(pSuite, "session_mem_send_into",
+                   test_nghttp2_session_mem_send_into) ||
+      !CU_add_test(pSuite, "session_mem_sendv",
+                   test_nghttp2_session_mem_sendv) ||
       !CU_add_test(pSuite, "session_on_begin_headers_temporal_failure",
                    test_nghttp2_session_on_begin_headers_temporal_failure) ||
       !CU_add_test(pSuite, "session_defer_then_close",
@@ -298,6 +308,12 @@ int main(int argc _U_, char *argv[] _U_) {
       !CU_add_test(pSuite, "session_detach_item_from_closed_stream",
                    test_nghttp2_session_detach_item_from_closed_stream) ||
       !CU_add_test(pSuite, "session_flooding", test_nghttp2_session_flooding) ||
+      !CU_add_test(pSuite, "session_outbound_ack_flooding",
+                   test_nghttp2_session_outbound_ack_flooding) ||
+      !CU_add_test(pSuite, "session_stream_reset_flooding",
+                   test_nghttp2_session_stream_reset_flooding) ||
+      !CU_add_test(pSuite, "session_empty_data_flooding",
+                   test_nghttp2_session_empty_data_flooding) ||
       !CU_add_test(pSuite, "session_change_stream_priority",
                    test_nghttp2_session_change_stream_priority) ||
       !CU_add_test(pSuite, "session_repeated_priority_change",
@@ -306,6 +322,10 @@ int main(int argc _U_, char *argv[] _U_) {
                    test_nghttp2_session_repeated_priority_submission) ||
       !CU_add_test(pSuite, "session_set_local_window_size",
                    test_nghttp2_session_set_local_window_size) ||
+      !CU_add_test(pSuite, "session_window_auto_tuning",
+                   test_nghttp2_session_window_auto_tuning) ||
+      !CU_add_test(pSuite, "session_coalesce_window_update",
+                   test_nghttp2_session_coalesce_window_update) ||
       !CU_add_test(pSuite, "session_cancel_from_before_frame_send",
                    test_nghttp2_session_cancel_from_before_frame_send) ||
       !CU_add_test(pSuite, "session_removed_closed_stream",
@@ -314,6 +334,24 @@ int main(int argc _U_, char *argv[] _U_) {
                    test_nghttp2_session_pause_data) ||
       !CU_add_test(pSuite, "session_no_closed_streams",
                    test_nghttp2_session_no_closed_streams) ||
+      !CU_add_test(pSuite, "session_no_header_copy",
+                   test_nghttp2_session_no_header_copy) ||
+      !CU_add_test(pSuite, "session_recv_header_block",
+                   test_nghttp2_session_recv_header_block) ||
+      !CU_add_test(pSuite, "session_no_rfc7540_priorities",
+                   test_nghttp2_session_no_rfc7540_priorities) ||
+      !CU_add_test(pSuite, "session_change_extpri_stream_priority",
+                   test_nghttp2_session_change_extpri_stream_priority) ||
+      !CU_add_test(pSuite, "session_mem_pool",
+                   test_nghttp2_session_mem_pool) ||
+      !CU_add_test(pSuite, "session_mem_usage",
+                   test_nghttp2_session_mem_usage) ||
+      !CU_add_test(pSuite, "session_max_session_memory",
+                   test_nghttp2_session_max_session_memory) ||
+      !CU_add_test(pSuite, "session_get_stats",
+                   test_nghttp2_session_get_stats) ||
+      !CU_add_test(pSuite, "session_command_queue",
+                   test_nghttp2_session_command_queue) ||
       !CU_add_test(pSuite, "http_mandatory_headers",
                    test_nghttp2_http_mandatory_headers) ||
       !CU_add_test(pSuite, "http_content_length",
@@ -358,6 +396,14 @@ int main(int argc _U_, char *argv[] _U_) {
       !CU_add_test(pSuite, "hd_deflate", test_nghttp2_hd_deflate) ||
       !CU_add_test(pSuite, "hd_deflate_same_indexed_repr",
                    test_nghttp2_hd_deflate_same_indexed_repr) ||
+      !CU_add_test(pSuite, "hd_deflate_large_table",
+                   test_nghttp2_hd_deflate_large_table) ||
+      !CU_add_test(pSuite, "hd_deflate_arena",
+                   test_nghttp2_hd_deflate_arena) ||
+      !CU_add_test(pSuite, "hd_deflate_adaptive_indexing",
+                   test_nghttp2_hd_deflate_adaptive_indexing) ||
+      !CU_add_test(pSuite, "hd_deflate_memoize",
+                   test_nghttp2_hd_deflate_memoize) ||
       !CU_add_test(pSuite, "hd_inflate_indexed",
                    test_nghttp2_hd_inflate_indexed) ||
       !CU_add_test(pSuite, "hd_inflate_indname_noinc",
@@ -370,6 +416,10 @@ int main(int argc _U_, char *argv[] _U_) {
                    test_nghttp2_hd_inflate_newname_noinc) ||
       !CU_add_test(pSuite, "hd_inflate_newname_inc",
                    test_nghttp2_hd_inflate_newname_inc) ||
+      !CU_add_test(pSuite, "hd_inflate_no_copy",
+                   test_nghttp2_hd_inflate_no_copy) ||
+      !CU_add_test(pSuite, "hd_inflate_hd_block",
+                   test_nghttp2_hd_inflate_hd_block) ||
       !CU_add_test(pSuite, "hd_inflate_clearall_inc",
                    test_nghttp2_hd_inflate_clearall_inc) ||
       !CU_add_test(pSuite, "hd_inflate_zero_length_huffman",
@@ -391,6 +441,7 @@ int main(int argc _U_, char *argv[] _U_) {
                    test_nghttp2_hd_deflate_hd_vec) ||
       !CU_add_test(pSuite, "hd_decode_length", test_nghttp2_hd_decode_length) ||
       !CU_add_test(pSuite, "hd_huff_encode", test_nghttp2_hd_huff_encode) ||
+      !CU_add_test(pSuite, "hd_huff_decode", test_nghttp2_hd_huff_decode) ||
       !CU_add_test(pSuite, "adjust_local_window_size",
                    test_nghttp2_adjust_local_window_size) ||
       !CU_add_test(pSuite, "check_header_name",
@@ -0,0 +1,135 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_bench_helper.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/* Minimum duration of a benchmark run in nanoseconds */
+#define NGHTTP2_BENCH_MIN_TIME 1000000000ULL
+
+/* Maximum number of iterations per run */
+#define NGHTTP2_BENCH_MAX_N 1000000000ULL
+
+static uint64_t bench_sink;
+
+static nghttp2_bench_output bench_output = NGHTTP2_BENCH_OUTPUT_TEXT;
+
+static uint64_t bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void nghttp2_bench_start_timer(nghttp2_bench *b) {
+  if (b->timer_on) {
+    return;
+  }
+  b->start = bench_now();
+  b->timer_on = 1;
+}
+
+void nghttp2_bench_stop_timer(nghttp2_bench *b) {
+  if (!b->timer_on) {
+    return;
+  }
+  b->elapsed += bench_now() - b->start;
+  b->timer_on = 0;
+}
+
+void nghttp2_bench_reset_timer(nghttp2_bench *b) {
+  if (b->timer_on) {
+    b->start = bench_now();
+  }
+  b->elapsed = 0;
+}
+
+void nghttp2_bench_set_bytes(nghttp2_bench *b, size_t bytes) {
+  b->bytes = bytes;
+}
+
+void nghttp2_bench_use(uint64_t v) { bench_sink += v; }
+
+void nghttp2_bench_set_output(nghttp2_bench_output output) {
+  bench_output = output;
+}
+
+static void bench_run1(nghttp2_bench *b, nghttp2_bench_func f, size_t n) {
+  b->n = n;
+  b->bytes = 0;
+  b->elapsed = 0;
+  b->timer_on = 0;
+
+  nghttp2_bench_start_timer(b);
+  f(b);
+  nghttp2_bench_stop_timer(b);
+}
+
+void nghttp2_bench_run(const char *name, nghttp2_bench_func f) {
+  nghttp2_bench b;
+  uint64_t n = 1;
+  double nsop;
+
+  bench_run1(&b, f, 1);
+
+  while (b.elapsed < NGHTTP2_BENCH_MIN_TIME && n < NGHTTP2_BENCH_MAX_N) {
+    /* Predict the number of iterations required to reach the minimum
+       duration, and grow it at most 100 times at once. */
+    if (b.elapsed == 0) {
+      n *= 100;
+    } else {
+      uint64_t next = NGHTTP2_BENCH_MIN_TIME * 6 / 5 * n / b.elapsed;
+
+      if (next > n * 100) {
+        next = n * 100;
+      } else if (next <= n) {
+        next = n + 1;
+      }
+
+      n = next;
+    }
+
+    bench_run1(&b, f, (size_t)n);
+  }
+
+  nsop = (double)b.elapsed / (double)b.n;
+
+  if (bench_output == NGHTTP2_BENCH_OUTPUT_JSON) {
+    /* Benchmark names are plain identifiers, and need no escaping */
+    printf("{\"name\":\"%s\",\"iterations\":%zu,\"ns_per_op\":%.1f,"
+           "\"bytes_per_op\":%zu,\"mb_per_s\":%.2f}\n",
+           name, b.n, nsop, b.bytes,
+           b.bytes ? (double)b.bytes * 1000.0 / nsop : 0.0);
+  } else if (b.bytes) {
+    printf("%-40s %12zu %14.1f ns/op %10.2f MB/s\n", name, b.n, nsop,
+           (double)b.bytes * 1000.0 / nsop);
+  } else {
+    printf("%-40s %12zu %14.1f ns/op\n", name, b.n, nsop);
+  }
+
+  fflush(stdout);
+}
@@ -0,0 +1,115 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_BENCH_HELPER_H
+#define NGHTTP2_BENCH_HELPER_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARRLEN(ARR) (sizeof(ARR) / sizeof(ARR[0]))
+
+#define MAKE_NV(NAME, VALUE)                                                   \
+  {                                                                            \
+    (uint8_t *)(NAME), (uint8_t *)(VALUE), sizeof((NAME)) - 1,                 \
+        sizeof((VALUE)) - 1, NGHTTP2_NV_FLAG_NONE                              \
+  }
+
+typedef struct nghttp2_bench nghttp2_bench;
+
+/* The format of the results printed by nghttp2_bench_run() */
+typedef enum {
+  /* Aligned columns for human */
+  NGHTTP2_BENCH_OUTPUT_TEXT,
+  /* One JSON object per line, so that the results can be collected
+     and compared over time by scripts. */
+  NGHTTP2_BENCH_OUTPUT_JSON
+} nghttp2_bench_output;
+
+/*
+ * Benchmark function.  It must perform the measured operation
+ * |b->n| times.
+ */
+typedef void (*nghttp2_bench_func)(nghttp2_bench *b);
+
+struct nghttp2_bench {
+  /* The number of iterations benchmark function must perform */
+  size_t n;
+  /* The number of bytes processed per iteration.  If nonzero,
+     throughput is reported as well. */
+  size_t bytes;
+  /* Accumulated measured time in nanoseconds */
+  uint64_t elapsed;
+  /* Time when timer was last started */
+  uint64_t start;
+  /* nonzero if timer is running */
+  int timer_on;
+};
+
+/*
+ * Starts measuring time.  The timer is started before benchmark
+ * function is called.
+ */
+void nghttp2_bench_start_timer(nghttp2_bench *b);
+
+/*
+ * Stops measuring time.  This is useful to exclude setup which must
+ * be done per iteration.
+ */
+void nghttp2_bench_stop_timer(nghttp2_bench *b);
+
+/*
+ * Discards the time measured so far.  This is useful to exclude
+ * expensive setup done before the measured loop.
+ */
+void nghttp2_bench_reset_timer(nghttp2_bench *b);
+
+/*
+ * Tells that each iteration processes |bytes| bytes.
+ */
+void nghttp2_bench_set_bytes(nghttp2_bench *b, size_t bytes);
+
+/*
+ * Sets the format of the results printed by nghttp2_bench_run().  The
+ * default is NGHTTP2_BENCH_OUTPUT_TEXT.
+ */
+void nghttp2_bench_set_output(nghttp2_bench_output output);
+
+/*
+ * Runs benchmark function |f| repeatedly, increasing the number of
+ * iterations until it runs long enough to get a stable result, and
+ * prints the result prefixed by |name| to standard output.
+ */
+void nghttp2_bench_run(const char *name, nghttp2_bench_func f);
+
+/*
+ * Prevents compiler from optimizing away the computation of |v|.
+ */
+void nghttp2_bench_use(uint64_t v);
+
+#endif /* NGHTTP2_BENCH_HELPER_H */
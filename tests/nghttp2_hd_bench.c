@@ -0,0 +1,513 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_hd_bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "nghttp2_hd.h"
+#include "nghttp2_frame.h"
+
+/* Header values which are typically long, and Huffman encoded by
+   clients. */
+static const char *huff_corpus[] = {
+    "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/56.0.2924.87 Safari/537.36",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 10_2_1 like Mac OS X) "
+    "AppleWebKit/602.4.6 (KHTML, like Gecko) Version/10.0 Mobile/14D27 "
+    "Safari/602.1",
+    "_ga=GA1.2.1803427581.1486718216; _gid=GA1.2.1213141516.1487132617; "
+    "__utma=30910097.1803427581.1486718216.1487132617.1487219017.5; "
+    "__utmz=30910097.1486718216.1.1.utmcsr=(direct)|utmccn=(direct)|utmcmd="
+    "(none); SID=DQAAAKgAAABhQ2Bv7GkkR1Fz8zmoNE4iKkzSLmZ7Y1eUxvIfs5J3; "
+    "HSID=AYQEVnDKrdst; SSID=A7Ghq_8rSo0S1QmOH; APISID=bNjG0GeP5fyH/"
+    "Ap8UGlSxt4tIWdeQeFH; SAPISID=fJdMzy0QAtqPfLbq/AoKr6A1O7u2g4Fo",
+    "text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/"
+    "*;q=0.8",
+    "gzip, deflate, sdch, br",
+    "en-US,en;q=0.8,ja;q=0.6,fr;q=0.4",
+    "https://www.example.com/articles/2017/02/16/"
+    "performance-of-http2-header-compression.html?utm_source=feed",
+    "/assets/application-5a1e8a9d3b7f2c4e6d8f0a1b3c5d7e9f.js?v=1487219017",
+};
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+} huff_input;
+
+static nghttp2_mem *mem;
+static huff_input huff_inputs[ARRLEN(huff_corpus)];
+static size_t huff_inputs_len;
+static uint8_t huff_outbuf[4096];
+
+static void huff_inputs_init(void) {
+  size_t i;
+  nghttp2_bufs bufs;
+  int rv;
+
+  if (huff_inputs_len) {
+    return;
+  }
+
+  mem = nghttp2_mem_default();
+
+  rv = nghttp2_bufs_init(&bufs, 4096, 1, mem);
+  assert(0 == rv);
+
+  for (i = 0; i < ARRLEN(huff_corpus); ++i) {
+    size_t len = strlen(huff_corpus[i]);
+
+    nghttp2_bufs_reset(&bufs);
+    rv = nghttp2_hd_huff_encode(&bufs, (const uint8_t *)huff_corpus[i], len);
+    assert(0 == rv);
+
+    huff_inputs[i].len = nghttp2_bufs_len(&bufs);
+    huff_inputs[i].data = nghttp2_mem_malloc(mem, huff_inputs[i].len);
+    memcpy(huff_inputs[i].data, bufs.head->buf.pos, huff_inputs[i].len);
+
+    huff_inputs_len += huff_inputs[i].len;
+  }
+
+  nghttp2_bufs_free(&bufs);
+}
+
+void bench_nghttp2_hd_huff_encode(nghttp2_bench *b) {
+  size_t i, j;
+  nghttp2_bufs bufs;
+  int rv;
+  size_t srclen = 0;
+
+  mem = nghttp2_mem_default();
+
+  rv = nghttp2_bufs_init(&bufs, 4096, 1, mem);
+  assert(0 == rv);
+
+  for (j = 0; j < ARRLEN(huff_corpus); ++j) {
+    srclen += strlen(huff_corpus[j]);
+  }
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    for (j = 0; j < ARRLEN(huff_corpus); ++j) {
+      nghttp2_bufs_reset(&bufs);
+      rv = nghttp2_hd_huff_encode(&bufs, (const uint8_t *)huff_corpus[j],
+                                  strlen(huff_corpus[j]));
+      nghttp2_bench_use((uint64_t)rv + nghttp2_bufs_len(&bufs));
+    }
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_set_bytes(b, srclen);
+
+  nghttp2_bufs_free(&bufs);
+}
+
+void bench_nghttp2_hd_huff_decode(nghttp2_bench *b) {
+  size_t i, j;
+  nghttp2_buf buf;
+  nghttp2_hd_huff_decode_context ctx;
+  ssize_t rv;
+
+  huff_inputs_init();
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    for (j = 0; j < ARRLEN(huff_inputs); ++j) {
+      nghttp2_buf_wrap_init(&buf, huff_outbuf, sizeof(huff_outbuf));
+      nghttp2_hd_huff_decode_context_init(&ctx);
+      rv = nghttp2_hd_huff_decode(&ctx, &buf, huff_inputs[j].data,
+                                  huff_inputs[j].len, 1);
+      nghttp2_bench_use((uint64_t)rv + huff_outbuf[0]);
+    }
+  }
+
+  nghttp2_bench_set_bytes(b, huff_inputs_len);
+}
+
+/*
+ * The decoder which advances the state 4 bits at a time using
+ * huff_decode_table.  This was the implementation of
+ * nghttp2_hd_huff_decode() before it switched to
+ * huff_byte_decode_table, and is kept here as a baseline.
+ */
+static ssize_t huff_decode_nibble(nghttp2_hd_huff_decode_context *ctx,
+                                  nghttp2_buf *buf, const uint8_t *src,
+                                  size_t srclen, int final) {
+  size_t i;
+
+  for (i = 0; i < srclen; ++i) {
+    const nghttp2_huff_decode *t;
+
+    t = &huff_decode_table[ctx->state][src[i] >> 4];
+    if (t->flags & NGHTTP2_HUFF_FAIL) {
+      return NGHTTP2_ERR_HEADER_COMP;
+    }
+    if (t->flags & NGHTTP2_HUFF_SYM) {
+      *buf->last++ = t->sym;
+    }
+
+    t = &huff_decode_table[t->state][src[i] & 0xf];
+    if (t->flags & NGHTTP2_HUFF_FAIL) {
+      return NGHTTP2_ERR_HEADER_COMP;
+    }
+    if (t->flags & NGHTTP2_HUFF_SYM) {
+      *buf->last++ = t->sym;
+    }
+
+    ctx->state = t->state;
+    ctx->accept = (t->flags & NGHTTP2_HUFF_ACCEPTED) != 0;
+  }
+  if (final && !ctx->accept) {
+    return NGHTTP2_ERR_HEADER_COMP;
+  }
+  return (ssize_t)i;
+}
+
+void bench_nghttp2_hd_huff_decode_nibble(nghttp2_bench *b) {
+  size_t i, j;
+  nghttp2_buf buf;
+  nghttp2_hd_huff_decode_context ctx;
+  ssize_t rv;
+
+  huff_inputs_init();
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    for (j = 0; j < ARRLEN(huff_inputs); ++j) {
+      nghttp2_buf_wrap_init(&buf, huff_outbuf, sizeof(huff_outbuf));
+      nghttp2_hd_huff_decode_context_init(&ctx);
+      rv = huff_decode_nibble(&ctx, &buf, huff_inputs[j].data,
+                              huff_inputs[j].len, 1);
+      nghttp2_bench_use((uint64_t)rv + huff_outbuf[0]);
+    }
+  }
+
+  nghttp2_bench_set_bytes(b, huff_inputs_len);
+}
+
+#define PROXY_NVLISTS 256
+
+/* Header lists mimicking responses and requests which a reverse proxy
+   relays: a handful of hosts, user agents and cookies are shared by
+   many streams, while paths vary, and some headers carry a unique
+   value per request. */
+static nghttp2_nv proxy_nvlists[PROXY_NVLISTS][16];
+static size_t proxy_nvlens[PROXY_NVLISTS];
+static char proxy_strs[PROXY_NVLISTS][6][128];
+
+static void proxy_nvlists_init(void) {
+  static const char *hosts[] = {"www.example.com", "static.example.com",
+                                "api.example.com", "img.example.org"};
+  static const char *ctypes[] = {"text/html; charset=utf-8",
+                                 "application/javascript", "image/png",
+                                 "text/css", "application/json"};
+  size_t i;
+  uint32_t x = 2463534242u;
+  static int initialized;
+
+  if (initialized) {
+    return;
+  }
+  initialized = 1;
+
+  for (i = 0; i < PROXY_NVLISTS; ++i) {
+    nghttp2_nv *nva = proxy_nvlists[i];
+    size_t n = 0;
+
+    /* xorshift32, so that the result is reproducible */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    snprintf(proxy_strs[i][0], sizeof(proxy_strs[i][0]),
+             "/assets/%u/app-%u.js?v=%u", x % 16, x % 97, x % 7);
+    snprintf(proxy_strs[i][1], sizeof(proxy_strs[i][1]),
+             "_ga=GA1.2.%u.1486718216; session=%08x%08x", x % 8, x % 8,
+             (x % 8) * 2654435761u);
+    snprintf(proxy_strs[i][2], sizeof(proxy_strs[i][2]), "%08x-%04x-%04x",
+             x, (unsigned)i, x >> 16);
+    snprintf(proxy_strs[i][3], sizeof(proxy_strs[i][3]), "10.0.%u.%u",
+             x % 4, x % 251);
+    snprintf(proxy_strs[i][4], sizeof(proxy_strs[i][4]), "%u", x % 65536);
+    snprintf(proxy_strs[i][5], sizeof(proxy_strs[i][5]), "\"%08x\"",
+             x % 512);
+
+#define PROXY_NV(NAME, VALUE)                                                  \
+  do {                                                                         \
+    nva[n].name = (uint8_t *)(NAME);                                           \
+    nva[n].namelen = strlen(NAME);                                             \
+    nva[n].value = (uint8_t *)(VALUE);                                         \
+    nva[n].valuelen = strlen(VALUE);                                           \
+    nva[n].flags = NGHTTP2_NV_FLAG_NONE;                                       \
+    ++n;                                                                       \
+  } while (0)
+
+    if (i % 2 == 0) {
+      PROXY_NV(":method", "GET");
+      PROXY_NV(":scheme", "https");
+      PROXY_NV(":authority", hosts[x % ARRLEN(hosts)]);
+      PROXY_NV(":path", proxy_strs[i][0]);
+      PROXY_NV("user-agent", huff_corpus[x % 2]);
+      PROXY_NV("accept", huff_corpus[3]);
+      PROXY_NV("accept-encoding", huff_corpus[4]);
+      PROXY_NV("accept-language", huff_corpus[5]);
+      PROXY_NV("cookie", proxy_strs[i][1]);
+      PROXY_NV("x-request-id", proxy_strs[i][2]);
+      PROXY_NV("x-forwarded-for", proxy_strs[i][3]);
+      PROXY_NV("via", "2 nghttpx");
+    } else {
+      PROXY_NV(":status", "200");
+      PROXY_NV("server", "nghttpx");
+      PROXY_NV("date", "Thu, 16 Feb 2017 04:23:17 GMT");
+      PROXY_NV("content-type", ctypes[x % ARRLEN(ctypes)]);
+      PROXY_NV("content-length", proxy_strs[i][4]);
+      PROXY_NV("cache-control", "public, max-age=31536000");
+      PROXY_NV("etag", proxy_strs[i][5]);
+      PROXY_NV("x-request-id", proxy_strs[i][2]);
+      PROXY_NV("strict-transport-security", "max-age=31536000");
+      PROXY_NV("via", "2 nghttpx");
+    }
+
+#undef PROXY_NV
+
+    proxy_nvlens[i] = n;
+  }
+}
+
+static void bench_hd_deflate_proxy(nghttp2_bench *b, size_t table_size) {
+  size_t i, j;
+  nghttp2_hd_deflater deflater;
+  nghttp2_bufs bufs;
+  int rv;
+  size_t nbytes = 0;
+
+  proxy_nvlists_init();
+
+  mem = nghttp2_mem_default();
+
+  rv = nghttp2_bufs_init(&bufs, 16384, 1, mem);
+  assert(0 == rv);
+
+  rv = nghttp2_hd_deflate_init2(&deflater, table_size, mem);
+  assert(0 == rv);
+
+  rv = nghttp2_hd_deflate_change_table_size(&deflater, table_size);
+  assert(0 == rv);
+
+  for (j = 0; j < PROXY_NVLISTS; ++j) {
+    for (i = 0; i < proxy_nvlens[j]; ++i) {
+      nbytes += proxy_nvlists[j][i].namelen + proxy_nvlists[j][i].valuelen;
+    }
+  }
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    for (j = 0; j < PROXY_NVLISTS; ++j) {
+      nghttp2_bufs_reset(&bufs);
+      rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, proxy_nvlists[j],
+                                      proxy_nvlens[j]);
+      nghttp2_bench_use((uint64_t)rv + nghttp2_bufs_len(&bufs));
+    }
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_set_bytes(b, nbytes);
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_bufs_free(&bufs);
+}
+
+void bench_nghttp2_hd_deflate_4k(nghttp2_bench *b) {
+  bench_hd_deflate_proxy(b, 4096);
+}
+
+void bench_nghttp2_hd_deflate_64k(nghttp2_bench *b) {
+  bench_hd_deflate_proxy(b, 65536);
+}
+
+static void bench_hd_deflate_response(nghttp2_bench *b, int memoize) {
+  size_t i;
+  nghttp2_hd_deflater deflater;
+  nghttp2_bufs bufs;
+  int rv;
+  size_t nbytes = 0;
+  nghttp2_nv nva[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttpx"),
+      MAKE_NV("date", "Thu, 16 Feb 2017 04:23:17 GMT"),
+      MAKE_NV("content-type", "text/html; charset=utf-8"),
+      MAKE_NV("cache-control", "public, max-age=31536000"),
+      MAKE_NV("strict-transport-security", "max-age=31536000"),
+      MAKE_NV("via", "2 nghttpx"),
+  };
+
+  mem = nghttp2_mem_default();
+
+  rv = nghttp2_bufs_init(&bufs, 16384, 1, mem);
+  assert(0 == rv);
+
+  rv = nghttp2_hd_deflate_init(&deflater, mem);
+  assert(0 == rv);
+
+  rv = nghttp2_hd_deflate_set_memoize(&deflater, memoize);
+  assert(0 == rv);
+
+  for (i = 0; i < ARRLEN(nva); ++i) {
+    nbytes += nva[i].namelen + nva[i].valuelen;
+  }
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    nghttp2_bufs_reset(&bufs);
+    rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva, ARRLEN(nva));
+    nghttp2_bench_use((uint64_t)rv + nghttp2_bufs_len(&bufs));
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_set_bytes(b, nbytes);
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_bufs_free(&bufs);
+}
+
+void bench_nghttp2_hd_deflate_response(nghttp2_bench *b) {
+  bench_hd_deflate_response(b, 0);
+}
+
+void bench_nghttp2_hd_deflate_response_memoize(nghttp2_bench *b) {
+  bench_hd_deflate_response(b, 1);
+}
+
+/* Each iteration decodes the header blocks which
+   bench_hd_deflate_proxy() would produce, from the first one.  Since
+   the blocks refer to the dynamic table built by the preceding ones,
+   a fresh inflater is used per iteration. */
+static void bench_hd_inflate_proxy(nghttp2_bench *b, size_t table_size) {
+  size_t i, j;
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_bufs bufs;
+  nghttp2_nv nv;
+  uint8_t *blocks[PROXY_NVLISTS];
+  size_t blocklens[PROXY_NVLISTS];
+  size_t nbytes = 0;
+  uint64_t sum = 0;
+  int rv;
+
+  proxy_nvlists_init();
+
+  mem = nghttp2_mem_default();
+
+  rv = nghttp2_bufs_init(&bufs, 16384, 1, mem);
+  assert(0 == rv);
+
+  rv = nghttp2_hd_deflate_init2(&deflater, table_size, mem);
+  assert(0 == rv);
+
+  rv = nghttp2_hd_deflate_change_table_size(&deflater, table_size);
+  assert(0 == rv);
+
+  for (j = 0; j < PROXY_NVLISTS; ++j) {
+    nghttp2_bufs_reset(&bufs);
+    rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, proxy_nvlists[j],
+                                    proxy_nvlens[j]);
+    assert(0 == rv);
+
+    blocklens[j] = nghttp2_bufs_len(&bufs);
+    blocks[j] = nghttp2_mem_malloc(mem, blocklens[j]);
+    assert(blocks[j]);
+    nghttp2_bufs_remove_copy(&bufs, blocks[j]);
+
+    for (i = 0; i < proxy_nvlens[j]; ++i) {
+      nbytes += proxy_nvlists[j][i].namelen + proxy_nvlists[j][i].valuelen;
+    }
+  }
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_bufs_free(&bufs);
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    rv = nghttp2_hd_inflate_init(&inflater, mem);
+    assert(0 == rv);
+
+    rv = nghttp2_hd_inflate_change_table_size(&inflater, table_size);
+    assert(0 == rv);
+
+    for (j = 0; j < PROXY_NVLISTS; ++j) {
+      const uint8_t *in = blocks[j];
+      size_t inlen = blocklens[j];
+
+      for (;;) {
+        int inflate_flags = 0;
+        ssize_t nread;
+
+        nread = nghttp2_hd_inflate_hd2(&inflater, &nv, &inflate_flags, in,
+                                       inlen, 1);
+        assert(nread >= 0);
+
+        in += nread;
+        inlen -= (size_t)nread;
+
+        if (inflate_flags & NGHTTP2_HD_INFLATE_EMIT) {
+          sum += nv.valuelen;
+        }
+
+        if (inflate_flags & NGHTTP2_HD_INFLATE_FINAL) {
+          nghttp2_hd_inflate_end_headers(&inflater);
+          break;
+        }
+      }
+    }
+
+    nghttp2_hd_inflate_free(&inflater);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use(sum);
+  nghttp2_bench_set_bytes(b, nbytes);
+
+  for (j = 0; j < PROXY_NVLISTS; ++j) {
+    nghttp2_mem_free(mem, blocks[j]);
+  }
+}
+
+void bench_nghttp2_hd_inflate_4k(nghttp2_bench *b) {
+  bench_hd_inflate_proxy(b, 4096);
+}
+
+void bench_nghttp2_hd_inflate_64k(nghttp2_bench *b) {
+  bench_hd_inflate_proxy(b, 65536);
+}
@@ -0,0 +1,44 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_HD_BENCH_H
+#define NGHTTP2_HD_BENCH_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "nghttp2_bench_helper.h"
+
+void bench_nghttp2_hd_huff_encode(nghttp2_bench *b);
+void bench_nghttp2_hd_huff_decode(nghttp2_bench *b);
+void bench_nghttp2_hd_huff_decode_nibble(nghttp2_bench *b);
+void bench_nghttp2_hd_deflate_4k(nghttp2_bench *b);
+void bench_nghttp2_hd_deflate_64k(nghttp2_bench *b);
+void bench_nghttp2_hd_deflate_response(nghttp2_bench *b);
+void bench_nghttp2_hd_deflate_response_memoize(nghttp2_bench *b);
+void bench_nghttp2_hd_inflate_4k(nghttp2_bench *b);
+void bench_nghttp2_hd_inflate_64k(nghttp2_bench *b);
+
+#endif /* NGHTTP2_HD_BENCH_H */
@@ -188,6 +188,388 @@ void test_nghttp2_hd_deflate_same_indexed_repr(void) {
   nghttp2_hd_deflate_free(&deflater);
 }
 
+void test_nghttp2_hd_deflate_large_table(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_nv nva[100];
+  char names[3000][16];
+  char values[3000][16];
+  nghttp2_bufs bufs;
+  ssize_t blocklen;
+  nva_out out;
+  int rv;
+  size_t i, j;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  nva_out_init(&out);
+  CU_ASSERT(0 == nghttp2_hd_deflate_init2(&deflater, 65536, mem));
+  CU_ASSERT(0 == nghttp2_hd_deflate_change_table_size(&deflater, 65536));
+  CU_ASSERT(0 == nghttp2_hd_inflate_init(&inflater, mem));
+  CU_ASSERT(0 == nghttp2_hd_inflate_change_table_size(&inflater, 65536));
+
+  for (i = 0; i < 3000; ++i) {
+    snprintf(names[i], sizeof(names[i]), "x-h%zu", i % 1000);
+    snprintf(values[i], sizeof(values[i]), "v%zu", i);
+  }
+
+  /* Add 3000 entries, so that the oldest ones are evicted, and the
+     index has to grow several times. */
+  for (i = 0; i < 3000; i += ARRLEN(nva)) {
+    for (j = 0; j < ARRLEN(nva); ++j) {
+      nva[j].name = (uint8_t *)names[i + j];
+      nva[j].namelen = strlen(names[i + j]);
+      nva[j].value = (uint8_t *)values[i + j];
+      nva[j].valuelen = strlen(values[i + j]);
+      nva[j].flags = NGHTTP2_NV_FLAG_NONE;
+    }
+
+    rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva, ARRLEN(nva));
+    blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+    CU_ASSERT(ARRLEN(nva) == out.nvlen);
+    assert_nv_equal(nva, out.nva, ARRLEN(nva), mem);
+
+    nva_out_reset(&out, mem);
+    nghttp2_bufs_reset(&bufs);
+  }
+
+  CU_ASSERT(deflater.ctx.hd_table.len < 3000);
+  CU_ASSERT(deflater.ctx.hd_table.len > ARRLEN(nva));
+
+  /* The most recent entries are still in the table, and each of them
+     is encoded as indexed representation. */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva, ARRLEN(nva));
+  blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(blocklen <= (ssize_t)ARRLEN(nva) * 2);
+  CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+  assert_nv_equal(nva, out.nva, ARRLEN(nva), mem);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* The oldest entry has been evicted, but its name is shared with a
+     newer entry. */
+  nva[0].name = (uint8_t *)names[0];
+  nva[0].namelen = strlen(names[0]);
+  nva[0].value = (uint8_t *)values[0];
+  nva[0].valuelen = strlen(values[0]);
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva, 1);
+  blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+  CU_ASSERT(0 == rv);
+  /* Literal with indexed name */
+  CU_ASSERT(0x40 == (bufs.head->buf.pos[0] & 0xc0));
+  CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+  assert_nv_equal(nva, out.nva, 1, mem);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Cleanup */
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_inflate_free(&inflater);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
+void test_nghttp2_hd_deflate_arena(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_nv nva[3];
+  char names[3][16];
+  uint8_t values[3][300];
+  nghttp2_bufs bufs;
+  ssize_t blocklen;
+  nva_out out;
+  int rv;
+  size_t i, j, k;
+  nghttp2_hd_entry *ent;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  nva_out_init(&out);
+  nghttp2_hd_deflate_init(&deflater, mem);
+  nghttp2_hd_inflate_init(&inflater, mem);
+
+  /* Entries of various sizes make the arena wrap around at various
+     positions. */
+  for (i = 0; i < 1000; ++i) {
+    for (j = 0; j < ARRLEN(nva); ++j) {
+      k = i * ARRLEN(nva) + j;
+
+      snprintf(names[j], sizeof(names[j]), "x-h%zu", k % 53);
+      memset(values[j], 'a' + (int)(k % 26), sizeof(values[j]));
+
+      nva[j].name = (uint8_t *)names[j];
+      nva[j].namelen = strlen(names[j]);
+      nva[j].value = values[j];
+      nva[j].valuelen = (k * 37) % sizeof(values[j]);
+      nva[j].flags = NGHTTP2_NV_FLAG_NONE;
+    }
+
+    rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva, ARRLEN(nva));
+    blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+    CU_ASSERT(ARRLEN(nva) == out.nvlen);
+    assert_nv_equal(nva, out.nva, ARRLEN(nva), mem);
+
+    nva_out_reset(&out, mem);
+    nghttp2_bufs_reset(&bufs);
+  }
+
+  CU_ASSERT(deflater.ctx.hd_table.len > 0);
+
+  /* All entries of deflater are stored in its arena */
+  for (i = 0; i < deflater.ctx.hd_table.len; ++i) {
+    ent = deflater.ctx.hd_table.buffer[(deflater.ctx.hd_table.first + i) &
+                                       deflater.ctx.hd_table.mask];
+
+    CU_ASSERT(NULL == ent->nv.name);
+    CU_ASSERT((uint8_t *)ent >= deflater.ctx.arena);
+    CU_ASSERT(ent->cnv.value + ent->cnv.valuelen <
+              deflater.ctx.arena + deflater.ctx.arenalen);
+    CU_ASSERT('\0' == ent->cnv.name[ent->cnv.namelen]);
+    CU_ASSERT('\0' == ent->cnv.value[ent->cnv.valuelen]);
+  }
+
+  /* The arena does not grow without bound */
+  CU_ASSERT(deflater.ctx.arenalen <= 4 * NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE);
+  CU_ASSERT(inflater.ctx.arenalen <= 4 * NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE);
+
+  /* Clearing table releases the arena */
+  CU_ASSERT(0 == nghttp2_hd_deflate_change_table_size(&deflater, 0));
+  CU_ASSERT(0 == deflater.ctx.hd_table.len);
+  CU_ASSERT(NULL == deflater.ctx.arena);
+
+  /* Cleanup */
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_inflate_free(&inflater);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
+void test_nghttp2_hd_deflate_adaptive_indexing(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_nv nva1[] = {MAKE_NV("content-type", "text/html"),
+                       MAKE_NV("x-request-id", "1")};
+  nghttp2_nv nva2[] = {MAKE_NV("content-type", "text/html"),
+                       MAKE_NV("x-request-id", "2")};
+  nghttp2_bufs bufs;
+  nva_out out;
+  ssize_t blocklen;
+  int rv;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+  nva_out_init(&out);
+
+  nghttp2_hd_deflate_init(&deflater, mem);
+  nghttp2_hd_inflate_init(&inflater, mem);
+
+  CU_ASSERT(0 == nghttp2_hd_deflate_set_adaptive_indexing(&deflater, 1));
+
+  /* Nothing is indexed on first sight */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva1, ARRLEN(nva1));
+  blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == deflater.ctx.hd_table.len);
+  CU_ASSERT(12 + 9 + 12 + 1 ==
+            nghttp2_hd_deflate_get_uncompressed_length(&deflater));
+  CU_ASSERT((uint64_t)blocklen ==
+            nghttp2_hd_deflate_get_compressed_length(&deflater));
+  CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  assert_nv_equal(nva1, out.nva, out.nvlen, mem);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* content-type is indexed on second sight, but the new request ID
+     is not */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva2, ARRLEN(nva2));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == deflater.ctx.hd_table.len);
+  CU_ASSERT(0 == memcmp("content-type",
+                        nghttp2_hd_deflate_get_table_entry(&deflater, 62)->name,
+                        12));
+
+  blocklen += (ssize_t)nghttp2_bufs_len(&bufs);
+
+  CU_ASSERT((uint64_t)blocklen ==
+            nghttp2_hd_deflate_get_compressed_length(&deflater));
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) ==
+            inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  assert_nv_equal(nva2, out.nva, out.nvlen, mem);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Now content-type is encoded as indexed representation */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva2, 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == nghttp2_bufs_len(&bufs));
+  CU_ASSERT(0xbe == bufs.head->buf.pos[0]);
+
+  nghttp2_bufs_reset(&bufs);
+
+  /* Without adaptive indexing, new header field is indexed right
+     away */
+  CU_ASSERT(0 == nghttp2_hd_deflate_set_adaptive_indexing(&deflater, 0));
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva1 + 1, 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == deflater.ctx.hd_table.len);
+
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_inflate_free(&inflater);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
+void test_nghttp2_hd_deflate_memoize(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_nv nva1[] = {MAKE_NV(":status", "200"),
+                       MAKE_NV("content-type", "text/html"),
+                       MAKE_NV("server", "nghttpd")};
+  nghttp2_nv nva2[] = {MAKE_NV(":status", "200"),
+                       MAKE_NV("content-type", "text/html"),
+                       MAKE_NV("server", "nghttpd")};
+  nghttp2_nv nva3[1];
+  nghttp2_bufs bufs;
+  nva_out out;
+  uint8_t block[256];
+  size_t blocklen;
+  int rv;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+  nva_out_init(&out);
+
+  nghttp2_hd_deflate_init(&deflater, mem);
+  nghttp2_hd_inflate_init(&inflater, mem);
+
+  CU_ASSERT(0 == nghttp2_hd_deflate_set_memoize(&deflater, 1));
+
+  /* The first header block modifies the dynamic table, and is not
+     memoized. */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva1, ARRLEN(nva1));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == deflater.ctx.hd_table.len);
+  CU_ASSERT(NULL == deflater.memo[0].nva);
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) ==
+            inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* The second one only consists of indexed representations */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva1, ARRLEN(nva1));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != deflater.memo[0].nva);
+  CU_ASSERT(3 == deflater.memo[0].nvlen);
+  CU_ASSERT(3 == deflater.memo[0].outlen);
+
+  blocklen = nghttp2_bufs_len(&bufs);
+  memcpy(block, bufs.head->buf.pos, blocklen);
+
+  CU_ASSERT((ssize_t)blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Identical header list in a different buffer is emitted from
+     memo */
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva2, ARRLEN(nva2));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(blocklen == nghttp2_bufs_len(&bufs));
+  CU_ASSERT(0 == memcmp(block, bufs.head->buf.pos, blocklen));
+  CU_ASSERT(NULL == deflater.memo[1].nva);
+  CU_ASSERT((ssize_t)blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  assert_nv_equal(nva2, out.nva, out.nvlen, mem);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* NGHTTP2_NV_FLAG_NO_INDEX makes a difference */
+  nva2[2].flags = NGHTTP2_NV_FLAG_NO_INDEX;
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva2, ARRLEN(nva2));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(blocklen < nghttp2_bufs_len(&bufs));
+  CU_ASSERT(NULL != deflater.memo[1].nva);
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) ==
+            inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Changing table size evicts entries, and clears memo */
+  nghttp2_hd_deflate_change_table_size(&deflater, 0);
+
+  CU_ASSERT(NULL == deflater.memo[0].nva);
+  CU_ASSERT(NULL == deflater.memo[1].nva);
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva1, ARRLEN(nva1));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) ==
+            inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+  assert_nv_equal(nva1, out.nva, out.nvlen, mem);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Empty value may be given as NULL */
+  nva3[0].name = (uint8_t *)"x-empty";
+  nva3[0].namelen = strlen("x-empty");
+  nva3[0].value = NULL;
+  nva3[0].valuelen = 0;
+  nva3[0].flags = NGHTTP2_NV_FLAG_NONE;
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva3, ARRLEN(nva3));
+
+  CU_ASSERT(0 == rv);
+
+  blocklen = nghttp2_bufs_len(&bufs);
+  nghttp2_bufs_reset(&bufs);
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva3, ARRLEN(nva3));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(blocklen == nghttp2_bufs_len(&bufs));
+  CU_ASSERT((ssize_t)blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+  CU_ASSERT(1 == out.nvlen);
+  CU_ASSERT(0 == out.nva[0].valuelen);
+
+  nva_out_reset(&out, mem);
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_inflate_free(&inflater);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
 void test_nghttp2_hd_inflate_indexed(void) {
   nghttp2_hd_inflater inflater;
   nghttp2_bufs bufs;
@@ -434,6 +816,208 @@ void test_nghttp2_hd_inflate_newname_inc(void) {
   nghttp2_hd_inflate_free(&inflater);
 }
 
+void test_nghttp2_hd_inflate_no_copy(void) {
+  nghttp2_hd_inflater inflater;
+  nghttp2_hd_nv nv;
+  int inflate_flags;
+  ssize_t rv;
+  nghttp2_mem *mem;
+  /* literal without indexing (new name), literal without indexing
+     (indexed name :path), empty value, literal with incremental
+     indexing, and huffman encoded name "a" */
+  uint8_t in[] = {0x00, 0x03, 'a',  'b',  'c',  0x03, 'x',  'y', 'z',
+                  0x04, 0x01, '/',  0x00, 0x01, 'e',  0x00, 0x40, 0x01,
+                  'k',  0x01, 'v',  0x00, 0x81, 0x1f, 0x01, 'q'};
+  uint8_t split[] = {0x00, 0x03, 'a', 'b', 'c', 0x03, 'x', 'y', 'z'};
+  const uint8_t *p, *end;
+
+  mem = nghttp2_mem_default();
+  nghttp2_hd_inflate_init(&inflater, mem);
+  nghttp2_hd_inflate_set_no_copy(&inflater, 1);
+
+  p = in;
+  end = in + sizeof(in);
+
+  /* Both name and value refer to input */
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, p,
+                                (size_t)(end - p), 1);
+
+  CU_ASSERT(9 == rv);
+  CU_ASSERT(inflate_flags & NGHTTP2_HD_INFLATE_EMIT);
+  CU_ASSERT(in + 2 == nv.name->base);
+  CU_ASSERT(3 == nv.name->len);
+  CU_ASSERT(in + 6 == nv.value->base);
+  CU_ASSERT(3 == nv.value->len);
+  CU_ASSERT(NGHTTP2_NV_FLAG_NONE == nv.flags);
+
+  p += rv;
+
+  /* Name is taken from the static table, and value refers to input */
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, p,
+                                (size_t)(end - p), 1);
+
+  CU_ASSERT(3 == rv);
+  CU_ASSERT(NGHTTP2_TOKEN__PATH == nv.token);
+  CU_ASSERT(in + 11 == nv.value->base);
+  CU_ASSERT(1 == nv.value->len);
+
+  p += rv;
+
+  /* Empty value still has readable base */
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, p,
+                                (size_t)(end - p), 1);
+
+  CU_ASSERT(4 == rv);
+  CU_ASSERT(in + 14 == nv.name->base);
+  CU_ASSERT(0 == nv.value->len);
+  CU_ASSERT('\0' == nv.value->base[0]);
+
+  p += rv;
+
+  /* Header field to be indexed is always copied */
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, p,
+                                (size_t)(end - p), 1);
+
+  CU_ASSERT(5 == rv);
+  CU_ASSERT(in + 18 != nv.name->base);
+  CU_ASSERT('k' == nv.name->base[0]);
+  CU_ASSERT('\0' == nv.name->base[1]);
+  CU_ASSERT(in + 20 != nv.value->base);
+  CU_ASSERT(1 == inflater.ctx.hd_table.len);
+
+  p += rv;
+
+  /* Huffman encoded name is copied, but raw value is not */
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, p,
+                                (size_t)(end - p), 1);
+
+  CU_ASSERT(5 == rv);
+  CU_ASSERT(1 == nv.name->len);
+  CU_ASSERT('a' == nv.name->base[0]);
+  CU_ASSERT(in + 25 == nv.value->base);
+
+  p += rv;
+
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, p,
+                                (size_t)(end - p), 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(inflate_flags & NGHTTP2_HD_INFLATE_FINAL);
+
+  nghttp2_hd_inflate_end_headers(&inflater);
+
+  /* Name is copied if the header field does not complete in the
+     current input */
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, split, 6, 0);
+
+  CU_ASSERT(6 == rv);
+  CU_ASSERT(0 == (inflate_flags & NGHTTP2_HD_INFLATE_EMIT));
+
+  memset(split, 0, 6);
+
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &nv, &inflate_flags, split + 6, 3,
+                                1);
+
+  CU_ASSERT(3 == rv);
+  CU_ASSERT(inflate_flags & NGHTTP2_HD_INFLATE_EMIT);
+  CU_ASSERT(3 == nv.name->len);
+  CU_ASSERT(0 == memcmp("abc", nv.name->base, 3));
+  CU_ASSERT(3 == nv.value->len);
+  CU_ASSERT(0 == memcmp("xyz", nv.value->base, 3));
+
+  nghttp2_hd_inflate_free(&inflater);
+}
+
+void test_nghttp2_hd_inflate_hd_block(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_nv nva1[] = {MAKE_NV(":path", "/"), MAKE_NV(":scheme", "https"),
+                       MAKE_NV("hello", "world"), MAKE_NV("x-empty", "")};
+  nghttp2_nv nva2[] = {MAKE_NV("hello", "world"), MAKE_NV("via", "proxy")};
+  nghttp2_nv nva3[] = {MAKE_NV("x-literal", "value")};
+  nghttp2_nv nva[8];
+  uint8_t buf[256];
+  size_t nvlen, buflen;
+  nghttp2_bufs bufs;
+  nghttp2_buf *in;
+  int rv;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  nghttp2_hd_deflate_init(&deflater, mem);
+  nghttp2_hd_inflate_init(&inflater, mem);
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva1, ARRLEN(nva1));
+
+  CU_ASSERT(0 == rv);
+
+  in = &bufs.head->buf;
+  nvlen = ARRLEN(nva);
+  buflen = sizeof(buf);
+
+  rv = nghttp2_hd_inflate_hd_block(&inflater, nva, &nvlen, buf, &buflen,
+                                   in->pos, nghttp2_buf_len(in));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == nvlen);
+  CU_ASSERT(5 + 1 + 7 + 5 + 5 + 5 + 7 + 0 + 4 * 2 == buflen);
+  assert_nv_equal(nva1, nva, 4, mem);
+  CU_ASSERT(nva[0].name == buf);
+  CU_ASSERT('\0' == nva[3].value[0]);
+
+  /* Both arrays are too small.  The required sizes are reported, and
+     the dynamic table is still updated. */
+  nghttp2_bufs_reset(&bufs);
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva2, ARRLEN(nva2));
+
+  CU_ASSERT(0 == rv);
+
+  nvlen = 1;
+  buflen = 4;
+
+  rv = nghttp2_hd_inflate_hd_block(&inflater, nva, &nvlen, buf, &buflen,
+                                   in->pos, nghttp2_buf_len(in));
+
+  CU_ASSERT(NGHTTP2_ERR_BUFFER_ERROR == rv);
+  CU_ASSERT(2 == nvlen);
+  CU_ASSERT(5 + 5 + 3 + 5 + 2 * 2 == buflen);
+
+  nghttp2_bufs_reset(&bufs);
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva2, ARRLEN(nva2));
+
+  CU_ASSERT(0 == rv);
+
+  nvlen = ARRLEN(nva);
+  buflen = sizeof(buf);
+
+  rv = nghttp2_hd_inflate_hd_block(&inflater, nva, &nvlen, buf, &buflen,
+                                   in->pos, nghttp2_buf_len(in));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == nvlen);
+  assert_nv_equal(nva2, nva, 2, mem);
+
+  /* Header block truncated in the middle of a literal */
+  nghttp2_bufs_reset(&bufs);
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, nva3, ARRLEN(nva3));
+
+  CU_ASSERT(0 == rv);
+
+  nvlen = ARRLEN(nva);
+  buflen = sizeof(buf);
+
+  rv = nghttp2_hd_inflate_hd_block(&inflater, nva, &nvlen, buf, &buflen,
+                                   in->pos, nghttp2_buf_len(in) - 1);
+
+  CU_ASSERT(NGHTTP2_ERR_HEADER_COMP == rv);
+
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_inflate_free(&inflater);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
 void test_nghttp2_hd_inflate_clearall_inc(void) {
   nghttp2_hd_inflater inflater;
   nghttp2_bufs bufs;
@@ -1515,7 +2099,12 @@ void test_nghttp2_hd_huff_encode(void) {
   nghttp2_hd_huff_decode_context ctx;
   const uint8_t t1[] = {22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11,
                         10, 9,  8,  7,  6,  5,  4,  3,  2,  1,  0};
-  uint8_t b[256];
+  uint8_t t2[256];
+  uint8_t b[1024];
+  uint8_t c[1024];
+  size_t i;
+  ssize_t enclen;
+  nghttp2_mem *mem = nghttp2_mem_default();
 
   nghttp2_buf_wrap_init(&outbuf, b, sizeof(b));
   frame_pack_bufs_init(&bufs);
@@ -1535,4 +2124,133 @@ void test_nghttp2_hd_huff_encode(void) {
   CU_ASSERT(0 == memcmp(t1, outbuf.pos, sizeof(t1)));
 
   nghttp2_bufs_free(&bufs);
+
+  /* Encode with small buffers so that output spans several chunks */
+  for (i = 0; i < sizeof(t2); ++i) {
+    t2[i] = (uint8_t)i;
+  }
+
+  nghttp2_bufs_init(&bufs, 3, 1024, mem);
+
+  rv = nghttp2_hd_huff_encode(&bufs, t2, sizeof(t2));
+
+  CU_ASSERT(rv == 0);
+  CU_ASSERT(nghttp2_hd_huff_encode_count(t2, sizeof(t2)) ==
+            nghttp2_bufs_len(&bufs));
+
+  enclen = nghttp2_hd_huff_encode_buf(b, sizeof(b), t2, sizeof(t2));
+
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) == enclen);
+
+  len = (ssize_t)nghttp2_bufs_remove_copy(&bufs, c);
+
+  CU_ASSERT(enclen == len);
+  CU_ASSERT(0 == memcmp(b, c, (size_t)len));
+
+  /* Output which does not fit in the given buffer */
+  CU_ASSERT(NGHTTP2_ERR_BUFFER_ERROR ==
+            nghttp2_hd_huff_encode_buf(b, (size_t)enclen - 1, t2, sizeof(t2)));
+
+  /* Huffman encoding of these bytes is longer than the input */
+  CU_ASSERT(NGHTTP2_ERR_BUFFER_ERROR ==
+            nghttp2_hd_huff_encode_buf(b, sizeof(t1) - 1, t1, sizeof(t1)));
+
+  nghttp2_bufs_free(&bufs);
+}
+
+void test_nghttp2_hd_huff_decode(void) {
+  size_t i, j;
+  ssize_t len;
+  nghttp2_buf outbuf;
+  nghttp2_bufs bufs;
+  nghttp2_hd_huff_decode_context ctx;
+  uint8_t src[256];
+  uint8_t b[512];
+  const uint8_t eos[] = {0xff, 0xff, 0xff, 0xff};
+  const uint8_t longpad[] = {0x1f, 0xff};
+
+  /* Each entry of huff_byte_decode_table must be equivalent to 2
+     consecutive transitions of huff_decode_table. */
+  for (i = 0; i < 256; ++i) {
+    for (j = 0; j < 256; ++j) {
+      const nghttp2_huff_byte_decode *t = &huff_byte_decode_table[i][j];
+      const nghttp2_huff_decode *hi = &huff_decode_table[i][j >> 4];
+      const nghttp2_huff_decode *lo;
+      uint8_t syms[2];
+      size_t nsym = 0;
+
+      if (hi->flags & NGHTTP2_HUFF_FAIL) {
+        CU_ASSERT(t->flags & NGHTTP2_HUFF_FAIL);
+        continue;
+      }
+      if (hi->flags & NGHTTP2_HUFF_SYM) {
+        syms[nsym++] = hi->sym;
+      }
+
+      lo = &huff_decode_table[hi->state][j & 0xf];
+      if (lo->flags & NGHTTP2_HUFF_FAIL) {
+        CU_ASSERT(t->flags & NGHTTP2_HUFF_FAIL);
+        continue;
+      }
+      if (lo->flags & NGHTTP2_HUFF_SYM) {
+        syms[nsym++] = lo->sym;
+      }
+
+      CU_ASSERT(0 == (t->flags & NGHTTP2_HUFF_FAIL));
+      CU_ASSERT(lo->state == t->state);
+      CU_ASSERT((lo->flags & NGHTTP2_HUFF_ACCEPTED) ==
+                (t->flags & NGHTTP2_HUFF_ACCEPTED));
+      CU_ASSERT((nsym >= 1) == ((t->flags & NGHTTP2_HUFF_SYM) != 0));
+      CU_ASSERT((nsym == 2) == ((t->flags & NGHTTP2_HUFF_SYM2) != 0));
+      if (nsym >= 1) {
+        CU_ASSERT(syms[0] == t->sym[0]);
+      }
+      if (nsym == 2) {
+        CU_ASSERT(syms[1] == t->sym[1]);
+      }
+    }
+  }
+
+  /* Decoding byte by byte must yield the same result as decoding the
+     whole input at once. */
+  for (i = 0; i < sizeof(src); ++i) {
+    src[i] = (uint8_t)(255 - i);
+  }
+
+  frame_pack_bufs_init(&bufs);
+
+  CU_ASSERT(0 == nghttp2_hd_huff_encode(&bufs, src, sizeof(src)));
+
+  nghttp2_buf_wrap_init(&outbuf, b, sizeof(b));
+  nghttp2_hd_huff_decode_context_init(&ctx);
+
+  for (i = 0; i < nghttp2_bufs_len(&bufs); ++i) {
+    len = nghttp2_hd_huff_decode(&ctx, &outbuf, bufs.cur->buf.pos + i, 1,
+                                 i + 1 == nghttp2_bufs_len(&bufs));
+
+    CU_ASSERT(1 == len);
+  }
+
+  CU_ASSERT(sizeof(src) == nghttp2_buf_len(&outbuf));
+  CU_ASSERT(0 == memcmp(src, outbuf.pos, sizeof(src)));
+
+  /* Empty final block after the last byte has been decoded */
+  CU_ASSERT(0 == nghttp2_hd_huff_decode(&ctx, &outbuf, NULL, 0, 1));
+
+  nghttp2_bufs_free(&bufs);
+
+  /* EOS must not appear in the encoded string */
+  nghttp2_buf_wrap_init(&outbuf, b, sizeof(b));
+  nghttp2_hd_huff_decode_context_init(&ctx);
+
+  CU_ASSERT(NGHTTP2_ERR_HEADER_COMP ==
+            nghttp2_hd_huff_decode(&ctx, &outbuf, eos, sizeof(eos), 1));
+
+  /* Padding longer than 7 bits is an error */
+  nghttp2_buf_wrap_init(&outbuf, b, sizeof(b));
+  nghttp2_hd_huff_decode_context_init(&ctx);
+
+  CU_ASSERT(NGHTTP2_ERR_HEADER_COMP ==
+            nghttp2_hd_huff_decode(&ctx, &outbuf, longpad, sizeof(longpad),
+                                   1));
 }
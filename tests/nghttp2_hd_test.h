@@ -31,12 +31,18 @@
 
 void test_nghttp2_hd_deflate(void);
 void test_nghttp2_hd_deflate_same_indexed_repr(void);
+void test_nghttp2_hd_deflate_large_table(void);
+void test_nghttp2_hd_deflate_arena(void);
+void test_nghttp2_hd_deflate_adaptive_indexing(void);
+void test_nghttp2_hd_deflate_memoize(void);
 void test_nghttp2_hd_inflate_indexed(void);
 void test_nghttp2_hd_inflate_indname_noinc(void);
 void test_nghttp2_hd_inflate_indname_inc(void);
 void test_nghttp2_hd_inflate_indname_inc_eviction(void);
 void test_nghttp2_hd_inflate_newname_noinc(void);
 void test_nghttp2_hd_inflate_newname_inc(void);
+void test_nghttp2_hd_inflate_no_copy(void);
+void test_nghttp2_hd_inflate_hd_block(void);
 void test_nghttp2_hd_inflate_clearall_inc(void);
 void test_nghttp2_hd_inflate_zero_length_huffman(void);
 void test_nghttp2_hd_inflate_expect_table_size_update(void);
@@ -50,5 +56,6 @@ void test_nghttp2_hd_public_api(void);
 void test_nghttp2_hd_deflate_hd_vec(void);
 void test_nghttp2_hd_decode_length(void);
 void test_nghttp2_hd_huff_encode(void);
+void test_nghttp2_hd_huff_decode(void);
 
 #endif /* NGHTTP2_HD_TEST_H */
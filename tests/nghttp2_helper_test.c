@@ -152,6 +152,8 @@ void test_nghttp2_check_header_name(void) {
   CU_ASSERT(!check_header_name("path:"));
   CU_ASSERT(!check_header_name(""));
   CU_ASSERT(!check_header_name(":"));
+  CU_ASSERT(check_header_name("x-long-header-field-name-which-spans-blocks"));
+  CU_ASSERT(!check_header_name("x-long-header-field-name-which-spans-BLOCKS"));
 }
 
 #define check_header_value(S)                                                  \
@@ -166,4 +168,36 @@ void test_nghttp2_check_header_value(void) {
   CU_ASSERT(check_header_value(goodval));
   CU_ASSERT(!check_header_value(badval1));
   CU_ASSERT(!check_header_value(badval2));
+
+  /* Long names and values are checked several bytes at a time.  Make
+     sure that each byte is classified in the same way regardless of
+     its position. */
+  {
+    uint8_t buf[67];
+    size_t pos[] = {0, 7, 15, 16, 31, 32, 47, 63, 66};
+    size_t i;
+    int c;
+
+    for (c = 0; c < 256; ++c) {
+      uint8_t b = (uint8_t)c;
+      int valid = nghttp2_check_header_value(&b, 1);
+
+      for (i = 0; i < sizeof(pos) / sizeof(pos[0]); ++i) {
+        memset(buf, 'a', sizeof(buf));
+        buf[pos[i]] = b;
+
+        CU_ASSERT(valid == nghttp2_check_header_value(buf, sizeof(buf)));
+      }
+
+      valid = nghttp2_check_header_name(&b, 1);
+
+      for (i = 0; i < sizeof(pos) / sizeof(pos[0]); ++i) {
+        memset(buf, 'a', sizeof(buf));
+        buf[pos[i]] = b;
+
+        CU_ASSERT((pos[i] == 0 && c == ':') ||
+                  valid == nghttp2_check_header_name(buf, sizeof(buf)));
+      }
+    }
+  }
 }
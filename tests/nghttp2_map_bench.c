@@ -0,0 +1,187 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_map_bench.h"
+
+#include <assert.h>
+
+#include "nghttp2_map.h"
+
+/* Stream IDs opened by client are consecutive odd integers.  The map
+   holds |nstreams| concurrent streams, and the oldest stream is
+   replaced by a new one as the session goes on.  Like nghttp2_stream,
+   each entry is a separately allocated object of a few hundred
+   bytes. */
+
+typedef struct {
+  nghttp2_map_entry map_entry;
+  uint8_t data[320];
+} bench_stream;
+
+static bench_stream **map_bench_streams_new(size_t nstreams,
+                                            nghttp2_mem *mem) {
+  bench_stream **streams;
+  size_t i;
+
+  streams = nghttp2_mem_malloc(mem, sizeof(bench_stream *) * nstreams);
+  assert(streams);
+
+  for (i = 0; i < nstreams; ++i) {
+    streams[i] = nghttp2_mem_malloc(mem, sizeof(bench_stream));
+    assert(streams[i]);
+    nghttp2_map_entry_init(&streams[i]->map_entry, (key_type)(i * 2 + 1));
+  }
+
+  return streams;
+}
+
+static void map_bench_streams_del(bench_stream **streams, size_t nstreams,
+                                  nghttp2_mem *mem) {
+  size_t i;
+
+  for (i = 0; i < nstreams; ++i) {
+    nghttp2_mem_free(mem, streams[i]);
+  }
+
+  nghttp2_mem_free(mem, streams);
+}
+
+static void bench_map_find(nghttp2_bench *b, size_t nstreams) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_map map;
+  bench_stream **streams;
+  key_type *keys;
+  size_t i, j;
+  uint32_t x = 1;
+  uint64_t found = 0;
+  int rv;
+
+  streams = map_bench_streams_new(nstreams, mem);
+
+  rv = nghttp2_map_init(&map, mem);
+  assert(0 == rv);
+
+  for (i = 0; i < nstreams; ++i) {
+    rv = nghttp2_map_insert(&map, &streams[i]->map_entry);
+    assert(0 == rv);
+  }
+
+  /* Frames interleave among streams in no particular order */
+  keys = nghttp2_mem_malloc(mem, sizeof(key_type) * nstreams);
+  assert(keys);
+
+  for (i = 0; i < nstreams; ++i) {
+    keys[i] = streams[i]->map_entry.key;
+  }
+
+  /* Shuffle keys using xorshift32 */
+  for (i = nstreams - 1; i > 0; --i) {
+    key_type t;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    j = x % (i + 1);
+    t = keys[i];
+    keys[i] = keys[j];
+    keys[j] = t;
+  }
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0, j = 0; i < b->n; ++i) {
+    found += ((bench_stream *)nghttp2_map_find(&map, keys[j]))->data[0];
+    if (++j == nstreams) {
+      j = 0;
+    }
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use(found);
+
+  nghttp2_mem_free(mem, keys);
+  nghttp2_map_free(&map);
+  map_bench_streams_del(streams, nstreams, mem);
+}
+
+static void bench_map_churn(nghttp2_bench *b, size_t nstreams) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_map map;
+  bench_stream **streams;
+  nghttp2_map_entry *ent;
+  key_type next_key;
+  size_t i, j;
+  int rv;
+
+  streams = map_bench_streams_new(nstreams, mem);
+
+  rv = nghttp2_map_init(&map, mem);
+  assert(0 == rv);
+
+  for (i = 0; i < nstreams; ++i) {
+    rv = nghttp2_map_insert(&map, &streams[i]->map_entry);
+    assert(0 == rv);
+  }
+
+  next_key = (key_type)(nstreams * 2 + 1);
+
+  nghttp2_bench_reset_timer(b);
+
+  /* Each iteration closes the oldest stream, and opens a new one */
+  for (i = 0, j = 0; i < b->n; ++i) {
+    ent = &streams[j]->map_entry;
+
+    rv = nghttp2_map_remove(&map, ent->key);
+    assert(0 == rv);
+
+    nghttp2_map_entry_init(ent, next_key);
+    next_key += 2;
+
+    rv = nghttp2_map_insert(&map, ent);
+    assert(0 == rv);
+
+    if (++j == nstreams) {
+      j = 0;
+    }
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use(nghttp2_map_size(&map));
+
+  nghttp2_map_free(&map);
+  map_bench_streams_del(streams, nstreams, mem);
+}
+
+void bench_nghttp2_map_find_100(nghttp2_bench *b) { bench_map_find(b, 100); }
+
+void bench_nghttp2_map_find_10k(nghttp2_bench *b) { bench_map_find(b, 10000); }
+
+void bench_nghttp2_map_churn_100(nghttp2_bench *b) { bench_map_churn(b, 100); }
+
+void bench_nghttp2_map_churn_10k(nghttp2_bench *b) {
+  bench_map_churn(b, 10000);
+}
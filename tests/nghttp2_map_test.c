@@ -87,6 +87,110 @@ void test_nghttp2_map(void) {
   CU_ASSERT(strcmp("shrubbery", ((strentry *)nghttp2_map_find(&map, 4))->str) ==
             0);
 
+  /* Replacing non-existent entry */
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_map_replace(&map, &FOO.map_entry));
+  CU_ASSERT(NULL == nghttp2_map_find(&map, 1));
+
+  strentry_init(&baz, 2, "BAR");
+
+  CU_ASSERT(0 == nghttp2_map_replace(&map, &baz.map_entry));
+  CU_ASSERT(2 == nghttp2_map_size(&map));
+  CU_ASSERT(strcmp("BAR", ((strentry *)nghttp2_map_find(&map, 2))->str) == 0);
+
+  nghttp2_map_free(&map);
+}
+
+#define NUM_STEERED 2048
+static strentry steered[NUM_STEERED];
+
+void test_nghttp2_map_collision(void) {
+  nghttp2_map map;
+  strentry ents[32], dup;
+  size_t i, n = 0;
+  uint32_t maxpsl;
+
+  nghttp2_map_init(&map, nghttp2_mem_default());
+
+  /* Both client and server initiated streams, and keys which differ
+     only in the upper bits */
+  for (i = 0; i < 8; ++i) {
+    strentry_init(&ents[n++], (key_type)(i + 1), "foo");
+    strentry_init(&ents[n++], (key_type)(i * 512 + 1001), "bar");
+  }
+
+  for (i = 0; i < n; ++i) {
+    CU_ASSERT(0 == nghttp2_map_insert(&map, &ents[i].map_entry));
+  }
+
+  CU_ASSERT(n == nghttp2_map_size(&map));
+
+  for (i = 0; i < n; ++i) {
+    CU_ASSERT(&ents[i].map_entry ==
+              nghttp2_map_find(&map, ents[i].map_entry.key));
+  }
+
+  /* Duplicated key */
+  strentry_init(&dup, 2537, "baz");
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_map_insert(&map, &dup.map_entry));
+  CU_ASSERT(NULL == nghttp2_map_find(&map, 5097));
+
+  /* Remove every other entry, and the rest must be still found */
+  for (i = 0; i < n; i += 2) {
+    CU_ASSERT(0 == nghttp2_map_remove(&map, ents[i].map_entry.key));
+  }
+
+  CU_ASSERT(n / 2 == nghttp2_map_size(&map));
+
+  for (i = 0; i < n; ++i) {
+    if (i % 2 == 0) {
+      CU_ASSERT(NULL == nghttp2_map_find(&map, ents[i].map_entry.key));
+      CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+                nghttp2_map_remove(&map, ents[i].map_entry.key));
+    } else {
+      CU_ASSERT(&ents[i].map_entry ==
+                nghttp2_map_find(&map, ents[i].map_entry.key));
+    }
+  }
+
+  /* Reinsert removed entries */
+  for (i = 0; i < n; i += 2) {
+    CU_ASSERT(0 == nghttp2_map_insert(&map, &ents[i].map_entry));
+  }
+
+  for (i = 0; i < n; ++i) {
+    CU_ASSERT(&ents[i].map_entry ==
+              nghttp2_map_find(&map, ents[i].map_entry.key));
+  }
+
+  nghttp2_map_free(&map);
+
+  /* Keys which the remote endpoint chooses so that their lower bits
+     are all the same must not pile up in one cluster. */
+  nghttp2_map_init(&map, nghttp2_mem_default());
+
+  for (i = 0; i < NUM_STEERED; ++i) {
+    strentry_init(&steered[i], (key_type)((i << 20) + 1), "foo");
+    CU_ASSERT(0 == nghttp2_map_insert(&map, &steered[i].map_entry));
+  }
+
+  maxpsl = 0;
+
+  for (i = 0; i < map.tablelen; ++i) {
+    if (map.table[i].data && map.table[i].psl > maxpsl) {
+      maxpsl = map.table[i].psl;
+    }
+  }
+
+  CU_ASSERT(maxpsl < 16);
+
+  for (i = 0; i < NUM_STEERED; ++i) {
+    CU_ASSERT(&steered[i].map_entry ==
+              nghttp2_map_find(&map, steered[i].map_entry.key));
+  }
+
   nghttp2_map_free(&map);
 }
 
@@ -30,6 +30,7 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_nghttp2_map(void);
+void test_nghttp2_map_collision(void);
 void test_nghttp2_map_functional(void);
 void test_nghttp2_map_each_free(void);
 
@@ -0,0 +1,168 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_pq_bench.h"
+
+#include <assert.h>
+
+#include "nghttp2_pq.h"
+#include "nghttp2_helper.h"
+
+/* The items are ordered like the streams in nghttp2_stream.obq: by
+   cycle, and then by sequence number to break ties.  The queue holds
+   |nitems| items all the time.  Cycles advance by pseudo random
+   amount, as if DATA of various length was written. */
+
+typedef struct {
+  nghttp2_pq_entry pq_entry;
+  uint64_t cycle;
+  uint64_t seq;
+} bench_item;
+
+static int bench_item_less(const void *lhsx, const void *rhsx) {
+  const bench_item *lhs, *rhs;
+
+  lhs = nghttp2_struct_of(lhsx, bench_item, pq_entry);
+  rhs = nghttp2_struct_of(rhsx, bench_item, pq_entry);
+
+  if (lhs->cycle == rhs->cycle) {
+    return lhs->seq < rhs->seq;
+  }
+
+  return lhs->cycle < rhs->cycle;
+}
+
+static uint32_t xorshift32(uint32_t *x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+
+  return *x;
+}
+
+static bench_item *pq_bench_items_new(nghttp2_pq *pq, size_t nitems,
+                                      uint32_t *x, nghttp2_mem *mem) {
+  bench_item *items;
+  size_t i;
+  int rv;
+
+  items = nghttp2_mem_malloc(mem, sizeof(bench_item) * nitems);
+  assert(items);
+
+  rv = nghttp2_pq_init(pq, bench_item_less, mem);
+  assert(0 == rv);
+
+  for (i = 0; i < nitems; ++i) {
+    items[i].cycle = xorshift32(x) % 16384;
+    items[i].seq = i;
+
+    rv = nghttp2_pq_push(pq, &items[i].pq_entry);
+    assert(0 == rv);
+  }
+
+  return items;
+}
+
+/* Each iteration pops the top item, and pushes it back with larger
+   cycle. */
+static void bench_pq_push_pop(nghttp2_bench *b, size_t nitems) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_pq pq;
+  bench_item *items, *item;
+  size_t i;
+  uint64_t seq = nitems;
+  uint32_t x = 1;
+  int rv;
+
+  items = pq_bench_items_new(&pq, nitems, &x, mem);
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    item = nghttp2_struct_of(nghttp2_pq_top(&pq), bench_item, pq_entry);
+    nghttp2_pq_pop(&pq);
+
+    item->cycle += xorshift32(&x) % 16384 + 1;
+    item->seq = seq++;
+
+    rv = nghttp2_pq_push(&pq, &item->pq_entry);
+    assert(0 == rv);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use(nghttp2_pq_size(&pq));
+
+  nghttp2_pq_free(&pq);
+  nghttp2_mem_free(mem, items);
+}
+
+/* Each iteration removes an arbitrary item, like the stream whose
+   priority is changed, and pushes it back with new cycle. */
+static void bench_pq_remove(nghttp2_bench *b, size_t nitems) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_pq pq;
+  bench_item *items, *item;
+  size_t i;
+  uint64_t seq = nitems;
+  uint32_t x = 1;
+  int rv;
+
+  items = pq_bench_items_new(&pq, nitems, &x, mem);
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    item = &items[xorshift32(&x) % nitems];
+
+    nghttp2_pq_remove(&pq, &item->pq_entry);
+
+    item->cycle += xorshift32(&x) % 16384 + 1;
+    item->seq = seq++;
+
+    rv = nghttp2_pq_push(&pq, &item->pq_entry);
+    assert(0 == rv);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use(nghttp2_pq_size(&pq));
+
+  nghttp2_pq_free(&pq);
+  nghttp2_mem_free(mem, items);
+}
+
+void bench_nghttp2_pq_push_pop_1k(nghttp2_bench *b) {
+  bench_pq_push_pop(b, 1000);
+}
+
+void bench_nghttp2_pq_push_pop_10k(nghttp2_bench *b) {
+  bench_pq_push_pop(b, 10000);
+}
+
+void bench_nghttp2_pq_remove_1k(nghttp2_bench *b) { bench_pq_remove(b, 1000); }
+
+void bench_nghttp2_pq_remove_10k(nghttp2_bench *b) {
+  bench_pq_remove(b, 10000);
+}
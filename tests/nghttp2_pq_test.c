@@ -222,3 +222,56 @@ void test_nghttp2_pq_remove(void) {
 
   nghttp2_pq_free(&pq);
 }
+
+void test_nghttp2_pq_fix(void) {
+  nghttp2_pq pq;
+  node nodes[30];
+  node *nd;
+  size_t i;
+  int last;
+
+  nghttp2_pq_init(&pq, node_less, nghttp2_mem_default());
+
+  push_nodes(&pq, nodes, 30);
+
+  /* Move the top toward the leaves */
+  nodes[0].key = 100;
+  nghttp2_pq_fix(&pq, &nodes[0].ent);
+
+  nd = (node *)nghttp2_pq_top(&pq);
+
+  CU_ASSERT(1 == nd->key);
+
+  /* Move a leaf to the top */
+  nodes[29].key = -1;
+  nghttp2_pq_fix(&pq, &nodes[29].ent);
+
+  nd = (node *)nghttp2_pq_top(&pq);
+
+  CU_ASSERT(-1 == nd->key);
+
+  /* Key is unchanged */
+  nghttp2_pq_fix(&pq, &nodes[7].ent);
+
+  /* Move a middle node in both directions */
+  nodes[5].key = 50;
+  nghttp2_pq_fix(&pq, &nodes[5].ent);
+  nodes[20].key = 0;
+  nghttp2_pq_fix(&pq, &nodes[20].ent);
+
+  CU_ASSERT(30 == nghttp2_pq_size(&pq));
+
+  last = -2;
+
+  for (i = 0; i < 30; ++i) {
+    nd = (node *)nghttp2_pq_top(&pq);
+    CU_ASSERT(last <= nd->key);
+    last = nd->key;
+    nghttp2_pq_pop(&pq);
+  }
+
+  CU_ASSERT(100 == last);
+  CU_ASSERT(nghttp2_pq_empty(&pq));
+
+  nghttp2_pq_free(&pq);
+}
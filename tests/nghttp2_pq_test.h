@@ -32,5 +32,6 @@
 void test_nghttp2_pq(void);
 void test_nghttp2_pq_update(void);
 void test_nghttp2_pq_remove(void);
+void test_nghttp2_pq_fix(void);
 
 #endif /* NGHTTP2_PQ_TEST_H */
@@ -0,0 +1,133 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_sched_bench.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "nghttp2_sched.h"
+#include "nghttp2_stream.h"
+
+/* All |nstreams| streams have DATA to send all the time, like a
+   proxy relaying many downloads.  Each iteration selects the next
+   stream, and reschedules it as if DATA frame of 16KiB has been
+   written.  RFC 7540 scheduler has all streams depend on root with
+   default weight.  Urgency scheduler has all streams incremental with
+   default urgency.  Both send DATA in round robin fashion. */
+
+static void bench_sched(nghttp2_bench *b, size_t nstreams, int urgency) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_stream root;
+  nghttp2_stream **streams;
+  nghttp2_outbound_item *items;
+  nghttp2_outbound_item *item;
+  nghttp2_sched sched;
+  nghttp2_stream *stream;
+  size_t i;
+  uint64_t sum = 0;
+  int rv;
+
+  nghttp2_stream_init(&root, 0, NGHTTP2_STREAM_FLAG_NONE, NGHTTP2_STREAM_IDLE,
+                      NGHTTP2_DEFAULT_WEIGHT, 0, 0, NULL, mem);
+
+  if (urgency) {
+    nghttp2_sched_urgency_init(&sched);
+  } else {
+    nghttp2_sched_rfc7540_init(&sched, &root);
+  }
+
+  streams = nghttp2_mem_malloc(mem, sizeof(nghttp2_stream *) * nstreams);
+  assert(streams);
+
+  items = nghttp2_mem_calloc(mem, nstreams, sizeof(nghttp2_outbound_item));
+  assert(items);
+
+  for (i = 0; i < nstreams; ++i) {
+    streams[i] = nghttp2_mem_malloc(mem, sizeof(nghttp2_stream));
+    assert(streams[i]);
+
+    stream = streams[i];
+
+    nghttp2_stream_init(stream, (int32_t)(i * 2 + 1), NGHTTP2_STREAM_FLAG_NONE,
+                        NGHTTP2_STREAM_OPENED, NGHTTP2_DEFAULT_WEIGHT,
+                        NGHTTP2_INITIAL_WINDOW_SIZE,
+                        NGHTTP2_INITIAL_WINDOW_SIZE, NULL, mem);
+
+    if (urgency) {
+      nghttp2_sched_change_extpri(
+          &sched, stream,
+          NGHTTP2_EXTPRI_DEFAULT_URGENCY | NGHTTP2_EXTPRI_INC_MASK);
+    } else {
+      nghttp2_stream_dep_add(&root, stream);
+    }
+
+    items[i].frame.hd.stream_id = stream->stream_id;
+    items[i].frame.hd.length = 16384;
+
+    rv = nghttp2_sched_attach_item(&sched, stream, &items[i]);
+    assert(0 == rv);
+  }
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    item = nghttp2_sched_next_outbound_item(&sched);
+    stream = streams[(size_t)(item->frame.hd.stream_id - 1) / 2];
+
+    sum += (uint64_t)stream->stream_id;
+
+    nghttp2_sched_reschedule(&sched, stream);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use(sum);
+
+  for (i = 0; i < nstreams; ++i) {
+    nghttp2_sched_detach_item(&sched, streams[i]);
+    nghttp2_stream_free(streams[i]);
+    nghttp2_mem_free(mem, streams[i]);
+  }
+
+  nghttp2_mem_free(mem, items);
+  nghttp2_mem_free(mem, streams);
+  nghttp2_stream_free(&root);
+}
+
+void bench_nghttp2_sched_rfc7540_1k(nghttp2_bench *b) {
+  bench_sched(b, 1000, 0);
+}
+
+void bench_nghttp2_sched_rfc7540_10k(nghttp2_bench *b) {
+  bench_sched(b, 10000, 0);
+}
+
+void bench_nghttp2_sched_urgency_1k(nghttp2_bench *b) {
+  bench_sched(b, 1000, 1);
+}
+
+void bench_nghttp2_sched_urgency_10k(nghttp2_bench *b) {
+  bench_sched(b, 10000, 1);
+}
@@ -0,0 +1,345 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_session_bench.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "nghttp2_session.h"
+#include "nghttp2_helper.h"
+
+static const nghttp2_nv bench_reqnv[] = {
+    MAKE_NV(":method", "POST"),
+    MAKE_NV(":scheme", "https"),
+    MAKE_NV(":authority", "api.example.com"),
+    MAKE_NV(":path", "/v1/events?client=nghttp2"),
+    MAKE_NV("user-agent", "nghttp2/1.20.0"),
+    MAKE_NV("accept", "application/json"),
+    MAKE_NV("content-type", "application/json"),
+    MAKE_NV("cookie", "session=5a1e8a9d3b7f2c4e6d8f0a1b3c5d7e9f"),
+};
+
+static const nghttp2_nv bench_resnv[] = {
+    MAKE_NV(":status", "200"),
+    MAKE_NV("server", "nghttpx"),
+    MAKE_NV("content-type", "application/octet-stream"),
+    MAKE_NV("cache-control", "no-store"),
+};
+
+/* The source of DATA.  |source->ptr| points to the number of bytes
+   left to send. */
+static ssize_t bench_data_source_read_callback(
+    nghttp2_session *session _U_, int32_t stream_id _U_, uint8_t *buf,
+    size_t len, uint32_t *data_flags, nghttp2_data_source *source,
+    void *user_data _U_) {
+  size_t *left = source->ptr;
+  size_t n = nghttp2_min(len, *left);
+
+  memset(buf, 'x', n);
+  *left -= n;
+
+  if (*left == 0) {
+    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+  }
+
+  return (ssize_t)n;
+}
+
+/*
+ * Returns the bytes which client sends to open |nstreams| streams at
+ * once, and stores its length in |*plen|.  Each request has |datalen|
+ * bytes of body, which must fit in the default flow control window.
+ * If |window_size| is nonzero, client declares that it is willing to
+ * receive |window_size| bytes per stream and connection.  The result
+ * is the same every time, so that benchmarks are reproducible.
+ */
+static uint8_t *client_request_bytes(size_t *plen, size_t nstreams,
+                                     size_t datalen, int32_t window_size,
+                                     nghttp2_mem *mem) {
+  nghttp2_session *client;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_data_provider data_prd;
+  nghttp2_settings_entry iv;
+  size_t *left;
+  uint8_t *out = NULL;
+  size_t outlen = 0;
+  const uint8_t *data;
+  ssize_t len;
+  size_t i;
+  int rv;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  rv = nghttp2_option_new(&option);
+  assert(0 == rv);
+
+  /* Do not wait for server's SETTINGS to open more than 100
+     streams */
+  nghttp2_option_set_peer_max_concurrent_streams(option, (uint32_t)nstreams);
+
+  rv = nghttp2_session_client_new2(&client, &callbacks, NULL, option);
+  assert(0 == rv);
+
+  nghttp2_option_del(option);
+
+  if (window_size) {
+    iv.settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    iv.value = (uint32_t)window_size;
+
+    rv = nghttp2_submit_settings(client, NGHTTP2_FLAG_NONE, &iv, 1);
+    assert(0 == rv);
+
+    rv = nghttp2_session_set_local_window_size(client, NGHTTP2_FLAG_NONE, 0,
+                                               window_size);
+    assert(0 == rv);
+  } else {
+    rv = nghttp2_submit_settings(client, NGHTTP2_FLAG_NONE, NULL, 0);
+    assert(0 == rv);
+  }
+
+  left = nghttp2_mem_malloc(mem, sizeof(size_t) * nstreams);
+  assert(left);
+
+  data_prd.read_callback = bench_data_source_read_callback;
+
+  for (i = 0; i < nstreams; ++i) {
+    left[i] = datalen;
+    data_prd.source.ptr = &left[i];
+
+    rv = nghttp2_submit_request(client, NULL, bench_reqnv, ARRLEN(bench_reqnv),
+                                datalen ? &data_prd : NULL, NULL);
+    assert(rv > 0);
+  }
+
+  while ((len = nghttp2_session_mem_send(client, &data)) > 0) {
+    out = nghttp2_mem_realloc(mem, out, outlen + (size_t)len);
+    assert(out);
+    memcpy(out + outlen, data, (size_t)len);
+    outlen += (size_t)len;
+  }
+
+  assert(0 == len);
+
+  for (i = 0; i < nstreams; ++i) {
+    assert(0 == left[i]);
+  }
+
+  nghttp2_mem_free(mem, left);
+  nghttp2_session_del(client);
+
+  *plen = outlen;
+
+  return out;
+}
+
+/* Each iteration creates server session, and processes requests of
+   |nstreams| streams pipelined in one buffer.  Each request consists
+   of HEADERS and DATA of |datalen| bytes. */
+static void bench_session_mem_recv(nghttp2_bench *b, size_t nstreams,
+                                   size_t datalen) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  uint8_t *in;
+  size_t inlen;
+  ssize_t nread;
+  size_t i;
+  int rv;
+
+  in = client_request_bytes(&inlen, nstreams, datalen, 0, mem);
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    rv = nghttp2_session_server_new(&session, &callbacks, NULL);
+    assert(0 == rv);
+
+    nread = nghttp2_session_mem_recv(session, in, inlen);
+    assert((ssize_t)inlen == nread);
+
+    nghttp2_bench_use((uint64_t)session->last_recv_stream_id);
+
+    nghttp2_session_del(session);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_set_bytes(b, inlen);
+
+  nghttp2_mem_free(mem, in);
+}
+
+/* Each iteration submits responses to |nstreams| concurrent streams,
+   each of which has |datalen| bytes of body, and serializes them all
+   with nghttp2_session_mem_send().  Flow control never blocks DATA.
+   Receiving requests is not measured. */
+static void bench_session_mem_send(nghttp2_bench *b, size_t nstreams,
+                                   size_t datalen) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_data_provider data_prd;
+  uint8_t *in;
+  size_t inlen;
+  size_t *left;
+  const uint8_t *data;
+  ssize_t len, nread;
+  size_t outlen;
+  size_t i, j;
+  int rv;
+
+  in = client_request_bytes(&inlen, nstreams, 0, NGHTTP2_MAX_WINDOW_SIZE, mem);
+
+  left = nghttp2_mem_malloc(mem, sizeof(size_t) * nstreams);
+  assert(left);
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  data_prd.read_callback = bench_data_source_read_callback;
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    nghttp2_bench_stop_timer(b);
+
+    rv = nghttp2_session_server_new(&session, &callbacks, NULL);
+    assert(0 == rv);
+
+    nread = nghttp2_session_mem_recv(session, in, inlen);
+    assert((ssize_t)inlen == nread);
+
+    nghttp2_bench_start_timer(b);
+
+    for (j = 0; j < nstreams; ++j) {
+      left[j] = datalen;
+      data_prd.source.ptr = &left[j];
+
+      rv = nghttp2_submit_response(session, (int32_t)(j * 2 + 1), bench_resnv,
+                                   ARRLEN(bench_resnv), &data_prd);
+      assert(0 == rv);
+    }
+
+    outlen = 0;
+
+    while ((len = nghttp2_session_mem_send(session, &data)) > 0) {
+      outlen += (size_t)len;
+      nghttp2_bench_use(data[0]);
+    }
+
+    assert(0 == len);
+    assert(outlen > nstreams * datalen);
+
+    nghttp2_bench_stop_timer(b);
+
+    nghttp2_session_del(session);
+
+    nghttp2_bench_start_timer(b);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_set_bytes(b, nstreams * datalen);
+
+  nghttp2_mem_free(mem, left);
+  nghttp2_mem_free(mem, in);
+}
+
+/* The server has |nstreams| open streams.  Each iteration makes a
+   stream depend on another stream with pseudo random weight, and
+   exclusive flag in 1 out of 8 changes, like the PRIORITY frames
+   which browsers send while a page loads. */
+static void bench_session_reprioritize(nghttp2_bench *b, size_t nstreams) {
+  nghttp2_mem *mem = nghttp2_mem_default();
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_priority_spec pri_spec;
+  uint8_t *in;
+  size_t inlen;
+  ssize_t nread;
+  int32_t stream_id, dep_stream_id;
+  uint32_t x = 1;
+  size_t i;
+  int rv;
+
+  in = client_request_bytes(&inlen, nstreams, 0, 0, mem);
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  rv = nghttp2_session_server_new(&session, &callbacks, NULL);
+  assert(0 == rv);
+
+  nread = nghttp2_session_mem_recv(session, in, inlen);
+  assert((ssize_t)inlen == nread);
+
+  nghttp2_bench_reset_timer(b);
+
+  for (i = 0; i < b->n; ++i) {
+    /* xorshift32, so that the result is reproducible */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    stream_id = (int32_t)((x % nstreams) * 2 + 1);
+    dep_stream_id = (int32_t)(((x >> 16) % nstreams) * 2 + 1);
+
+    if (dep_stream_id == stream_id) {
+      dep_stream_id = 0;
+    }
+
+    nghttp2_priority_spec_init(&pri_spec, dep_stream_id,
+                               (int32_t)((x >> 8) % 256 + 1),
+                               (x >> 24) % 8 == 0);
+
+    rv = nghttp2_session_change_stream_priority(session, stream_id,
+                                                &pri_spec);
+    assert(0 == rv);
+  }
+
+  nghttp2_bench_stop_timer(b);
+
+  nghttp2_bench_use((uint64_t)session->root.sum_dep_weight);
+
+  nghttp2_session_del(session);
+  nghttp2_mem_free(mem, in);
+}
+
+void bench_nghttp2_session_mem_recv_100(nghttp2_bench *b) {
+  bench_session_mem_recv(b, 100, 512);
+}
+
+void bench_nghttp2_session_mem_send_100(nghttp2_bench *b) {
+  bench_session_mem_send(b, 100, 16384);
+}
+
+void bench_nghttp2_session_mem_send_1k(nghttp2_bench *b) {
+  bench_session_mem_send(b, 1000, 16384);
+}
+
+void bench_nghttp2_session_reprioritize_1k(nghttp2_bench *b) {
+  bench_session_reprioritize(b, 1000);
+}
@@ -35,6 +35,7 @@
 #include "nghttp2_helper.h"
 #include "nghttp2_test_helper.h"
 #include "nghttp2_priority_spec.h"
+#include "nghttp2_time.h"
 
 typedef struct {
   uint8_t buf[65535];
@@ -78,6 +79,10 @@ typedef struct {
   int begin_frame_cb_called;
   nghttp2_buf scratchbuf;
   size_t data_source_read_cb_paused;
+  int header_block_cb_called;
+  size_t header_block_nvlen;
+  int data_ref_release_cb_called;
+  int queued_data_discard_cb_called;
 } my_user_data;
 
 static const nghttp2_nv reqnv[] = {
@@ -327,6 +332,46 @@ static ssize_t no_copy_data_source_read_callback(
   return (ssize_t)wlen;
 }
 
+static const uint8_t data_ref_payload[NGHTTP2_DATA_PAYLOADLEN];
+
+static int data_ref_callback(nghttp2_session *session _U_,
+                             nghttp2_frame *frame _U_, const uint8_t **pdata,
+                             nghttp2_data_source *source _U_,
+                             void *user_data _U_) {
+  *pdata = data_ref_payload;
+  return 0;
+}
+
+static int on_queued_data_discard_callback(nghttp2_session *session _U_,
+                                           int32_t stream_id,
+                                           nghttp2_data_source *source,
+                                           int lib_error_code,
+                                           void *user_data) {
+  my_user_data *ud = (my_user_data *)user_data;
+
+  CU_ASSERT(7 == stream_id);
+  CU_ASSERT(ud == source->ptr);
+  CU_ASSERT(NGHTTP2_ERR_STREAM_CLOSED == lib_error_code);
+
+  ++ud->queued_data_discard_cb_called;
+
+  return 0;
+}
+
+static int data_ref_release_callback(nghttp2_session *session _U_,
+                                     nghttp2_frame *frame _U_,
+                                     const uint8_t *data,
+                                     nghttp2_data_source *source _U_,
+                                     void *user_data) {
+  my_user_data *ud = (my_user_data *)user_data;
+
+  CU_ASSERT(data_ref_payload == data);
+
+  ++ud->data_ref_release_cb_called;
+
+  return 0;
+}
+
 static int send_data_callback(nghttp2_session *session _U_,
                               nghttp2_frame *frame, const uint8_t *framehd,
                               size_t length, nghttp2_data_source *source _U_,
@@ -378,6 +423,33 @@ static int on_header_callback(nghttp2_session *session _U_,
   return 0;
 }
 
+static int on_header_block_callback(nghttp2_session *session _U_,
+                                    const nghttp2_frame *frame,
+                                    const nghttp2_nv *nva, size_t nvlen,
+                                    void *user_data) {
+  my_user_data *ud = (my_user_data *)user_data;
+  size_t i;
+
+  ++ud->header_block_cb_called;
+  ud->header_block_nvlen = nvlen;
+
+  for (i = 0; i < nvlen && i < ARRLEN(reqnv); ++i) {
+    CU_ASSERT(nghttp2_nv_equal(&reqnv[i], &nva[i]));
+    CU_ASSERT('\0' == nva[i].name[nva[i].namelen]);
+    CU_ASSERT('\0' == nva[i].value[nva[i].valuelen]);
+  }
+
+  ud->frame = frame;
+  return 0;
+}
+
+static int temporal_failure_on_header_block_callback(
+    nghttp2_session *session, const nghttp2_frame *frame,
+    const nghttp2_nv *nva, size_t nvlen, void *user_data) {
+  on_header_block_callback(session, frame, nva, nvlen, user_data);
+  return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+}
+
 static int pause_on_header_callback(nghttp2_session *session,
                                     const nghttp2_frame *frame,
                                     const uint8_t *name, size_t namelen,
@@ -760,6 +832,103 @@ void test_nghttp2_session_recv_eof(void) {
   nghttp2_session_del(session);
 }
 
+void test_nghttp2_session_mem_recvv(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  my_user_data ud;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  nghttp2_hd_deflater deflater;
+  nghttp2_frame_hd hd;
+  nghttp2_mem *mem;
+  uint8_t data[4096];
+  uint8_t *p;
+  nghttp2_vec vec[4];
+  size_t nread[4];
+  size_t headerslen, datalen;
+  ssize_t rv;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  rv = pack_headers(&bufs, &deflater, 1, NGHTTP2_FLAG_END_HEADERS, reqnv,
+                    ARRLEN(reqnv), mem);
+
+  CU_ASSERT(0 == rv);
+
+  buf = &bufs.head->buf;
+  headerslen = nghttp2_buf_len(buf);
+  p = nghttp2_cpymem(data, buf->pos, headerslen);
+
+  nghttp2_frame_hd_init(&hd, 100, NGHTTP2_DATA, NGHTTP2_FLAG_END_STREAM, 1);
+  nghttp2_frame_pack_frame_hd(p, &hd);
+  p += NGHTTP2_FRAME_HDLEN;
+  memset(p, 0, 100);
+  p += 100;
+
+  datalen = (size_t)(p - data);
+
+  /* Split in the middle of frame headers and DATA payload */
+  vec[0].base = data;
+  vec[0].len = 5;
+  vec[1].base = data + 5;
+  vec[1].len = headerslen - 5 + 4;
+  vec[2].base = vec[1].base + vec[1].len;
+  vec[2].len = NGHTTP2_FRAME_HDLEN - 4 + 50;
+  vec[3].base = vec[2].base + vec[2].len;
+  vec[3].len = 50;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_frame_recv_callback = on_frame_recv_callback;
+  callbacks.on_data_chunk_recv_callback = on_data_chunk_recv_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+
+  ud.frame_recv_cb_called = 0;
+  ud.data_chunk_recv_cb_called = 0;
+
+  rv = nghttp2_session_mem_recvv(session, vec, ARRLEN(vec), nread);
+
+  CU_ASSERT((ssize_t)datalen == rv);
+  CU_ASSERT(vec[0].len == nread[0]);
+  CU_ASSERT(vec[1].len == nread[1]);
+  CU_ASSERT(vec[2].len == nread[2]);
+  CU_ASSERT(vec[3].len == nread[3]);
+  CU_ASSERT(2 == ud.frame_recv_cb_called);
+  CU_ASSERT(2 == ud.data_chunk_recv_cb_called);
+  CU_ASSERT(50 == ud.data_chunk_len);
+
+  nghttp2_session_del(session);
+
+  /* Pausing at the end of a vector must not process the next one */
+  callbacks.on_data_chunk_recv_callback = pause_on_data_chunk_recv_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+
+  ud.frame_recv_cb_called = 0;
+  ud.data_chunk_recv_cb_called = 0;
+
+  rv = nghttp2_session_mem_recvv(session, vec, ARRLEN(vec), nread);
+
+  CU_ASSERT((ssize_t)(datalen - 50) == rv);
+  CU_ASSERT(vec[2].len == nread[2]);
+  CU_ASSERT(0 == nread[3]);
+  CU_ASSERT(1 == ud.frame_recv_cb_called);
+  CU_ASSERT(1 == ud.data_chunk_recv_cb_called);
+
+  rv = nghttp2_session_mem_recvv(session, &vec[3], 1, NULL);
+
+  CU_ASSERT(50 == rv);
+  CU_ASSERT(1 == ud.frame_recv_cb_called);
+  CU_ASSERT(2 == ud.data_chunk_recv_cb_called);
+
+  nghttp2_session_del(session);
+
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
 void test_nghttp2_session_recv_data(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
@@ -8582,6 +8751,76 @@ void test_nghttp2_session_keep_idle_stream(void) {
   nghttp2_session_del(session);
 }
 
+void test_nghttp2_session_compact_stream(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_mem *mem;
+  nghttp2_stream *a, *b, *stream;
+  nghttp2_outbound_item *db;
+  uint8_t buf[1];
+
+  mem = nghttp2_mem_default();
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, NULL);
+
+  /* a  c
+   * |
+   * b
+   */
+  a = open_recv_stream(session, 1);
+  b = open_recv_stream_with_dep(session, 3, a);
+  open_recv_stream2(session, 5, NGHTTP2_STREAM_IDLE);
+
+  db = create_data_ob_item(mem);
+
+  nghttp2_stream_attach_item(b, db);
+
+  nghttp2_session_close_stream(session, 1, NGHTTP2_NO_ERROR);
+
+  CU_ASSERT(1 == session->num_closed_streams);
+  CU_ASSERT(1 == session->num_idle_streams);
+  CU_ASSERT(0 == session->num_compact_streams);
+
+  /* Retained streams are compacted at the beginning of
+     nghttp2_session_mem_recv() */
+  CU_ASSERT(0 == nghttp2_session_mem_recv(session, buf, 0));
+
+  CU_ASSERT(2 == session->num_compact_streams);
+
+  stream = nghttp2_session_get_stream_raw(session, 1);
+
+  CU_ASSERT(stream->flags & NGHTTP2_STREAM_FLAG_COMPACT);
+  CU_ASSERT(stream == session->closed_stream_head);
+  CU_ASSERT(stream == session->closed_stream_tail);
+  CU_ASSERT(NGHTTP2_STREAM_STATE_CLOSED == nghttp2_stream_get_state(stream));
+  CU_ASSERT(stream == b->dep_prev);
+  CU_ASSERT(stream == nghttp2_stream_get_parent(b));
+  CU_ASSERT(stream->queued);
+  CU_ASSERT(&stream->pq_entry == nghttp2_pq_top(&session->root.obq));
+  CU_ASSERT(db == nghttp2_stream_next_outbound_item(&session->root));
+
+  stream = nghttp2_session_get_stream_raw(session, 5);
+
+  CU_ASSERT(stream->flags & NGHTTP2_STREAM_FLAG_COMPACT);
+  CU_ASSERT(stream == session->idle_stream_head);
+  CU_ASSERT(nghttp2_stream_in_dep_tree(stream));
+
+  /* Opening compact idle stream gets full stream object */
+  stream = open_recv_stream(session, 5);
+
+  CU_ASSERT(!(stream->flags & NGHTTP2_STREAM_FLAG_COMPACT));
+  CU_ASSERT(stream == nghttp2_session_get_stream(session, 5));
+  CU_ASSERT(NGHTTP2_STREAM_OPENED == stream->state);
+  CU_ASSERT(NGHTTP2_INITIAL_WINDOW_SIZE == stream->local_window_size);
+  CU_ASSERT(nghttp2_stream_in_dep_tree(stream));
+  CU_ASSERT(0 == session->num_idle_streams);
+  CU_ASSERT(1 == session->num_compact_streams);
+
+  nghttp2_session_del(session);
+}
+
 void test_nghttp2_session_detach_idle_stream(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
@@ -9140,112 +9379,395 @@ void test_nghttp2_session_send_data_callback(void) {
   nghttp2_session_del(session);
 }
 
-void test_nghttp2_session_on_begin_headers_temporal_failure(void) {
+void test_nghttp2_session_mem_send_into(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
+  nghttp2_data_provider data_prd;
   my_user_data ud;
-  nghttp2_bufs bufs;
-  nghttp2_mem *mem;
+  accumulator acc;
+  uint8_t buf[1000];
+  nghttp2_frame_hd hd;
   ssize_t rv;
-  nghttp2_hd_deflater deflater;
-  nghttp2_outbound_item *item;
-
-  mem = nghttp2_mem_default();
-  frame_pack_bufs_init(&bufs);
-  nghttp2_hd_deflate_init(&deflater, mem);
+  size_t len, nframes, ncalls = 0;
 
   memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
-  callbacks.on_begin_headers_callback =
-      temporal_failure_on_begin_headers_callback;
-  callbacks.on_header_callback = on_header_callback;
-  callbacks.on_frame_recv_callback = on_frame_recv_callback;
-  callbacks.send_callback = null_send_callback;
-  nghttp2_session_server_new(&session, &callbacks, &ud);
+  callbacks.on_frame_send_callback = on_frame_send_callback;
 
-  rv = pack_headers(&bufs, &deflater, 1, NGHTTP2_FLAG_END_HEADERS, reqnv,
-                    ARRLEN(reqnv), mem);
-  CU_ASSERT(0 == rv);
+  data_prd.read_callback = fixed_length_data_source_read_callback;
 
-  ud.header_cb_called = 0;
-  ud.frame_recv_cb_called = 0;
-  rv = nghttp2_session_mem_recv(session, bufs.head->buf.pos,
-                                nghttp2_bufs_len(&bufs));
-  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) == rv);
-  CU_ASSERT(0 == ud.header_cb_called);
-  CU_ASSERT(0 == ud.frame_recv_cb_called);
+  nghttp2_session_client_new(&session, &callbacks, &ud);
 
-  item = nghttp2_session_get_next_ob_item(session);
-  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
-  CU_ASSERT(1 == item->frame.hd.stream_id);
-  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+  ud.data_source_length = 40000;
+  ud.frame_send_cb_called = 0;
+
+  open_sent_stream(session, 1);
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  acc.length = 0;
+
+  /* Frames are packed until the buffer is full, and the frame which
+     does not fit is continued in the next call */
+  for (;;) {
+    rv = nghttp2_session_mem_send_into(session, buf, sizeof(buf));
+
+    CU_ASSERT(rv >= 0);
+
+    if (rv <= 0) {
+      break;
+    }
+
+    memcpy(acc.buf + acc.length, buf, (size_t)rv);
+    acc.length += (size_t)rv;
+    ++ncalls;
+  }
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN * 4 + 8 + 40000 == acc.length);
+  /* All calls but the last one fill the buffer */
+  CU_ASSERT((acc.length + sizeof(buf) - 1) / sizeof(buf) == ncalls);
+  CU_ASSERT(4 == ud.frame_send_cb_called);
+
+  nframes = 0;
+
+  for (len = 0; len < acc.length; len += NGHTTP2_FRAME_HDLEN + hd.length) {
+    nghttp2_frame_unpack_frame_hd(&hd, acc.buf + len);
+    CU_ASSERT((nframes == 0 ? NGHTTP2_PING : NGHTTP2_DATA) == hd.type);
+    ++nframes;
+  }
+
+  CU_ASSERT(4 == nframes);
+  CU_ASSERT(NGHTTP2_FLAG_END_STREAM == hd.flags);
 
   nghttp2_session_del(session);
-  nghttp2_hd_deflate_free(&deflater);
 
-  nghttp2_bufs_reset(&bufs);
-  /* check for PUSH_PROMISE */
-  nghttp2_hd_deflate_init(&deflater, mem);
+  /* DATA written by send_data_callback must not overtake the bytes
+     returned earlier */
+  callbacks.send_data_callback = send_data_callback;
+
+  data_prd.read_callback = no_copy_data_source_read_callback;
+
   nghttp2_session_client_new(&session, &callbacks, &ud);
 
+  ud.data_source_length = 100;
+  ud.acc = &acc;
+
+  acc.length = 0;
+
   open_sent_stream(session, 1);
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
 
-  rv = pack_push_promise(&bufs, &deflater, 1, NGHTTP2_FLAG_END_HEADERS, 2,
-                         reqnv, ARRLEN(reqnv), mem);
-  CU_ASSERT(0 == rv);
+  rv = nghttp2_session_mem_send_into(session, buf, sizeof(buf));
 
-  ud.header_cb_called = 0;
-  ud.frame_recv_cb_called = 0;
-  rv = nghttp2_session_mem_recv(session, bufs.head->buf.pos,
-                                nghttp2_bufs_len(&bufs));
-  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) == rv);
-  CU_ASSERT(0 == ud.header_cb_called);
-  CU_ASSERT(0 == ud.frame_recv_cb_called);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 == rv);
+  CU_ASSERT(0 == acc.length);
 
-  item = nghttp2_session_get_next_ob_item(session);
-  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
-  CU_ASSERT(2 == item->frame.hd.stream_id);
-  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+  rv = nghttp2_session_mem_send_into(session, buf, sizeof(buf));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 100 == acc.length);
 
   nghttp2_session_del(session);
-  nghttp2_hd_deflate_free(&deflater);
-  nghttp2_bufs_free(&bufs);
 }
 
-void test_nghttp2_session_defer_then_close(void) {
+void test_nghttp2_session_mem_sendv(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
-  nghttp2_data_provider prd;
-  int rv;
-  const uint8_t *datap;
-  ssize_t datalen;
-  nghttp2_frame frame;
+  nghttp2_data_provider data_prd;
+  my_user_data ud;
+  nghttp2_vec vec[3], bigvec[8];
+  nghttp2_stream *stream;
+  nghttp2_frame_hd hd;
+  const uint8_t *data;
+  ssize_t rv;
+  size_t i;
 
   memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
-  callbacks.send_callback = null_send_callback;
+  callbacks.on_stream_close_callback = on_stream_close_callback;
+  callbacks.data_ref_callback = data_ref_callback;
+  callbacks.data_ref_release_callback = data_ref_release_callback;
 
-  nghttp2_session_client_new(&session, &callbacks, NULL);
+  data_prd.read_callback = no_copy_data_source_read_callback;
 
-  prd.read_callback = defer_data_source_read_callback;
+  /* The payload is referred, and released in the next call */
+  nghttp2_session_client_new(&session, &callbacks, &ud);
 
-  rv = nghttp2_submit_request(session, NULL, reqnv, ARRLEN(reqnv), &prd, NULL);
-  CU_ASSERT(rv > 0);
+  ud.data_source_length = 100;
+  ud.data_ref_release_cb_called = 0;
+  ud.stream_close_cb_called = 0;
 
-  /* This sends HEADERS */
-  datalen = nghttp2_session_mem_send(session, &datap);
+  stream = open_sent_stream(session, 1);
+  /* END_STREAM closes stream */
+  nghttp2_stream_shutdown(stream, NGHTTP2_SHUT_RD);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
 
-  CU_ASSERT(datalen > 0);
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_mem_sendv(session, vec, 2));
 
-  /* This makes DATA item deferred */
-  datalen = nghttp2_session_mem_send(session, &datap);
+  rv = nghttp2_session_mem_sendv(session, vec, ARRLEN(vec));
 
-  CU_ASSERT(datalen == 0);
+  CU_ASSERT(2 == rv);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN == vec[0].len);
 
-  nghttp2_frame_rst_stream_init(&frame.rst_stream, 1, NGHTTP2_CANCEL);
+  nghttp2_frame_unpack_frame_hd(&hd, vec[0].base);
 
-  /* Assertion failure; GH-264 */
-  rv = nghttp2_session_on_rst_stream_received(session, &frame);
+  CU_ASSERT(100 == hd.length);
+  CU_ASSERT(NGHTTP2_DATA == hd.type);
+  CU_ASSERT(NGHTTP2_FLAG_END_STREAM == hd.flags);
+  CU_ASSERT(data_ref_payload == vec[1].base);
+  CU_ASSERT(100 == vec[1].len);
+  CU_ASSERT(0 == ud.data_ref_release_cb_called);
+  CU_ASSERT(0 == ud.stream_close_cb_called);
 
-  CU_ASSERT(rv == 0);
+  CU_ASSERT(0 == nghttp2_session_mem_sendv(session, vec, ARRLEN(vec)));
+  CU_ASSERT(1 == ud.data_ref_release_cb_called);
+  CU_ASSERT(1 == ud.stream_close_cb_called);
+
+  nghttp2_session_del(session);
+
+  /* Padding is taken from the internal buffer */
+  callbacks.select_padding_callback = select_padding_callback;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  ud.data_source_length = 100;
+  ud.padlen = 8;
+  ud.data_ref_release_cb_called = 0;
+
+  open_sent_stream(session, 1);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  rv = nghttp2_session_mem_sendv(session, vec, ARRLEN(vec));
+
+  CU_ASSERT(3 == rv);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 1 == vec[0].len);
+
+  nghttp2_frame_unpack_frame_hd(&hd, vec[0].base);
+
+  CU_ASSERT(108 == hd.length);
+  CU_ASSERT((NGHTTP2_FLAG_END_STREAM | NGHTTP2_FLAG_PADDED) == hd.flags);
+  CU_ASSERT(7 == vec[0].base[NGHTTP2_FRAME_HDLEN]);
+  CU_ASSERT(data_ref_payload == vec[1].base);
+  CU_ASSERT(100 == vec[1].len);
+  CU_ASSERT(7 == vec[2].len);
+
+  for (i = 0; i < vec[2].len; ++i) {
+    CU_ASSERT(0 == vec[2].base[i]);
+  }
+
+  CU_ASSERT(0 == nghttp2_session_mem_sendv(session, vec, ARRLEN(vec)));
+  CU_ASSERT(1 == ud.data_ref_release_cb_called);
+
+  nghttp2_session_del(session);
+
+  /* nghttp2_session_mem_send() copies the payload */
+  callbacks.select_padding_callback = NULL;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  ud.data_source_length = 100;
+  ud.data_ref_release_cb_called = 0;
+
+  open_sent_stream(session, 1);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  rv = nghttp2_session_mem_send(session, &data);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 100 == rv);
+  CU_ASSERT(1 == ud.data_ref_release_cb_called);
+  CU_ASSERT(0 == memcmp(data_ref_payload, data + NGHTTP2_FRAME_HDLEN, 100));
+
+  /* Non-DATA frame is returned in one buffer */
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+
+  rv = nghttp2_session_mem_sendv(session, vec, ARRLEN(vec));
+
+  CU_ASSERT(1 == rv);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 == vec[0].len);
+  CU_ASSERT(NGHTTP2_PING == vec[0].base[3]);
+
+  CU_ASSERT(0 == nghttp2_session_mem_sendv(session, vec, ARRLEN(vec)));
+
+  nghttp2_session_del(session);
+
+  /* Several frames are returned at once */
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  ud.data_source_length = NGHTTP2_DATA_PAYLOADLEN * 2 + 100;
+  ud.data_ref_release_cb_called = 0;
+  ud.stream_close_cb_called = 0;
+
+  stream = open_sent_stream(session, 1);
+  nghttp2_stream_shutdown(stream, NGHTTP2_SHUT_RD);
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  rv = nghttp2_session_mem_sendv(session, bigvec, ARRLEN(bigvec));
+
+  CU_ASSERT(6 == rv);
+  /* PING and the header of the first DATA are copied together */
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 + NGHTTP2_FRAME_HDLEN == bigvec[0].len);
+  CU_ASSERT(NGHTTP2_PING == bigvec[0].base[3]);
+
+  nghttp2_frame_unpack_frame_hd(&hd, bigvec[0].base + NGHTTP2_FRAME_HDLEN + 8);
+
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == hd.length);
+  CU_ASSERT(NGHTTP2_FLAG_NONE == hd.flags);
+  CU_ASSERT(data_ref_payload == bigvec[1].base);
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == bigvec[1].len);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN == bigvec[2].len);
+  CU_ASSERT(data_ref_payload == bigvec[3].base);
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == bigvec[3].len);
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN == bigvec[4].len);
+
+  nghttp2_frame_unpack_frame_hd(&hd, bigvec[4].base);
+
+  CU_ASSERT(100 == hd.length);
+  CU_ASSERT(NGHTTP2_FLAG_END_STREAM == hd.flags);
+  CU_ASSERT(data_ref_payload == bigvec[5].base);
+  CU_ASSERT(100 == bigvec[5].len);
+  CU_ASSERT(0 == ud.data_ref_release_cb_called);
+  CU_ASSERT(0 == ud.stream_close_cb_called);
+
+  CU_ASSERT(0 == nghttp2_session_mem_sendv(session, bigvec, ARRLEN(bigvec)));
+  CU_ASSERT(3 == ud.data_ref_release_cb_called);
+  CU_ASSERT(1 == ud.stream_close_cb_called);
+
+  nghttp2_session_del(session);
+
+  /* The next frame does not fit in the rest of vec */
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  ud.data_source_length = NGHTTP2_DATA_PAYLOADLEN + 100;
+  ud.data_ref_release_cb_called = 0;
+
+  open_sent_stream(session, 1);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  rv = nghttp2_session_mem_sendv(session, vec, ARRLEN(vec));
+
+  CU_ASSERT(2 == rv);
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == vec[1].len);
+  CU_ASSERT(0 == ud.data_ref_release_cb_called);
+
+  rv = nghttp2_session_mem_sendv(session, vec, ARRLEN(vec));
+
+  CU_ASSERT(2 == rv);
+  CU_ASSERT(100 == vec[1].len);
+  CU_ASSERT(1 == ud.data_ref_release_cb_called);
+
+  CU_ASSERT(0 == nghttp2_session_mem_sendv(session, vec, ARRLEN(vec)));
+  CU_ASSERT(2 == ud.data_ref_release_cb_called);
+
+  nghttp2_session_del(session);
+}
+
+void test_nghttp2_session_on_begin_headers_temporal_failure(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  my_user_data ud;
+  nghttp2_bufs bufs;
+  nghttp2_mem *mem;
+  ssize_t rv;
+  nghttp2_hd_deflater deflater;
+  nghttp2_outbound_item *item;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_begin_headers_callback =
+      temporal_failure_on_begin_headers_callback;
+  callbacks.on_header_callback = on_header_callback;
+  callbacks.on_frame_recv_callback = on_frame_recv_callback;
+  callbacks.send_callback = null_send_callback;
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+
+  rv = pack_headers(&bufs, &deflater, 1, NGHTTP2_FLAG_END_HEADERS, reqnv,
+                    ARRLEN(reqnv), mem);
+  CU_ASSERT(0 == rv);
+
+  ud.header_cb_called = 0;
+  ud.frame_recv_cb_called = 0;
+  rv = nghttp2_session_mem_recv(session, bufs.head->buf.pos,
+                                nghttp2_bufs_len(&bufs));
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) == rv);
+  CU_ASSERT(0 == ud.header_cb_called);
+  CU_ASSERT(0 == ud.frame_recv_cb_called);
+
+  item = nghttp2_session_get_next_ob_item(session);
+  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
+  CU_ASSERT(1 == item->frame.hd.stream_id);
+  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+
+  nghttp2_session_del(session);
+  nghttp2_hd_deflate_free(&deflater);
+
+  nghttp2_bufs_reset(&bufs);
+  /* check for PUSH_PROMISE */
+  nghttp2_hd_deflate_init(&deflater, mem);
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  open_sent_stream(session, 1);
+
+  rv = pack_push_promise(&bufs, &deflater, 1, NGHTTP2_FLAG_END_HEADERS, 2,
+                         reqnv, ARRLEN(reqnv), mem);
+  CU_ASSERT(0 == rv);
+
+  ud.header_cb_called = 0;
+  ud.frame_recv_cb_called = 0;
+  rv = nghttp2_session_mem_recv(session, bufs.head->buf.pos,
+                                nghttp2_bufs_len(&bufs));
+  CU_ASSERT((ssize_t)nghttp2_bufs_len(&bufs) == rv);
+  CU_ASSERT(0 == ud.header_cb_called);
+  CU_ASSERT(0 == ud.frame_recv_cb_called);
+
+  item = nghttp2_session_get_next_ob_item(session);
+  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
+  CU_ASSERT(2 == item->frame.hd.stream_id);
+  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+
+  nghttp2_session_del(session);
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_bufs_free(&bufs);
+}
+
+void test_nghttp2_session_defer_then_close(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_data_provider prd;
+  int rv;
+  const uint8_t *datap;
+  ssize_t datalen;
+  nghttp2_frame frame;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  nghttp2_session_client_new(&session, &callbacks, NULL);
+
+  prd.read_callback = defer_data_source_read_callback;
+
+  rv = nghttp2_submit_request(session, NULL, reqnv, ARRLEN(reqnv), &prd, NULL);
+  CU_ASSERT(rv > 0);
+
+  /* This sends HEADERS */
+  datalen = nghttp2_session_mem_send(session, &datap);
+
+  CU_ASSERT(datalen > 0);
+
+  /* This makes DATA item deferred */
+  datalen = nghttp2_session_mem_send(session, &datap);
+
+  CU_ASSERT(datalen == 0);
+
+  nghttp2_frame_rst_stream_init(&frame.rst_stream, 1, NGHTTP2_CANCEL);
+
+  /* Assertion failure; GH-264 */
+  rv = nghttp2_session_on_rst_stream_received(session, &frame);
+
+  CU_ASSERT(rv == 0);
 
   nghttp2_session_del(session);
 }
@@ -9353,67 +9875,253 @@ void test_nghttp2_session_flooding(void) {
   nghttp2_bufs_free(&bufs);
 }
 
-void test_nghttp2_session_change_stream_priority(void) {
+void test_nghttp2_session_outbound_ack_flooding(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
-  nghttp2_stream *stream1, *stream2, *stream3, *stream5;
-  nghttp2_priority_spec pri_spec;
-  int rv;
+  nghttp2_option *option;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  nghttp2_frame frame;
+  size_t i;
+
+  frame_pack_bufs_init(&bufs);
 
   memset(&callbacks, 0, sizeof(callbacks));
 
-  nghttp2_session_server_new(&session, &callbacks, NULL);
+  nghttp2_frame_ping_init(&frame.ping, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_frame_pack_ping(&bufs, &frame.ping);
+  nghttp2_frame_ping_free(&frame.ping);
 
-  stream1 = open_recv_stream(session, 1);
-  stream3 = open_recv_stream_with_dep_weight(session, 3, 199, stream1);
-  stream2 = open_sent_stream_with_dep_weight(session, 2, 101, stream3);
+  buf = &bufs.head->buf;
 
-  nghttp2_priority_spec_init(&pri_spec, 1, 256, 0);
+  nghttp2_option_new(&option);
+  nghttp2_option_set_max_outbound_ack(option, 3);
 
-  rv = nghttp2_session_change_stream_priority(session, 2, &pri_spec);
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
 
-  CU_ASSERT(0 == rv);
+  for (i = 0; i < 3; ++i) {
+    CU_ASSERT(
+        (ssize_t)nghttp2_buf_len(buf) ==
+        nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf)));
+  }
 
-  CU_ASSERT(stream1 == stream2->dep_prev);
-  CU_ASSERT(256 == stream2->weight);
+  CU_ASSERT(NGHTTP2_ERR_FLOODED ==
+            nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf)));
+  CU_ASSERT(NGHTTP2_ERR_FLOODED ==
+            nghttp2_submit_ping(session, NGHTTP2_FLAG_ACK, NULL));
 
-  /* Cannot change stream which does not exist */
-  rv = nghttp2_session_change_stream_priority(session, 5, &pri_spec);
-  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+  nghttp2_session_del(session);
 
-  /* It is an error to depend on itself */
-  rv = nghttp2_session_change_stream_priority(session, 1, &pri_spec);
-  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+  /* 0 allows no ACK at all */
+  nghttp2_option_set_max_outbound_ack(option, 0);
 
-  /* It is an error to change priority of root stream (0) */
-  rv = nghttp2_session_change_stream_priority(session, 0, &pri_spec);
-  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
 
-  /* Depends on the non-existing idle stream.  This creates that idle
-     stream. */
-  nghttp2_priority_spec_init(&pri_spec, 5, 9, 1);
+  CU_ASSERT(NGHTTP2_ERR_FLOODED ==
+            nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf)));
 
-  rv = nghttp2_session_change_stream_priority(session, 2, &pri_spec);
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+  nghttp2_bufs_free(&bufs);
+}
 
-  CU_ASSERT(0 == rv);
+void test_nghttp2_session_stream_reset_flooding(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_outbound_item *item;
+  nghttp2_frame frame;
+  size_t i;
 
-  stream5 = nghttp2_session_get_stream_raw(session, 5);
+  memset(&callbacks, 0, sizeof(callbacks));
 
-  CU_ASSERT(NULL != stream5);
-  CU_ASSERT(&session->root == stream5->dep_prev);
-  CU_ASSERT(stream5 == stream2->dep_prev);
-  CU_ASSERT(9 == stream2->weight);
+  nghttp2_option_new(&option);
+  /* The budget is never refilled */
+  nghttp2_option_set_stream_reset_rate_limit(option, 3, 0);
 
-  nghttp2_session_del(session);
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
 
-  /* Check that this works in client session too */
-  nghttp2_session_client_new(&session, &callbacks, NULL);
+  for (i = 0; i < 3; ++i) {
+    open_recv_stream(session, (int32_t)(i * 2 + 1));
 
-  stream1 = open_sent_stream(session, 1);
+    nghttp2_frame_rst_stream_init(&frame.rst_stream, (int32_t)(i * 2 + 1),
+                                  NGHTTP2_CANCEL);
 
-  nghttp2_priority_spec_init(&pri_spec, 5, 9, 1);
+    CU_ASSERT(0 == nghttp2_session_on_rst_stream_received(session, &frame));
+    CU_ASSERT(0 == session->flooded);
 
-  rv = nghttp2_session_change_stream_priority(session, 1, &pri_spec);
+    nghttp2_frame_rst_stream_free(&frame.rst_stream);
+  }
+
+  CU_ASSERT(NULL == nghttp2_outbound_queue_top(&session->ob_reg));
+
+  open_recv_stream(session, 7);
+
+  nghttp2_frame_rst_stream_init(&frame.rst_stream, 7, NGHTTP2_CANCEL);
+
+  CU_ASSERT(0 == nghttp2_session_on_rst_stream_received(session, &frame));
+  CU_ASSERT(session->flooded);
+
+  nghttp2_frame_rst_stream_free(&frame.rst_stream);
+
+  item = nghttp2_outbound_queue_top(&session->ob_reg);
+  CU_ASSERT(NGHTTP2_GOAWAY == item->frame.hd.type);
+  CU_ASSERT(NGHTTP2_ENHANCE_YOUR_CALM == item->frame.goaway.error_code);
+
+  nghttp2_session_del(session);
+
+  /* Client is not limited */
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
+
+  for (i = 0; i < 4; ++i) {
+    open_sent_stream(session, (int32_t)(i * 2 + 1));
+
+    nghttp2_frame_rst_stream_init(&frame.rst_stream, (int32_t)(i * 2 + 1),
+                                  NGHTTP2_CANCEL);
+
+    CU_ASSERT(0 == nghttp2_session_on_rst_stream_received(session, &frame));
+
+    nghttp2_frame_rst_stream_free(&frame.rst_stream);
+  }
+
+  CU_ASSERT(0 == session->flooded);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_empty_data_flooding(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_outbound_item *item;
+  nghttp2_frame_hd hd;
+  uint8_t data[NGHTTP2_FRAME_HDLEN + 1];
+  size_t i;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_recv_client_magic(option, 1);
+  nghttp2_option_set_max_empty_data_frames(option, 3);
+
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
+
+  open_recv_stream(session, 1);
+  open_recv_stream(session, 3);
+  nghttp2_session_close_stream(session, 3, NGHTTP2_NO_ERROR);
+
+  nghttp2_frame_hd_init(&hd, 0, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  for (i = 0; i < 3; ++i) {
+    CU_ASSERT(NGHTTP2_FRAME_HDLEN ==
+              nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN));
+  }
+
+  /* DATA with payload resets the count */
+  nghttp2_frame_hd_init(&hd, 1, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+  data[NGHTTP2_FRAME_HDLEN] = 'a';
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 1 ==
+            nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 1));
+  CU_ASSERT(0 == session->num_empty_data_frames);
+
+  /* Padding is not payload, and DATA to closed stream is counted
+     too */
+  nghttp2_frame_hd_init(&hd, 1, NGHTTP2_DATA, NGHTTP2_FLAG_PADDED, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+  data[NGHTTP2_FRAME_HDLEN] = 0;
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 1 ==
+            nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 1));
+  CU_ASSERT(1 == session->num_empty_data_frames);
+
+  nghttp2_frame_hd_init(&hd, 0, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 3);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  for (i = 0; i < 2; ++i) {
+    CU_ASSERT(NGHTTP2_FRAME_HDLEN ==
+              nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN));
+  }
+
+  CU_ASSERT(0 == session->flooded);
+  CU_ASSERT(NULL == nghttp2_outbound_queue_top(&session->ob_reg));
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN ==
+            nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN));
+  CU_ASSERT(session->flooded);
+
+  item = nghttp2_outbound_queue_top(&session->ob_reg);
+  CU_ASSERT(NGHTTP2_GOAWAY == item->frame.hd.type);
+  CU_ASSERT(NGHTTP2_ENHANCE_YOUR_CALM == item->frame.goaway.error_code);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_change_stream_priority(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_stream *stream1, *stream2, *stream3, *stream5;
+  nghttp2_priority_spec pri_spec;
+  int rv;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  nghttp2_session_server_new(&session, &callbacks, NULL);
+
+  stream1 = open_recv_stream(session, 1);
+  stream3 = open_recv_stream_with_dep_weight(session, 3, 199, stream1);
+  stream2 = open_sent_stream_with_dep_weight(session, 2, 101, stream3);
+
+  nghttp2_priority_spec_init(&pri_spec, 1, 256, 0);
+
+  rv = nghttp2_session_change_stream_priority(session, 2, &pri_spec);
+
+  CU_ASSERT(0 == rv);
+
+  CU_ASSERT(stream1 == stream2->dep_prev);
+  CU_ASSERT(256 == stream2->weight);
+
+  /* Cannot change stream which does not exist */
+  rv = nghttp2_session_change_stream_priority(session, 5, &pri_spec);
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* It is an error to depend on itself */
+  rv = nghttp2_session_change_stream_priority(session, 1, &pri_spec);
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* It is an error to change priority of root stream (0) */
+  rv = nghttp2_session_change_stream_priority(session, 0, &pri_spec);
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+
+  /* Depends on the non-existing idle stream.  This creates that idle
+     stream. */
+  nghttp2_priority_spec_init(&pri_spec, 5, 9, 1);
+
+  rv = nghttp2_session_change_stream_priority(session, 2, &pri_spec);
+
+  CU_ASSERT(0 == rv);
+
+  stream5 = nghttp2_session_get_stream_raw(session, 5);
+
+  CU_ASSERT(NULL != stream5);
+  CU_ASSERT(&session->root == stream5->dep_prev);
+  CU_ASSERT(stream5 == stream2->dep_prev);
+  CU_ASSERT(9 == stream2->weight);
+
+  nghttp2_session_del(session);
+
+  /* Check that this works in client session too */
+  nghttp2_session_client_new(&session, &callbacks, NULL);
+
+  stream1 = open_sent_stream(session, 1);
+
+  nghttp2_priority_spec_init(&pri_spec, 5, 9, 1);
+
+  rv = nghttp2_session_change_stream_priority(session, 1, &pri_spec);
 
   CU_ASSERT(0 == rv);
 
@@ -9786,109 +10494,419 @@ void test_nghttp2_session_set_local_window_size(void) {
   nghttp2_session_del(session);
 }
 
-void test_nghttp2_session_cancel_from_before_frame_send(void) {
-  int rv;
+/*
+ * Receives DATA which triggers window auto-tuning probe, sends it,
+ * and receives |n| full DATA frames during the round trip of 1ms.
+ */
+static void window_auto_tuning_fill(nghttp2_session *session, uint8_t *data,
+                                    int n) {
+  nghttp2_frame_hd hd;
+  int i;
+
+  nghttp2_frame_hd_init(&hd, 4096, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 4096);
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(NGHTTP2_BDP_INFLIGHT == session->bdp.state);
+
+  session->bdp.ping_sent -= 1000;
+
+  nghttp2_frame_hd_init(&hd, 16384, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  for (i = 0; i < n; ++i) {
+    nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 16384);
+  }
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+}
+
+void test_nghttp2_session_window_auto_tuning(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
-  my_user_data ud;
-  nghttp2_settings_entry iv;
-  nghttp2_data_provider data_prd;
-  int32_t stream_id;
+  nghttp2_option *option;
   nghttp2_stream *stream;
+  nghttp2_outbound_item *item;
+  nghttp2_frame_hd hd;
+  nghttp2_frame frame;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  uint8_t data[NGHTTP2_FRAME_HDLEN + 16384];
+  const uint8_t opaque[] = {'n', 'g', 'h', 't', 't', 'p', '2', 'b'};
+  ssize_t rv;
+  int i;
 
-  memset(&callbacks, 0, sizeof(callbacks));
+  frame_pack_bufs_init(&bufs);
 
-  callbacks.before_frame_send_callback = cancel_before_frame_send_callback;
-  callbacks.on_frame_not_send_callback = on_frame_not_send_callback;
+  memset(&callbacks, 0, sizeof(callbacks));
   callbacks.send_callback = null_send_callback;
 
-  nghttp2_session_client_new(&session, &callbacks, &ud);
-
-  iv.settings_id = 0;
-  iv.value = 1000000009;
-
-  rv = nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, &iv, 1);
+  nghttp2_option_new(&option);
+  nghttp2_option_set_window_auto_tuning(option, 1 << 20);
 
-  CU_ASSERT(0 == rv);
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
 
-  ud.frame_send_cb_called = 0;
-  ud.before_frame_send_cb_called = 0;
-  ud.frame_not_send_cb_called = 0;
+  stream = open_sent_stream(session, 1);
 
-  rv = nghttp2_session_send(session);
+  memset(data, 0, sizeof(data));
+  nghttp2_frame_hd_init(&hd, 4096, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.frame_send_cb_called);
-  CU_ASSERT(1 == ud.before_frame_send_cb_called);
-  CU_ASSERT(1 == ud.frame_not_send_cb_called);
+  /* The first DATA triggers probe PING */
+  rv = nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 4096);
 
-  data_prd.source.ptr = NULL;
-  data_prd.read_callback = temporal_failure_data_source_read_callback;
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 4096 == rv);
 
-  stream_id = nghttp2_submit_request(session, NULL, reqnv, ARRLEN(reqnv),
-                                     &data_prd, NULL);
+  item = nghttp2_session_get_next_ob_item(session);
 
-  CU_ASSERT(stream_id > 0);
+  CU_ASSERT(NGHTTP2_PING == item->frame.hd.type);
+  CU_ASSERT(0 == memcmp(opaque, item->frame.ping.opaque_data, 8));
+  CU_ASSERT(NGHTTP2_BDP_QUEUED == session->bdp.state);
 
-  ud.frame_send_cb_called = 0;
-  ud.before_frame_send_cb_called = 0;
-  ud.frame_not_send_cb_called = 0;
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(NGHTTP2_BDP_INFLIGHT == session->bdp.state);
 
-  rv = nghttp2_session_send(session);
+  /* Pretend that the round trip takes 1ms */
+  session->bdp.ping_sent -= 1000;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.frame_send_cb_called);
-  CU_ASSERT(1 == ud.before_frame_send_cb_called);
-  CU_ASSERT(1 == ud.frame_not_send_cb_called);
+  /* Fill 3/4 of windows during the round trip */
+  nghttp2_frame_hd_init(&hd, 16384, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
 
-  stream = nghttp2_session_get_stream_raw(session, stream_id);
+  for (i = 0; i < 3; ++i) {
+    rv = nghttp2_session_mem_recv(session, data, sizeof(data));
 
-  CU_ASSERT(NULL == stream);
+    CU_ASSERT((ssize_t)sizeof(data) == rv);
+  }
 
-  nghttp2_session_del(session);
+  CU_ASSERT(49152 == session->bdp.sample);
+  CU_ASSERT(49152 == session->bdp.stream_sample);
+  CU_ASSERT(49152 == stream->bdp_recv);
 
-  nghttp2_session_server_new(&session, &callbacks, &ud);
+  CU_ASSERT(0 == nghttp2_session_send(session));
 
-  open_recv_stream(session, 1);
+  nghttp2_frame_ping_init(&frame.ping, NGHTTP2_FLAG_ACK, opaque);
+  nghttp2_frame_pack_ping(&bufs, &frame.ping);
+  nghttp2_frame_ping_free(&frame.ping);
 
-  stream_id = nghttp2_submit_push_promise(session, NGHTTP2_FLAG_NONE, 1, reqnv,
-                                          ARRLEN(reqnv), NULL);
+  buf = &bufs.head->buf;
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
 
-  CU_ASSERT(stream_id > 0);
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(NGHTTP2_BDP_IDLE == session->bdp.state);
+  CU_ASSERT(98304 == session->local_window_size);
 
-  ud.frame_send_cb_called = 0;
-  ud.before_frame_send_cb_called = 0;
-  ud.frame_not_send_cb_called = 0;
+  item = nghttp2_session_get_next_ob_item(session);
 
-  rv = nghttp2_session_send(session);
+  CU_ASSERT(NGHTTP2_SETTINGS == item->frame.hd.type);
+  CU_ASSERT(1 == item->frame.settings.niv);
+  CU_ASSERT(NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE ==
+            item->frame.settings.iv[0].settings_id);
+  CU_ASSERT(98304 == item->frame.settings.iv[0].value);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.frame_send_cb_called);
-  CU_ASSERT(1 == ud.before_frame_send_cb_called);
-  CU_ASSERT(1 == ud.frame_not_send_cb_called);
+  CU_ASSERT(0 == nghttp2_session_send(session));
 
-  stream = nghttp2_session_get_stream_raw(session, stream_id);
+  item = nghttp2_session_get_next_ob_item(session);
 
-  CU_ASSERT(NULL == stream);
+  CU_ASSERT(NULL == item);
 
   nghttp2_session_del(session);
-}
 
-static void
-prepare_session_removed_closed_stream(nghttp2_session *session,
-                                      nghttp2_hd_deflater *deflater) {
-  int rv;
-  nghttp2_settings_entry iv;
-  nghttp2_bufs bufs;
-  nghttp2_mem *mem;
-  ssize_t nread;
-  int i;
-  nghttp2_stream *stream;
-  nghttp2_frame_hd hd;
+  /* Small DATA during the round trip does not grow windows */
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
 
-  mem = nghttp2_mem_default();
+  open_sent_stream(session, 1);
 
-  frame_pack_bufs_init(&bufs);
+  nghttp2_frame_hd_init(&hd, 4096, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 4096);
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  session->bdp.ping_sent -= 1000;
+  nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 4096);
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(NGHTTP2_INITIAL_CONNECTION_WINDOW_SIZE ==
+            session->local_window_size);
+  CU_ASSERT(NULL == nghttp2_session_get_next_ob_item(session));
+  CU_ASSERT(session->bdp.backoff > 0);
+
+  nghttp2_session_del(session);
+
+  /* Without valid round trip time, the sample is discarded */
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
+
+  open_sent_stream(session, 1);
+  window_auto_tuning_fill(session, data, 1);
+
+  session->bdp.ping_sent = UINT64_MAX;
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(NGHTTP2_BDP_IDLE == session->bdp.state);
+  CU_ASSERT(0 == session->bdp.rtt);
+  CU_ASSERT(session->bdp.backoff > 0);
+  CU_ASSERT(NGHTTP2_INITIAL_CONNECTION_WINDOW_SIZE ==
+            session->local_window_size);
+
+  nghttp2_session_del(session);
+
+  /* Lower bandwidth than the recent maximum does not grow windows */
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
+
+  open_sent_stream(session, 1);
+  window_auto_tuning_fill(session, data, 3);
+
+  session->bdp.max_bw = UINT64_MAX;
+  session->bdp.max_bw_tstamp = nghttp2_time_now_us();
+
+  nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT(NGHTTP2_INITIAL_CONNECTION_WINDOW_SIZE ==
+            session->local_window_size);
+
+  /* The maximum expires after NGHTTP2_BDP_MAX_BW_WINDOW */
+  session->bdp.next_probe = 0;
+  window_auto_tuning_fill(session, data, 3);
+
+  session->bdp.max_bw_tstamp -= NGHTTP2_BDP_MAX_BW_WINDOW;
+
+  nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT(98304 == session->local_window_size);
+
+  nghttp2_session_del(session);
+
+  /* Probe dropped on session closure can be queued again */
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
+
+  stream = open_sent_stream(session, 1);
+
+  nghttp2_frame_hd_init(&hd, 4096, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 4096);
+
+  CU_ASSERT(NGHTTP2_BDP_QUEUED == session->bdp.state);
+
+  nghttp2_session_terminate_session(session, NGHTTP2_NO_ERROR);
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(NGHTTP2_BDP_IDLE == session->bdp.state);
+
+  nghttp2_session_del(session);
+
+  nghttp2_option_del(option);
+  nghttp2_bufs_free(&bufs);
+}
+
+void test_nghttp2_session_coalesce_window_update(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_stream *stream;
+  nghttp2_frame_hd hd;
+  my_user_data ud;
+  uint8_t data[NGHTTP2_FRAME_HDLEN + 16384];
+  ssize_t rv;
+  int i;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.send_callback = null_send_callback;
+  callbacks.on_frame_send_callback = on_frame_send_callback;
+
+  memset(data, 0, sizeof(data));
+  nghttp2_frame_hd_init(&hd, 16384, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_coalesce_window_update(option, 1);
+
+  nghttp2_session_client_new2(&session, &callbacks, &ud, option);
+
+  stream = open_sent_stream(session, 1);
+
+  for (i = 0; i < 3; ++i) {
+    rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+    CU_ASSERT((ssize_t)sizeof(data) == rv);
+  }
+
+  /* WINDOW_UPDATE is deferred until session sends frames */
+  CU_ASSERT(NULL == nghttp2_session_get_next_ob_item(session));
+  CU_ASSERT(nghttp2_session_want_write(session));
+  CU_ASSERT(1 == session->window_update_pending);
+  CU_ASSERT(1 == session->num_pending_window_update_streams);
+  CU_ASSERT(stream->flags & NGHTTP2_STREAM_FLAG_WINDOW_UPDATE_PENDING);
+
+  ud.frame_send_cb_called = 0;
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(2 == ud.frame_send_cb_called);
+  CU_ASSERT(0 == session->recv_window_size);
+  CU_ASSERT(0 == stream->recv_window_size);
+  CU_ASSERT(0 == session->num_pending_window_update_streams);
+  CU_ASSERT(!(stream->flags & NGHTTP2_STREAM_FLAG_WINDOW_UPDATE_PENDING));
+  CU_ASSERT(!nghttp2_session_want_write(session));
+
+  /* Stream closed in the meantime is skipped */
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT(1 == session->num_pending_window_update_streams);
+
+  nghttp2_session_close_stream(session, 1, NGHTTP2_NO_ERROR);
+
+  ud.frame_send_cb_called = 0;
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(1 == ud.frame_send_cb_called);
+  CU_ASSERT(0 == session->recv_window_size);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+
+  /* Raise threshold to 80% */
+  nghttp2_option_new(&option);
+  nghttp2_option_set_window_update_threshold(option, 80);
+
+  nghttp2_session_client_new2(&session, &callbacks, &ud, option);
+
+  stream = open_sent_stream(session, 1);
+
+  for (i = 0; i < 2; ++i) {
+    rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+    CU_ASSERT((ssize_t)sizeof(data) == rv);
+  }
+
+  CU_ASSERT(NULL == nghttp2_session_get_next_ob_item(session));
+
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT((ssize_t)sizeof(data) == rv);
+  CU_ASSERT(NULL == nghttp2_session_get_next_ob_item(session));
+
+  nghttp2_frame_hd_init(&hd, 4096, NGHTTP2_DATA, NGHTTP2_FLAG_NONE, 1);
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  rv = nghttp2_session_mem_recv(session, data, NGHTTP2_FRAME_HDLEN + 4096);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 4096 == rv);
+  CU_ASSERT(NGHTTP2_WINDOW_UPDATE ==
+            nghttp2_session_get_next_ob_item(session)->frame.hd.type);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_cancel_from_before_frame_send(void) {
+  int rv;
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  my_user_data ud;
+  nghttp2_settings_entry iv;
+  nghttp2_data_provider data_prd;
+  int32_t stream_id;
+  nghttp2_stream *stream;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  callbacks.before_frame_send_callback = cancel_before_frame_send_callback;
+  callbacks.on_frame_not_send_callback = on_frame_not_send_callback;
+  callbacks.send_callback = null_send_callback;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  iv.settings_id = 0;
+  iv.value = 1000000009;
+
+  rv = nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, &iv, 1);
+
+  CU_ASSERT(0 == rv);
+
+  ud.frame_send_cb_called = 0;
+  ud.before_frame_send_cb_called = 0;
+  ud.frame_not_send_cb_called = 0;
+
+  rv = nghttp2_session_send(session);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.frame_send_cb_called);
+  CU_ASSERT(1 == ud.before_frame_send_cb_called);
+  CU_ASSERT(1 == ud.frame_not_send_cb_called);
+
+  data_prd.source.ptr = NULL;
+  data_prd.read_callback = temporal_failure_data_source_read_callback;
+
+  stream_id = nghttp2_submit_request(session, NULL, reqnv, ARRLEN(reqnv),
+                                     &data_prd, NULL);
+
+  CU_ASSERT(stream_id > 0);
+
+  ud.frame_send_cb_called = 0;
+  ud.before_frame_send_cb_called = 0;
+  ud.frame_not_send_cb_called = 0;
+
+  rv = nghttp2_session_send(session);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.frame_send_cb_called);
+  CU_ASSERT(1 == ud.before_frame_send_cb_called);
+  CU_ASSERT(1 == ud.frame_not_send_cb_called);
+
+  stream = nghttp2_session_get_stream_raw(session, stream_id);
+
+  CU_ASSERT(NULL == stream);
+
+  nghttp2_session_del(session);
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+
+  open_recv_stream(session, 1);
+
+  stream_id = nghttp2_submit_push_promise(session, NGHTTP2_FLAG_NONE, 1, reqnv,
+                                          ARRLEN(reqnv), NULL);
+
+  CU_ASSERT(stream_id > 0);
+
+  ud.frame_send_cb_called = 0;
+  ud.before_frame_send_cb_called = 0;
+  ud.frame_not_send_cb_called = 0;
+
+  rv = nghttp2_session_send(session);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.frame_send_cb_called);
+  CU_ASSERT(1 == ud.before_frame_send_cb_called);
+  CU_ASSERT(1 == ud.frame_not_send_cb_called);
+
+  stream = nghttp2_session_get_stream_raw(session, stream_id);
+
+  CU_ASSERT(NULL == stream);
+
+  nghttp2_session_del(session);
+}
+
+static void
+prepare_session_removed_closed_stream(nghttp2_session *session,
+                                      nghttp2_hd_deflater *deflater) {
+  int rv;
+  nghttp2_settings_entry iv;
+  nghttp2_bufs bufs;
+  nghttp2_mem *mem;
+  ssize_t nread;
+  int i;
+  nghttp2_stream *stream;
+  nghttp2_frame_hd hd;
+
+  mem = nghttp2_mem_default();
+
+  frame_pack_bufs_init(&bufs);
 
   iv.settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
   iv.value = 2;
@@ -10120,27 +11138,257 @@ void test_nghttp2_session_no_closed_streams(void) {
   nghttp2_option_del(option);
 }
 
-static void check_nghttp2_http_recv_headers_fail(
-    nghttp2_session *session, nghttp2_hd_deflater *deflater, int32_t stream_id,
-    int stream_state, const nghttp2_nv *nva, size_t nvlen) {
-  nghttp2_mem *mem;
+void test_nghttp2_session_no_header_copy(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  my_user_data ud;
   ssize_t rv;
-  nghttp2_outbound_item *item;
-  nghttp2_bufs bufs;
-  my_user_data *ud;
+  /* HEADERS with END_STREAM and END_HEADERS on stream 1, carrying
+     :method GET, :scheme https, :path / and raw :authority
+     localhost */
+  uint8_t in[] = {0x00, 0x00, 0x0e, 0x01, 0x05, 0x00, 0x00, 0x00, 0x01,
+                  0x82, 0x87, 0x84, 0x01, 0x09, 'l',  'o',  'c',  'a',
+                  'l',  'h',  'o',  's',  't'};
 
-  mem = nghttp2_mem_default();
-  frame_pack_bufs_init(&bufs);
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_header_callback = on_header_callback;
 
-  ud = session->user_data;
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_header_copy(option, 1);
 
-  if (stream_state != -1) {
-    if (nghttp2_session_is_my_stream_id(session, stream_id)) {
-      open_sent_stream2(session, stream_id, (nghttp2_stream_state)stream_state);
-    } else {
-      open_recv_stream2(session, stream_id, (nghttp2_stream_state)stream_state);
-    }
-  }
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  ud.header_cb_called = 0;
+
+  rv = nghttp2_session_mem_recv(session, in, sizeof(in));
+
+  CU_ASSERT((ssize_t)sizeof(in) == rv);
+  CU_ASSERT(4 == ud.header_cb_called);
+  CU_ASSERT(in + 14 == ud.nv.value);
+  CU_ASSERT(9 == ud.nv.valuelen);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_recv_header_block(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_hd_deflater deflater;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  nghttp2_buf_chain *ci;
+  nghttp2_outbound_item *item;
+  my_user_data ud;
+  ssize_t rv;
+  nghttp2_mem *mem;
+  uint8_t value[9000];
+  nghttp2_nv nva[ARRLEN(reqnv) + 8];
+  size_t i;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_header_callback = on_header_callback;
+  callbacks.on_frame_recv_callback = on_frame_recv_callback;
+  callbacks.on_header_block_callback = on_header_block_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  rv = pack_headers(&bufs, &deflater, 1,
+                    NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM, reqnv,
+                    ARRLEN(reqnv), mem);
+
+  CU_ASSERT(0 == rv);
+
+  buf = &bufs.head->buf;
+
+  ud.header_cb_called = 0;
+  ud.header_block_cb_called = 0;
+  ud.frame_recv_cb_called = 0;
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(0 == ud.header_cb_called);
+  CU_ASSERT(1 == ud.header_block_cb_called);
+  CU_ASSERT(ARRLEN(reqnv) == ud.header_block_nvlen);
+  CU_ASSERT(1 == ud.frame_recv_cb_called);
+  CU_ASSERT(NULL == nghttp2_session_get_next_ob_item(session));
+
+  /* Buffers are reused for the next header block */
+  nghttp2_bufs_reset(&bufs);
+  rv = pack_headers(&bufs, &deflater, 3,
+                    NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM, reqnv,
+                    ARRLEN(reqnv), mem);
+
+  CU_ASSERT(0 == rv);
+
+  ud.header_block_cb_called = 0;
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(1 == ud.header_block_cb_called);
+  CU_ASSERT(ARRLEN(reqnv) == ud.header_block_nvlen);
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_session_del(session);
+
+  /* Callback returns NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE */
+  callbacks.on_header_block_callback =
+      temporal_failure_on_header_block_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  nghttp2_bufs_reset(&bufs);
+  rv = pack_headers(&bufs, &deflater, 1,
+                    NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM, reqnv,
+                    ARRLEN(reqnv), mem);
+
+  CU_ASSERT(0 == rv);
+
+  ud.header_block_cb_called = 0;
+  ud.frame_recv_cb_called = 0;
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(1 == ud.header_block_cb_called);
+  CU_ASSERT(0 == ud.frame_recv_cb_called);
+
+  item = nghttp2_session_get_next_ob_item(session);
+
+  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
+  CU_ASSERT(1 == item->frame.hd.stream_id);
+  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_session_del(session);
+
+  /* Header list exceeds SETTINGS_MAX_HEADER_LIST_SIZE */
+  callbacks.on_header_block_callback = on_header_block_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  session->local_settings.max_header_list_size = 64;
+
+  nghttp2_bufs_reset(&bufs);
+  rv = pack_headers(&bufs, &deflater, 1,
+                    NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM, reqnv,
+                    ARRLEN(reqnv), mem);
+
+  CU_ASSERT(0 == rv);
+
+  ud.header_block_cb_called = 0;
+  ud.frame_recv_cb_called = 0;
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(0 == ud.header_block_cb_called);
+  CU_ASSERT(0 == ud.frame_recv_cb_called);
+
+  item = nghttp2_session_get_next_ob_item(session);
+
+  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
+  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_session_del(session);
+
+  /* Large buffer is freed after the header block */
+  memset(value, 'a', sizeof(value));
+
+  memcpy(nva, reqnv, sizeof(reqnv));
+
+  for (i = ARRLEN(reqnv); i < ARRLEN(nva); ++i) {
+    nva[i].name = (uint8_t *)"x-a";
+    nva[i].namelen = 3;
+    nva[i].value = value;
+    nva[i].valuelen = sizeof(value);
+    nva[i].flags = NGHTTP2_NV_FLAG_NONE;
+  }
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  nghttp2_bufs_reset(&bufs);
+  rv = pack_headers(&bufs, &deflater, 1,
+                    NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM, nva,
+                    ARRLEN(reqnv) + 1, mem);
+
+  CU_ASSERT(0 == rv);
+
+  ud.header_block_cb_called = 0;
+
+  for (ci = bufs.head; ci; ci = ci->next) {
+    rv = nghttp2_session_mem_recv(session, ci->buf.pos,
+                                  nghttp2_buf_len(&ci->buf));
+
+    CU_ASSERT((ssize_t)nghttp2_buf_len(&ci->buf) == rv);
+  }
+
+  CU_ASSERT(1 == ud.header_block_cb_called);
+  CU_ASSERT(NULL == session->iframe.nvbuf.begin);
+
+  /* Without SETTINGS_MAX_HEADER_LIST_SIZE, the header list is limited
+     to NGHTTP2_MAX_HEADERSLEN */
+  nghttp2_bufs_reset(&bufs);
+  rv = pack_headers(&bufs, &deflater, 3,
+                    NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM, nva,
+                    ARRLEN(nva), mem);
+
+  CU_ASSERT(0 == rv);
+
+  ud.header_block_cb_called = 0;
+
+  for (ci = bufs.head; ci; ci = ci->next) {
+    rv = nghttp2_session_mem_recv(session, ci->buf.pos,
+                                  nghttp2_buf_len(&ci->buf));
+
+    CU_ASSERT((ssize_t)nghttp2_buf_len(&ci->buf) == rv);
+  }
+
+  CU_ASSERT(0 == ud.header_block_cb_called);
+
+  item = nghttp2_session_get_next_ob_item(session);
+
+  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
+  CU_ASSERT(3 == item->frame.hd.stream_id);
+  CU_ASSERT(NGHTTP2_INTERNAL_ERROR == item->frame.rst_stream.error_code);
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_session_del(session);
+  nghttp2_bufs_free(&bufs);
+}
+
+static void check_nghttp2_http_recv_headers_fail(
+    nghttp2_session *session, nghttp2_hd_deflater *deflater, int32_t stream_id,
+    int stream_state, const nghttp2_nv *nva, size_t nvlen) {
+  nghttp2_mem *mem;
+  ssize_t rv;
+  nghttp2_outbound_item *item;
+  nghttp2_bufs bufs;
+  my_user_data *ud;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  ud = session->user_data;
+
+  if (stream_state != -1) {
+    if (nghttp2_session_is_my_stream_id(session, stream_id)) {
+      open_sent_stream2(session, stream_id, (nghttp2_stream_state)stream_state);
+    } else {
+      open_recv_stream2(session, stream_id, (nghttp2_stream_state)stream_state);
+    }
+  }
 
   rv = pack_headers(&bufs, deflater, stream_id, NGHTTP2_FLAG_END_HEADERS, nva,
                     nvlen, mem);
@@ -10200,6 +11448,681 @@ static void check_nghttp2_http_recv_headers_ok(
   nghttp2_bufs_free(&bufs);
 }
 
+void test_nghttp2_session_no_rfc7540_priorities(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_stream *stream;
+  nghttp2_priority_spec pri_spec;
+  nghttp2_frame frame;
+  nghttp2_outbound_item *item;
+  my_user_data ud;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_frame_recv_callback = on_frame_recv_callback;
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_rfc7540_priorities(option, 1);
+
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  /* Priority in HEADERS is ignored, and idle stream 3 is not
+     created. */
+  nghttp2_priority_spec_init(&pri_spec, 3, 256, 1);
+  stream = open_recv_stream3(session, 1, NGHTTP2_STREAM_FLAG_NONE, &pri_spec,
+                             NGHTTP2_STREAM_OPENED, NULL);
+
+  CU_ASSERT(!nghttp2_stream_in_dep_tree(stream));
+  CU_ASSERT(NGHTTP2_DEFAULT_WEIGHT == stream->weight);
+  CU_ASSERT(NULL == nghttp2_session_get_stream_raw(session, 3));
+
+  /* PRIORITY is ignored */
+  nghttp2_priority_spec_init(&pri_spec, 0, 1, 0);
+  nghttp2_frame_priority_init(&frame.priority, 1, &pri_spec);
+
+  ud.frame_recv_cb_called = 0;
+
+  CU_ASSERT(0 == nghttp2_session_on_priority_received(session, &frame));
+  CU_ASSERT(1 == ud.frame_recv_cb_called);
+  CU_ASSERT(NGHTTP2_DEFAULT_WEIGHT == stream->weight);
+
+  /* PRIORITY against idle stream does not create stream */
+  frame.hd.stream_id = 5;
+
+  CU_ASSERT(0 == nghttp2_session_on_priority_received(session, &frame));
+  CU_ASSERT(NULL == nghttp2_session_get_stream_raw(session, 5));
+  CU_ASSERT(0 == session->num_idle_streams);
+
+  nghttp2_frame_priority_free(&frame.priority);
+
+  CU_ASSERT(0 == nghttp2_session_change_stream_priority(session, 1, &pri_spec));
+  CU_ASSERT(NGHTTP2_DEFAULT_WEIGHT == stream->weight);
+
+  /* Closed stream is not retained */
+  nghttp2_session_close_stream(session, 1, NGHTTP2_NO_ERROR);
+
+  CU_ASSERT(0 == session->num_closed_streams);
+
+  nghttp2_session_del(session);
+
+  /* Client does not send priority signals */
+  nghttp2_session_client_new2(&session, &callbacks, &ud, option);
+
+  CU_ASSERT(1 == nghttp2_submit_request(session, &pri_spec, reqnv,
+                                        ARRLEN(reqnv), NULL, NULL));
+
+  item = nghttp2_session_get_next_ob_item(session);
+
+  CU_ASSERT(NGHTTP2_HEADERS == item->frame.hd.type);
+  CU_ASSERT(0 == (item->frame.hd.flags & NGHTTP2_FLAG_PRIORITY));
+
+  CU_ASSERT(0 ==
+            nghttp2_submit_priority(session, NGHTTP2_FLAG_NONE, 1, &pri_spec));
+  CU_ASSERT(NULL == session->ob_reg.head);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_change_extpri_stream_priority(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_stream *a, *b, *c;
+  nghttp2_outbound_item *da, *db, *dc;
+  nghttp2_extpri extpri;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_rfc7540_priorities(option, 1);
+
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
+
+  a = open_recv_stream(session, 1);
+  b = open_recv_stream(session, 3);
+  c = open_recv_stream(session, 5);
+
+  CU_ASSERT(0 == nghttp2_session_get_extpri_stream_priority(session, &extpri,
+                                                             1));
+  CU_ASSERT(NGHTTP2_EXTPRI_DEFAULT_URGENCY == extpri.urgency);
+  CU_ASSERT(0 == extpri.inc);
+
+  da = create_data_ob_item(mem);
+  db = create_data_ob_item(mem);
+  dc = create_data_ob_item(mem);
+
+  CU_ASSERT(0 == nghttp2_sched_attach_item(&session->sched, a, da));
+  CU_ASSERT(0 == nghttp2_sched_attach_item(&session->sched, b, db));
+  CU_ASSERT(0 == nghttp2_sched_attach_item(&session->sched, c, dc));
+
+  /* Non-incremental streams of the same urgency are sent one by
+     one. */
+  CU_ASSERT(da == nghttp2_session_get_next_ob_item(session));
+
+  nghttp2_sched_reschedule(&session->sched, a);
+
+  CU_ASSERT(da == nghttp2_session_get_next_ob_item(session));
+
+  /* Higher urgency is sent first */
+  extpri.urgency = 1;
+  extpri.inc = 0;
+
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 5, &extpri));
+  CU_ASSERT(dc == nghttp2_session_get_next_ob_item(session));
+
+  /* Incremental streams are sent in round robin fashion */
+  extpri.urgency = NGHTTP2_EXTPRI_URGENCY_HIGH;
+  extpri.inc = 1;
+
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 1, &extpri));
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 3, &extpri));
+
+  CU_ASSERT(da == nghttp2_session_get_next_ob_item(session));
+
+  nghttp2_sched_reschedule(&session->sched, a);
+
+  CU_ASSERT(db == nghttp2_session_get_next_ob_item(session));
+
+  nghttp2_sched_reschedule(&session->sched, b);
+
+  CU_ASSERT(da == nghttp2_session_get_next_ob_item(session));
+
+  /* Deferred stream is not scheduled */
+  CU_ASSERT(0 == nghttp2_sched_defer_item(&session->sched, a,
+                                          NGHTTP2_STREAM_FLAG_DEFERRED_USER));
+  CU_ASSERT(db == nghttp2_session_get_next_ob_item(session));
+
+  CU_ASSERT(0 == nghttp2_sched_detach_item(&session->sched, b));
+  mem->free(db, NULL);
+
+  CU_ASSERT(dc == nghttp2_session_get_next_ob_item(session));
+
+  CU_ASSERT(0 == nghttp2_sched_resume_deferred_item(
+                     &session->sched, a, NGHTTP2_STREAM_FLAG_DEFERRED_USER));
+  CU_ASSERT(da == nghttp2_session_get_next_ob_item(session));
+
+  /* Urgency is capped to NGHTTP2_EXTPRI_URGENCY_LOW */
+  extpri.urgency = 1000;
+  extpri.inc = 0;
+
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 1, &extpri));
+  CU_ASSERT(0 == nghttp2_session_get_extpri_stream_priority(session, &extpri,
+                                                             1));
+  CU_ASSERT(NGHTTP2_EXTPRI_URGENCY_LOW == extpri.urgency);
+  CU_ASSERT(dc == nghttp2_session_get_next_ob_item(session));
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_change_extpri_stream_priority(session, 0, &extpri));
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_change_extpri_stream_priority(session, 7, &extpri));
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+
+  /* RFC 7540 priorities are enabled */
+  nghttp2_session_server_new(&session, &callbacks, NULL);
+
+  open_recv_stream(session, 1);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_STATE ==
+            nghttp2_session_change_extpri_stream_priority(session, 1, &extpri));
+  CU_ASSERT(NGHTTP2_ERR_INVALID_STATE ==
+            nghttp2_session_get_extpri_stream_priority(session, &extpri, 1));
+
+  nghttp2_session_del(session);
+}
+
+static void *counting_malloc(size_t size, void *mem_user_data) {
+  ++*(size_t *)mem_user_data;
+  return malloc(size);
+}
+
+static void counting_free(void *ptr, void *mem_user_data _U_) { free(ptr); }
+
+static void *counting_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  ++*(size_t *)mem_user_data;
+  return calloc(nmemb, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *mem_user_data) {
+  ++*(size_t *)mem_user_data;
+  return realloc(ptr, size);
+}
+
+void test_nghttp2_session_mem_pool(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  size_t nalloc = 0, nalloc_before;
+  nghttp2_mem mem = {&nalloc, counting_malloc, counting_free, counting_calloc,
+                     counting_realloc};
+  int32_t stream_id;
+  int i;
+  void *p;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_closed_streams(option, 1);
+  nghttp2_option_set_mem_pool(option, 1);
+
+  nghttp2_session_server_new3(&session, &callbacks, NULL, option, &mem);
+
+  stream_id = 1;
+
+  for (i = 0; i < 4; ++i, stream_id += 2) {
+    open_recv_stream(session, stream_id);
+    nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+    CU_ASSERT(0 == nghttp2_session_send(session));
+    nghttp2_session_close_stream(session, stream_id, NGHTTP2_NO_ERROR);
+  }
+
+  nalloc_before = nalloc;
+
+  /* Streams and outbound items are recycled in the pool */
+  for (i = 0; i < 100; ++i, stream_id += 2) {
+    open_recv_stream(session, stream_id);
+    nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+    CU_ASSERT(0 == nghttp2_session_send(session));
+    nghttp2_session_close_stream(session, stream_id, NGHTTP2_NO_ERROR);
+  }
+
+  CU_ASSERT(nalloc_before == nalloc);
+
+  /* The size which overflows with the block header fails */
+  CU_ASSERT(NULL == nghttp2_mem_malloc(&session->mem, SIZE_MAX));
+
+  p = nghttp2_mem_malloc(&session->mem, 16);
+
+  CU_ASSERT(NULL != p);
+  CU_ASSERT(NULL == nghttp2_mem_realloc(&session->mem, p, SIZE_MAX));
+
+  nghttp2_mem_free(&session->mem, p);
+
+  p = nghttp2_mem_malloc(&session->mem, 65536);
+
+  CU_ASSERT(NULL != p);
+  CU_ASSERT(NULL == nghttp2_mem_realloc(&session->mem, p, SIZE_MAX));
+
+  nghttp2_mem_free(&session->mem, p);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+
+  /* Without the pool, each stream is allocated by mem */
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_closed_streams(option, 1);
+
+  nghttp2_session_server_new3(&session, &callbacks, NULL, option, &mem);
+
+  nalloc_before = nalloc;
+
+  for (i = 0; i < 100; ++i) {
+    open_recv_stream(session, i * 2 + 1);
+    nghttp2_session_close_stream(session, i * 2 + 1, NGHTTP2_NO_ERROR);
+  }
+
+  CU_ASSERT(nalloc_before + 100 <= nalloc);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_mem_usage(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_mem_usage usage, prev;
+  const nghttp2_nv nv[] = {MAKE_NV(":status", "200"),
+                           MAKE_NV("server", "nghttp2")};
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  /* Memory accounting is disabled by default */
+  nghttp2_session_server_new(&session, &callbacks, NULL);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_STATE ==
+            nghttp2_session_get_mem_usage(session, &usage));
+
+  nghttp2_session_del(session);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_mem_accounting(option, 1);
+
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
+
+  CU_ASSERT(0 == nghttp2_session_get_mem_usage(session, &prev));
+  CU_ASSERT(prev.outbound > 0);
+  CU_ASSERT(0 == prev.closed_streams);
+
+  open_recv_stream(session, 1);
+
+  CU_ASSERT(0 == nghttp2_session_get_mem_usage(session, &usage));
+  CU_ASSERT(usage.streams >= prev.streams + sizeof(nghttp2_stream));
+  CU_ASSERT(prev.hd == usage.hd);
+
+  prev = usage;
+
+  nghttp2_submit_response(session, 1, nv, ARRLEN(nv), NULL);
+
+  CU_ASSERT(0 == nghttp2_session_get_mem_usage(session, &usage));
+  CU_ASSERT(usage.outbound > prev.outbound);
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  prev = usage;
+
+  CU_ASSERT(0 == nghttp2_session_get_mem_usage(session, &usage));
+  CU_ASSERT(usage.hd > prev.hd);
+  CU_ASSERT(usage.outbound < prev.outbound);
+  CU_ASSERT(0 == usage.closed_streams);
+
+  /* Server retains closed stream */
+  nghttp2_session_close_stream(session, 1, NGHTTP2_NO_ERROR);
+
+  CU_ASSERT(1 == session->num_closed_streams);
+  CU_ASSERT(0 == nghttp2_session_get_mem_usage(session, &usage));
+  CU_ASSERT(sizeof(nghttp2_stream) == usage.closed_streams);
+  CU_ASSERT(usage.total == usage.streams + usage.closed_streams + usage.hd +
+                               usage.outbound + usage.inbound);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_max_session_memory(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_mem_usage usage;
+  nghttp2_frame frame;
+  nghttp2_outbound_item *item;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  nghttp2_option_new(&option);
+  /* Any session exceeds this limit */
+  nghttp2_option_set_max_session_memory(option, 1);
+
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
+
+  /* The limit implies memory accounting */
+  CU_ASSERT(0 == nghttp2_session_get_mem_usage(session, &usage));
+
+  open_recv_stream(session, 1);
+  open_recv_stream(session, 3);
+  nghttp2_session_close_stream(session, 3, NGHTTP2_NO_ERROR);
+
+  CU_ASSERT(1 == session->num_closed_streams);
+
+  /* Closed stream is released first, and then new stream is
+     refused */
+  nghttp2_frame_headers_init(&frame.headers, NGHTTP2_FLAG_END_HEADERS, 5,
+                             NGHTTP2_HCAT_HEADERS, NULL, NULL, 0);
+
+  CU_ASSERT(NGHTTP2_ERR_IGN_HEADER_BLOCK ==
+            nghttp2_session_on_request_headers_received(session, &frame));
+  CU_ASSERT(0 == session->num_closed_streams);
+  CU_ASSERT(NULL == nghttp2_session_get_stream_raw(session, 3));
+  CU_ASSERT(NULL == nghttp2_session_get_stream_raw(session, 5));
+
+  item = nghttp2_outbound_queue_top(&session->ob_reg);
+  CU_ASSERT(NGHTTP2_RST_STREAM == item->frame.hd.type);
+  CU_ASSERT(5 == item->frame.hd.stream_id);
+  CU_ASSERT(NGHTTP2_REFUSED_STREAM == item->frame.rst_stream.error_code);
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  /* Without open streams, nothing releases memory */
+  nghttp2_session_close_stream(session, 1, NGHTTP2_NO_ERROR);
+
+  frame.hd.stream_id = 7;
+
+  CU_ASSERT(NGHTTP2_ERR_IGN_HEADER_BLOCK ==
+            nghttp2_session_on_request_headers_received(session, &frame));
+
+  item = nghttp2_outbound_queue_top(&session->ob_reg);
+  CU_ASSERT(NGHTTP2_GOAWAY == item->frame.hd.type);
+  CU_ASSERT(NGHTTP2_ENHANCE_YOUR_CALM == item->frame.goaway.error_code);
+
+  nghttp2_frame_headers_free(&frame.headers, mem);
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+
+  /* Under the limit, new stream is accepted */
+  nghttp2_option_new(&option);
+  nghttp2_option_set_max_session_memory(option, 1 << 20);
+
+  nghttp2_session_server_new2(&session, &callbacks, NULL, option);
+
+  nghttp2_frame_headers_init(&frame.headers, NGHTTP2_FLAG_END_HEADERS, 1,
+                             NGHTTP2_HCAT_HEADERS, NULL, NULL, 0);
+
+  CU_ASSERT(0 == nghttp2_session_on_request_headers_received(session, &frame));
+  CU_ASSERT(NULL != nghttp2_session_get_stream(session, 1));
+
+  nghttp2_frame_headers_free(&frame.headers, mem);
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_get_stats(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  nghttp2_hd_deflater deflater;
+  nghttp2_frame frame;
+  nghttp2_frame_hd hd;
+  nghttp2_data_provider data_prd;
+  nghttp2_stats stats;
+  nghttp2_stream *stream;
+  my_user_data ud;
+  nghttp2_mem *mem;
+  uint8_t data[1024];
+  uint8_t *p;
+  size_t headerslen, nvlen, i;
+  ssize_t rv;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  data_prd.read_callback = fixed_length_data_source_read_callback;
+
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  /* Request with DATA */
+  rv = pack_headers(&bufs, &deflater, 1, NGHTTP2_FLAG_END_HEADERS, reqnv,
+                    ARRLEN(reqnv), mem);
+
+  CU_ASSERT(0 == rv);
+
+  buf = &bufs.head->buf;
+  headerslen = nghttp2_buf_len(buf);
+  p = nghttp2_cpymem(data, buf->pos, headerslen);
+
+  nghttp2_frame_hd_init(&hd, 100, NGHTTP2_DATA, NGHTTP2_FLAG_END_STREAM, 1);
+  nghttp2_frame_pack_frame_hd(p, &hd);
+  p += NGHTTP2_FRAME_HDLEN;
+  memset(p, 0, 100);
+  p += 100;
+
+  rv = nghttp2_session_mem_recv(session, data, (size_t)(p - data));
+
+  CU_ASSERT(p - data == rv);
+
+  nvlen = 0;
+  for (i = 0; i < ARRLEN(reqnv); ++i) {
+    nvlen += reqnv[i].namelen + reqnv[i].valuelen;
+  }
+
+  nghttp2_session_get_stats(session, &stats, sizeof(stats));
+
+  CU_ASSERT(1 == stats.frames_recv[NGHTTP2_HEADERS]);
+  CU_ASSERT(1 == stats.frames_recv[NGHTTP2_DATA]);
+  CU_ASSERT(headerslen - NGHTTP2_FRAME_HDLEN == stats.header_block_bytes_recv);
+  CU_ASSERT(nvlen == stats.header_bytes_recv);
+  CU_ASSERT(100 == stats.data_bytes_recv);
+  CU_ASSERT(1 == stats.peak_concurrent_streams);
+
+  /* Only statslen bytes are written */
+  memset(&stats, 0, sizeof(stats));
+
+  CU_ASSERT(sizeof(stats.frames_sent) ==
+            nghttp2_session_get_stats(session, &stats,
+                                      sizeof(stats.frames_sent)));
+  CU_ASSERT(0 == stats.frames_recv[NGHTTP2_HEADERS]);
+  CU_ASSERT(sizeof(stats) ==
+            nghttp2_session_get_stats(session, &stats, sizeof(stats) + 8));
+  CU_ASSERT(1 == stats.frames_recv[NGHTTP2_HEADERS]);
+
+  /* Response with DATA */
+  ud.data_source_length = 300;
+
+  CU_ASSERT(0 == nghttp2_submit_response(session, 1, resnv, ARRLEN(resnv),
+                                         &data_prd));
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  nghttp2_session_get_stats(session, &stats, sizeof(stats));
+
+  CU_ASSERT(1 == stats.frames_sent[NGHTTP2_HEADERS]);
+  CU_ASSERT(1 == stats.frames_sent[NGHTTP2_DATA]);
+  CU_ASSERT(300 == stats.data_bytes_sent);
+  CU_ASSERT(resnv[0].namelen + resnv[0].valuelen == stats.header_bytes_sent);
+  /* ":status: 200" is in static table */
+  CU_ASSERT(1 == stats.header_block_bytes_sent);
+
+  /* RST_STREAM is counted by error code.  Unknown error code goes to
+     the last slot. */
+  open_recv_stream(session, 3);
+  open_recv_stream(session, 5);
+  open_recv_stream(session, 7);
+
+  nghttp2_frame_rst_stream_init(&frame.rst_stream, 3, NGHTTP2_CANCEL);
+
+  CU_ASSERT(0 == nghttp2_session_on_rst_stream_received(session, &frame));
+
+  nghttp2_frame_rst_stream_free(&frame.rst_stream);
+
+  nghttp2_frame_rst_stream_init(&frame.rst_stream, 5, 0x100);
+
+  CU_ASSERT(0 == nghttp2_session_on_rst_stream_received(session, &frame));
+
+  nghttp2_frame_rst_stream_free(&frame.rst_stream);
+
+  CU_ASSERT(0 == nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, 7,
+                                           NGHTTP2_REFUSED_STREAM));
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  nghttp2_session_get_stats(session, &stats, sizeof(stats));
+
+  CU_ASSERT(1 == stats.rst_stream_recv[NGHTTP2_CANCEL]);
+  CU_ASSERT(1 == stats.rst_stream_recv[NGHTTP2_STATS_NUM_ERROR_CODES - 1]);
+  CU_ASSERT(1 == stats.frames_sent[NGHTTP2_RST_STREAM]);
+  CU_ASSERT(1 == stats.rst_stream_sent[NGHTTP2_REFUSED_STREAM]);
+  CU_ASSERT(3 == stats.peak_concurrent_streams);
+
+  /* Blocked by stream level flow control */
+  stream = open_recv_stream(session, 9);
+  stream->remote_window_size = 0;
+  ud.data_source_length = 100;
+
+  CU_ASSERT(0 == nghttp2_submit_response(session, 9, resnv, ARRLEN(resnv),
+                                         &data_prd));
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(1 == session->num_flow_blocked_streams);
+
+  nghttp2_frame_window_update_init(&frame.window_update, NGHTTP2_FLAG_NONE, 9,
+                                   100);
+
+  CU_ASSERT(0 == nghttp2_session_on_window_update_received(session, &frame));
+  CU_ASSERT(0 == session->num_flow_blocked_streams);
+
+  nghttp2_frame_window_update_free(&frame.window_update);
+
+  /* Blocked by connection level flow control */
+  session->remote_window_size = 0;
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(session->conn_flow_blocked);
+
+  nghttp2_frame_window_update_init(&frame.window_update, NGHTTP2_FLAG_NONE, 0,
+                                   100);
+
+  CU_ASSERT(0 == nghttp2_session_on_window_update_received(session, &frame));
+  CU_ASSERT(!session->conn_flow_blocked);
+
+  nghttp2_frame_window_update_free(&frame.window_update);
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  nghttp2_session_get_stats(session, &stats, sizeof(stats));
+
+  CU_ASSERT(400 == stats.data_bytes_sent);
+  CU_ASSERT(3 == stats.peak_concurrent_streams);
+
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_session_del(session);
+}
+
+void test_nghttp2_session_command_queue(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_data_provider data_prd;
+  nghttp2_stats stats;
+  my_user_data ud;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  data_prd.read_callback = fixed_length_data_source_read_callback;
+
+  /* Command queue is disabled by default */
+  nghttp2_session_server_new(&session, &callbacks, &ud);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_STATE ==
+            nghttp2_session_queue_resume_data(session, 1));
+
+  nghttp2_session_del(session);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_command_queue(option, 1);
+
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_queue_rst_stream(session, 0, NGHTTP2_CANCEL));
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_queue_data(session, NGHTTP2_FLAG_END_STREAM, 1,
+                                       NULL));
+
+  open_recv_stream(session, 1);
+  open_recv_stream(session, 3);
+
+  CU_ASSERT(0 == nghttp2_submit_headers(session, NGHTTP2_FLAG_NONE, 1, NULL,
+                                        resnv, ARRLEN(resnv), NULL));
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(0 == nghttp2_session_want_write(session));
+
+  ud.data_source_length = 100;
+
+  CU_ASSERT(0 == nghttp2_session_queue_data(session, NGHTTP2_FLAG_END_STREAM,
+                                            1, &data_prd));
+  CU_ASSERT(0 == nghttp2_session_queue_rst_stream(session, 3, NGHTTP2_CANCEL));
+  /* Stream 5 does not exist, and this command is discarded */
+  CU_ASSERT(0 == nghttp2_session_queue_resume_data(session, 5));
+  CU_ASSERT(1 == nghttp2_session_want_write(session));
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(0 == nghttp2_session_want_write(session));
+
+  nghttp2_session_get_stats(session, &stats, sizeof(stats));
+
+  CU_ASSERT(1 == stats.frames_sent[NGHTTP2_DATA]);
+  CU_ASSERT(100 == stats.data_bytes_sent);
+  CU_ASSERT(1 == stats.rst_stream_sent[NGHTTP2_CANCEL]);
+
+  /* Application can release the source of DATA which is discarded */
+  nghttp2_session_del(session);
+
+  callbacks.on_queued_data_discard_callback = on_queued_data_discard_callback;
+
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  ud.queued_data_discard_cb_called = 0;
+  data_prd.source.ptr = &ud;
+
+  CU_ASSERT(0 == nghttp2_session_queue_data(session, NGHTTP2_FLAG_END_STREAM,
+                                            7, &data_prd));
+  CU_ASSERT(0 == nghttp2_session_send(session));
+  CU_ASSERT(1 == ud.queued_data_discard_cb_called);
+
+  /* Commands left in the queue are freed with session */
+  CU_ASSERT(0 == nghttp2_session_queue_resume_data(session, 1));
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
 void test_nghttp2_http_mandatory_headers(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
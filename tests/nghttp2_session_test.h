@@ -33,6 +33,7 @@ void test_nghttp2_session_recv(void);
 void test_nghttp2_session_recv_invalid_stream_id(void);
 void test_nghttp2_session_recv_invalid_frame(void);
 void test_nghttp2_session_recv_eof(void);
+void test_nghttp2_session_mem_recvv(void);
 void test_nghttp2_session_recv_data(void);
 void test_nghttp2_session_recv_data_no_auto_flow_control(void);
 void test_nghttp2_session_recv_continuation(void);
@@ -132,6 +133,7 @@ void test_nghttp2_session_stream_get_something(void);
 void test_nghttp2_session_find_stream(void);
 void test_nghttp2_session_keep_closed_stream(void);
 void test_nghttp2_session_keep_idle_stream(void);
+void test_nghttp2_session_compact_stream(void);
 void test_nghttp2_session_detach_idle_stream(void);
 void test_nghttp2_session_large_dep_tree(void);
 void test_nghttp2_session_graceful_shutdown(void);
@@ -142,19 +144,35 @@ void test_nghttp2_session_open_idle_stream(void);
 void test_nghttp2_session_cancel_reserved_remote(void);
 void test_nghttp2_session_reset_pending_headers(void);
 void test_nghttp2_session_send_data_callback(void);
+void test_nghttp2_session_mem_send_into(void);
+void test_nghttp2_session_mem_sendv(void);
 void test_nghttp2_session_on_begin_headers_temporal_failure(void);
 void test_nghttp2_session_defer_then_close(void);
 void test_nghttp2_session_detach_item_from_closed_stream(void);
 void test_nghttp2_session_flooding(void);
+void test_nghttp2_session_outbound_ack_flooding(void);
+void test_nghttp2_session_stream_reset_flooding(void);
+void test_nghttp2_session_empty_data_flooding(void);
 void test_nghttp2_session_change_stream_priority(void);
 void test_nghttp2_session_create_idle_stream(void);
 void test_nghttp2_session_repeated_priority_change(void);
 void test_nghttp2_session_repeated_priority_submission(void);
 void test_nghttp2_session_set_local_window_size(void);
+void test_nghttp2_session_window_auto_tuning(void);
+void test_nghttp2_session_coalesce_window_update(void);
 void test_nghttp2_session_cancel_from_before_frame_send(void);
 void test_nghttp2_session_removed_closed_stream(void);
 void test_nghttp2_session_pause_data(void);
 void test_nghttp2_session_no_closed_streams(void);
+void test_nghttp2_session_no_header_copy(void);
+void test_nghttp2_session_recv_header_block(void);
+void test_nghttp2_session_no_rfc7540_priorities(void);
+void test_nghttp2_session_change_extpri_stream_priority(void);
+void test_nghttp2_session_mem_pool(void);
+void test_nghttp2_session_mem_usage(void);
+void test_nghttp2_session_max_session_memory(void);
+void test_nghttp2_session_get_stats(void);
+void test_nghttp2_session_command_queue(void);
 void test_nghttp2_http_mandatory_headers(void);
 void test_nghttp2_http_content_length(void);
 void test_nghttp2_http_content_length_mismatch(void);